@@ -0,0 +1,170 @@
+#include "blendModes.hpp"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//Rounded x/255, exact for every product of two channels
+static inline Uint32 Div255(Uint32 x){
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+//The mixed color of a single channel, before the alpha of both pixels gets applied
+template <BlendMode MODE>
+static inline Uint32 MixChannel(Uint32 backdrop, Uint32 source){
+	if constexpr (MODE == BlendMode::NORMAL) return source;
+	else if constexpr (MODE == BlendMode::MULTIPLY) return Div255(backdrop*source);
+	else if constexpr (MODE == BlendMode::SCREEN) return backdrop + source - Div255(backdrop*source);
+	else if constexpr (MODE == BlendMode::OVERLAY) return (backdrop < 128 ? Div255(2*backdrop*source) : 255 - Div255(2*(255 - backdrop)*(255 - source)));
+	else if constexpr (MODE == BlendMode::ADD) return std::min<Uint32>(255, backdrop + source);
+	else if constexpr (MODE == BlendMode::DARKEN) return std::min(backdrop, source);
+	else if constexpr (MODE == BlendMode::LIGHTEN) return std::max(backdrop, source);
+	else return (backdrop > source ? backdrop - source : source - backdrop);
+}
+
+#ifdef __SSE2__
+//Same as the ones above, on 16 bit lanes holding a channel each
+static inline __m128i Div255(__m128i x){
+	x = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+template <BlendMode MODE>
+static inline __m128i MixChannels(__m128i backdrop, __m128i source){
+	if constexpr (MODE == BlendMode::NORMAL) return source;
+	else if constexpr (MODE == BlendMode::MULTIPLY) return Div255(_mm_mullo_epi16(backdrop, source));
+	else if constexpr (MODE == BlendMode::SCREEN) return _mm_sub_epi16(_mm_add_epi16(backdrop, source), Div255(_mm_mullo_epi16(backdrop, source)));
+	else if constexpr (MODE == BlendMode::OVERLAY){
+		//The light channels get inverted before and after, so both halves are a multiplication
+		__m128i inversion = _mm_and_si128(_mm_cmpgt_epi16(backdrop, _mm_set1_epi16(127)), _mm_set1_epi16(255));
+		__m128i product = _mm_mullo_epi16(_mm_slli_epi16(_mm_xor_si128(backdrop, inversion), 1), _mm_xor_si128(source, inversion));
+		return _mm_xor_si128(Div255(product), inversion);
+	}
+	else if constexpr (MODE == BlendMode::ADD) return _mm_min_epi16(_mm_add_epi16(backdrop, source), _mm_set1_epi16(255));
+	else if constexpr (MODE == BlendMode::DARKEN) return _mm_min_epi16(backdrop, source);
+	else if constexpr (MODE == BlendMode::LIGHTEN) return _mm_max_epi16(backdrop, source);
+	else return _mm_sub_epi16(_mm_max_epi16(backdrop, source), _mm_min_epi16(backdrop, source));
+}
+
+//Blends 2 pixels, unpacked into a lane per channel
+//Over an opaque backdrop, the common case once the bottom layer is drawn, the result stays opaque and the colors don't have to be divided by its alpha
+template <BlendMode MODE, bool OPAQUE_BACKDROP>
+static inline __m128i BlendPixels(__m128i backdrop, __m128i source, __m128i alphaMod){
+	const __m128i zero = _mm_setzero_si128(), opaque = _mm_set1_epi16(255), alphaLanes = _mm_set_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+
+	//The alpha is the lowest channel of every pixel, and gets repeated on the other ones
+	__m128i sourceAlpha = Div255(_mm_mullo_epi16(_mm_shufflehi_epi16(_mm_shufflelo_epi16(source, 0), 0), alphaMod));
+	if constexpr (OPAQUE_BACKDROP){
+		__m128i colors = Div255(_mm_add_epi16(_mm_mullo_epi16(MixChannels<MODE>(backdrop, source), sourceAlpha), _mm_mullo_epi16(backdrop, _mm_sub_epi16(opaque, sourceAlpha))));
+		return _mm_or_si128(_mm_andnot_si128(alphaLanes, colors), _mm_and_si128(alphaLanes, opaque));
+	}
+
+	__m128i backdropAlpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(backdrop, 0), 0);
+	__m128i backdropWeight = Div255(_mm_mullo_epi16(backdropAlpha, _mm_sub_epi16(opaque, sourceAlpha)));
+	__m128i alpha = _mm_add_epi16(sourceAlpha, backdropWeight);
+
+	//The numerator is at most 255*alpha + alpha/2, which still fits in an unsigned lane
+	__m128i mixed = Div255(_mm_add_epi16(_mm_mullo_epi16(source, _mm_sub_epi16(opaque, backdropAlpha)), _mm_mullo_epi16(MixChannels<MODE>(backdrop, source), backdropAlpha)));
+	__m128i numerator = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(mixed, sourceAlpha), _mm_mullo_epi16(backdrop, backdropWeight)), _mm_srli_epi16(alpha, 1));
+
+	//Truncating the float quotient gives the same result as the integer division, as it can't get within 1/255 of the next integer
+	__m128i divisor = _mm_max_epi16(alpha, _mm_set1_epi16(1));
+	__m128 lowQuotient = _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(numerator, zero)), _mm_cvtepi32_ps(_mm_unpacklo_epi16(divisor, zero)));
+	__m128 highQuotient = _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(numerator, zero)), _mm_cvtepi32_ps(_mm_unpackhi_epi16(divisor, zero)));
+	__m128i colors = _mm_packs_epi32(_mm_cvttps_epi32(lowQuotient), _mm_cvttps_epi32(highQuotient));
+
+	//Where both pixels are transparent the backdrop is kept, as the scalar fallback skips them
+	__m128i keepBackdrop = _mm_cmpeq_epi16(alpha, zero);
+	colors = _mm_or_si128(_mm_and_si128(keepBackdrop, backdrop), _mm_andnot_si128(keepBackdrop, colors));
+
+	return _mm_or_si128(_mm_andnot_si128(alphaLanes, colors), _mm_and_si128(alphaLanes, alpha));
+}
+#endif
+
+template <BlendMode MODE>
+static void BlendRowWith(Uint32 *pBackdrop, const Uint32 *pSource, int count, Uint8 alphaMod){
+	int x = 0;
+
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128(), alphaMask = _mm_set1_epi32(0xFF), alphaModLanes = _mm_set1_epi16(alphaMod);
+	for(; x+4 <= count; x += 4){
+		__m128i source = _mm_loadu_si128((const __m128i*)(pSource + x));
+
+		//Transparent pixels leave the backdrop as it is, which is common on layers that are mostly empty
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(source, alphaMask), zero)) == 0xFFFF) continue;
+
+		__m128i backdrop = _mm_loadu_si128((const __m128i*)(pBackdrop + x)), low, high;
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(backdrop, alphaMask), alphaMask)) == 0xFFFF){
+			low = BlendPixels<MODE, true>(_mm_unpacklo_epi8(backdrop, zero), _mm_unpacklo_epi8(source, zero), alphaModLanes);
+			high = BlendPixels<MODE, true>(_mm_unpackhi_epi8(backdrop, zero), _mm_unpackhi_epi8(source, zero), alphaModLanes);
+		} else {
+			low = BlendPixels<MODE, false>(_mm_unpacklo_epi8(backdrop, zero), _mm_unpacklo_epi8(source, zero), alphaModLanes);
+			high = BlendPixels<MODE, false>(_mm_unpackhi_epi8(backdrop, zero), _mm_unpackhi_epi8(source, zero), alphaModLanes);
+		}
+		_mm_storeu_si128((__m128i*)(pBackdrop + x), _mm_packus_epi16(low, high));
+	}
+#endif
+
+	for(; x < count; x++){
+		Uint32 sourceAlpha = Div255((pSource[x] & 0xFF)*alphaMod);
+		if(sourceAlpha == 0) continue;
+
+		Uint32 backdrop = pBackdrop[x], backdropAlpha = backdrop & 0xFF;
+		Uint32 backdropWeight = Div255(backdropAlpha*(255 - sourceAlpha)), alpha = sourceAlpha + backdropWeight;
+		Uint32 pixel = alpha;
+		for(int shift = 8; shift < 32; shift += 8){
+			Uint32 backdropChannel = (backdrop >> shift) & 0xFF, sourceChannel = (pSource[x] >> shift) & 0xFF;
+			Uint32 mixed = Div255(sourceChannel*(255 - backdropAlpha) + MixChannel<MODE>(backdropChannel, sourceChannel)*backdropAlpha);
+			pixel |= ((mixed*sourceAlpha + backdropChannel*backdropWeight + alpha/2)/alpha) << shift;
+		}
+		pBackdrop[x] = pixel;
+	}
+}
+
+void BlendRow(BlendMode mode, Uint32 *pBackdrop, const Uint32 *pSource, int count, Uint8 alphaMod){
+	if(alphaMod == SDL_ALPHA_TRANSPARENT) return;
+
+	switch(mode){
+		case BlendMode::NORMAL: BlendRowWith<BlendMode::NORMAL>(pBackdrop, pSource, count, alphaMod); break;
+		case BlendMode::MULTIPLY: BlendRowWith<BlendMode::MULTIPLY>(pBackdrop, pSource, count, alphaMod); break;
+		case BlendMode::SCREEN: BlendRowWith<BlendMode::SCREEN>(pBackdrop, pSource, count, alphaMod); break;
+		case BlendMode::OVERLAY: BlendRowWith<BlendMode::OVERLAY>(pBackdrop, pSource, count, alphaMod); break;
+		case BlendMode::ADD: BlendRowWith<BlendMode::ADD>(pBackdrop, pSource, count, alphaMod); break;
+		case BlendMode::DARKEN: BlendRowWith<BlendMode::DARKEN>(pBackdrop, pSource, count, alphaMod); break;
+		case BlendMode::LIGHTEN: BlendRowWith<BlendMode::LIGHTEN>(pBackdrop, pSource, count, alphaMod); break;
+		case BlendMode::DIFFERENCE: BlendRowWith<BlendMode::DIFFERENCE>(pBackdrop, pSource, count, alphaMod); break;
+	}
+}
+
+void BenchmarkBlendModes(){
+	constexpr int SIZE = 2048, LAYERS = 20;
+	const char *modeNames[BLEND_MODE_AMOUNT] = {"normal", "multiply", "screen", "overlay", "add", "darken", "lighten", "difference"};
+
+	//Half transparent noise on every layer, so that no pixel can be skipped, over an opaque one without alpha mod as the background of a new image
+	std::vector<Uint32> layers((size_t)SIZE*LAYERS);
+	Uint32 seed = 12345;
+	for(size_t i = 0; i < layers.size(); i++){
+		seed = seed*1664525 + 1013904223;
+		layers[i] = (seed & 0xFFFFFF00) | (i < SIZE ? SDL_ALPHA_OPAQUE : 64 + (seed >> 8 & 0x7F));
+	}
+
+	std::vector<Uint32> composite(SIZE);
+	double counterToMs = 1000.0/SDL_GetPerformanceFrequency(), normalMs = 0.0;
+
+	for(int mode = 0; mode < BLEND_MODE_AMOUNT; mode++){
+		//Every row of the image gets the same layers, so the benchmark measures the kernel instead of the memory
+		Uint64 start = SDL_GetPerformanceCounter();
+		for(int y = 0; y < SIZE; y++){
+			std::fill(composite.begin(), composite.end(), 0xFFFFFF00);
+			for(int layer = 0; layer < LAYERS; layer++) BlendRow((BlendMode)mode, composite.data(), layers.data() + (size_t)layer*SIZE, SIZE, layer == 0 ? SDL_ALPHA_OPAQUE : 200);
+		}
+		double modeMs = (SDL_GetPerformanceCounter() - start)*counterToMs;
+		if(mode == 0) normalMs = modeMs;
+
+		std::cout << "Compositing " << SIZE << "x" << SIZE << " with " << LAYERS << " " << modeNames[mode] << " layers: " << modeMs << "ms ("
+			<< modeMs/normalMs << " times the normal one)\n";
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "SDL.h"
+
+//How the colors of a layer get mixed with the ones below it. The result is then put over them by the alpha of the layer, as SDL_BLENDMODE_BLEND does
+enum class BlendMode{
+    NORMAL = 0,
+    MULTIPLY = 1,
+    SCREEN = 2,
+    OVERLAY = 3,    //Multiplies the dark colors below and screens the light ones
+    ADD = 4,
+    DARKEN = 5,
+    LIGHTEN = 6,
+    DIFFERENCE = 7
+};
+constexpr int BLEND_MODE_AMOUNT = 8;
+
+//Blends a row of RGBA8888 source pixels, with their alpha scaled by 'alphaMod', over the backdrop pixels
+//Where the backdrop is transparent the source colors are kept as they are, so a mode only changes the colors it lands on
+//The alpha is composited with source-over on straight colors, which is associative: blending the normal layers one after the other over an opaque
+//background gives the same colors as blending their composite over it, up to the rounding of each step
+//SSE2 does 4 pixels at a time when available, and the scalar fallback gives exactly the same results
+void BlendRow(BlendMode mode, Uint32 *pBackdrop, const Uint32 *pSource, int count, Uint8 alphaMod = SDL_ALPHA_OPAQUE);
+
+//Prints how long every mode takes to composite many layers, compared to the normal one. Every row gets the same layers, so it measures the kernels
+//instead of the memory. Used by the --benchmark-blend argument, along with BenchmarkComposite
+void BenchmarkBlendModes();
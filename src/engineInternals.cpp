@@ -3,19 +3,56 @@
 #include "logger.hpp"
 #include <string>
 #include <sstream>
+#include <iostream>
 #include <fstream>
 #include <algorithm>
 #include <iomanip>
 #include <charconv>
 #include <ranges>
 
+const std::array<Benchmark, 5> BENCHMARKS = {{
+	{"--benchmark-upload", BenchmarkTextureUpload},
+	{"--benchmark-save", BenchmarkSave},
+	{"--benchmark-fill", [](SDL_Renderer*){ BenchmarkFloodFill(); }},
+	{"--benchmark-filter", [](SDL_Renderer*){ BenchmarkFilters(); }},
+	{"--benchmark-blend", [](SDL_Renderer *pRenderer){ BenchmarkBlendModes(); BenchmarkComposite(pRenderer); }}
+}};
+
+const Benchmark *FindBenchmark(std::span<char*> args){
+	if(args.size() != 2) return nullptr;
+
+	for(const Benchmark &benchmark : BENCHMARKS){
+		if(benchmark.argument == args[1]) return &benchmark;
+	}
+	return nullptr;
+}
+
 void MainLoop(AppManager &appWindow, std::span<char*> args){
+	tracing::SetThreadName("Main");
+
 	bool keepRunning = true;
 	SDL_Event ev;
 	Uint64 lastUpdate = 0, currentUpdate = SDL_GetPerformanceCounter();
 	float deltaTime;
 
-	if(args.size() == 2) appWindow.AddImage(args[1]);
+	//Arguments: [image to open], --record [session file], --replay [session file] or the argument of one of the BENCHMARKS
+	if(const Benchmark *pBenchmark = FindBenchmark(args)){
+		appWindow.RunBenchmark(*pBenchmark);
+		return;
+	}
+
+	std::string_view mode = (args.size() == 3 ? args[1] : "");
+	if(mode == "--replay"){
+		appWindow.ReplaySession(args[2]);
+		return;
+	}
+
+	bool recovered = appWindow.StartJournal();
+	if(mode == "--record"){
+		if(recovered) ErrorPrint("The recorded session starts from a recovered image, so replaying it won't end with the same image");
+		appWindow.StartRecording(args[2]);
+	}
+	else if(args.size() == 2) appWindow.AddImage(args[1]);
 
 	while(keepRunning){
 		while(SDL_PollEvent(&ev)){
@@ -65,6 +102,10 @@ InternalWindow::InternalWindow(SDL_Point optionsSize, InitializationData nData,
 	}
 
 	Option::OptionCommands::UnloadCommands();
+
+	//Reserving enough space beforehand means that options never allocate when they get modified
+	mChangedOptions.reserve(mOptions.size()*2);
+	for(auto &option : mOptions) option->SetChangedOptionsBuffer(&mChangedOptions);
 	
 	UpdateContentDimensions();
 }
@@ -73,7 +114,10 @@ void InternalWindow::SetPosition(int x, int y){
 	SDL_Point mainWindowSize; AppManager::GetWindowSize(mainWindowSize.x, mainWindowSize.y);
 	mDimensions.x = std::clamp(x, 0, mainWindowSize.x - mDimensions.w);
 	mDimensions.y = std::clamp(y, AppManager::GetMinimumWindowY(), mainWindowSize.y - mDimensions.h);
-	UpdateContentDimensions();
+
+	//Moving the window doesn't change what is drawn inside, so there is no need to call UpdateContentDimensions (which would make the cache be drawn again)
+	mContentDimensions.x = mDimensions.x + mInnerBorder;
+	mContentDimensions.y = mDimensions.y + mInnerBorder;
 }
 
 void InternalWindow::SetSize(int w, int h){
@@ -87,36 +131,24 @@ void InternalWindow::SetDimensions(const SDL_Rect &nDimensions){
 	SetPosition(nDimensions.x, nDimensions.y);
 }
 
-void InternalWindow::AddTemporalData(OptionInfo *newData){
+void InternalWindow::AddTemporalData(const OptionInfo &newData){
 	//TODO: make it so that sliders don't transmit their value until mouse up? (may have problems for previsualization)
 	
 	for(auto &current : mTemporalData){
-		if(current->optionID == newData->optionID){
-			current->SetTo(*newData);
+		if(current->optionID == newData.optionID){
+			current->SetTo(newData);
 			return;
 		}
 	}
 
 	mTemporalData.push_back(std::make_shared<OptionInfo>());
-	mTemporalData.back()->SetTo(*newData);
+	mTemporalData.back()->SetTo(newData);
 }
 
 std::vector<std::shared_ptr<OptionInfo>> &InternalWindow::GetTemporalData(){
 	return mTemporalData;
 }
 
-std::vector<Option*> InternalWindow::GetOptionsWithTag(Option::Tag identifier){
-	std::vector<Option*> result;
-
-	for(const auto& option : mOptions){
-		if(option->HasTag(identifier)){
-			result.push_back(option.get());
-		}
-	}
-
-	return result;
-}
-
 const std::string_view InternalWindow::GetName(){
 	return M_WINDOW_NAME;
 }
@@ -285,32 +317,76 @@ void InternalWindow::Draw(SDL_Renderer *pRenderer){
 	if(mMinimized){
 		if(mpIcon.get() != nullptr) DisplayTexture(pRenderer, mpIcon.get(), &mDimensions);
 		else 						FillRect(pRenderer, mDimensions, 100, 100, 100);
+	} else if(UpdateCache(pRenderer)){
+		SDL_RenderCopy(pRenderer, mpCache.get(), nullptr, &mDimensions);
 	} else {
-		FillRect(pRenderer, mDimensions, 100, 100, 100); // border
+		//If the cache can't be used, the window gets drawn directly
+		DrawContents(pRenderer, {mDimensions.x, mDimensions.y});
+	}
+}
 
-		FillRect(pRenderer, mContentDimensions, 200, 200, 200); 
+void InternalWindow::InvalidateCache(){
+	mCacheDirty = true;
+}
 
-		SDL_RenderSetViewport(pRenderer, &mContentDimensions);
+void InternalWindow::ReleaseCache(){
+	mpCache.reset();
+	mCacheDirty = true;
+}
 
-		for(auto &option : mOptions){
-			option->Draw(pRenderer);
-		};
+void InternalWindow::DrawContents(SDL_Renderer *pRenderer, SDL_Point origin){
+	SDL_Rect border = {origin.x, origin.y, mDimensions.w, mDimensions.h};
+	SDL_Rect content = {origin.x + mContentDimensions.x - mDimensions.x, origin.y + mContentDimensions.y - mDimensions.y, mContentDimensions.w, mContentDimensions.h};
 
-		SDL_RenderSetViewport(pRenderer, nullptr);
-	}
-}
+	FillRect(pRenderer, border, 100, 100, 100); // border
 
-std::vector<std::shared_ptr<OptionInfo>> InternalWindow::GetData(){
-	std::vector<std::shared_ptr<OptionInfo>> data;
-	OptionInfo *auxiliar;
+	FillRect(pRenderer, content, 200, 200, 200); 
+
+	SDL_RenderSetViewport(pRenderer, &content);
 
 	for(auto &option : mOptions){
-		auxiliar = option->GetData();
-		if(!auxiliar->IsInvalid()) data.emplace_back(auxiliar);
-		else delete auxiliar;
+		option->Draw(pRenderer);
 	};
-	
-	return data;
+
+	SDL_RenderSetViewport(pRenderer, nullptr);
+}
+
+bool InternalWindow::UpdateCache(SDL_Renderer *pRenderer){
+	if(mDimensions.w <= 0 || mDimensions.h <= 0 || SDL_RenderTargetSupported(pRenderer) != SDL_TRUE) return false;
+
+	//Every option gets asked, so that none of them keeps its flag for the next frame
+	for(auto &option : mOptions){
+		if(option->TakeNeedsRedraw()) mCacheDirty = true;
+	}
+
+	int cacheW = 0, cacheH = 0;
+	if(mpCache) SDL_QueryTexture(mpCache.get(), nullptr, nullptr, &cacheW, &cacheH);
+
+	if(cacheW != mDimensions.w || cacheH != mDimensions.h){
+		mpCache.reset(SDL_CreateTexture(pRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, mDimensions.w, mDimensions.h));
+		if(!mpCache) return false;
+		mCacheDirty = true;
+	}
+
+	if(mCacheDirty){
+		SDL_Texture *pPreviousTarget = SDL_GetRenderTarget(pRenderer);
+		if(SDL_SetRenderTarget(pRenderer, mpCache.get()) != 0) return false;
+
+		DrawContents(pRenderer, {0, 0});
+
+		SDL_SetRenderTarget(pRenderer, pPreviousTarget);
+		mCacheDirty = false;
+	}
+
+	return true;
+}
+
+std::vector<Option*> &InternalWindow::GetChangedOptions(){
+	return mChangedOptions;
+}
+
+void InternalWindow::ClearChangedOptions(size_t handledAmount){
+	mChangedOptions.erase(mChangedOptions.begin(), mChangedOptions.begin()+std::min(handledAmount, mChangedOptions.size()));
 }
 
 int InternalWindow::ProcessWindowInfo(std::string_view info){
@@ -346,6 +422,8 @@ int InternalWindow::ProcessWindowInfo(std::string_view info){
 }
 
 void InternalWindow::UpdateContentDimensions(){
+	mCacheDirty = true;
+
 	mContentDimensions.x = mDimensions.x + mInnerBorder;
 	mContentDimensions.y = mDimensions.y + mInnerBorder;
 	mContentDimensions.w = mDimensions.w-mInnerBorder*2;
@@ -432,10 +510,14 @@ MainBar::MainBar(SDL_Rect nDimensions) : mDimensions(nDimensions){
 
 	selectionDimensions.x += selectionDimensions.w;
 	mMainOptions.push_back(MainOption(selectionDimensions, "PREFERENCES"));
+
+	selectionDimensions.x += selectionDimensions.w;
+	mMainOptions.push_back(MainOption(selectionDimensions, "FILTERS"));
 }
  
 void MainBar::SetWidth(int nWidth){
 	mDimensions.w = nWidth;
+	mCacheDirty = true;
 }
 
 bool MainBar::HandleEvent(SDL_Event *pEvent){
@@ -465,28 +547,65 @@ bool MainBar::HandleEvent(SDL_Event *pEvent){
 }
 
 void MainBar::Draw(SDL_Renderer *pRenderer){
-	FillRect(pRenderer, mDimensions, 150, 150, 150);
-	DrawRect(pRenderer, mDimensions, 0, 0, 0);
+	auto drawContents = [this, pRenderer](){
+		FillRect(pRenderer, mDimensions, 150, 150, 150);
+		DrawRect(pRenderer, mDimensions, 0, 0, 0);
 
-	for(auto &selection : mMainOptions){
-		selection.Draw(pRenderer);
+		for(auto &selection : mMainOptions){
+			selection.Draw(pRenderer);
+		}
+	};
+
+	int cacheW = 0, cacheH = 0;
+	if(mpCache) SDL_QueryTexture(mpCache.get(), nullptr, nullptr, &cacheW, &cacheH);
+
+	//The cache covers the bar from the origin of the renderer, as the options are positioned relative to it
+	SDL_Rect cacheRect = {0, 0, mDimensions.x + mDimensions.w, mDimensions.y + mDimensions.h};
+	if((cacheW != cacheRect.w || cacheH != cacheRect.h) && SDL_RenderTargetSupported(pRenderer) == SDL_TRUE && cacheRect.w > 0 && cacheRect.h > 0){
+		mpCache.reset(SDL_CreateTexture(pRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, cacheRect.w, cacheRect.h));
+		mCacheDirty = true;
+	}
+
+	if(!mpCache){
+		drawContents();
+		return;
 	}
+
+	if(mCacheDirty){
+		SDL_Texture *pPreviousTarget = SDL_GetRenderTarget(pRenderer);
+		SDL_SetRenderTarget(pRenderer, mpCache.get());
+		drawContents();
+		SDL_SetRenderTarget(pRenderer, pPreviousTarget);
+		mCacheDirty = false;
+	}
+
+	SDL_RenderCopy(pRenderer, mpCache.get(), nullptr, &cacheRect);
+}
+
+void MainBar::InvalidateCache(){
+	mCacheDirty = true;
+}
+
+void MainBar::ReleaseCache(){
+	mpCache.reset();
+	mCacheDirty = true;
 }
 
-std::shared_ptr<OptionInfo> MainBar::GetData(){
-	if(mCurrentClickedIndex == -1) return std::shared_ptr<OptionInfo>(new OptionInfo());
+bool MainBar::GetData(OptionInfo &data){
+	if(mCurrentClickedIndex == -1) return false;
 	else switch(mCurrentClickedIndex){
 		case static_cast<int>(MainOptionIDs::SAVE):
 		case static_cast<int>(MainOptionIDs::CLEAR):
 		case static_cast<int>(MainOptionIDs::NEW_CANVAS):
-		case static_cast<int>(MainOptionIDs::PREFERENCES):{
-			int clickedIndex = mCurrentClickedIndex;
+		case static_cast<int>(MainOptionIDs::PREFERENCES):
+		case static_cast<int>(MainOptionIDs::FILTERS):
+			data.optionID = static_cast<OptionInfo::OptionIDs>(mCurrentClickedIndex);
+			data.data = true;
 			mCurrentClickedIndex = -1; //Reset the current clicked index to -1 to prevent repeated firing of the same option
-			return std::shared_ptr<OptionInfo>(new OptionInfo(static_cast<OptionInfo::OptionIDs>(clickedIndex), true));
-		}
+			return true;
 		default:
 			ErrorPrint("Current clicked index could not be converted into a main option: "+std::to_string(mCurrentClickedIndex));
-			return std::shared_ptr<OptionInfo>(new OptionInfo());
+			return false;
 	}
 }
 
@@ -499,6 +618,8 @@ int AppManager::mMaximumHeight = 1000;
 std::shared_ptr<TTF_Font> AppManager::mpFont;
 int AppManager::mMainBarHeight;
 std::vector<std::unique_ptr<InternalWindow>> AppManager::mInternalWindows;
+std::vector<AppManager::RegisteredOption> AppManager::mOptionsRegistry;
+std::array<std::vector<AppManager::RegisteredOption>, AppManager::M_TAG_BITS> AppManager::mTagsRegistry;
 //APP WINDOW METHODS:
 
 AppManager::AppManager(int nWidth, int nHeight, Uint32 nFlags, const char* pWindowsName){
@@ -530,30 +651,26 @@ AppManager::AppManager(int nWidth, int nHeight, Uint32 nFlags, const char* pWind
 	InitializeWindow("LayerWindow");
 }
 
+AppManager::~AppManager(){
+	//The atlases hold textures, which have to be destroyed before the renderer is
+	GlyphAtlas::ReleaseAll();
+}
+
 void AppManager::AddImage(const std::string &imagePath){
+	if(mpRecorder) mpRecorder->RecordImage(imagePath);
 
-	SDL_Point imageSize;
-	std::string imageFormat = imagePath.substr(imagePath.find_last_of('.'));
-	if(imageFormat == ".png"){
-		imageSize = GetSizeOfPNG(imagePath.c_str());
-		if(imageSize.x  <= 0 || imageSize.x > mMaximumWidth || imageSize.y <= 0 || imageSize.y > mMaximumHeight){
-			ErrorPrint(std::to_string(imageSize.x) + "x" + std::to_string(imageSize.y) + " are not valid dimensions (check the app's maximum values and make sure the png isn't corrupted)");
-			return;
-		}
-	} else if (imageFormat == ".bmp"){
-		imageSize = GetSizeOfBMP(imagePath.c_str());
-		if(imageSize.x  <= 0 || imageSize.x > mMaximumWidth || imageSize.y <= 0 || imageSize.y > mMaximumHeight){
-			ErrorPrint(std::to_string(imageSize.x) + "x" + std::to_string(imageSize.y) + " are not valid dimensions (check the app's maximum values and make sure the png isn't corrupted)");
-			return;
-		}
-	} else {
-		ErrorPrint("The image " + imagePath + " has the invalid format" + imageFormat);
+	//The header is enough to reject the image before anything gets allocated for it
+	ImageProbe probe = ProbeImage(imagePath.c_str());
+	if(probe.type == ImageProbe::Type::UNKNOWN) return;
+
+	SDL_Point imageSize = probe.size;
+	if(imageSize.x > mMaximumWidth || imageSize.y > mMaximumHeight){
+		ErrorPrint(std::to_string(imageSize.x) + "x" + std::to_string(imageSize.y) + " are not valid dimensions for "+imagePath+" (check the app's maximum values)");
 		return;
 	}
 
-	mpCanvas->OpenFile(mpRenderer.get(), imagePath.c_str(), imageSize);
-	mpCanvas->CenterInViewport();
-	mpCanvas->SetResolution(std::min(mWidth/(float)mpCanvas->GetImageSize().x, (mHeight-mMainBarHeight)/(float)mpCanvas->GetImageSize().y)*0.9f);
+	//The image gets decoded in another thread, see the canvas imports in 'Update'
+	mpCanvas->ImportFile(imagePath.c_str(), imageSize);
 }
 
 void AppManager::NewCanvas(int width, int height){
@@ -571,6 +688,95 @@ void AppManager::NewCanvas(int width, int height){
 	mpCanvas->SetResolution(std::min(mWidth/(float)mpCanvas->GetImageSize().x, (mHeight-mMainBarHeight)/(float)mpCanvas->GetImageSize().y)*0.9f);
 }
 
+bool AppManager::StartJournal(){
+	//If the previous run crashed, its work is recovered from the journal instead of starting with an empty canvas
+	if(!mpCanvas->StartJournal(mpRenderer.get())) return false;
+
+	mpCanvas->CenterInViewport();
+	mpCanvas->SetResolution(std::min(mWidth/(float)mpCanvas->GetImageSize().x, (mHeight-mMainBarHeight)/(float)mpCanvas->GetImageSize().y)*0.9f);
+	return true;
+}
+
+void AppManager::StartRecording(const std::string &path){
+	mpRecorder.reset(new SessionRecorder(path.c_str(), {mWidth, mHeight}));
+	if(!mpRecorder->IsOpen()) mpRecorder.reset();
+}
+
+bool AppManager::ReplaySession(const std::string &path){
+	SessionReader reader(path.c_str());
+	if(!reader.IsOpen()) return false;
+
+	//The app has to be laid out as it was when recording, otherwise the recorded mouse events land on other pixels
+	SDL_Point recordedSize = reader.GetWindowSize();
+	if(recordedSize.x != mWidth || recordedSize.y != mHeight){
+		ErrorPrint("The session was recorded with a "+std::to_string(recordedSize.x)+"x"+std::to_string(recordedSize.y)+" window, so replaying it won't end with the same image");
+	}
+
+	//Replaying shouldn't overwrite anything the user saved
+	mpCanvas->saveOnDestroy = false;
+
+	SessionEntry entry;
+	std::vector<double> strokeLatencies;
+	Uint64 strokeStart = 0;
+	int frames = 0, events = 0;
+	Uint64 replayStart = SDL_GetPerformanceCounter();
+	double counterToMs = 1000.0/SDL_GetPerformanceFrequency();
+
+	while(reader.Next(entry)){
+		switch(entry.type){
+			case SessionEntry::Type::EVENT:{
+				//The modifiers are read with SDL_GetModState while handling the events, so they have to be the recorded ones
+				SDL_SetModState((SDL_Keymod)entry.modState);
+
+				//The latency of a stroke goes from the event that starts it until the worker has applied all of it
+				Uint64 eventStart = SDL_GetPerformanceCounter();
+				bool wasHolded = mpCanvas->IsHolded();
+				HandleEvent(&entry.event);
+				events++;
+
+				if(!wasHolded && mpCanvas->IsHolded()){
+					strokeStart = eventStart;
+				} else if(wasHolded && !mpCanvas->IsHolded()){
+					mpCanvas->FinishPendingStrokes();
+					strokeLatencies.push_back((SDL_GetPerformanceCounter()-strokeStart)*counterToMs);
+				}
+				break;
+			}
+			case SessionEntry::Type::FRAME:
+				SDL_SetModState((SDL_Keymod)entry.modState);
+				mReplayedImports = entry.finishedImports;
+				Update(entry.deltaTime);
+				mReplayedImports = -1;
+				frames++;
+				break;
+			case SessionEntry::Type::IMAGE:
+				AddImage(entry.text);
+				break;
+		}
+	}
+	mpCanvas->FinishPendingStrokes();
+	double totalMs = (SDL_GetPerformanceCounter()-replayStart)*counterToMs;
+
+	std::cout << "Replayed " << path << ": " << frames << " frames and " << events << " events in " << totalMs << "ms\n";
+	if(!strokeLatencies.empty()){
+		std::sort(strokeLatencies.begin(), strokeLatencies.end());
+		auto percentile = [&strokeLatencies](double fraction){
+			return strokeLatencies[std::min((size_t)(fraction*strokeLatencies.size()), strokeLatencies.size()-1)];
+		};
+		std::cout << "Stroke latency (" << strokeLatencies.size() << " strokes): p50 " << percentile(0.5) << "ms, p90 " << percentile(0.9)
+			<< "ms, p99 " << percentile(0.99) << "ms, max " << strokeLatencies.back() << "ms\n";
+	}
+
+	std::cout << "Final image hash: " << std::hex << std::setw(16) << std::setfill('0') << HashImage(*mpCanvas->GetImage()) << std::dec << '\n';
+	return true;
+}
+
+void AppManager::RunBenchmark(const Benchmark &benchmark){
+	//The benchmarks don't touch the canvas, which would otherwise overwrite the user's image with an empty one when destroyed
+	mpCanvas->saveOnDestroy = false;
+	benchmark.pRun(mpRenderer.get());
+}
+
 Canvas *AppManager::GetCanvas(){
 	return mpCanvas.get();
 }
@@ -582,14 +788,24 @@ Uint32 AppManager::GetWindowID(){
 void AppManager::HandleEvent(SDL_Event *event){
 	bool hasBeenHandled = false;
 
+	if(mpRecorder) mpRecorder->RecordEvent(*event);
+
 	if(event->type == SDL_DROPFILE){
 		const char* sourceDir = event->drop.file;
 		AddImage(sourceDir);
 		return;
-    } else if (event->type == SDL_WINDOWEVENT && event->window.event == SDL_WINDOWEVENT_RESIZED){
-		SDL_Point nSize, relativeSize;
-		
-		SDL_GetWindowSize(mpWindow.get(), &nSize.x, &nSize.y);
+    } else if(event->type == SDL_RENDER_TARGETS_RESET){
+		//The textures are kept, but what was drawn into them was lost
+		for(auto &window : mInternalWindows) window->InvalidateCache();
+		mpMainBar->InvalidateCache();
+		return;
+	} else if(event->type == SDL_RENDER_DEVICE_RESET){
+		for(auto &window : mInternalWindows) window->ReleaseCache();
+		mpMainBar->ReleaseCache();
+		return;
+	} else if (event->type == SDL_WINDOWEVENT && event->window.event == SDL_WINDOWEVENT_RESIZED){
+		//The size comes from the event instead of the window, as the window of a replayed session never gets resized
+		SDL_Point nSize = {event->window.data1, event->window.data2}, relativeSize;
 		bool horizontalStretch = ((nSize.x*mHeight) > (nSize.y*mWidth));
 		if(horizontalStretch){
 			relativeSize = {(int)ceilf(nSize.x * ((float)mHeight)/nSize.y), mHeight};
@@ -631,6 +847,8 @@ void AppManager::HandleEvent(SDL_Event *event){
 }
 
 void AppManager::Update(float deltaTime){
+	TRACE_SCOPE("Update");
+
 	static float windowTimer = 0.0f;
 	windowTimer += deltaTime*0.1f;
 
@@ -650,8 +868,15 @@ void AppManager::Update(float deltaTime){
 	ProcessWindowsData();
 
 	mpCanvas->Update(deltaTime);
+
+	int finishedImports = mpCanvas->FinishImports(mpRenderer.get(), mReplayedImports);
+	if(finishedImports > 0){
+		mpCanvas->CenterInViewport();
+		mpCanvas->SetResolution(std::min(mWidth/(float)mpCanvas->GetImageSize().x, (mHeight-mMainBarHeight)/(float)mpCanvas->GetImageSize().y)*0.9f);
+	}
+	if(mpRecorder) mpRecorder->RecordFrame(deltaTime, finishedImports);
 	
-	ProcessCommandData(mpCanvas->GiveCommands());
+	ProcessCommands(mpCanvas->GetCommands());
 
 	int state = (int)windowTimer;
 	switch(state){
@@ -691,6 +916,8 @@ void AppManager::Update(float deltaTime){
 }
 
 void AppManager::Draw(){
+	TRACE_SCOPE("Draw");
+
 	SDL_SetRenderDrawColor(mpRenderer.get(), 255, 255, 255, SDL_ALPHA_OPAQUE);
 	SDL_RenderClear(mpRenderer.get());
 	
@@ -700,6 +927,7 @@ void AppManager::Draw(){
 
 	mpMainBar->Draw(mpRenderer.get());
 
+	TRACE_SCOPE("Present");
 	SDL_RenderPresent(mpRenderer.get());
 }
 
@@ -717,30 +945,46 @@ std::shared_ptr<TTF_Font> AppManager::GetAppFont(){
 }
 
 Option *AppManager::FindOption(OptionInfo::OptionIDs optionID){
-	for(const auto &window : mInternalWindows){
-		for(const auto &option : window->mOptions){
-			if(option->GetOptionID() == optionID){
-				return option.get();
-			}
-		}
+	InternalWindow *pWindow = nullptr;
+	return FindOption(optionID, pWindow);
+}
+
+Option *AppManager::FindOption(OptionInfo::OptionIDs optionID, InternalWindow *&pWindow){
+	int index = static_cast<int>(optionID);
+
+	if(index >= 0 && (size_t)index < mOptionsRegistry.size() && mOptionsRegistry[index].pOption != nullptr){
+		pWindow = mOptionsRegistry[index].pWindow;
+		return mOptionsRegistry[index].pOption;
 	}
 
-	DebugPrint("Could not find an Option with the specified optionID: " + std::to_string(static_cast<int>(optionID)));
+	DebugPrint("Could not find an Option with the specified optionID: " + std::to_string(index));
 	return nullptr;
 }
 
-Option *AppManager::FindOption(OptionInfo::OptionIDs optionID, InternalWindow *&pWindow){
+void AppManager::UpdateOptionsRegistry(){
+	mOptionsRegistry.clear();
+	for(auto &taggedOptions : mTagsRegistry) taggedOptions.clear();
+
 	for(const auto &window : mInternalWindows){
 		for(const auto &option : window->mOptions){
-			if(option->GetOptionID() == optionID){
-				pWindow = window.get();
-				return option.get();
+			RegisteredOption registered{window.get(), option.get()};
+
+			int index = static_cast<int>(option->GetOptionID());
+			if(index >= 0){
+				if((size_t)index >= mOptionsRegistry.size()) mOptionsRegistry.resize(index+1);
+				mOptionsRegistry[index] = registered;
+			}
+
+			for(auto tagBits = std::to_underlying(option->mTags); tagBits != 0; tagBits &= tagBits-1){
+				mTagsRegistry[std::countr_zero(tagBits)].push_back(registered);
 			}
 		}
 	}
+}
 
-	DebugPrint("Could not find an Option with the specified optionID: " + std::to_string(static_cast<int>(optionID)));
-	return nullptr;
+std::span<const AppManager::RegisteredOption> AppManager::GetRegisteredWithTag(Option::Tag tag){
+	if(tag == Option::Tag::NONE) return {};
+	return mTagsRegistry[std::countr_zero(std::to_underlying(tag))];
 }
 
 void AppManager::InitializeWindow(const std::string &windowName){
@@ -768,6 +1012,7 @@ void AppManager::InitializeWindow(const std::string &windowName){
 		}
 
 		mInternalWindows.push_back(std::make_unique<InternalWindow>(SDL_Point{200, 28}, InternalWindow::InitializationData{windowName, options, file}, mpRenderer.get()));
+		UpdateOptionsRegistry();
 
 		windowFile.close();
 	} else {
@@ -779,13 +1024,16 @@ void AppManager::InitializeWindow(const std::string &windowName){
 bool AppManager::HandleHotkeys(SDL_Event *pEvent){
 	if(pEvent->type == SDL_KEYDOWN){
 		switch(pEvent->key.keysym.sym){
-			case SDLK_1: FindOption(OptionInfo::OptionIDs::CHOOSE_TOOL)->FetchInfo("InitialValue/0_"); return true;
-			case SDLK_2: FindOption(OptionInfo::OptionIDs::CHOOSE_TOOL)->FetchInfo("InitialValue/1_"); return true;
-			case SDLK_3: FindOption(OptionInfo::OptionIDs::CHOOSE_TOOL)->FetchInfo("InitialValue/2_"); return true;
-			case SDLK_4: FindOption(OptionInfo::OptionIDs::CHOOSE_TOOL)->FetchInfo("InitialValue/3_"); return true;
-			case SDLK_t: FindOption(OptionInfo::OptionIDs::SELECT_LAYER)->FetchInfo("InitialValue/"+std::to_string(mpCanvas->GetImage()->GetLayer()+1)+"_"); return true;
-			case SDLK_g: FindOption(OptionInfo::OptionIDs::SELECT_LAYER)->FetchInfo("InitialValue/"+std::to_string(mpCanvas->GetImage()->GetLayer()-1)+"_"); return true;
-			case SDLK_SPACE: FindOption(OptionInfo::OptionIDs::ADD_LAYER)->FetchInfo("InitialValue/T_"); return true;
+			case SDLK_1: ApplyCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::CHOOSE_TOOL, 0)); return true;
+			case SDLK_2: ApplyCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::CHOOSE_TOOL, 1)); return true;
+			case SDLK_3: ApplyCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::CHOOSE_TOOL, 2)); return true;
+			case SDLK_4: ApplyCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::CHOOSE_TOOL, 3)); return true;
+			case SDLK_5: ApplyCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::CHOOSE_TOOL, 4)); return true;
+			case SDLK_6: ApplyCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::CHOOSE_TOOL, 5)); return true;
+			case SDLK_7: ApplyCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::CHOOSE_TOOL, 6)); return true;
+			case SDLK_t: ApplyCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::SELECT_LAYER, mpCanvas->GetImage()->GetLayer()+1)); return true;
+			case SDLK_g: ApplyCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::SELECT_LAYER, mpCanvas->GetImage()->GetLayer()-1)); return true;
+			case SDLK_SPACE: ApplyCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::ADD_LAYER, true)); return true;
 		}
 	}
 
@@ -812,7 +1060,7 @@ void AppManager::InitializeFromFile(){
 						if(line[1] != ':'){
 							ErrorPrint("Could not read app's font, as the ':' after the 'F' is missing");
 						} else {
-							mpFont.reset(LoadFont("Fonts/"+line.substr(2), 72), PointerDeleter{});
+							mpFont.reset(LoadFont("Fonts/"+line.substr(2), FONT_POINT_SIZE), PointerDeleter{});
 						}
 						break;
 					
@@ -843,6 +1091,35 @@ void AppManager::InitializeFromFile(){
 						}
 						break;
 
+					//This character indicates the zlib compression level of the saved pngs, from 0 (fastest) to 9 (smallest)
+					case 'Z':
+						if(line[1] != ':'){
+							ErrorPrint("Could not read app's png compression level, as the ':' after the 'Z' is missing");
+						} else {
+							Canvas::pngSaveSettings.compressionLevel = std::clamp(stoi(line.substr(2)), 0, 9);
+						}
+						break;
+
+					//This character indicates if every layer gets its own texture, blended by the renderer
+					case 'L':
+						if(line[1] != ':'){
+							ErrorPrint("Could not read if the layers use their own textures, as the ':' after the 'L' is missing");
+						} else {
+							MutableTexture::useLayerTextures = (stoi(line.substr(2)) != 0);
+						}
+						break;
+
+					//This character indicates the filter used on the rows of the saved pngs
+					case 'P':
+						if(line[1] != ':'){
+							ErrorPrint("Could not read app's png filter, as the ':' after the 'P' is missing");
+						} else {
+							bool validFilter = true;
+							Canvas::pngSaveSettings.filter = PngEncodeSettings::FilterFromString(line.substr(2), &validFilter);
+							if(!validFilter) ErrorPrint("The png filter "+line.substr(2)+" doesn't exist, using the adaptive one");
+						}
+						break;
+
 					//This character indicates the image that the program will open upon start
 					case 'I':
 						if(line[1] != ':'){
@@ -863,12 +1140,10 @@ void AppManager::InitializeFromFile(){
 }
 
 void AppManager::ProcessMainBarData(){
-	auto data = mpMainBar->GetData();
-
 	//If no data, there's nothing to handle
-	if(data->IsInvalid()) return;
+	if(!mpMainBar->GetData(mPolledData)) return;
 
-	MainBar::MainOptionIDs mainOptionID = static_cast<MainBar::MainOptionIDs>(data->optionID);
+	MainBar::MainOptionIDs mainOptionID = static_cast<MainBar::MainOptionIDs>(mPolledData.optionID);
 
 	switch(mainOptionID){
 		case MainBar::MainOptionIDs::SAVE:
@@ -884,245 +1159,319 @@ void AppManager::ProcessMainBarData(){
 		case MainBar::MainOptionIDs::PREFERENCES:
 			InitializeWindow("PreferencesWindow");
 			break;
+		case MainBar::MainOptionIDs::FILTERS:
+			InitializeWindow("FilterWindow");
+			break;
 		default:
 			ErrorPrint("Unable to tell the main option id: "+std::to_string(static_cast<int>(mainOptionID)));
 			break;
 	}
 }
 
-void AppManager::ProcessWindowsData(){
-	auto safeDataApply = []<typename T>(const OptionInfo* option, const std::function<void(T)> &function){
-		auto data = option->GetData<T>();
-		if(data.has_value()){
-			function(data.value());
-		} else {
-			ErrorPrint("option did not have a valid value");
-		}
-	};
+//Calls 'function' with the data held by 'option' if it is of type T. The function is taken as a template parameter instead of a std::function, so that no allocation is needed
+template <typename T, typename F>
+static void SafeDataApply(const OptionInfo &option, F &&function){
+	if(auto data = std::get_if<T>(&option.data)){
+		function(*data);
+	} else {
+		ErrorPrint("option did not have a valid value");
+	}
+}
 
-	//using OptionInfo;
+void AppManager::ProcessWindowsData(){
+#ifndef NDEBUG
+	size_t previousAllocations = GetAllocationsCount();
+	bool anyOptionChanged = false;
+#endif
 
 	for(int i = 0; i < mInternalWindows.size(); i++){
-		auto windowData = mInternalWindows[i]->GetData();
-
-		//TODO: look into ways to avoid code repetition
-		for(auto &option : windowData){
-			switch(option->optionID){
-				case OptionInfo::OptionIDs::DRAWING_COLOR:{
-					std::function<void(OptionInfo::hex_textfield_t)>  fn = std::bind(&Canvas::SetColor, mpCanvas.get(), std::placeholders::_1);
-					safeDataApply(option.get(), fn);
+		//Only the options that are currently in the buffer are handled, as handling them may modify other options (which will be handled the next frame)
+		auto &changedOptions = mInternalWindows[i]->GetChangedOptions();
+		size_t handledAmount = changedOptions.size();
+		bool erasedWindow = false;
+
+		for(size_t j = 0; j < handledAmount && !erasedWindow; j++){
+			if(!changedOptions[j]->GetData(mPolledData)) continue;
+#ifndef NDEBUG
+			anyOptionChanged = true;
+#endif
+
+			switch(mPolledData.optionID){
+				case OptionInfo::OptionIDs::DRAWING_COLOR:
+					SafeDataApply<OptionInfo::hex_textfield_t>(mPolledData, [this](OptionInfo::hex_textfield_t color){
+						mpCanvas->SetColor(color);
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::HARD_OR_SOFT:{
-					auto mLambda = [this](OptionInfo::tick_t toHard){
+				case OptionInfo::OptionIDs::HARD_OR_SOFT:
+					SafeDataApply<OptionInfo::tick_t>(mPolledData, [this](OptionInfo::tick_t toHard){
 						Pencil *canvasPencil = mpCanvas->GetTool<Pencil>();
 						if(canvasPencil) canvasPencil->SetPencilType(toHard ? Pencil::PencilType::HARD : Pencil::PencilType::SOFT);
-					};
-					std::function<void(OptionInfo::tick_t)> fn = mLambda;
-					safeDataApply(option.get(), fn);
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::TOOL_RADIUS:{
-					auto mLambda = [this](OptionInfo::slider_t radius){
+				case OptionInfo::OptionIDs::TOOL_RADIUS:
+					SafeDataApply<OptionInfo::slider_t>(mPolledData, [this](OptionInfo::slider_t radius){
 						mpCanvas->SetRadius((int)radius);
-					};
-					std::function<void(OptionInfo::slider_t)> fn = mLambda;
-					safeDataApply(option.get(), fn);
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::PENCIL_HARDNESS:{
-					Pencil *canvasPencil = mpCanvas->GetTool<Pencil>();
-					if(canvasPencil){
-						std::function<void(OptionInfo::slider_t)> fn = std::bind(&Pencil::SetHardness, canvasPencil, std::placeholders::_1);
-						safeDataApply(option.get(), fn);
-					}
+				case OptionInfo::OptionIDs::PENCIL_HARDNESS:
+					SafeDataApply<OptionInfo::slider_t>(mPolledData, [this](OptionInfo::slider_t hardness){
+						Pencil *canvasPencil = mpCanvas->GetTool<Pencil>();
+						if(canvasPencil) canvasPencil->SetHardness(hardness);
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::SOFT_ALPHA_CALCULATION:{
-					auto mLambda = [this](OptionInfo::choices_array_t alphaMode){
+				case OptionInfo::OptionIDs::SOFT_ALPHA_CALCULATION:
+					SafeDataApply<OptionInfo::choices_array_t>(mPolledData, [this](OptionInfo::choices_array_t alphaMode){
 						Pencil *canvasPencil = mpCanvas->GetTool<Pencil>();
 						if(canvasPencil) canvasPencil->SetAlphaCalculation(static_cast<Pencil::AlphaCalculation>(alphaMode));
-					};
-					std::function<void(OptionInfo::choices_array_t)> fn = mLambda;
-					safeDataApply(option.get(), fn);
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::AREA_WRAP_AROUND:{
-					auto mLambda = [this](OptionInfo::tick_t wrapAround){
+				case OptionInfo::OptionIDs::AREA_WRAP_AROUND:
+					SafeDataApply<OptionInfo::tick_t>(mPolledData, [this](OptionInfo::tick_t wrapAround){
 						AreaDelimiter *areaDelimeter = mpCanvas->GetTool<AreaDelimiter>();
 						if(areaDelimeter) areaDelimeter->loopBack = wrapAround;
-					};
-					std::function<void(OptionInfo::tick_t)> fn = mLambda;
-					safeDataApply(option.get(), fn);
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::AREA_DRAW_OUTLINE:{
-					auto mLambda = [this](OptionInfo::action_t drawOutline){
+				case OptionInfo::OptionIDs::AREA_DRAW_OUTLINE:
+					SafeDataApply<OptionInfo::action_t>(mPolledData, [this](OptionInfo::action_t drawOutline){
 						if(drawOutline){
 							mpCanvas->ApplyAreaOutline();
 						} else {
-							ErrorPrint("ADD_LAYER data was false! (Should never happen)");
+							ErrorPrint("AREA_DRAW_OUTLINE data was false! (Should never happen)");
 						}
-					};
-					std::function<void(OptionInfo::action_t)> fn = mLambda;
-					safeDataApply(option.get(), fn);
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::CHOOSE_TOOL:{
-					auto mLambda = [this](OptionInfo::choices_array_t chosenTool){
+				case OptionInfo::OptionIDs::AREA_FILL:
+					SafeDataApply<OptionInfo::action_t>(mPolledData, [this](OptionInfo::action_t fill){
+						if(fill){
+							mpCanvas->ApplyAreaFill();
+						} else {
+							ErrorPrint("AREA_FILL data was false! (Should never happen)");
+						}
+					});
+					break;
+				case OptionInfo::OptionIDs::AREA_RESTRICT:
+					SafeDataApply<OptionInfo::tick_t>(mPolledData, [this](OptionInfo::tick_t restricted){
+						AreaDelimiter *areaDelimeter = mpCanvas->GetTool<AreaDelimiter>();
+						if(areaDelimeter) areaDelimeter->restrictPainting = restricted;
+						mpCanvas->UpdateSelection();
+					});
+					break;
+				case OptionInfo::OptionIDs::AREA_SMOOTH_EDGES:
+					SafeDataApply<OptionInfo::tick_t>(mPolledData, [this](OptionInfo::tick_t smooth){
+						AreaDelimiter *areaDelimeter = mpCanvas->GetTool<AreaDelimiter>();
+						if(areaDelimeter) areaDelimeter->smoothEdges = smooth;
+						mpCanvas->UpdateSelection();
+					});
+					break;
+				case OptionInfo::OptionIDs::FILL_TOLERANCE:
+					SafeDataApply<OptionInfo::slider_t>(mPolledData, [this](OptionInfo::slider_t tolerance){
+						BucketFill *canvasBucket = mpCanvas->GetTool<BucketFill>();
+						if(canvasBucket) canvasBucket->tolerance = (Uint8)std::clamp((int)tolerance, 0, 255);
+					});
+					break;
+				case OptionInfo::OptionIDs::FILL_SAMPLE_MERGED:
+					SafeDataApply<OptionInfo::tick_t>(mPolledData, [this](OptionInfo::tick_t sampleMerged){
+						BucketFill *canvasBucket = mpCanvas->GetTool<BucketFill>();
+						if(canvasBucket) canvasBucket->sampleMerged = sampleMerged;
+					});
+					break;
+				case OptionInfo::OptionIDs::SMUDGE_STRENGTH:
+					SafeDataApply<OptionInfo::slider_t>(mPolledData, [this](OptionInfo::slider_t strength){
+						Smudge *canvasSmudge = mpCanvas->GetTool<Smudge>();
+						if(canvasSmudge) canvasSmudge->strength = strength;
+					});
+					break;
+				case OptionInfo::OptionIDs::CLONE_SAMPLE_MERGED:
+					SafeDataApply<OptionInfo::tick_t>(mPolledData, [this](OptionInfo::tick_t sampleMerged){
+						CloneStamp *canvasCloneStamp = mpCanvas->GetTool<CloneStamp>();
+						if(canvasCloneStamp) canvasCloneStamp->sampleMerged = sampleMerged;
+					});
+					break;
+				case OptionInfo::OptionIDs::CHOOSE_TOOL:
+					SafeDataApply<OptionInfo::choices_array_t>(mPolledData, [this](OptionInfo::choices_array_t chosenTool){
 						mpCanvas->SetTool(static_cast<Canvas::Tool>(chosenTool));
-					};
-					std::function<void(OptionInfo::choices_array_t)> fn = mLambda;
-					safeDataApply(option.get(), fn);
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::ADD_LAYER:{
-					auto mLambda = [this](OptionInfo::action_t addLayer){
+				case OptionInfo::OptionIDs::ADD_LAYER:
+					SafeDataApply<OptionInfo::action_t>(mPolledData, [this](OptionInfo::action_t addLayer){
 						if(addLayer){
 							mpCanvas->AddLayer();
 							
 							//We update select layer slider max
-							Option *layerSelector = FindOption(OptionInfo::OptionIDs::SELECT_LAYER);
-							if(layerSelector) layerSelector->FetchInfo("SliderMax/"+std::to_string(mpCanvas->GetImage()->GetTotalLayers()-1)+"_InitialValue/"+std::to_string(mpCanvas->GetImage()->GetLayer())+"_");
+							ApplyCommand(OptionCommand::SetSliderMax(OptionInfo::OptionIDs::SELECT_LAYER, mpCanvas->GetImage()->GetTotalLayers()-1));
+							ApplyCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::SELECT_LAYER, mpCanvas->GetImage()->GetLayer()));
 						} else {
 							ErrorPrint("ADD_LAYER data was false! (Should never happen)");
 						}
-					};
-					std::function<void(OptionInfo::action_t)> fn = mLambda;
-					safeDataApply(option.get(), fn);
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::REMOVE_CURRENT_LAYER:{
-					auto mLambda = [this](OptionInfo::action_t deleteLayer){
+				case OptionInfo::OptionIDs::REMOVE_CURRENT_LAYER:
+					SafeDataApply<OptionInfo::action_t>(mPolledData, [this](OptionInfo::action_t deleteLayer){
 						if(deleteLayer){
 							mpCanvas->DeleteCurrentLayer();
 							
 							//We update select layer slider max
-							Option *layerSelector = FindOption(OptionInfo::OptionIDs::SELECT_LAYER);
-							if(layerSelector) layerSelector->FetchInfo("SliderMax/"+std::to_string(mpCanvas->GetImage()->GetTotalLayers()-1)+"_InitialValue/"+std::to_string(mpCanvas->GetImage()->GetLayer())+"_");
+							ApplyCommand(OptionCommand::SetSliderMax(OptionInfo::OptionIDs::SELECT_LAYER, mpCanvas->GetImage()->GetTotalLayers()-1));
+							ApplyCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::SELECT_LAYER, mpCanvas->GetImage()->GetLayer()));
 						} else {
 							ErrorPrint("REMOVE_CURRENT_LAYER data was false! (Should never happen)");
 						}
-					};
-					std::function<void(OptionInfo::action_t)> fn = mLambda;
-					safeDataApply(option.get(), fn);
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::SELECT_LAYER:{
-					auto mLambda = [this](OptionInfo::slider_t layer){
+				case OptionInfo::OptionIDs::SELECT_LAYER:
+					SafeDataApply<OptionInfo::slider_t>(mPolledData, [this](OptionInfo::slider_t layer){
 						mpCanvas->SetLayer((int)layer);
-					};
-					std::function<void(OptionInfo::slider_t)> fn = mLambda;
-					safeDataApply(option.get(), fn);
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::SHOW_LAYER:{
-					auto mLambda = [this](OptionInfo::tick_t showLayer){
+				case OptionInfo::OptionIDs::SHOW_LAYER:
+					SafeDataApply<OptionInfo::tick_t>(mPolledData, [this](OptionInfo::tick_t showLayer){
 						mpCanvas->SetLayerVisibility(showLayer);
-					};
-					std::function<void(OptionInfo::tick_t)> fn = mLambda;
-					safeDataApply(option.get(), fn);
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::LAYER_ALPHA:{
-					auto mLambda = [this](OptionInfo::slider_t layerAlpha){
+				case OptionInfo::OptionIDs::LAYER_ALPHA:
+					SafeDataApply<OptionInfo::slider_t>(mPolledData, [this](OptionInfo::slider_t layerAlpha){
 						mpCanvas->SetLayerAlpha((Uint8)layerAlpha);
-					};
-					std::function<void(OptionInfo::slider_t)> fn = mLambda;
-					safeDataApply(option.get(), fn);
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::NEW_CANVAS_WIDTH:{
-					//No need to use the specific data
-					mInternalWindows[i]->AddTemporalData(option.get());
+				case OptionInfo::OptionIDs::LAYER_BLEND_MODE:
+					SafeDataApply<OptionInfo::choices_array_t>(mPolledData, [this](OptionInfo::choices_array_t blendMode){
+						mpCanvas->SetLayerBlendMode(static_cast<BlendMode>(blendMode));
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::NEW_CANVAS_HEIGHT:{
+				case OptionInfo::OptionIDs::FILTER_TYPE:
+					SafeDataApply<OptionInfo::choices_array_t>(mPolledData, [this](OptionInfo::choices_array_t filterType){
+						mpCanvas->GetFilters().type = static_cast<FilterType>(filterType);
+					});
+					break;
+				case OptionInfo::OptionIDs::FILTER_RADIUS:
+					SafeDataApply<OptionInfo::slider_t>(mPolledData, [this](OptionInfo::slider_t radius){
+						mpCanvas->GetFilters().radius = radius;
+					});
+					break;
+				case OptionInfo::OptionIDs::FILTER_AMOUNT:
+					SafeDataApply<OptionInfo::slider_t>(mPolledData, [this](OptionInfo::slider_t amount){
+						mpCanvas->GetFilters().amount = amount;
+					});
+					break;
+				case OptionInfo::OptionIDs::FILTER_APPLY:
+					SafeDataApply<OptionInfo::action_t>(mPolledData, [this](OptionInfo::action_t apply){
+						if(apply){
+							mpCanvas->ApplyFilter();
+						} else {
+							ErrorPrint("FILTER_APPLY data was false! (Should never happen)");
+						}
+					});
+					break;
+				case OptionInfo::OptionIDs::NEW_CANVAS_WIDTH:
+				case OptionInfo::OptionIDs::NEW_CANVAS_HEIGHT:
 					//No need to use the specific data
-					mInternalWindows[i]->AddTemporalData(option.get());
+					mInternalWindows[i]->AddTemporalData(mPolledData);
 					break;
-				}
-				case OptionInfo::OptionIDs::NEW_CANVAS_CREATE:{
-					auto mLambda = [this, &i](OptionInfo::action_t newCanvas){
+				case OptionInfo::OptionIDs::NEW_CANVAS_CREATE:
+					SafeDataApply<OptionInfo::action_t>(mPolledData, [this, &i, &erasedWindow](OptionInfo::action_t newCanvas){
 						if(!newCanvas){
 							ErrorPrint("NEW_CANVAS_CREATE data was false! (Should never happen)");
-						} else {
-							auto &temporalData = mInternalWindows[i]->GetTemporalData();
-							
-							//We search for the width and height of the new canvas that the user may have set
-							auto widthOption = std::find_if(temporalData.begin(), temporalData.end(), [](decltype(*temporalData.begin()) option){return option->optionID == OptionInfo::OptionIDs::NEW_CANVAS_WIDTH;});
-							auto heightOption = std::find_if(temporalData.begin(), temporalData.end(), [](decltype(*temporalData.begin()) option){return option->optionID == OptionInfo::OptionIDs::NEW_CANVAS_HEIGHT;});
-							
-							//TODO: If no width/height was specified we currently use a default value (100), may be changed into an error in the future
-							int width = (widthOption == temporalData.end() || !(*widthOption)->GetData<int>().has_value()) ? 100 : (*widthOption)->GetData<int>().value();
-							int height = (heightOption == temporalData.end() || !(*heightOption)->GetData<int>().has_value()) ? 100 : (*heightOption)->GetData<int>().value();
-
-							NewCanvas(width, height);
-							temporalData.clear();
-
-							//Finally we delete this window as it's only purporse is to create a new canvas
-							mInternalWindows.erase(mInternalWindows.begin()+i);
-							i--;
-
-							//Finally, as a new canvas was created, we update select layer slider max
-							Option *layerSelector = FindOption(OptionInfo::OptionIDs::SELECT_LAYER);
-							if(layerSelector) layerSelector->FetchInfo("SliderMax/"+std::to_string(mpCanvas->GetImage()->GetTotalLayers()-1)+"_InitialValue/"+std::to_string(mpCanvas->GetImage()->GetLayer())+"_");
+							return;
 						}
-					};
-					std::function<void(OptionInfo::action_t)> fn = mLambda;
-					safeDataApply(option.get(), fn);
+
+						auto &temporalData = mInternalWindows[i]->GetTemporalData();
+						
+						//We search for the width and height of the new canvas that the user may have set
+						auto widthOption = std::find_if(temporalData.begin(), temporalData.end(), [](decltype(*temporalData.begin()) option){return option->optionID == OptionInfo::OptionIDs::NEW_CANVAS_WIDTH;});
+						auto heightOption = std::find_if(temporalData.begin(), temporalData.end(), [](decltype(*temporalData.begin()) option){return option->optionID == OptionInfo::OptionIDs::NEW_CANVAS_HEIGHT;});
+						
+						//TODO: If no width/height was specified we currently use a default value (100), may be changed into an error in the future
+						int width = (widthOption == temporalData.end() || !(*widthOption)->GetData<int>().has_value()) ? 100 : (*widthOption)->GetData<int>().value();
+						int height = (heightOption == temporalData.end() || !(*heightOption)->GetData<int>().has_value()) ? 100 : (*heightOption)->GetData<int>().value();
+
+						NewCanvas(width, height);
+						temporalData.clear();
+
+						//Finally we delete this window as it's only purporse is to create a new canvas. Its changed options can't be accessed anymore
+						mInternalWindows.erase(mInternalWindows.begin()+i);
+						i--;
+						erasedWindow = true;
+						UpdateOptionsRegistry();
+
+						//Finally, as a new canvas was created, we update select layer slider max
+						ApplyCommand(OptionCommand::SetSliderMax(OptionInfo::OptionIDs::SELECT_LAYER, mpCanvas->GetImage()->GetTotalLayers()-1));
+						ApplyCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::SELECT_LAYER, mpCanvas->GetImage()->GetLayer()));
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::SAVING_NAME:{
-					auto mLambda = [this](OptionInfo::plain_textfield_t text){
+				case OptionInfo::OptionIDs::SAVING_NAME:
+					SafeDataApply<OptionInfo::plain_textfield_t>(mPolledData, [this](const OptionInfo::plain_textfield_t &text){
 						if(text.empty()){
 							mpCanvas->SetSavePath("NewImage.png");
 						} else {
 							mpCanvas->SetSavePath((text + ".png").c_str());
 						}
-					};
-					std::function<void(OptionInfo::plain_textfield_t)> fn = mLambda;
-					safeDataApply(option.get(), fn);
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::PENCIL_DISPLAY_MAIN_COLOR:{
-					auto mLambda = [this](OptionInfo::hex_textfield_t pencilDisplay){
+				case OptionInfo::OptionIDs::PENCIL_DISPLAY_MAIN_COLOR:
+					SafeDataApply<OptionInfo::hex_textfield_t>(mPolledData, [this](OptionInfo::hex_textfield_t pencilDisplay){
 						mpCanvas->toolPreviewMainColor = pencilDisplay;
-					};
-					std::function<void(OptionInfo::hex_textfield_t)> fn = mLambda;
-					safeDataApply(option.get(), fn);
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::PENCIL_DISPLAY_ALTERNATE_COLOR:{
-					auto mLambda = [this](OptionInfo::hex_textfield_t pencilDisplay){
+				case OptionInfo::OptionIDs::PENCIL_DISPLAY_ALTERNATE_COLOR:
+					SafeDataApply<OptionInfo::hex_textfield_t>(mPolledData, [this](OptionInfo::hex_textfield_t pencilDisplay){
 						mpCanvas->toolPreviewAlternateColor = pencilDisplay;
-					};
-					std::function<void(OptionInfo::hex_textfield_t)> fn = mLambda;
-					safeDataApply(option.get(), fn);
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::CANVAS_MOVEMENT_SPEED:{
-					auto mLambda = [this](OptionInfo::whole_textfield_t speed){
+				case OptionInfo::OptionIDs::CANVAS_MOVEMENT_SPEED:
+					SafeDataApply<OptionInfo::whole_textfield_t>(mPolledData, [this](OptionInfo::whole_textfield_t speed){
 						mpCanvas->defaultMovementSpeed = speed;
-					};
-					std::function<void(OptionInfo::whole_textfield_t)> fn = mLambda;
-					safeDataApply(option.get(), fn);
+					});
 					break;
-				}
-				case OptionInfo::OptionIDs::CANVAS_MOVEMENT_FAST_SPEED:{
-					auto mLambda = [this](OptionInfo::whole_textfield_t speed){
+				case OptionInfo::OptionIDs::CANVAS_MOVEMENT_FAST_SPEED:
+					SafeDataApply<OptionInfo::whole_textfield_t>(mPolledData, [this](OptionInfo::whole_textfield_t speed){
 						mpCanvas->fastMovementSpeed = speed;
-					};
-					std::function<void(OptionInfo::whole_textfield_t)> fn = mLambda;
-					safeDataApply(option.get(), fn);
+					});
 					break;
-				}
 				default:
-					ErrorPrint("Unable to tell the option id: "+std::to_string(static_cast<int>(option->optionID)));
+					ErrorPrint("Unable to tell the option id: "+std::to_string(static_cast<int>(mPolledData.optionID)));
 					break;
 			}
 		}
+
+		if(!erasedWindow) mInternalWindows[i]->ClearChangedOptions(handledAmount);
 	}
+
+#ifndef NDEBUG
+	//If no option changed, polling them must not have allocated any memory
+	if(!anyOptionChanged && GetAllocationsCount() != previousAllocations){
+		ErrorPrint("Polling the unchanged options allocated memory "+std::to_string(GetAllocationsCount()-previousAllocations)+" times");
+	}
+#endif
+}
+
+void AppManager::ApplyCommand(const OptionCommand &command){
+	if(command.tag != Option::Tag::NONE){
+		//Every option that holds the tag gets the command, and its window is updated in case of any resize/activation-related commands
+		InternalWindow *pLastWindow = nullptr;
+		for(const auto &registered : GetRegisteredWithTag(command.tag)){
+			if(!registered.pOption->HasTag(command.tag)) continue;
+
+			registered.pOption->ApplyCommand(command);
+			if(registered.pWindow != pLastWindow){
+				if(pLastWindow != nullptr) pLastWindow->UpdateContentDimensions();
+				pLastWindow = registered.pWindow;
+			}
+		}
+		if(pLastWindow != nullptr) pLastWindow->UpdateContentDimensions();
+		return;
+	}
+
+	InternalWindow *pWindow = nullptr;
+	Option *pOption = FindOption(command.optionID, pWindow);
+	if(pOption == nullptr) return;
+
+	pOption->ApplyCommand(command);
+	if(command.operation == OptionCommand::Operation::SET_ACTIVE) pWindow->UpdateContentDimensions();
+}
+
+void AppManager::ProcessCommands(OptionCommandQueue &commands){
+	OptionCommand command;
+	while(commands.Pop(command)) ApplyCommand(command);
 }
 
 void AppManager::ProcessCommandData(const std::string &commands){
@@ -1151,21 +1500,24 @@ void AppManager::ProcessCommandData(const std::string &commands){
 				continue;
 			}
 			
-			std::vector<Option*> optionsWithTag;
-			std::vector<InternalWindow*> windowsWithOptions; //These are needed to update their options distribution, if needed
-
-			//We gather every option that holds the specified tag and their windows
-			for(const auto& window : mInternalWindows){
-				std::vector<Option*> currentOptions = window->GetOptionsWithTag(Option::PrimitiveToTag(filterTag));
-				if(currentOptions.size() != 0){
-					optionsWithTag.insert(optionsWithTag.end(), currentOptions.begin(), currentOptions.end());
-					windowsWithOptions.push_back(window.get());
+			//Finally we apply the commands on the affected options and update their windows in case of any resize/activation-related commands
+			Option::Tag tag = Option::PrimitiveToTag(filterTag);
+			InternalWindow *pLastWindow = nullptr;
+			bool tagsChanged = false;
+			for(const auto &registered : GetRegisteredWithTag(tag)){
+				Option::Tag previousTags = registered.pOption->mTags;
+				registered.pOption->FetchInfo(stringCommand.substr(lastIndex+1));
+				tagsChanged |= (registered.pOption->mTags != previousTags);
+
+				if(registered.pWindow != pLastWindow){
+					if(pLastWindow != nullptr) pLastWindow->UpdateContentDimensions();
+					pLastWindow = registered.pWindow;
 				}
 			}
+			if(pLastWindow != nullptr) pLastWindow->UpdateContentDimensions();
 
-			//Finally we apply the commands on the affected options and update the windows in case of any resize/activation-related commands
-			for(const auto& option : optionsWithTag) option->FetchInfo(stringCommand.substr(lastIndex+1));
-			for(const auto& window : windowsWithOptions) window->UpdateContentDimensions();
+			//A 'Tag/' command adds the options to other tags, which can only be registered once the loop stops reading the registry
+			if(tagsChanged) UpdateOptionsRegistry();
 			
 		} else {
 			//We are performing a common command, where the first number is the id and then a character to confirm the input method
@@ -1187,8 +1539,12 @@ void AppManager::ProcessCommandData(const std::string &commands){
 			if(pOption == nullptr || pOption->mInputMethod != pOption->CharToInputMethod(stringCommand[firstIndex])) return;
 
 			//Finally we apply the commands on the affected option and update the window in case of any resize/activation-related commands
+			Option::Tag previousTags = pOption->mTags;
 			pOption->FetchInfo(stringCommand.substr(lastIndex+1));
 			pWindow->UpdateContentDimensions();
+
+			//A 'Tag/' command adds the option to another tag, which the registry has to know about
+			if(pOption->mTags != previousTags) UpdateOptionsRegistry();
 		}
 	}
 }
\ No newline at end of file
@@ -1,9 +1,21 @@
 #pragma once
 #include "options.hpp"
 #include "paintingTools.hpp"
+#include "sessionRecorder.hpp"
 #include <array>
 #include <span>
 #include <functional>
+#include <bit>
+
+//Chosen by passing its argument alone (e.g: --benchmark-fill), in which case the app runs it in a hidden window instead of its main loop
+struct Benchmark{
+    std::string_view argument;
+    void (*pRun)(SDL_Renderer *pRenderer);
+};
+extern const std::array<Benchmark, 5> BENCHMARKS;
+
+//Returns the benchmark asked for by the arguments, or nullptr if they don't ask for any
+const Benchmark *FindBenchmark(std::span<char*> args);
 
 class InternalWindow{
     public:
@@ -28,11 +40,9 @@ class InternalWindow{
 
     void SetDimensions(const SDL_Rect &nDimensions);
 
-    void AddTemporalData(OptionInfo *newData);
+    void AddTemporalData(const OptionInfo &newData);
     std::vector<std::shared_ptr<OptionInfo>> &GetTemporalData();
 
-    std::vector<Option*> GetOptionsWithTag(Option::Tag identifier);
-
     const std::string_view GetName();
 
     //Either minimizes or un-minimizes the window, depending on its previous state. The window, when minimized, just displays a small logo in a square.
@@ -40,9 +50,18 @@ class InternalWindow{
 
     bool HandleEvent(SDL_Event *event);
     void Update(float deltaTime);
+    //Copies the cached texture of the window, which only gets drawn again if the window or any of its options changed
     void Draw(SDL_Renderer *pRenderer);
 
-    std::vector<std::shared_ptr<OptionInfo>> GetData();
+    //Forces the window to be drawn again into its cached texture (e.g: when the contents of render targets are lost)
+    void InvalidateCache();
+    //Destroys the cached texture, so that it gets created again (e.g: when the render device gets reset)
+    void ReleaseCache();
+
+    //Returns the options modified since the last call to ClearChangedOptions, in the order they changed. It may grow while the data is being handled
+    std::vector<Option*> &GetChangedOptions();
+    //Removes the first 'handledAmount' options from the changed options, which should be the ones already handled
+    void ClearChangedOptions(size_t handledAmount);
 
     private:
 
@@ -54,6 +73,11 @@ class InternalWindow{
     //Identifies this window
     const std::string M_WINDOW_NAME;
 
+    //The window (not minimized) is drawn into this texture, which is then copied into the renderer every frame
+    std::unique_ptr<SDL_Texture, PointerDeleter> mpCache;
+    //If true, the cache has to be drawn again before being copied
+    bool mCacheDirty = true;
+
     bool mMinimized = false;
     SDL_Point mPreMiniSize = {0, 0};
     std::unique_ptr<SDL_Texture, PointerDeleter> mpIcon;
@@ -61,6 +85,9 @@ class InternalWindow{
 
     std::vector<std::unique_ptr<Option>> mOptions;
 
+    //Reserved upon construction, the options append themselves to it when modified (see Option::SetChangedOptionsBuffer)
+    std::vector<Option*> mChangedOptions;
+
     //Set and read by the app manager, used for temporally saving special input from buttons (e.g: a button to choose the desired width for the new Canvas that hasn't been created yet)
     std::vector<std::shared_ptr<OptionInfo>> mTemporalData;
 
@@ -89,6 +116,11 @@ class InternalWindow{
 
     void UpdateContentDimensions();
 
+    //Draws the border, background and options as if the top left corner of the window was at 'origin'
+    void DrawContents(SDL_Renderer *pRenderer, SDL_Point origin);
+    //Makes sure the cache exists with the window's size and is up to date. Returns false if it can't be used
+    bool UpdateCache(SDL_Renderer *pRenderer);
+
     //Returns true if the given point falls exactly inside the inner border of the window
     //If border != nullptr, it gets assigned to the value of the exact border with the preferences being TOP > LEFT > BOTTOM > RIGHT
     bool PointInsideInnerBorder(SDL_Point point, Border *border);
@@ -118,7 +150,8 @@ class MainBar{
         SAVE = 0,
         CLEAR = 1,
         NEW_CANVAS = 2,
-        PREFERENCES = 3
+        PREFERENCES = 3,
+        FILTERS = 4
     };
 
     MainBar(SDL_Rect nDimensions);
@@ -126,9 +159,14 @@ class MainBar{
     void SetWidth(int nWidth);
 
     bool HandleEvent(SDL_Event *pEvent);
+    //Copies the cached texture of the bar, drawing it first if its width changed or its contents were lost
     void Draw(SDL_Renderer *pRenderer);
 
-    std::shared_ptr<OptionInfo> GetData();
+    void InvalidateCache();
+    void ReleaseCache();
+
+    //Returns false if no main option was clicked. Otherwise, data gets set to the clicked option
+    bool GetData(OptionInfo &data);
 
     private:
 
@@ -136,17 +174,34 @@ class MainBar{
     
     std::vector<MainOption> mMainOptions;
     int mCurrentClickedIndex = -1;
+
+    std::unique_ptr<SDL_Texture, PointerDeleter> mpCache;
+    bool mCacheDirty = true;
 };
 
 class AppManager{
     public:
 
     AppManager(int nWidth, int nHeight, Uint32 nFlags = 0, const char* pWindowsName = "App window");
+    ~AppManager();
     
     void AddImage(const std::string &imagePath);
     void NewCanvas(int width, int height);
     Canvas *GetCanvas();
 
+    //Recovers the work of a previous run that crashed, if any, and starts journaling the canvas. Returns true if something was recovered
+    //Not used when replaying, so that every replay starts the same way
+    bool StartJournal();
+
+    //Records from now on the session into the file, so that it can be replayed with 'ReplaySession'
+    void StartRecording(const std::string &path);
+    //Feeds the recorded session to the app as fast as possible, without drawing it, and prints the latency of its strokes and the hash of the final image
+    //Returns false if the session couldn't be opened. The app must have been created with the size given by SessionReader::GetWindowSize
+    bool ReplaySession(const std::string &path);
+
+    //Runs the benchmark with the renderer of the app. The canvas isn't saved when the app gets destroyed afterwards
+    void RunBenchmark(const Benchmark &benchmark);
+
     Uint32 GetWindowID(); 
 
     //When this function gets called, it is assumed that the window is focused. The canvas is passed in case it's needed
@@ -166,6 +221,12 @@ class AppManager{
     //If the option couldn't be found, a null pointer is returned. pWindow gets set to the window holding the option, or nullptr if the option wasn't found
     static Option *FindOption(OptionInfo::OptionIDs optionID, InternalWindow *&pWindow);
 
+    //Applies the command to its option, or to every option holding its tag
+    void ApplyCommand(const OptionCommand &command);
+
+    //Executes commands written in the same text format used by the InternalData files (one per line), for scripts and config files
+    void ProcessCommandData(const std::string &commands);
+
     //Opens a text file with the name of the window from the InternalData forlder and creates a new window using that information 
     void InitializeWindow(const std::string &windowName);
 
@@ -190,12 +251,38 @@ class AppManager{
     std::unique_ptr<MainBar> mpMainBar;
     static std::vector<std::unique_ptr<InternalWindow>> mInternalWindows;
 
+    struct RegisteredOption{
+        InternalWindow *pWindow = nullptr;
+        Option *pOption = nullptr;
+    };
+
+    //Indexed directly by the OptionIDs values, so that finding an option doesn't depend on the amount of windows and options. Empty slots hold nullptr
+    static std::vector<RegisteredOption> mOptionsRegistry;
+
+    //For each bit of Option::Tag, the options holding it, grouped by window
+    static constexpr size_t M_TAG_BITS = sizeof(Option::Tag)*8;
+    static std::array<std::vector<RegisteredOption>, M_TAG_BITS> mTagsRegistry;
+
+    //Rebuilds both registries, must be called whenever a window gets added or removed, or the tags of an option change
+    static void UpdateOptionsRegistry();
+
+    //Returns the registered options holding the lowest bit of the tag, the ones that don't hold the rest of the bits still need to be filtered with Option::HasTag
+    static std::span<const RegisteredOption> GetRegisteredWithTag(Option::Tag tag);
+
+    //Reused every frame to hold the data of the changed options, so that polling them doesn't allocate
+    OptionInfo mPolledData;
+
+    //Only exists while a session is being recorded
+    std::unique_ptr<SessionRecorder> mpRecorder;
+    //Set while replaying to the amount of imports that were finished in the recorded frame, or -1 otherwise
+    int mReplayedImports = -1;
+
     bool HandleHotkeys(SDL_Event *pEvent);
 
     void InitializeFromFile();
     void ProcessMainBarData();
     void ProcessWindowsData();
-    void ProcessCommandData(const std::string &commands);
+    void ProcessCommands(OptionCommandQueue &commands);
 };
 /*
 class AppDataRequester{
@@ -0,0 +1,241 @@
+#include "filterEngine.hpp"
+#include "rasterizer.hpp"
+#include "threadPool.hpp"
+#include "renderLib.hpp"
+#include "logger.hpp"
+#include <iostream>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//Value of a fully opaque channel while filtering
+static constexpr Uint32 UNIT = 128;
+
+//Box blur of a row (4 channels per pixel) in place, repeating the pixels at its ends. 'pScratch' must hold as many values as the row
+static void BoxBlurRow(Uint16 *pRow, Uint16 *pScratch, int width, int radius){
+	std::copy(pRow, pRow + width*4, pScratch);
+	const float scale = 1.0f/(2*radius + 1);
+
+#ifdef __SSE2__
+	//The 4 channels of a pixel at a time, as 32 bit sums
+	const __m128i zero = _mm_setzero_si128();
+	auto load = [pScratch, zero](int x){ return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(pScratch + x*4)), zero); };
+	const __m128 scales = _mm_set1_ps(scale);
+
+	__m128i sum = zero;
+	for(int x = -radius; x <= radius; x++) sum = _mm_add_epi32(sum, load(std::clamp(x, 0, width-1)));
+
+	for(int x = 0; x < width; x++){
+		__m128i average = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(sum), scales));
+		_mm_storel_epi64((__m128i*)(pRow + x*4), _mm_packs_epi32(average, average));
+		sum = _mm_add_epi32(sum, _mm_sub_epi32(load(std::min(x + radius + 1, width-1)), load(std::max(x - radius, 0))));
+	}
+#else
+	int sums[4] = {0, 0, 0, 0};
+	for(int x = -radius; x <= radius; x++){
+		for(int channel = 0; channel < 4; channel++) sums[channel] += pScratch[std::clamp(x, 0, width-1)*4 + channel];
+	}
+
+	for(int x = 0; x < width; x++){
+		const Uint16 *pEntering = pScratch + std::min(x + radius + 1, width-1)*4, *pLeaving = pScratch + std::max(x - radius, 0)*4;
+		for(int channel = 0; channel < 4; channel++){
+			pRow[x*4 + channel] = (Uint16)std::lround(sums[channel]*scale);
+			sums[channel] += pEntering[channel] - pLeaving[channel];
+		}
+	}
+#endif
+}
+
+//Turns the premultiplied channels back into a RGBA8888 pixel
+static Uint32 Unpremultiply(const Uint16 *pChannels){
+	Uint32 alpha = pChannels[0];
+	if(alpha == 0) return 0;
+
+	Uint32 pixel = (alpha + UNIT/2)/UNIT;
+	for(int channel = 1; channel < 4; channel++){
+		pixel |= std::min<Uint32>(255, (pChannels[channel]*255 + alpha/2)/alpha) << channel*8;
+	}
+	return pixel;
+}
+
+//Pushes every color channel of the pixel away from its blurred version, keeping its alpha
+static Uint32 Sharpen(Uint32 original, const Uint16 *pBlurred, float amount){
+	Uint32 alpha = original & 0xFF, blurredAlpha = pBlurred[0];
+	if(alpha == 0 || blurredAlpha == 0) return original;
+
+	Uint32 pixel = alpha;
+	for(int channel = 1; channel < 4; channel++){
+		float color = (original >> channel*8) & 0xFF, blurred = pBlurred[channel]*255.0f/blurredAlpha;
+		pixel |= (Uint32)std::clamp((int)std::lround(color + amount*(color - blurred)), 0, 255) << channel*8;
+	}
+	return pixel;
+}
+
+//Linear interpolation of every channel, from 'original' with no coverage to 'filtered' with full coverage
+static Uint32 Mix(Uint32 original, Uint32 filtered, Uint8 coverage){
+	Uint32 pixel = 0;
+	for(int shift = 0; shift < 32; shift += 8){
+		Uint32 mixed = (((filtered >> shift) & 0xFF)*coverage + ((original >> shift) & 0xFF)*(255 - coverage) + 127)/255;
+		pixel |= mixed << shift;
+	}
+	return pixel;
+}
+
+//FILTER ENGINE METHODS:
+
+SDL_Rect FilterEngine::Apply(SDL_Surface *pSurface, SDL_Rect area, const CoverageMask *pClip, ThreadPool &pool){
+	TRACE_SCOPE("Filter");
+
+	SDL_Rect surfaceRect = {0, 0, pSurface->w, pSurface->h}, filteredRect;
+	if(SDL_IntersectRect(&area, &surfaceRect, &filteredRect) == SDL_FALSE) return {0, 0, 0, 0};
+	if(pClip != nullptr){
+		SDL_Rect clipBounds = pClip->GetBounds(), clippedRect;
+		if(SDL_IntersectRect(&filteredRect, &clipBounds, &clippedRect) == SDL_FALSE) return {0, 0, 0, 0};
+		filteredRect = clippedRect;
+	}
+
+	int radii[3];
+	std::span<const int> boxRadii(radii, GetBoxRadii(radii));
+
+	//The filtered pixels depend on the ones as far as all the boxes reach, which are read too when they are inside the surface
+	int reach = 0;
+	for(int boxRadius : boxRadii) reach += boxRadius;
+	SDL_Rect readRect = {filteredRect.x - reach, filteredRect.y - reach, filteredRect.w + reach*2, filteredRect.h + reach*2}, sourceRect;
+	SDL_IntersectRect(&readRect, &surfaceRect, &sourceRect);
+
+	const int width = sourceRect.w, height = sourceRect.h;
+	mRows.resize((size_t)width*height);
+	mColumns.resize((size_t)width*height);
+
+	pool.ParallelFor(height, [&](size_t begin, size_t end){
+		for(size_t y = begin; y < end; y++){
+			const Uint32 *pPixels = UnsafeGetPixelFromSurface<Uint32>({sourceRect.x, sourceRect.y + (int)y}, pSurface);
+			WorkPixel *pRow = mRows.data() + y*width;
+
+			for(int x = 0; x < width; x++){
+				Uint32 alpha = pPixels[x] & 0xFF;
+				pRow[x].channels[0] = (Uint16)(alpha*UNIT);
+				for(int channel = 1; channel < 4; channel++){
+					pRow[x].channels[channel] = (Uint16)((((pPixels[x] >> channel*8) & 0xFF)*alpha*UNIT + 127)/255);
+				}
+			}
+		}
+	});
+
+	BlurRows(mRows.data(), width, height, boxRadii, pool);
+	Transpose(mRows.data(), mColumns.data(), width, height, pool);
+	BlurRows(mColumns.data(), height, width, boxRadii, pool);
+	Transpose(mColumns.data(), mRows.data(), height, width, pool);
+
+	pool.ParallelFor(filteredRect.h, [&](size_t begin, size_t end){
+		for(int y = filteredRect.y + (int)begin; y < filteredRect.y + (int)end; y++){
+			Uint32 *pPixels = UnsafeGetPixelFromSurface<Uint32>({0, y}, pSurface);
+			const WorkPixel *pRow = mRows.data() + (size_t)(y - sourceRect.y)*width;
+
+			for(int x = filteredRect.x; x < filteredRect.x + filteredRect.w; x++){
+				const Uint16 *pChannels = pRow[x - sourceRect.x].channels;
+				Uint32 filtered = (type == FilterType::UNSHARP_MASK ? Sharpen(pPixels[x], pChannels, amount) : Unpremultiply(pChannels));
+
+				if(pClip != nullptr) filtered = Mix(pPixels[x], filtered, pClip->GetCoverage(x, y));
+				pPixels[x] = filtered;
+			}
+		}
+	});
+
+	return filteredRect;
+}
+
+void FilterEngine::Release(){
+	std::vector<WorkPixel>().swap(mRows);
+	std::vector<WorkPixel>().swap(mColumns);
+}
+
+int FilterEngine::GetBoxRadii(int radii[3]){
+	if(type == FilterType::BOX_BLUR){
+		radii[0] = std::max(1, (int)std::lround(radius));
+		return 1;
+	}
+
+	//The variances of the boxes add up to the one of the gaussian. Their widths are the odd one below the ideal width and the next odd one,
+	//using as many of the smaller one as needed to get the closest total
+	const float variance = radius*radius;
+	int lowerWidth = (int)std::sqrt(4.0f*variance + 1.0f);
+	if(lowerWidth % 2 == 0) lowerWidth--;
+
+	int lowerAmount = (int)std::lround((12.0f*variance - 3*lowerWidth*lowerWidth - 12*lowerWidth - 9)/(-4.0f*lowerWidth - 4.0f));
+	lowerAmount = std::clamp(lowerAmount, 0, 3);
+
+	for(int i = 0; i < 3; i++) radii[i] = ((i < lowerAmount ? lowerWidth : lowerWidth + 2) - 1)/2;
+	return 3;
+}
+
+void FilterEngine::BlurRows(WorkPixel *pPixels, int width, int height, std::span<const int> radii, ThreadPool &pool){
+	pool.ParallelFor(height, [&](size_t begin, size_t end){
+		std::vector<WorkPixel> scratch(width);
+
+		for(size_t y = begin; y < end; y++){
+			for(int boxRadius : radii){
+				if(boxRadius > 0) BoxBlurRow(pPixels[y*width].channels, scratch.data()->channels, width, boxRadius);
+			}
+		}
+	});
+}
+
+void FilterEngine::Transpose(const WorkPixel *pSource, WorkPixel *pDestination, int width, int height, ThreadPool &pool){
+	//Done in square blocks small enough for both the rows read and the ones written to stay in cache
+	constexpr int BLOCK_SIZE = 32;
+	const size_t blockRows = (height + BLOCK_SIZE - 1)/BLOCK_SIZE;
+
+	pool.ParallelFor(blockRows, [&](size_t begin, size_t end){
+		for(int blockY = (int)begin*BLOCK_SIZE; blockY < std::min((int)end*BLOCK_SIZE, height); blockY += BLOCK_SIZE){
+			const int endY = std::min(blockY + BLOCK_SIZE, height);
+
+			for(int blockX = 0; blockX < width; blockX += BLOCK_SIZE){
+				const int endX = std::min(blockX + BLOCK_SIZE, width);
+
+				for(int y = blockY; y < endY; y++){
+					for(int x = blockX; x < endX; x++) pDestination[(size_t)x*height + y] = pSource[(size_t)y*width + x];
+				}
+			}
+		}
+	});
+}
+
+void BenchmarkFilters(){
+	constexpr int SIZE = 3000, REPETITIONS = 3;
+
+	std::unique_ptr<SDL_Surface, PointerDeleter> pImage(SDL_CreateRGBSurfaceWithFormat(0, SIZE, SIZE, 32, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888));
+	for(int y = 0; y < SIZE; y++){
+		Uint32 *pRow = UnsafeGetPixelFromSurface<Uint32>({0, y}, pImage.get());
+		for(int x = 0; x < SIZE; x++) pRow[x] = ((x*7) & 0xFF) << 24 | ((y*3) & 0xFF) << 16 | ((x^y) & 0xFF) << 8 | (x%5 == 0 ? 0 : 255);
+	}
+
+	struct Case{
+		const char *pName;
+		FilterType type;
+		float radius;
+	};
+	const Case cases[4] = {
+		{"gaussian blur", FilterType::GAUSSIAN_BLUR, 4.0f},
+		{"gaussian blur", FilterType::GAUSSIAN_BLUR, 40.0f},
+		{"box blur", FilterType::BOX_BLUR, 10.0f},
+		{"unsharp mask", FilterType::UNSHARP_MASK, 4.0f}
+	};
+
+	FilterEngine filter;
+	double counterToMs = 1000.0/SDL_GetPerformanceFrequency();
+
+	for(const Case &benchmarkCase : cases){
+		filter.type = benchmarkCase.type;
+		filter.radius = benchmarkCase.radius;
+
+		Uint64 start = SDL_GetPerformanceCounter();
+		for(int repetition = 0; repetition < REPETITIONS; repetition++) filter.Apply(pImage.get(), {0, 0, SIZE, SIZE}, nullptr, ThreadPool::GetShared());
+		double filterMs = (SDL_GetPerformanceCounter() - start)*counterToMs/REPETITIONS;
+
+		std::cout << "Filtering " << SIZE << "x" << SIZE << " with a " << benchmarkCase.pName << " of radius " << benchmarkCase.radius << ": " << filterMs << "ms\n";
+	}
+}
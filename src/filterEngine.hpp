@@ -0,0 +1,50 @@
+#pragma once
+#include "SDL.h"
+#include <vector>
+#include <span>
+
+class ThreadPool;
+class CoverageMask;
+
+enum class FilterType{
+    GAUSSIAN_BLUR = 0,
+    BOX_BLUR = 1,
+    UNSHARP_MASK = 2 //Sharpens by subtracting a gaussian blur of the image
+};
+
+//Blurs and sharpens RGBA8888 surfaces. Every blur is made of box blurs (3 of them approximate a gaussian), which cost the same no matter the radius
+//Each box blur is a running sum along the rows, and the columns are blurred as the rows of a transposed copy, so every pass reads memory in order
+//The colors are premultiplied by their alpha while filtering, so that transparent pixels don't darken their neighbours
+class FilterEngine{
+    public:
+
+    FilterType type = FilterType::GAUSSIAN_BLUR;
+    float radius = 3.0f; //Of the box blur, or the standard deviation of the gaussian one (also used by the unsharp mask)
+    float amount = 1.0f; //How much the unsharp mask increases the difference between every pixel and its blurred version
+
+    //Filters the part of the surface inside 'area'. The pixels around it are still read, so its borders blend with the rest of the image
+    //With 'pClip' only its bounds are filtered, and the result is blended with the original by its coverage. Returns the changed rect
+    SDL_Rect Apply(SDL_Surface *pSurface, SDL_Rect area, const CoverageMask *pClip, ThreadPool &pool);
+
+    //Frees the buffers, which otherwise are kept for the next filter
+    void Release();
+
+    private:
+
+    //The premultiplied channels of a pixel (in the same order as its bytes), with 7 fractional bits so they fit in the signed 16 bits SSE2 can pack into
+    struct WorkPixel{
+        Uint16 channels[4];
+    };
+    std::vector<WorkPixel> mRows, mColumns; //The filtered part of the surface, and its transposed copy
+
+    //Radii of the box blurs to apply one after the other, returning how many there are
+    int GetBoxRadii(int radii[3]);
+
+    //Applies the box blurs to every row, in parallel
+    static void BlurRows(WorkPixel *pPixels, int width, int height, std::span<const int> radii, ThreadPool &pool);
+    //Writes the 'width'x'height' source transposed into the destination (which is 'height' wide)
+    static void Transpose(const WorkPixel *pSource, WorkPixel *pDestination, int width, int height, ThreadPool &pool);
+};
+
+//Prints how long every filter takes on a big image with the shared thread pool, used by the --benchmark-filter argument
+void BenchmarkFilters();
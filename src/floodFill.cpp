@@ -0,0 +1,158 @@
+#include "floodFill.hpp"
+#include "threadPool.hpp"
+#include "renderLib.hpp"
+#include "paintingTools.hpp"
+#include "logger.hpp"
+#include <iostream>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <cstdlib>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//Sets the mask of every pixel of the row to MATCHES or DIFFERENT
+static void MatchRow(const Uint32 *pRow, Uint8 *pMask, int width, Uint32 seedColor, Uint8 tolerance){
+	int x = 0;
+
+#ifdef __SSE2__
+	//4 pixels at a time. The absolute difference of every channel is taken with saturated subtractions, and a pixel matches if all of them stay within the tolerance
+	const __m128i seed = _mm_set1_epi32((int)seedColor), limit = _mm_set1_epi8((char)tolerance), zero = _mm_setzero_si128();
+	for(; x+4 <= width; x += 4){
+		__m128i pixels = _mm_loadu_si128((const __m128i*)(pRow + x));
+		__m128i difference = _mm_or_si128(_mm_subs_epu8(pixels, seed), _mm_subs_epu8(seed, pixels));
+		__m128i matches = _mm_cmpeq_epi32(_mm_subs_epu8(difference, limit), zero);
+
+		int bits = _mm_movemask_ps(_mm_castsi128_ps(matches));
+		pMask[x] = bits & 1;
+		pMask[x+1] = (bits >> 1) & 1;
+		pMask[x+2] = (bits >> 2) & 1;
+		pMask[x+3] = (bits >> 3) & 1;
+	}
+#endif
+
+	for(; x < width; x++){
+		bool matches = true;
+		for(int shift = 0; shift < 32; shift += 8){
+			matches &= std::abs((int)((pRow[x] >> shift) & 0xFF) - (int)((seedColor >> shift) & 0xFF)) <= tolerance;
+		}
+		pMask[x] = matches;
+	}
+}
+
+//FLOOD FILL METHODS:
+
+SDL_Rect FloodFill::Find(SDL_Surface *pSample, SDL_Point seed, Uint8 tolerance, ThreadPool *pPool){
+	TRACE_SCOPE("Flood fill");
+	mSpans.clear();
+	mPendingSeeds.clear();
+
+	const int width = pSample->w, height = pSample->h;
+	if(seed.x < 0 || seed.y < 0 || seed.x >= width || seed.y >= height) return {0, 0, 0, 0};
+
+	const Uint32 seedColor = *(const Uint32*)((const Uint8*)pSample->pixels + seed.y*pSample->pitch + seed.x*4);
+	mMask.resize((size_t)width*height);
+
+	auto matchRows = [&](size_t begin, size_t end){
+		for(size_t y = begin; y < end; y++){
+			MatchRow((const Uint32*)((const Uint8*)pSample->pixels + y*pSample->pitch), mMask.data() + y*width, width, seedColor, tolerance);
+		}
+	};
+	if(pPool) pPool->ParallelFor(height, matchRows);
+	else matchRows(0, height);
+
+	int minX = seed.x, maxX = seed.x, minY = seed.y, maxY = seed.y;
+	mPendingSeeds.push_back(seed);
+
+	while(!mPendingSeeds.empty()){
+		SDL_Point pixel = mPendingSeeds.back();
+		mPendingSeeds.pop_back();
+
+		Uint8 *pRow = mMask.data() + (size_t)pixel.y*width;
+		//It may have been filled since it was added, by the span of another seed
+		if(pRow[pixel.x] != MATCHES) continue;
+
+		int left = pixel.x, right = pixel.x;
+		while(left > 0 && pRow[left-1] == MATCHES) left--;
+		while(right+1 < width && pRow[right+1] == MATCHES) right++;
+
+		std::fill(pRow + left, pRow + right + 1, FILLED);
+		mSpans.push_back({pixel.y, left, right});
+
+		minX = std::min(minX, left);
+		maxX = std::max(maxX, right);
+		minY = std::min(minY, pixel.y);
+		maxY = std::max(maxY, pixel.y);
+
+		//Only the first pixel of every run that touches the span is added, the rest of the run is found when it gets walked
+		for(int y : {pixel.y-1, pixel.y+1}){
+			if(y < 0 || y >= height) continue;
+
+			const Uint8 *pNeighbour = mMask.data() + (size_t)y*width;
+			for(int x = left; x <= right; x++){
+				if(pNeighbour[x] == MATCHES && (x == left || pNeighbour[x-1] != MATCHES)) mPendingSeeds.push_back({x, y});
+			}
+		}
+	}
+
+	return {minX, minY, maxX-minX+1, maxY-minY+1};
+}
+
+const std::vector<FillSpan> &FloodFill::GetSpans(){
+	return mSpans;
+}
+
+void FloodFill::Release(){
+	std::vector<Uint8>().swap(mMask);
+	std::vector<FillSpan>().swap(mSpans);
+	std::vector<SDL_Point>().swap(mPendingSeeds);
+}
+
+void BenchmarkFloodFill(){
+	constexpr int SIZE = 3000, REPETITIONS = 5;
+	constexpr Uint32 WALL = 0x000000FF, FLOOR = 0xFFFFFFFF;
+	constexpr SDL_Color FILL_COLOR = {255, 0, 0, SDL_ALPHA_OPAQUE};
+
+	std::unique_ptr<SDL_Surface, PointerDeleter> pImage(SDL_CreateRGBSurfaceWithFormat(0, SIZE, SIZE, 32, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888));
+	auto setPixel = [&pImage](int x, int y, Uint32 color){
+		*(Uint32*)((Uint8*)pImage->pixels + y*pImage->pitch + x*4) = color;
+	};
+
+	struct Case{
+		const char *pName;
+		std::function<Uint32(int x, int y)> color;
+	};
+	const Case cases[3] = {
+		{"empty image", [](int, int){ return FLOOR; }},
+		//Walls on the odd rows, with a gap at alternating ends, so the area is a single corridor that goes back and forth
+		{"winding corridor", [](int x, int y){
+			if(y%2 == 0) return FLOOR;
+			return ((y%4 == 1 && x == SIZE-1) || (y%4 == 3 && x == 0)) ? FLOOR : WALL;
+		}},
+		//Teeth joined by the first row, so every row below it has SIZE/2 spans of a single pixel
+		{"comb", [](int x, int y){ return (y == 0 || x%2 == 0) ? FLOOR : WALL; }}
+	};
+
+	FloodFill fill;
+	double counterToMs = 1000.0/SDL_GetPerformanceFrequency();
+
+	for(const Case &benchmarkCase : cases){
+		for(int y = 0; y < SIZE; y++){
+			for(int x = 0; x < SIZE; x++) setPixel(x, y, benchmarkCase.color(x, y));
+		}
+
+		for(ThreadPool *pPool : {(ThreadPool*)nullptr, &ThreadPool::GetShared()}){
+			Uint64 start = SDL_GetPerformanceCounter();
+			//The whole fill, like BucketFill::ApplyOn does it. Painting keeps the area the same, as the walls never match the fill color
+			for(int repetition = 0; repetition < REPETITIONS; repetition++){
+				fill.Find(pImage.get(), {0, 0}, 0, pPool);
+				BucketFill::PaintSpans(pImage.get(), fill.GetSpans(), FILL_COLOR, nullptr, pPool);
+			}
+			double fillMs = (SDL_GetPerformanceCounter() - start)*counterToMs/REPETITIONS;
+
+			std::cout << "Flood fill of " << SIZE << "x" << SIZE << " (" << benchmarkCase.pName << ", " << fill.GetSpans().size() << " spans) "
+				<< (pPool ? "with the thread pool: " : "in a single thread: ") << fillMs << "ms\n";
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "SDL.h"
+#include <vector>
+
+class ThreadPool;
+
+//A run of filled pixels in a row, both ends included
+struct FillSpan{
+    int y;
+    int left, right;
+};
+
+//Scanline flood fill: finds the pixels 4-connected to a seed whose color is similar to it, as a list of horizontal spans
+//The pixels that match the seed are found first for the whole surface (in parallel and with SIMD when available), and then the area is walked
+//a span at a time, so every pixel is compared only once no matter its shape
+class FloodFill{
+    public:
+
+    //'pSample' must be RGBA8888. A pixel matches if none of its channels differs more than 'tolerance' from the ones of the seed
+    //Returns the rect that encloses the found area, which is empty if the seed is outside the surface
+    SDL_Rect Find(SDL_Surface *pSample, SDL_Point seed, Uint8 tolerance, ThreadPool *pPool = nullptr);
+
+    //The spans found by the last call to 'Find', in no particular order
+    const std::vector<FillSpan> &GetSpans();
+
+    //Frees the buffers, which otherwise are kept for the next fill
+    void Release();
+
+    private:
+
+    enum MaskValue : Uint8{
+        DIFFERENT = 0,
+        MATCHES = 1,
+        FILLED = 2
+    };
+    //A value per pixel of the sample
+    std::vector<Uint8> mMask;
+    std::vector<FillSpan> mSpans;
+    //Pixels of the found area whose span hasn't been walked yet
+    std::vector<SDL_Point> mPendingSeeds;
+};
+
+//Fills a big image with worst case shapes (a corridor that winds through the whole image and a comb of 1 pixel wide teeth, which has the most spans possible)
+//and prints how long finding and painting the area takes with and without the shared thread pool, used by the --benchmark-fill argument
+void BenchmarkFloodFill();
@@ -0,0 +1,560 @@
+#include "journal.hpp"
+#include "paintingTools.hpp"
+#include "logger.hpp"
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+
+//The second version added the blend mode to the state of the layers
+static constexpr char SNAPSHOT_MAGIC[4] = {'P', 'A', 'B', '2'};
+static constexpr char JOURNAL_MAGIC[4] = {'P', 'A', 'J', '2'};
+//Bigger images than this are considered corrupted data
+static constexpr Uint32 MAX_JOURNAL_SIDE = 1 << 15;
+static constexpr Uint32 MAX_JOURNAL_LAYERS = 1 << 12;
+
+//The records are checked with FNV-1a, which is enough to tell apart a record cut by a crash
+static Uint32 Fnv1a(const Uint8 *pData, size_t size, Uint32 hash = 2166136261u){
+	for(size_t i = 0; i < size; i++){
+		hash ^= pData[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+//The files are only meant to be read by the same machine that wrote them, so the numbers are kept in its own byte order
+template <typename T>
+static void AppendValue(std::vector<Uint8> &buffer, T value){
+	const Uint8 *pBytes = reinterpret_cast<const Uint8*>(&value);
+	buffer.insert(buffer.end(), pBytes, pBytes + sizeof(T));
+}
+
+template <typename T>
+static bool ReadValue(FILE *pFile, T &value){
+	return std::fread(&value, sizeof(T), 1, pFile) == 1;
+}
+
+template <typename T>
+static T TakeValue(const Uint8 *&pData){
+	T value;
+	std::memcpy(&value, pData, sizeof(T));
+	pData += sizeof(T);
+	return value;
+}
+
+Journal::Journal(const std::string &directory) : mDirectory(directory){
+	mSnapshotPath = (std::filesystem::path(directory) / "base.bin").string();
+	mJournalPath = (std::filesystem::path(directory) / "journal.bin").string();
+	mTemporalPath = (std::filesystem::path(directory) / "base.tmp").string();
+
+	mThread = std::thread(&Journal::Run, this);
+}
+
+Journal::~Journal(){
+	{
+		std::lock_guard<std::mutex> queueLock(mQueueMutex);
+		mStop = true;
+	}
+	mQueueCondition.notify_all();
+	if(mThread.joinable()) mThread.join();
+
+	if(mpJournalFile) std::fclose(mpJournalFile);
+}
+
+//JOURNAL RECORDING METHODS:
+
+void Journal::RecordRegion(int layer, SDL_Surface *pLayer, SDL_Rect region){
+	SDL_Rect surfaceRect = {0, 0, pLayer->w, pLayer->h};
+	if(!SDL_IntersectRect(&region, &surfaceRect, &region)) return;
+
+	{
+		std::lock_guard<std::mutex> queueLock(mQueueMutex);
+		if(!mRecording) return;
+	}
+
+	Record record;
+	record.type = Record::Type::REGION;
+	record.layer = layer;
+	record.region = region;
+	CopyRegion(pLayer, region, record.pixels);
+	Push(std::move(record));
+}
+
+void Journal::RecordLayerState(int layer, bool visible, Uint8 alpha, BlendMode blendMode){
+	Record record;
+	record.type = Record::Type::LAYER_STATE;
+	record.layer = layer;
+	record.visible = visible;
+	record.alpha = alpha;
+	record.blendMode = blendMode;
+	Push(std::move(record));
+}
+
+void Journal::RecordSnapshot(MutableTexture &image){
+	PushImage(image, Record::Type::SNAPSHOT);
+}
+
+void Journal::Compact(MutableTexture &image){
+	PushImage(image, Record::Type::COMPACTION);
+}
+
+void Journal::Start(MutableTexture &image, std::function<std::unique_lock<std::mutex>()> lockSurfaces){
+	{
+		std::lock_guard<std::mutex> queueLock(mQueueMutex);
+		mLockSurfaces = std::move(lockSurfaces);
+		mRecording = true;
+	}
+	RecordSnapshot(image);
+}
+
+void Journal::Flush(){
+	std::unique_lock<std::mutex> queueLock(mQueueMutex);
+	mIdleCondition.wait(queueLock, [this]{ return mQueue.empty() && !mWriting; });
+}
+
+void Journal::Push(Record &&record){
+	{
+		std::lock_guard<std::mutex> queueLock(mQueueMutex);
+		if(!mRecording) return;
+
+		//A newer snapshot makes everything queued before it useless, and stops the copy of the one being written
+		if(record.type == Record::Type::SNAPSHOT){
+			mQueue.clear();
+			mGeneration++;
+		}
+		record.generation = mGeneration;
+		mQueue.push_back(std::move(record));
+	}
+	mQueueCondition.notify_one();
+}
+
+void Journal::PushImage(MutableTexture &image, Record::Type type){
+	{
+		std::lock_guard<std::mutex> queueLock(mQueueMutex);
+		if(!mRecording) return;
+	}
+
+	Record record;
+	record.type = type;
+	record.width = image.GetWidth();
+	record.height = image.GetHeight();
+	record.currentLayer = image.GetLayer();
+	record.pImage = &image;
+
+	record.layers.resize(image.GetTotalLayers());
+	for(int i = 0; i < image.GetTotalLayers(); i++){
+		record.layers[i].visible = image.GetLayerVisibility(i);
+		SDL_GetSurfaceAlphaMod(image.GetSurfaceAtLayer(i), &record.layers[i].alpha);
+		record.layers[i].blendMode = image.GetLayerBlendMode(i);
+	}
+
+	Push(std::move(record));
+}
+
+void Journal::Run(){
+	tracing::SetThreadName("Journal");
+
+	while(true){
+		Record record;
+		{
+			std::unique_lock<std::mutex> queueLock(mQueueMutex);
+			mQueueCondition.wait(queueLock, [this]{ return mStop || !mQueue.empty(); });
+			if(mQueue.empty()) return; //Only when stopping, so that everything queued is still written
+
+			record = std::move(mQueue.front());
+			mQueue.pop_front();
+			mWriting = true;
+		}
+
+		Write(record);
+
+		{
+			std::lock_guard<std::mutex> queueLock(mQueueMutex);
+			mWriting = false;
+		}
+		mIdleCondition.notify_all();
+	}
+}
+
+void Journal::Write(Record &record){
+	TRACE_SCOPE("Journal write");
+
+	if(record.type == Record::Type::SNAPSHOT){
+		WriteSnapshot(record);
+		return;
+	}
+	if(record.type == Record::Type::COMPACTION){
+		WriteCompaction(record);
+		return;
+	}
+
+	//The journal only exists once a snapshot was written
+	if(!mpJournalFile) return;
+
+	std::vector<Uint8> buffer;
+	buffer.reserve(32 + record.pixels.size());
+	AppendValue<Uint32>(buffer, (Uint32)record.type);
+	AppendValue<Uint32>(buffer, 0); //Size of the payload, set below
+
+	if(record.type == Record::Type::REGION){
+		AppendValue<Sint32>(buffer, record.layer);
+		AppendValue<Sint32>(buffer, record.region.x);
+		AppendValue<Sint32>(buffer, record.region.y);
+		AppendValue<Sint32>(buffer, record.region.w);
+		AppendValue<Sint32>(buffer, record.region.h);
+		buffer.insert(buffer.end(), record.pixels.begin(), record.pixels.end());
+	} else {
+		AppendValue<Sint32>(buffer, record.layer);
+		AppendValue<Uint8>(buffer, record.visible);
+		AppendValue<Uint8>(buffer, record.alpha);
+		AppendValue<Uint8>(buffer, (Uint8)record.blendMode);
+	}
+
+	Uint32 payloadSize = buffer.size() - 2*sizeof(Uint32);
+	std::memcpy(buffer.data() + sizeof(Uint32), &payloadSize, sizeof(Uint32));
+	AppendValue<Uint32>(buffer, Fnv1a(buffer.data(), buffer.size()));
+
+	//Each record is flushed on its own, so that a crash can only lose the one being written
+	if(std::fwrite(buffer.data(), 1, buffer.size(), mpJournalFile) != buffer.size() || std::fflush(mpJournalFile) != 0){
+		//Nothing else gets appended, as the records after a broken one would be ignored anyway
+		std::fclose(mpJournalFile);
+		mpJournalFile = nullptr;
+	}
+}
+
+bool Journal::WriteSnapshot(Record &snapshot){
+	Uint32 epoch = 0;
+	FILE *pFile = BeginSnapshotFile(snapshot, epoch);
+	bool success = (pFile != nullptr);
+
+	for(size_t i = 0; i < snapshot.layers.size() && success; i++){
+		Uint8 state[3] = {(Uint8)snapshot.layers[i].visible, snapshot.layers[i].alpha, (Uint8)snapshot.layers[i].blendMode};
+		success = std::fwrite(state, 1, 3, pFile) == 3;
+
+		//The surfaces are only locked while copying each band, the worker and the main thread can modify them in between
+		//Whatever they change after the snapshot was queued is recorded after it, so replaying the journal gives the right pixels anyway
+		for(int firstRow = 0; firstRow < snapshot.height && success; firstRow += M_BAND_ROWS){
+			success = CopyBand(snapshot, (int)i, firstRow, std::min(M_BAND_ROWS, snapshot.height - firstRow));
+			success = success && std::fwrite(mBand.data(), 1, mBand.size(), pFile) == mBand.size();
+		}
+	}
+
+	return EndSnapshotFile(pFile, epoch, success);
+}
+
+bool Journal::WriteCompaction(Record &compaction){
+	//Without the journal the changes since the snapshot were lost, so the layers are copied instead
+	if(!mpJournalFile) return WriteSnapshot(compaction);
+
+	FILE *pBase = std::fopen(mSnapshotPath.c_str(), "rb");
+	FILE *pJournal = std::fopen(mJournalPath.c_str(), "rb");
+	auto closeFiles = [&]{
+		if(pBase) std::fclose(pBase);
+		if(pJournal) std::fclose(pJournal);
+	};
+
+	//Every structural change queues a snapshot, which drops the compactions queued before it, so the current snapshot has the layers of the image
+	Uint32 baseEpoch = 0, width = 0, height = 0, layerAmount = 0, currentLayer = 0, journalEpoch = 0;
+	bool usable = pBase && pJournal && ReadEpoch(pBase, SNAPSHOT_MAGIC, baseEpoch) && ReadValue(pBase, width) && ReadValue(pBase, height)
+		&& ReadValue(pBase, layerAmount) && ReadValue(pBase, currentLayer) && ReadEpoch(pJournal, JOURNAL_MAGIC, journalEpoch);
+	usable = usable && baseEpoch == mEpoch && journalEpoch == mEpoch && width == (Uint32)compaction.width && height == (Uint32)compaction.height
+		&& layerAmount == compaction.layers.size();
+
+	//Only the position of the regions is kept, their pixels are read again when each band is rewritten. The states of the layers aren't needed,
+	//as the ones read with the compaction already include every change written to the journal before it
+	std::vector<WrittenRegion> regions;
+	std::vector<Uint8> chunk(64*1024);
+	while(usable){
+		Uint32 header[2];
+		if(std::fread(header, sizeof(Uint32), 2, pJournal) != 2) break;
+		usable = header[1] <= (size_t)width*height*4 + 64;
+
+		//The payload is checked a chunk at a time, so even a region as big as a layer doesn't need to be held in memory
+		const long payloadOffset = std::ftell(pJournal);
+		Uint32 checksum = Fnv1a((const Uint8*)header, sizeof(header)), writtenChecksum = 0;
+		for(Uint32 read = 0; read < header[1] && usable; ){
+			const size_t chunkSize = std::min<size_t>(chunk.size(), header[1] - read);
+			usable = std::fread(chunk.data(), 1, chunkSize, pJournal) == chunkSize;
+			checksum = Fnv1a(chunk.data(), chunkSize, checksum);
+
+			//The region is at the start of the payload, followed by its pixels
+			if(usable && read == 0 && header[0] == (Uint32)Record::Type::REGION){
+				usable = chunkSize >= 5*sizeof(Sint32);
+				if(!usable) break;
+
+				const Uint8 *pPayload = chunk.data();
+				WrittenRegion written;
+				written.layer = TakeValue<Sint32>(pPayload);
+				written.region.x = TakeValue<Sint32>(pPayload);
+				written.region.y = TakeValue<Sint32>(pPayload);
+				written.region.w = TakeValue<Sint32>(pPayload);
+				written.region.h = TakeValue<Sint32>(pPayload);
+				written.pixelsOffset = payloadOffset + 5*sizeof(Sint32);
+				usable = header[1] == 5*sizeof(Sint32) + (size_t)written.region.w*written.region.h*4;
+				regions.push_back(written);
+			}
+			read += chunkSize;
+		}
+		//Everything in the journal was written and flushed by this thread, so a broken record means the file can't be trusted
+		usable = usable && ReadValue(pJournal, writtenChecksum) && writtenChecksum == checksum;
+	}
+
+	for(const WrittenRegion &written : regions){
+		usable = usable && written.layer >= 0 && written.layer < (int)layerAmount && written.region.x >= 0 && written.region.y >= 0
+			&& written.region.w > 0 && written.region.h > 0 && written.region.x + written.region.w <= (int)width && written.region.y + written.region.h <= (int)height;
+	}
+	if(!usable){
+		closeFiles();
+		return WriteSnapshot(compaction);
+	}
+
+	Uint32 epoch = 0;
+	FILE *pFile = BeginSnapshotFile(compaction, epoch);
+	bool success = (pFile != nullptr);
+
+	//Each band of the current snapshot gets the rows of the regions that overlap it pasted in the order they were recorded
+	const size_t rowSize = (size_t)width*4;
+	for(Uint32 i = 0; i < layerAmount && success; i++){
+		Uint8 state[3] = {(Uint8)compaction.layers[i].visible, compaction.layers[i].alpha, (Uint8)compaction.layers[i].blendMode};
+		success = std::fwrite(state, 1, 3, pFile) == 3 && std::fseek(pBase, 3, SEEK_CUR) == 0;
+
+		for(int firstRow = 0; firstRow < (int)height && success; firstRow += M_BAND_ROWS){
+			const int rows = std::min(M_BAND_ROWS, (int)height - firstRow);
+			mBand.resize(rows*rowSize);
+			success = std::fread(mBand.data(), 1, mBand.size(), pBase) == mBand.size();
+
+			for(const WrittenRegion &written : regions){
+				if(written.layer != (int)i) continue;
+
+				const int top = std::max(firstRow, written.region.y), bottom = std::min(firstRow + rows, written.region.y + written.region.h);
+				const size_t regionRowSize = (size_t)written.region.w*4;
+				for(int y = top; y < bottom && success; y++){
+					success = std::fseek(pJournal, written.pixelsOffset + (long)((y - written.region.y)*regionRowSize), SEEK_SET) == 0
+						&& std::fread(mBand.data() + (y - firstRow)*rowSize + written.region.x*4, 1, regionRowSize, pJournal) == regionRowSize;
+				}
+			}
+			success = success && std::fwrite(mBand.data(), 1, mBand.size(), pFile) == mBand.size();
+		}
+	}
+	closeFiles();
+
+	//The previous snapshot and journal are still valid, so they are kept if the new one can't be written
+	if(!success){
+		if(pFile) std::fclose(pFile);
+		std::error_code error;
+		std::filesystem::remove(mTemporalPath, error);
+		return false;
+	}
+	return EndSnapshotFile(pFile, epoch, true);
+}
+
+FILE *Journal::BeginSnapshotFile(const Record &snapshot, Uint32 &epoch){
+	std::error_code error;
+	std::filesystem::create_directories(mDirectory, error);
+
+	//Written into a temporal file first, so that the previous snapshot remains usable until this one is complete
+	FILE *pFile = std::fopen(mTemporalPath.c_str(), "wb");
+	if(!pFile) return nullptr;
+
+	epoch = (Uint32)std::chrono::steady_clock::now().time_since_epoch().count() ^ (Uint32)std::chrono::system_clock::now().time_since_epoch().count();
+	if(epoch == mEpoch) epoch++;
+
+	std::vector<Uint8> header;
+	header.insert(header.end(), SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + 4);
+	AppendValue<Uint32>(header, epoch);
+	AppendValue<Uint32>(header, snapshot.width);
+	AppendValue<Uint32>(header, snapshot.height);
+	AppendValue<Uint32>(header, snapshot.layers.size());
+	AppendValue<Uint32>(header, snapshot.currentLayer);
+	if(std::fwrite(header.data(), 1, header.size(), pFile) != header.size()){
+		std::fclose(pFile);
+		std::filesystem::remove(mTemporalPath, error);
+		return nullptr;
+	}
+	return pFile;
+}
+
+bool Journal::EndSnapshotFile(FILE *pFile, Uint32 epoch, bool success){
+	std::error_code error;
+	if(pFile) success = (std::fclose(pFile) == 0) && success;
+
+	if(success){
+		std::filesystem::rename(mTemporalPath, mSnapshotPath, error);
+		success = !error;
+	}
+	if(!success){
+		std::filesystem::remove(mTemporalPath, error);
+
+		//The next records belong to the snapshot that couldn't be written (or to a newer one, which starts its own journal), so they can't be appended to the previous journal
+		if(mpJournalFile) std::fclose(mpJournalFile);
+		mpJournalFile = nullptr;
+		return false;
+	}
+
+	//If the app crashes before the journal is emptied, its old epoch stops it from being replayed over the new snapshot
+	mEpoch = epoch;
+	if(mpJournalFile) std::fclose(mpJournalFile);
+	mpJournalFile = std::fopen(mJournalPath.c_str(), "wb");
+	if(!mpJournalFile) return false;
+
+	if(std::fwrite(JOURNAL_MAGIC, 1, 4, mpJournalFile) != 4 || std::fwrite(&mEpoch, sizeof(mEpoch), 1, mpJournalFile) != 1 || std::fflush(mpJournalFile) != 0){
+		std::fclose(mpJournalFile);
+		mpJournalFile = nullptr;
+		return false;
+	}
+	return true;
+}
+
+bool Journal::CopyBand(const Record &snapshot, int layer, int firstRow, int rows){
+	std::unique_lock<std::mutex> surfacesLock = mLockSurfaces();
+	{
+		//A newer snapshot may have been queued after changing the layers (or even replacing the image), which is done while holding the surfaces
+		std::lock_guard<std::mutex> queueLock(mQueueMutex);
+		if(snapshot.generation != mGeneration) return false;
+	}
+
+	CopyRegion(snapshot.pImage->GetSurfaceAtLayer(layer), {0, firstRow, snapshot.width, rows}, mBand);
+	return true;
+}
+
+//JOURNAL RECOVERY METHODS:
+
+bool Journal::HasRecoveryData(){
+	std::error_code error;
+	return std::filesystem::exists(mSnapshotPath, error);
+}
+
+std::unique_ptr<MutableTexture> Journal::Recover(SDL_Renderer *pRenderer){
+	FILE *pSnapshot = std::fopen(mSnapshotPath.c_str(), "rb");
+	if(!pSnapshot) return nullptr;
+
+	Uint32 snapshotEpoch = 0, width = 0, height = 0, layerAmount = 0, currentLayer = 0;
+	bool valid = ReadEpoch(pSnapshot, SNAPSHOT_MAGIC, snapshotEpoch) && ReadValue(pSnapshot, width) && ReadValue(pSnapshot, height)
+		&& ReadValue(pSnapshot, layerAmount) && ReadValue(pSnapshot, currentLayer);
+	valid = valid && width > 0 && height > 0 && width <= MAX_JOURNAL_SIDE && height <= MAX_JOURNAL_SIDE && layerAmount > 0 && layerAmount <= MAX_JOURNAL_LAYERS;
+	if(!valid){
+		std::fclose(pSnapshot);
+		ErrorPrint("the autosave in "+mSnapshotPath+" is corrupted and can't be recovered");
+		return nullptr;
+	}
+
+	std::unique_ptr<MutableTexture> pImage(new MutableTexture(pRenderer, width, height, {255, 255, 255, SDL_ALPHA_TRANSPARENT}));
+	for(Uint32 i = 1; i < layerAmount; i++) pImage->AddLayer();
+
+	std::vector<Uint8> pixels((size_t)width*height*4);
+	for(Uint32 i = 0; i < layerAmount && valid; i++){
+		Uint8 state[3];
+		valid = std::fread(state, 1, 3, pSnapshot) == 3 && state[2] < BLEND_MODE_AMOUNT && std::fread(pixels.data(), 1, pixels.size(), pSnapshot) == pixels.size();
+		if(!valid) break;
+
+		pImage->SetLayer(i);
+		pImage->SetLayerVisibility(state[0] != 0);
+		pImage->SetLayerAlpha(state[1]);
+		pImage->SetLayerBlendMode((BlendMode)state[2]);
+		PasteRegion(pImage->GetSurfaceAtLayer(i), {0, 0, (int)width, (int)height}, pixels.data());
+	}
+	std::fclose(pSnapshot);
+
+	if(!valid){
+		ErrorPrint("the autosave in "+mSnapshotPath+" is incomplete and can't be recovered");
+		return nullptr;
+	}
+
+	//The journal is replayed until its end or the first record that isn't complete
+	int replayedRecords = 0;
+	FILE *pJournal = std::fopen(mJournalPath.c_str(), "rb");
+	Uint32 journalEpoch = 0;
+	if(pJournal && ReadEpoch(pJournal, JOURNAL_MAGIC, journalEpoch) && journalEpoch == snapshotEpoch){
+		std::vector<Uint8> record;
+		while(true){
+			Uint32 header[2];
+			if(std::fread(header, sizeof(Uint32), 2, pJournal) != 2 || header[1] > (size_t)width*height*4 + 64) break;
+
+			record.resize(sizeof(header) + header[1]);
+			std::memcpy(record.data(), header, sizeof(header));
+			Uint32 checksum = 0;
+			if(std::fread(record.data() + sizeof(header), 1, header[1], pJournal) != header[1] || !ReadValue(pJournal, checksum)) break;
+			if(checksum != Fnv1a(record.data(), record.size())) break;
+
+			const Uint8 *pPayload = record.data() + sizeof(header);
+			if(header[0] == (Uint32)Record::Type::REGION && header[1] >= 5*sizeof(Sint32)){
+				int layer = TakeValue<Sint32>(pPayload);
+				SDL_Rect region;
+				region.x = TakeValue<Sint32>(pPayload);
+				region.y = TakeValue<Sint32>(pPayload);
+				region.w = TakeValue<Sint32>(pPayload);
+				region.h = TakeValue<Sint32>(pPayload);
+
+				bool inside = layer >= 0 && layer < (int)layerAmount && region.x >= 0 && region.y >= 0 && region.w > 0 && region.h > 0
+					&& region.x + region.w <= (int)width && region.y + region.h <= (int)height;
+				if(!inside || header[1] != 5*sizeof(Sint32) + (size_t)region.w*region.h*4) break;
+
+				PasteRegion(pImage->GetSurfaceAtLayer(layer), region, pPayload);
+			} else if(header[0] == (Uint32)Record::Type::LAYER_STATE && header[1] == sizeof(Sint32) + 3){
+				int layer = TakeValue<Sint32>(pPayload);
+				if(layer < 0 || layer >= (int)layerAmount || pPayload[2] >= BLEND_MODE_AMOUNT) break;
+
+				pImage->SetLayer(layer);
+				pImage->SetLayerVisibility(TakeValue<Uint8>(pPayload) != 0);
+				pImage->SetLayerAlpha(TakeValue<Uint8>(pPayload));
+				pImage->SetLayerBlendMode((BlendMode)TakeValue<Uint8>(pPayload));
+			} else {
+				break;
+			}
+			replayedRecords++;
+		}
+	}
+	if(pJournal) std::fclose(pJournal);
+
+	pImage->SetLayer(currentLayer);
+	pImage->UpdateTexture({0, 0, (int)width, (int)height});
+
+	DebugPrint("Recovered the autosave with "+std::to_string(layerAmount)+" layers and "+std::to_string(replayedRecords)+" journal records");
+	return pImage;
+}
+
+void Journal::Discard(){
+	{
+		std::lock_guard<std::mutex> queueLock(mQueueMutex);
+		//The files may belong to a previous run that still has to be recovered
+		if(!mRecording) return;
+
+		mRecording = false;
+		mQueue.clear();
+		//Stops copying the snapshot being written, if any
+		mGeneration++;
+	}
+	Flush();
+
+	if(mpJournalFile){
+		std::fclose(mpJournalFile);
+		mpJournalFile = nullptr;
+	}
+
+	std::error_code error;
+	std::filesystem::remove(mJournalPath, error);
+	std::filesystem::remove(mSnapshotPath, error);
+}
+
+//JOURNAL UTILITY METHODS:
+
+bool Journal::ReadEpoch(FILE *pFile, const char *pMagic, Uint32 &epoch){
+	char magic[4];
+	return std::fread(magic, 1, 4, pFile) == 4 && std::memcmp(magic, pMagic, 4) == 0 && ReadValue(pFile, epoch);
+}
+
+void Journal::CopyRegion(SDL_Surface *pSurface, SDL_Rect region, std::vector<Uint8> &pixels){
+	pixels.resize((size_t)region.w*region.h*4);
+	const Uint8 *pSource = (const Uint8*)pSurface->pixels + region.y*pSurface->pitch + region.x*4;
+	for(int y = 0; y < region.h; y++){
+		std::memcpy(pixels.data() + (size_t)y*region.w*4, pSource + y*pSurface->pitch, region.w*4);
+	}
+}
+
+void Journal::PasteRegion(SDL_Surface *pSurface, SDL_Rect region, const Uint8 *pPixels){
+	Uint8 *pDestination = (Uint8*)pSurface->pixels + region.y*pSurface->pitch + region.x*4;
+	for(int y = 0; y < region.h; y++){
+		std::memcpy(pDestination + y*pSurface->pitch, pPixels + (size_t)y*region.w*4, region.w*4);
+	}
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include "SDL.h"
+#include "blendModes.hpp"
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+class MutableTexture;
+
+//Keeps on disk a base copy of every layer (the snapshot) and a journal with every change committed since it was made, so that the work can be recovered after a crash
+//The files are written by a background thread, so recording a change only costs copying the changed region. Each record is flushed once written
+//The snapshots are copied from the layers by that thread too, a band at a time while holding the surfaces lock, so they don't stall the main thread nor duplicate the image in memory
+//Every snapshot has a new epoch, which is also written at the start of the journal, so that a journal is never replayed over a snapshot it doesn't belong to
+class Journal{
+    public:
+
+    //The files are kept inside 'directory', which gets created if needed
+    Journal(const std::string &directory);
+    //Writes whatever is still queued
+    ~Journal();
+
+    Journal(const Journal&) = delete;
+    Journal &operator=(const Journal&) = delete;
+
+    //Queues a copy of the region of the layer. Can be called from any thread, as long as the surface isn't being modified at the same time
+    void RecordRegion(int layer, SDL_Surface *pLayer, SDL_Rect region);
+    void RecordLayerState(int layer, bool visible, Uint8 alpha, BlendMode blendMode);
+    //Queues a copy of every layer as the new snapshot, which empties the journal once written. Needed after any change to the amount or size of the layers
+    //Only the state of the layers is read here. As their pixels are copied later, the surfaces must stay locked from the change that needs the snapshot until
+    //this returns, and the layers can only be modified while locked. A newer snapshot makes the copy of the previous one stop
+    void RecordSnapshot(MutableTexture &image);
+    //Queues folding the journal into the snapshot, so that it doesn't grow forever nor take long to replay. The layers are only copied (as in RecordSnapshot) if the journal is unusable
+    void Compact(MutableTexture &image);
+
+    //Nothing is recorded until this gets called, which queues the first snapshot. The files of a previous run should be recovered before, as they get replaced
+    //'lockSurfaces' is called by the journal thread before copying each band of a snapshot
+    void Start(MutableTexture &image, std::function<std::unique_lock<std::mutex>()> lockSurfaces);
+
+    //Waits until everything queued has been written
+    void Flush();
+
+    //Returns true if the files of a previous run that didn't exit cleanly are there
+    bool HasRecoveryData();
+    //Builds the image from the snapshot and the journal of the previous run, or returns nullptr if they are unusable
+    //A record that was left incomplete by the crash, and anything after it, is ignored
+    std::unique_ptr<MutableTexture> Recover(SDL_Renderer *pRenderer);
+
+    //Stops recording and deletes the files, should be called when the app exits cleanly. Does nothing if 'Start' wasn't called
+    void Discard();
+
+    private:
+
+    struct LayerState{
+        bool visible = true;
+        Uint8 alpha = SDL_ALPHA_OPAQUE;
+        BlendMode blendMode = BlendMode::NORMAL;
+    };
+
+    //A region record of the journal file, whose pixels are read from it when compacting
+    struct WrittenRegion{
+        int layer;
+        SDL_Rect region;
+        long pixelsOffset;
+    };
+
+    struct Record{
+        enum class Type : Uint32{
+            REGION = 1,
+            LAYER_STATE = 2,
+            SNAPSHOT = 3, //Never written to the journal, it replaces the snapshot file
+            COMPACTION = 4 //Same
+        };
+
+        Type type = Type::REGION;
+        int layer = 0;
+        SDL_Rect region = {0, 0, 0, 0};
+        bool visible = true;
+        Uint8 alpha = SDL_ALPHA_OPAQUE;
+        BlendMode blendMode = BlendMode::NORMAL;
+        std::vector<Uint8> pixels;
+
+        //Only used by snapshots and compactions. The pixels are copied from 'pImage' while 'generation' is still the last one
+        int width = 0, height = 0, currentLayer = 0;
+        std::vector<LayerState> layers;
+        MutableTexture *pImage = nullptr;
+        Uint32 generation = 0;
+    };
+
+    //The rows of a layer copied or rewritten at once
+    static constexpr int M_BAND_ROWS = 256;
+
+    std::string mDirectory;
+    std::string mSnapshotPath, mJournalPath, mTemporalPath;
+
+    FILE *mpJournalFile = nullptr;
+    Uint32 mEpoch = 0;
+
+    std::thread mThread;
+    std::mutex mQueueMutex;
+    std::condition_variable mQueueCondition;
+    std::condition_variable mIdleCondition;
+    std::deque<Record> mQueue;
+    bool mWriting = false;
+    bool mStop = false;
+    bool mRecording = false; //Set by Start and unset by Discard
+    Uint32 mGeneration = 0; //Increased by every snapshot queued and by Discard, which makes the copy of the previous snapshot stop
+
+    std::function<std::unique_lock<std::mutex>()> mLockSurfaces;
+    std::vector<Uint8> mBand; //Only used by the journal thread
+
+    void Push(Record &&record);
+    //Queues a snapshot or a compaction of the image, with its layers in the state they are now
+    void PushImage(MutableTexture &image, Record::Type type);
+    void Run();
+    void Write(Record &record);
+    bool WriteSnapshot(Record &snapshot);
+    //Writes a new snapshot with the current one and the regions of the journal file, falling back to WriteSnapshot if any of them is unusable
+    bool WriteCompaction(Record &compaction);
+
+    //Returns a new snapshot file, whose header is already written, or nullptr if it can't be created
+    FILE *BeginSnapshotFile(const Record &snapshot, Uint32 &epoch);
+    //Closes the new snapshot file and replaces the previous one with it if 'success', then starts an empty journal for it
+    bool EndSnapshotFile(FILE *pFile, Uint32 epoch, bool success);
+    //Copies the rows of the layer into 'mBand' while the surfaces are locked. Returns false if a newer snapshot was queued, as the layers may not match anymore
+    bool CopyBand(const Record &snapshot, int layer, int firstRow, int rows);
+
+    //Reads the epoch at the start of the file, returns false if it isn't there
+    static bool ReadEpoch(FILE *pFile, const char *pMagic, Uint32 &epoch);
+    static void CopyRegion(SDL_Surface *pSurface, SDL_Rect region, std::vector<Uint8> &pixels);
+    static void PasteRegion(SDL_Surface *pSurface, SDL_Rect region, const Uint8 *pPixels);
+};
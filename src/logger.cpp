@@ -1,3 +1,323 @@
 #include "logger.hpp"
+#include <iostream>
+#include <fstream>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
-std::ofstream logFile ("DebugLog.txt", std::ios::out);
\ No newline at end of file
+namespace{
+    //Every entry takes a slot of 64 bytes, the text of the messages that doesn't fit in the first slot takes the following ones
+    struct TraceEvent{
+        const char *pName = nullptr; //Name of the span, or the function that printed the message
+        std::uint64_t start = 0, end = 0;
+        std::uint32_t line = 0;
+        std::uint16_t textLength = 0;
+        std::uint8_t isMessage = 0;
+        LogLevel level = LogLevel::TRACING;
+        char text[32];
+    };
+    static_assert(sizeof(TraceEvent) == 64);
+
+    constexpr size_t M_FIRST_SLOT_TEXT = sizeof(TraceEvent::text);
+    constexpr size_t M_MAX_MESSAGE_LENGTH = 4096;
+
+    //Written only by its thread and read only by the flusher
+    struct TraceBuffer{
+        static constexpr size_t CAPACITY = 1 << 13; //Must be a power of 2
+
+        std::unique_ptr<TraceEvent[]> slots{new TraceEvent[CAPACITY]};
+        alignas(64) std::atomic<size_t> head = 0; //Slots written by the thread
+        alignas(64) std::atomic<size_t> tail = 0; //Slots read by the flusher
+        std::atomic<size_t> dropped = 0;
+        std::atomic<const char*> pThreadName = nullptr;
+        std::atomic<bool> retired = false; //Set when its thread ends, so that it gets removed once empty
+
+        int threadIndex = 0;
+        bool namedInTrace = false;
+
+        //Returns true if 'amount' consecutive slots are free after the written ones. Otherwise the entry is counted as dropped
+        bool Reserve(size_t amount){
+            size_t used = head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire);
+            if(CAPACITY - used >= amount) return true;
+
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        TraceEvent &Slot(size_t index){
+            return slots[index & (CAPACITY-1)];
+        }
+    };
+
+    class Tracer{
+        public:
+
+        Tracer() : mStart(tracing::Now()){
+            mLogFile.open("DebugLog.txt", std::ios::out);
+            if constexpr (TRACE_INFO){
+                mTraceFile.open("Trace.json", std::ios::out);
+                mTraceFile << "[\n";
+            }
+
+            mFlusher = std::thread(&Tracer::Run, this);
+        }
+
+        ~Tracer(){
+            {
+                std::lock_guard<std::mutex> flushLock(mFlushMutex);
+                mStop = true;
+            }
+            mFlushCondition.notify_one();
+            if(mFlusher.joinable()) mFlusher.join();
+
+            if(mTraceFile.is_open()) mTraceFile << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"PaintApp\"}}\n]\n";
+        }
+
+        TraceBuffer &GetThreadBuffer(){
+            //Keeps the buffer alive until the flusher has read it, even after its thread ends
+            struct ThreadBuffer{
+                std::shared_ptr<TraceBuffer> pBuffer;
+                ~ThreadBuffer(){
+                    if(pBuffer) pBuffer->retired.store(true, std::memory_order_release);
+                }
+            };
+            thread_local ThreadBuffer threadBuffer;
+
+            if(!threadBuffer.pBuffer){
+                threadBuffer.pBuffer = std::make_shared<TraceBuffer>();
+
+                std::lock_guard<std::mutex> buffersLock(mBuffersMutex);
+                threadBuffer.pBuffer->threadIndex = mNextThreadIndex++;
+                mBuffers.push_back(threadBuffer.pBuffer);
+            }
+            return *threadBuffer.pBuffer;
+        }
+
+        //Errors are written right away, instead of waiting for the next flush
+        void RequestFlush(){
+            mFlushCondition.notify_one();
+        }
+
+        private:
+
+        const std::uint64_t mStart;
+        std::ofstream mLogFile, mTraceFile;
+
+        std::mutex mBuffersMutex;
+        std::vector<std::shared_ptr<TraceBuffer>> mBuffers;
+        int mNextThreadIndex = 1;
+
+        std::thread mFlusher;
+        std::mutex mFlushMutex;
+        std::condition_variable mFlushCondition;
+        bool mStop = false;
+        static constexpr std::chrono::milliseconds M_FLUSH_INTERVAL{50};
+
+        struct Message{
+            TraceEvent header;
+            int threadIndex;
+            std::string text;
+        };
+        //Reused by every flush, so that the messages of all threads are printed in order
+        std::vector<Message> mMessages;
+
+        void Run(){
+            std::unique_lock<std::mutex> flushLock(mFlushMutex);
+            while(!mStop){
+                mFlushCondition.wait_for(flushLock, M_FLUSH_INTERVAL);
+
+                flushLock.unlock();
+                Flush();
+                flushLock.lock();
+            }
+
+            flushLock.unlock();
+            Flush();
+        }
+
+        void Flush(){
+            std::vector<std::shared_ptr<TraceBuffer>> buffers;
+            {
+                std::lock_guard<std::mutex> buffersLock(mBuffersMutex);
+                buffers = mBuffers;
+            }
+
+            for(auto &pBuffer : buffers) Drain(*pBuffer);
+
+            std::sort(mMessages.begin(), mMessages.end(), [](const Message &a, const Message &b){ return a.header.start < b.header.start; });
+            for(Message &message : mMessages) WriteMessage(message);
+            mMessages.clear();
+
+            std::cout << std::flush;
+            mLogFile << std::flush;
+            if(mTraceFile.is_open()) mTraceFile << std::flush;
+
+            //The buffers of the threads that ended are removed once they have been emptied
+            std::lock_guard<std::mutex> buffersLock(mBuffersMutex);
+            std::erase_if(mBuffers, [](const std::shared_ptr<TraceBuffer> &pBuffer){
+                return pBuffer->retired.load(std::memory_order_acquire) && pBuffer->head.load(std::memory_order_acquire) == pBuffer->tail.load(std::memory_order_relaxed);
+            });
+        }
+
+        void Drain(TraceBuffer &buffer){
+            if(mTraceFile.is_open() && !buffer.namedInTrace){
+                if(const char *pThreadName = buffer.pThreadName.load(std::memory_order_acquire)){
+                    mTraceFile << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.threadIndex << ",\"args\":{\"name\":\"";
+                    WriteEscaped(pThreadName);
+                    mTraceFile << "\"}},\n";
+                    buffer.namedInTrace = true;
+                }
+            }
+
+            size_t tail = buffer.tail.load(std::memory_order_relaxed);
+            size_t head = buffer.head.load(std::memory_order_acquire);
+
+            while(tail != head){
+                TraceEvent &event = buffer.Slot(tail++);
+                if(!event.isMessage){
+                    WriteSpan(event, buffer.threadIndex);
+                    continue;
+                }
+
+                Message &message = mMessages.emplace_back(Message{event, buffer.threadIndex, {}});
+                message.text.assign(event.text, std::min<size_t>(event.textLength, M_FIRST_SLOT_TEXT));
+                while(message.text.size() < event.textLength){
+                    const char *pText = reinterpret_cast<const char*>(&buffer.Slot(tail++));
+                    message.text.append(pText, std::min(sizeof(TraceEvent), event.textLength - message.text.size()));
+                }
+            }
+            buffer.tail.store(tail, std::memory_order_release);
+
+            size_t dropped = buffer.dropped.exchange(0, std::memory_order_relaxed);
+            if(dropped > 0){
+                std::cout << "[ERROR]\n\t" << dropped << " log entries of thread " << buffer.threadIndex << " were dropped, as its buffer was full\n";
+                mLogFile << "[ERROR]\n\t" << dropped << " log entries of thread " << buffer.threadIndex << " were dropped, as its buffer was full\n";
+            }
+        }
+
+        void WriteSpan(const TraceEvent &event, int threadIndex){
+            if(!mTraceFile.is_open()) return;
+
+            mTraceFile << "{\"name\":\"" << event.pName << "\",\"ph\":\"X\",\"ts\":" << ToMicroseconds(event.start) << ",\"dur\":" << (event.end - event.start)/1000.0
+                << ",\"pid\":1,\"tid\":" << threadIndex << "},\n";
+        }
+
+        void WriteMessage(const Message &message){
+            const char *pHeader = (message.header.level == LogLevel::ERRORS ? "[ERROR]\n" : "[Debug]\n");
+            for(std::ostream *pStream : {(std::ostream*)&std::cout, (std::ostream*)&mLogFile}){
+                *pStream << pHeader << "\tFunction: " << message.header.pName << ":\n\tLine: " << message.header.line << ":\n\t" << message.text << '\n';
+            }
+
+            //The messages also appear in the trace, as instant events
+            if(mTraceFile.is_open()){
+                mTraceFile << "{\"name\":\"";
+                WriteEscaped(message.text);
+                mTraceFile << "\",\"cat\":\"" << (message.header.level == LogLevel::ERRORS ? "error" : "debug") << "\",\"ph\":\"i\",\"s\":\"t\",\"ts\":"
+                    << ToMicroseconds(message.header.start) << ",\"pid\":1,\"tid\":" << message.threadIndex << "},\n";
+            }
+        }
+
+        void WriteEscaped(std::string_view text){
+            for(char character : text){
+                switch(character){
+                    case '"':  mTraceFile << "\\\""; break;
+                    case '\\': mTraceFile << "\\\\"; break;
+                    case '\n': mTraceFile << "\\n"; break;
+                    case '\t': mTraceFile << "\\t"; break;
+                    default:
+                        if((unsigned char)character < 0x20) mTraceFile << ' ';
+                        else mTraceFile << character;
+                        break;
+                }
+            }
+        }
+
+        double ToMicroseconds(std::uint64_t time){
+            return (double)(time - mStart)/1000.0;
+        }
+    };
+
+    Tracer &GetTracer(){
+        static Tracer tracer;
+        return tracer;
+    }
+}
+
+namespace tracing{
+    void RecordSpan(const char *pName, std::uint64_t start, std::uint64_t end){
+        TraceBuffer &buffer = GetTracer().GetThreadBuffer();
+        if(!buffer.Reserve(1)) return;
+
+        size_t head = buffer.head.load(std::memory_order_relaxed);
+        TraceEvent &event = buffer.Slot(head);
+        event.pName = pName;
+        event.start = start;
+        event.end = end;
+        event.isMessage = 0;
+        buffer.head.store(head+1, std::memory_order_release);
+    }
+
+    void RecordMessage(LogLevel level, std::string_view text, const std::source_location &location){
+        Tracer &tracer = GetTracer();
+        TraceBuffer &buffer = tracer.GetThreadBuffer();
+
+        text = text.substr(0, M_MAX_MESSAGE_LENGTH);
+        size_t extraSlots = (text.size() > M_FIRST_SLOT_TEXT ? (text.size() - M_FIRST_SLOT_TEXT + sizeof(TraceEvent)-1)/sizeof(TraceEvent) : 0);
+        if(!buffer.Reserve(1 + extraSlots)) return;
+
+        size_t head = buffer.head.load(std::memory_order_relaxed);
+        TraceEvent &event = buffer.Slot(head++);
+        event.pName = location.function_name();
+        event.start = event.end = Now();
+        event.line = location.line();
+        event.textLength = text.size();
+        event.isMessage = 1;
+        event.level = level;
+
+        size_t copied = std::min(text.size(), M_FIRST_SLOT_TEXT);
+        std::memcpy(event.text, text.data(), copied);
+        while(copied < text.size()){
+            size_t amount = std::min(sizeof(TraceEvent), text.size() - copied);
+            std::memcpy(&buffer.Slot(head++), text.data() + copied, amount);
+            copied += amount;
+        }
+        buffer.head.store(head, std::memory_order_release);
+
+        if(level == LogLevel::ERRORS) tracer.RequestFlush();
+    }
+
+    void SetThreadName(const char *pName){
+        GetTracer().GetThreadBuffer().pThreadName.store(pName, std::memory_order_release);
+    }
+}
+
+#ifndef NDEBUG
+#include <cstdlib>
+#include <new>
+
+//Per thread, so that the allocations of the other threads (stroke worker, pools, journal, tracer...) don't get blamed on the calling one
+static thread_local size_t allocationsCount = 0;
+
+size_t GetAllocationsCount(){
+    return allocationsCount;
+}
+
+//Every allocation goes through these in debug builds, so that they can be counted
+void *operator new(std::size_t size){
+    allocationsCount++;
+    if(void *pMemory = std::malloc(size == 0 ? 1 : size)) return pMemory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pMemory) noexcept{
+    std::free(pMemory);
+}
+
+void operator delete(void *pMemory, std::size_t) noexcept{
+    std::free(pMemory);
+}
+#endif
@@ -1,33 +1,97 @@
 #pragma once
-#include <iostream>
-#include <fstream>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sstream>
+#include <chrono>
+#include <type_traits>
 #include <source_location>
 
-static constexpr bool DEBUG_INFO = true; // true = Display debug info, false = Don't display debug info
+//Everything below the chosen level gets removed at compile time
+enum class LogLevel : std::uint8_t{
+    TRACING = 0,   //Timing spans (see TRACE_SCOPE), exported as a Chrome trace into Trace.json
+    DEBUGGING = 1, //DebugPrint messages
+    ERRORS = 2,    //ErrorPrint messages
+    NOTHING = 3
+};
+//The spans of every frame keep growing Trace.json, so tracing is only enabled by building with PAINTAPP_TRACING
+#ifdef PAINTAPP_TRACING
+static constexpr LogLevel MIN_LOG_LEVEL = LogLevel::TRACING;
+#else
+static constexpr LogLevel MIN_LOG_LEVEL = LogLevel::DEBUGGING;
+#endif
 
-extern std::ofstream logFile;
+static constexpr bool TRACE_INFO = (MIN_LOG_LEVEL <= LogLevel::TRACING); // true = Record timing spans, false = Don't record them
+static constexpr bool DEBUG_INFO = (MIN_LOG_LEVEL <= LogLevel::DEBUGGING); // true = Display debug info, false = Don't display debug info
 
-template <typename T>
-void PrintWithoutHeader(T val, std::source_location location = std::source_location::current()){
-    std::cout << "\tFunction: " << location.function_name() << ":\n\tLine: " << location.line() << ":\n\t"<< val << '\n';
-    logFile << "\tFunction: "<< location.function_name() << ":\n\tLine: " << location.line() << ":\n\t"<< val << '\n' <<std::flush;
+//Every thread writes its messages and spans into its own lock free ring buffer, so logging never waits for the console nor the files
+//A background thread empties the buffers every few milliseconds, printing the messages into the console and DebugLog.txt and exporting everything into Trace.json
+//If a buffer is full the new entries are dropped (and counted) instead of waiting
+namespace tracing{
+    //Nanoseconds of a monotonic clock
+    inline std::uint64_t Now(){
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    //'pName' must have static storage (e.g: a string literal)
+    void RecordSpan(const char *pName, std::uint64_t start, std::uint64_t end);
+    void RecordMessage(LogLevel level, std::string_view text, const std::source_location &location);
+
+    //Names the calling thread in the trace. 'pName' must have static storage
+    void SetThreadName(const char *pName);
+
+    template <typename T>
+    void Log(LogLevel level, const T &val, const std::source_location &location){
+        if constexpr (std::is_convertible_v<const T&, std::string_view>){
+            RecordMessage(level, val, location);
+        } else {
+            //Only for the values that aren't text already
+            thread_local std::ostringstream stream;
+            stream.str("");
+            stream << val;
+            RecordMessage(level, stream.view(), location);
+        }
+    }
 }
 
-//Prints 'val' to the console as a Debug message 
+//Measures the time between its construction and destruction, use it through TRACE_SCOPE
+class TraceSpan{
+    public:
+
+    explicit TraceSpan(const char *pName) : mpName(pName){
+        if constexpr (TRACE_INFO) mStart = tracing::Now();
+    }
+    ~TraceSpan(){
+        if constexpr (TRACE_INFO) tracing::RecordSpan(mpName, mStart, tracing::Now());
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan &operator=(const TraceSpan&) = delete;
+
+    private:
+
+    const char *mpName;
+    std::uint64_t mStart = 0;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+//Records a span with the given name (a string literal) that lasts until the end of the current scope
+#define TRACE_SCOPE(name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+
+//Prints 'val' to the console as a Debug message
 template <typename T>
-void DebugPrint(T val, std::source_location location = std::source_location::current()){
-    if(!DEBUG_INFO) return;
-    
-    std::cout<<"[Debug]\n";
-    logFile<<"[Debug]\n";
-    PrintWithoutHeader(val, location);
+void DebugPrint(const T &val, std::source_location location = std::source_location::current()){
+    if constexpr (DEBUG_INFO) tracing::Log(LogLevel::DEBUGGING, val, location);
 }
 
-//Prints 'val' to the console as an Error message 
+//Prints 'val' to the console as an Error message
 template <typename T>
-void ErrorPrint(T val, std::source_location location = std::source_location::current()){
-    std::cout<<"[ERROR]\n";
-    logFile<<"[ERROR]\n";
-    PrintWithoutHeader(val, location);
-    //std::cin.get(); //Pauses executable
-}
\ No newline at end of file
+void ErrorPrint(const T &val, std::source_location location = std::source_location::current()){
+    if constexpr (MIN_LOG_LEVEL <= LogLevel::ERRORS) tracing::Log(LogLevel::ERRORS, val, location);
+}
+
+#ifndef NDEBUG
+//Returns how many times operator new has been called by the calling thread since it started. Only available in debug builds, used to check that code that shouldn't allocate doesn't
+size_t GetAllocationsCount();
+#endif
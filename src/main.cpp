@@ -1,8 +1,10 @@
 #include <iostream>
 #include <span>
+#include <string_view>
 #include "logger.hpp"
 #include "renderLib.hpp"
 #include "engineInternals.hpp"
+#include "sessionRecorder.hpp"
 
 bool InitializeDependencies();
 
@@ -10,7 +12,18 @@ int main(int argc, char* args[]){
     if(!InitializeDependencies()) return -1;
 
 	{
-		AppManager appWindow = AppManager(1000, 500, SDL_WINDOW_RESIZABLE | SDL_WINDOW_MAXIMIZED, "Tools");
+		//Replayed sessions and benchmarks aren't drawn, so there is no need to show the window
+		bool headless = (argc == 3 && std::string_view(args[1]) == "--replay") || FindBenchmark(std::span{args, (size_t)argc}) != nullptr;
+		Uint32 windowFlags = (headless ? SDL_WINDOW_HIDDEN : SDL_WINDOW_RESIZABLE | SDL_WINDOW_MAXIMIZED);
+
+		//A replay is laid out like the recorded window, so that its mouse events land on the same pixels
+		SDL_Point windowSize = {1000, 500};
+		if(argc == 3 && std::string_view(args[1]) == "--replay"){
+			SessionReader reader(args[2]);
+			if(reader.IsOpen()) windowSize = reader.GetWindowSize();
+		}
+
+		AppManager appWindow = AppManager(windowSize.x, windowSize.y, windowFlags, "Tools");
 		MainLoop(appWindow, std::span{args, (size_t)argc});
 	}
 
@@ -21,7 +21,6 @@ void ConstantText::Reset(const char *pText, std::shared_ptr<TTF_Font> pFont){
 	TTF_SizeText(pFont.get(), pText, &mTextSize.x, &mTextSize.y);
 	
 	mpActualText = pText;
-	mUpdateText = true;
 }
 
 void ConstantText::SetX(int x){
@@ -46,10 +45,9 @@ SDL_Rect ConstantText::GetDimensions(){
 }
 
 void ConstantText::Draw(SDL_Renderer *pRenderer){
-	if(mUpdateText){
-		mpTextTexture.reset(LoadTextureFromText(mpActualText.c_str(), pRenderer, mpFont.get()));
+	if(GlyphAtlas *pAtlas = GlyphAtlas::Get(pRenderer, mpFont.get(), mDimensions.h)){
+		pAtlas->DrawText(pRenderer, mpActualText, mDimensions.x, mDimensions.y, mDimensions.h, SDL_Color{0, 0, 0, SDL_ALPHA_OPAQUE});
 	}
-	SDL_RenderCopy(pRenderer, mpTextTexture.get(), nullptr, &mDimensions);
 }
 
 //TEXT FIELD METHODS:
@@ -82,7 +80,11 @@ void TextField::SetText(std::string_view nTextString){
 
 	if(sanitizedString != mTextString){
 		mUpdateText = true;
+
+		//Only the widths after the first byte that differs need to be recalculated
+		size_t firstChanged = std::mismatch(sanitizedString.begin(), sanitizedString.end(), mTextString.begin(), mTextString.end()).first - sanitizedString.begin();
 		mTextString = sanitizedString;
+		UpdatePrefixWidths(firstChanged);
 	}
 
 	mCursor.SetPotition(std::clamp(mCursor.GetPosition(), 0, (int)mTextString.size()));
@@ -135,6 +137,7 @@ bool TextField::HandleEvent(SDL_Event *event){
 		if(SDL_PointInRect(&mousePos, &dimensions)){
 			mSelected = true;
 			TextInputManager::SetRequester(this);
+			mCursor.SetPotition(GetPositionAt(mousePos.x - dimensions.x));
 		} else {
 			mSelected = false;
 			TextInputManager::UnsetRequester(this);
@@ -203,28 +206,27 @@ void TextField::Update(float deltaTime){
 }
 
 void TextField::Draw(SDL_Renderer *pRenderer){
-	SDL_Rect cursorDimensions = {-1, -1, -1, -1};
-	if(mUpdateText){
-		if(!mTextString.empty()) mpTextTexture.reset(LoadTextureFromText(mTextString.c_str(), pRenderer, mpFont.get(), mTextColor));
-		//If the text is empty, it renders the blank text
-		else					 mpTextTexture.reset(LoadTextureFromText(mBlankText.c_str(), pRenderer, mpFont.get(), {150, 150, 150}));
-
-		mUpdateText = false; 
-	}
+	//The text is drawn from the glyph atlas, so a change in it only needs to be noticed until the next draw
+	mUpdateText = false;
 	
 	//It doesn't make sense to keep rendering if the size is less or equal to 0
 	if(dimensions.w <= 0 || dimensions.h <= 0){
 		return;
 	}
 
-	int textW, textH; 
+	GlyphAtlas *pAtlas = GlyphAtlas::Get(pRenderer, mpFont.get(), dimensions.h);
+	if(pAtlas == nullptr) return;
 
-	if(!mTextString.empty()) {
-		TTF_SizeUTF8(mpFont.get(), mTextString.c_str(), &textW, &textH);
-	} else {
-		TTF_SizeUTF8(mpFont.get(), mBlankText.c_str(), &textW, &textH);
+	//The widths are measured with the atlas that draws the text, so they are measured again when its height changes
+	if(mAtlasHeight != dimensions.h){
+		mAtlasHeight = dimensions.h;
+		UpdatePrefixWidths(0);
 	}
 
+	//If the text is empty, it renders the blank text
+	const bool showBlankText = mTextString.empty();
+	std::string_view displayedText = showBlankText ? mBlankText : mTextString;
+
 	if(displayBackground){
 		SDL_Color background = {215, 215, 215};
 		if(mTextColor.r + mTextColor.g + mTextColor.b > 382) background = {50, 50, 50};
@@ -238,7 +240,6 @@ void TextField::Draw(SDL_Renderer *pRenderer){
 	}
 
 	const float TEXT_X_PADDING = dimensions.h/6.25f;
-	SDL_Rect textRect = {(int)TEXT_X_PADDING, 0, (textW*dimensions.h)/textH, dimensions.h};
 	
 	SDL_Rect previousViewport;
 	SDL_RenderGetViewport(pRenderer, &previousViewport);
@@ -248,17 +249,71 @@ void TextField::Draw(SDL_Renderer *pRenderer){
 	//First we check if the text is supposed to render (aka is inside the viewport)
 	if(SDL_Rect resultingDimensions; SDL_IntersectRect(&previousViewport, &realDimensions, &resultingDimensions) == SDL_TRUE){
 		SDL_RenderSetViewport(pRenderer, &resultingDimensions);
-		SDL_RenderCopy(pRenderer, mpTextTexture.get(), nullptr, &textRect);
+		pAtlas->DrawText(pRenderer, displayedText, (int)TEXT_X_PADDING, 0, dimensions.h, showBlankText ? SDL_Color{150, 150, 150, SDL_ALPHA_OPAQUE} : mTextColor);
 
 		//Easy way of removing the cursor on sliders, may be changed into the future (maybe by changing what sliders use to display value in text, maybe by letting them be interactable, maybe doesnby having its own bool)
 		if(displayBackground && mSelected){
-			mCursor.Draw(pRenderer, mTextColor, dimensions.h, mpFont.get(), mTextString);
+			mCursor.Draw(pRenderer, mTextColor, dimensions.h, mTextPrefixWidths[mCursor.GetPosition()], pAtlas->GetHeight());
 		}
 
 		SDL_RenderSetViewport(pRenderer, &previousViewport);
 	}
 }
 
+void TextField::UpdatePrefixWidths(size_t firstChanged){
+	//We start from the beginning of the character holding the first changed byte
+	while(firstChanged > 0 && firstChanged < mTextString.size() && (mTextString[firstChanged] & 0xC0) == 0x80) firstChanged--;
+	firstChanged = std::min(firstChanged, mTextString.size());
+
+	mTextPrefixWidths.resize(mTextString.size()+1);
+
+	//Until the text is drawn there's no atlas to measure it with, Draw measures all of it once there is
+	GlyphAtlas *pAtlas = GlyphAtlas::Find(mpFont.get(), mAtlasHeight);
+	if(pAtlas == nullptr){
+		std::fill(mTextPrefixWidths.begin(), mTextPrefixWidths.end(), 0);
+		return;
+	}
+
+	//The first changed character is kerned with the one before it
+	Uint32 previous = 0;
+	if(firstChanged > 0){
+		size_t previousStart = firstChanged-1;
+		while(previousStart > 0 && (mTextString[previousStart] & 0xC0) == 0x80) previousStart--;
+		previous = GlyphAtlas::DecodeUTF8(mTextString, previousStart);
+	}
+
+	for(size_t i = firstChanged, next = i; i < mTextString.size(); i = next){
+		Uint32 character = GlyphAtlas::DecodeUTF8(mTextString, next);
+
+		//The same spacing as the one used by the glyph atlas when drawing
+		int advance = pAtlas->GetKerning(previous, character) + pAtlas->GetAdvance(character);
+		previous = character;
+
+		for(size_t j = i+1; j < next; j++) mTextPrefixWidths[j] = mTextPrefixWidths[i];
+		mTextPrefixWidths[next] = mTextPrefixWidths[i] + advance;
+	}
+}
+
+int TextField::GetPositionAt(int x){
+	GlyphAtlas *pAtlas = GlyphAtlas::Find(mpFont.get(), mAtlasHeight);
+	if(dimensions.h <= 0 || pAtlas == nullptr) return 0;
+
+	//We transform x into the scale of the atlas, which is the one used by the prefix widths
+	const float TEXT_X_PADDING = dimensions.h/6.25f;
+	int fontX = (int)((x - TEXT_X_PADDING) * pAtlas->GetHeight() / dimensions.h);
+
+	//The first position whose width reaches x, as the widths are sorted. Bytes in the middle of a character share the width of its first byte, so the result is always a character boundary
+	auto it = std::lower_bound(mTextPrefixWidths.begin(), mTextPrefixWidths.end(), fontX);
+	if(it == mTextPrefixWidths.end()) return mTextString.size();
+
+	int position = it - mTextPrefixWidths.begin();
+	if(position == 0) return 0;
+
+	//We choose the closest boundary between this one and the previous character's one
+	int previous = std::lower_bound(mTextPrefixWidths.begin(), mTextPrefixWidths.end(), mTextPrefixWidths[position-1]) - mTextPrefixWidths.begin();
+	return (fontX - mTextPrefixWidths[previous] < *it - fontX) ? previous : position;
+}
+
 bool TextField::IsValidNumber(){
 	if(mTextString.empty()) return false;
 	switch (mTextFormat)
@@ -382,17 +437,13 @@ void TextField::Cursor::IncreasePosition(int minPosition, int maxPosition, int a
 	}
 }
 
-void TextField::Cursor::Draw(SDL_Renderer* pRenderer, SDL_Color cursorColor, int height, TTF_Font *pFont, const std::string& text){
+void TextField::Cursor::Draw(SDL_Renderer* pRenderer, SDL_Color cursorColor, int height, int prefixWidth, int fontHeight){
 	//May change into the future, making it a parametter or a constexpr function
 	const int TEXT_X_PADDING = height/6.25f;
 
 	SDL_Rect cursorDimensions = {TEXT_X_PADDING, 0, 2, height};
 
-	if(!text.empty()) {
-		int textW, textH;
-		TTF_SizeUTF8(pFont, text.substr(0, mPosition).c_str(), &textW, &textH);
-		cursorDimensions.x += (textW*height)/textH;
-	}
+	if(fontHeight > 0) cursorDimensions.x += (prefixWidth*height)/fontHeight;
 
 	//We don't use the alpha value because it aready has no effect on the text
 	SDL_SetRenderDrawColor(pRenderer, cursorColor.r, cursorColor.g, cursorColor.b, SDL_ALPHA_OPAQUE);
@@ -770,36 +821,36 @@ bool Option::HandleEvent(SDL_Event *event){
 	switch(mInputMethod){
 		case InputMethod::TEXT_FIELD:
 			eventHandled = input.mpTextField->HandleEvent(event);
-			if(input.mpTextField->HasChanged()) mModified = true;
+			if(input.mpTextField->HasChanged()) SetModified();
 			break;
 		case InputMethod::HEX_TEXT_FIELD:
 			eventHandled = input.mpTextField->HandleEvent(event);
-			if(input.mpTextField->HasChanged() && input.mpTextField->IsValidColor()) mModified = true;
+			if(input.mpTextField->HasChanged() && input.mpTextField->IsValidColor()) SetModified();
 			break;
 
 		case InputMethod::WHOLE_TEXT_FIELD:
 			eventHandled = input.mpTextField->HandleEvent(event);
-			if(input.mpTextField->HasChanged() && input.mpTextField->IsValidNumber()) mModified = true;
+			if(input.mpTextField->HasChanged() && input.mpTextField->IsValidNumber()) SetModified();
 			break;
 
 		case InputMethod::SLIDER:
 			eventHandled = input.mpSlider->HandleEvent(event);
-			if(eventHandled && input.mpSlider->HasChanged()) mModified = true;
+			if(eventHandled && input.mpSlider->HasChanged()) SetModified();
 			break;
 
 		case InputMethod::CHOICES_ARRAY:
 			eventHandled = input.mpChoicesArray->HandleEvent(event);
-			if(eventHandled) mModified = true;
+			if(eventHandled) SetModified();
 			break;
 
 		case InputMethod::TICK:
 			eventHandled = input.mpTickButton->HandleEvent(event);
-			if(eventHandled) mModified = true;
+			if(eventHandled) SetModified();
 			break;
 
 		case InputMethod::ACTION:
 			eventHandled = input.mpActionButton->HandleEvent(event);
-			if(eventHandled) mModified = true;
+			if(eventHandled) SetModified();
 			break;
 	}
 
@@ -809,6 +860,10 @@ bool Option::HandleEvent(SDL_Event *event){
 		*eventMouseY = originalMousePosition.x;
 	}
 
+	//Releasing the mouse resets the look of held buttons, and keys move the cursor of a selected text field without the event being considered handled
+	bool isTypingInto = event->type == SDL_KEYDOWN && (mInputMethod == InputMethod::TEXT_FIELD || mInputMethod == InputMethod::HEX_TEXT_FIELD || mInputMethod == InputMethod::WHOLE_TEXT_FIELD) && TextInputManager::IsRequester(input.mpTextField);
+	if(eventHandled || wasOptionClicked || isTypingInto || event->type == SDL_MOUSEBUTTONUP) mNeedsRedraw = true;
+
 	return eventHandled || wasOptionClicked;
 }
 void Option::Draw(SDL_Renderer *pRenderer){
@@ -946,7 +1001,7 @@ void Option::SetY(int nY){
 }
 
 void Option::SetOptionText(const char *pNewText){
-	
+	mNeedsRedraw = true;
 	mOptionText.reset(new ConstantText(pNewText, mpOptionsFont));
 	mOptionText->SetX(MIN_SPACE);
 	mOptionText->SetY(MIN_SPACE);
@@ -1029,6 +1084,83 @@ void Option::FetchInfo(std::string_view info){
 	Option::OptionCommands::UnloadCommands();
 }
 
+void Option::ApplyCommand(const OptionCommand &command){
+	mNeedsRedraw = true;
+
+	switch(command.operation){
+		case OptionCommand::Operation::SET_ACTIVE:
+			if(auto nActive = std::get_if<bool>(&command.value)) mActive = *nActive;
+			else ErrorPrint("id " + std::to_string(std::to_underlying(mOptionID))+" received a SET_ACTIVE command without a bool value");
+			return;
+		case OptionCommand::Operation::SET_SLIDER_MIN:
+		case OptionCommand::Operation::SET_SLIDER_MAX:{
+			auto nLimit = std::get_if<float>(&command.value);
+			if(mInputMethod != InputMethod::SLIDER || nLimit == nullptr){
+				ErrorPrint("id " + std::to_string(std::to_underlying(mOptionID))+" is not a slider or got a non float limit, inputMethod: "+std::to_string(std::to_underlying(mInputMethod)));
+				return;
+			}
+			if(command.operation == OptionCommand::Operation::SET_SLIDER_MIN) input.mpSlider->SetMinValue(*nLimit);
+			else input.mpSlider->SetMaxValue(*nLimit);
+			return;
+		}
+		case OptionCommand::Operation::SET_VALUE:
+			break;
+	}
+
+	//The text is written into a buffer in the stack, a hex color needs 6 characters and an int at most 11
+	char text[12];
+	bool validValue = true;
+
+	switch(mInputMethod){
+		case InputMethod::HEX_TEXT_FIELD:
+			if(auto nColor = std::get_if<SDL_Color>(&command.value)){
+				constexpr char digits[] = "0123456789abcdef";
+				const Uint8 channels[3] = {nColor->r, nColor->g, nColor->b};
+				for(int i = 0; i < 3; i++){
+					text[i*2] = digits[channels[i] >> 4];
+					text[i*2+1] = digits[channels[i] & 0x0f];
+				}
+				input.mpTextField->SetText(std::string_view(text, 6));
+			} else validValue = false;
+			break;
+		case InputMethod::WHOLE_TEXT_FIELD:
+			if(auto nWhole = std::get_if<int>(&command.value)){
+				auto result = std::to_chars(text, text+sizeof(text), *nWhole);
+				input.mpTextField->SetText(std::string_view(text, result.ptr));
+			} else validValue = false;
+			break;
+		case InputMethod::SLIDER:
+			if(auto nSliderValue = std::get_if<float>(&command.value)) input.mpSlider->SetValue(*nSliderValue);
+			else if(auto nWhole = std::get_if<int>(&command.value)) input.mpSlider->SetValue(*nWhole);
+			else validValue = false;
+			break;
+		case InputMethod::CHOICES_ARRAY:
+			if(auto nChosen = std::get_if<int>(&command.value)) input.mpChoicesArray->UncheckedSetLastChosenOption(*nChosen);
+			else validValue = false;
+			break;
+		case InputMethod::TICK:
+			if(auto nTick = std::get_if<bool>(&command.value)) input.mpTickButton->SetValue(*nTick);
+			else validValue = false;
+			break;
+		case InputMethod::ACTION:
+			//A true value works as if the button was clicked
+			if(auto nClicked = std::get_if<bool>(&command.value)){
+				if(!*nClicked) return;
+			} else validValue = false;
+			break;
+		default:
+			//Plain text fields can't be set through typed commands, as the text would need an allocation
+			validValue = false;
+			break;
+	}
+
+	if(!validValue){
+		ErrorPrint("id " + std::to_string(std::to_underlying(mOptionID))+" can't take a value of variant index "+std::to_string(command.value.index())+", inputMethod: "+std::to_string(std::to_underlying(mInputMethod)));
+		return;
+	}
+	SetModified();
+}
+
 bool Option::HasTag(Tag tag){
 	return (std::to_underlying(tag) == (std::to_underlying(tag) & std::to_underlying(mTags)));
 }
@@ -1043,6 +1175,9 @@ Option::Tag Option::PrimitiveToTag(unsigned int primitive){
 		case 1: return Tag::ERASER_OPTION;
 		case 2: return Tag::COLOR_PICKER_OPTION;
 		case 3: return Tag::AREA_DELIMITER_OPTION;
+		case 4: return Tag::BUCKET_FILL_OPTION;
+		case 5: return Tag::SMUDGE_OPTION;
+		case 6: return Tag::CLONE_STAMP_OPTION;
 		default: ErrorPrint("The tag "+std::to_string(primitive)+" doesn't exist"); return Tag::NONE;
 	}
 }
@@ -1051,37 +1186,65 @@ void Option::SetOptionsFont(std::shared_ptr<TTF_Font> npOptionsFont){
     mpOptionsFont.reset(npOptionsFont.get(), PointerDeleter{});
 }
 
-OptionInfo *Option::GetData(){
+bool Option::GetData(OptionInfo &data){
 	if(mModified) mModified = false;
-	else return new OptionInfo();
+	else return false;
+
+	data.optionID = mOptionID;
 
 	switch(mInputMethod){
 		case InputMethod::TEXT_FIELD:
-			return new OptionInfo(mOptionID, std::string(input.mpTextField->GetText()));
+			//The string already held by data is reused when possible, to avoid allocating
+			if(auto text = std::get_if<std::string>(&data.data)) text->assign(input.mpTextField->GetText());
+			else data.data.emplace<std::string>(input.mpTextField->GetText());
+			return true;
 
 		case InputMethod::HEX_TEXT_FIELD:
-			return new OptionInfo(mOptionID, input.mpTextField->GetAsColor(nullptr));
+			data.data = input.mpTextField->GetAsColor(nullptr);
+			return true;
 
 		case InputMethod::WHOLE_TEXT_FIELD:
-			return new OptionInfo(mOptionID, input.mpTextField->GetAsNumber(nullptr));
+			data.data = input.mpTextField->GetAsNumber(nullptr);
+			return true;
 
 		case InputMethod::SLIDER:
-			return new OptionInfo(mOptionID, input.mpSlider->GetValue());
+			data.data = input.mpSlider->GetValue();
+			return true;
 
 		case InputMethod::CHOICES_ARRAY:
-			return new OptionInfo(mOptionID, input.mpChoicesArray->GetLastChosenOption());
+			data.data = input.mpChoicesArray->GetLastChosenOption();
+			return true;
 
 		case InputMethod::TICK:
-			return new OptionInfo(mOptionID, input.mpTickButton->GetValue());
+			data.data = input.mpTickButton->GetValue();
+			return true;
 
 		case InputMethod::ACTION:
-			return new OptionInfo(mOptionID, true);
+			data.data = true;
+			return true;
 
 		default:
-			return new OptionInfo();
+			return false;
 	}
 }
 
+void Option::SetModified(){
+	if(!mModified && mpChangedOptions != nullptr) mpChangedOptions->push_back(this);
+	mModified = true;
+	mNeedsRedraw = true;
+}
+
+bool Option::TakeNeedsRedraw(){
+	bool needsRedraw = mNeedsRedraw;
+	mNeedsRedraw = false;
+	return needsRedraw;
+}
+
+void Option::SetChangedOptionsBuffer(std::vector<Option*> *npChangedOptions){
+	mpChangedOptions = npChangedOptions;
+	if(mModified && mpChangedOptions != nullptr) mpChangedOptions->push_back(this);
+}
+
 void Option::HandleInfo(std::string_view info){
 	//If there is no information to handle, we just return
 	if(info.empty()) return;
@@ -1238,7 +1401,7 @@ void Option::OptionCommands::SetInitialValue(Option *pOption, std::string_view n
 			ErrorPrint("Option doesn't have a valid input method, value: "+std::string(nValue));
 			return;
 	}
-	pOption->mModified = true;
+	pOption->SetModified();
 }
         
 void Option::OptionCommands::SetOptionText(Option *pOption, std::string_view nOptionText){
@@ -1310,4 +1473,27 @@ void Option::OptionCommands::SetDefaultText(Option *pOption, std::string_view nD
 
 void Option::OptionCommands::UnusableInfo(Option *pOption, std::string_view nUnusableInfo){
 	ErrorPrint("id "+std::to_string(std::to_underlying(pOption->mOptionID))+" found some garbage \'"+std::string(nUnusableInfo.data(), nUnusableInfo.data()+nUnusableInfo.size())+'\'');
+}
+
+//OPTION COMMAND QUEUE METHODS:
+
+bool OptionCommandQueue::Push(const OptionCommand &command){
+	if(mSize == M_CAPACITY) return false;
+
+	mCommands[(mFirst+mSize)%M_CAPACITY] = command;
+	mSize++;
+	return true;
+}
+
+bool OptionCommandQueue::Pop(OptionCommand &command){
+	if(mSize == 0) return false;
+
+	command = mCommands[mFirst];
+	mFirst = (mFirst+1)%M_CAPACITY;
+	mSize--;
+	return true;
+}
+
+bool OptionCommandQueue::IsEmpty(){
+	return mSize == 0;
 }
\ No newline at end of file
@@ -12,6 +12,7 @@
 #include <variant>
 #include <unordered_map>
 #include <functional>
+#include <array>
 
 //A class that holds and displays a given text. It can be moved and its dimensions can be resized
 class ConstantText{
@@ -32,20 +33,16 @@ class ConstantText{
     int GetWidth();
     SDL_Rect GetDimensions();
 
-    //Creates the texture, if needed, and displays the text into the renderer, on the set coordinates
+    //Displays the text into the renderer, on the set coordinates, using the glyph atlas of the font
     void Draw(SDL_Renderer *pRenderer);
 
     private:
 
-    //When set to true, calling draw will (once) create a texture from the text using the font
-    bool mUpdateText = false;
-    //The text that gets displayed, in a string format. Used to allow the creation of the texture in Draw, instead of having to pass the renderer to the constructor / Reset method
+    //The text that gets displayed
     std::string mpActualText;
-    //The font used in order to create the texture. Used to allow the creation of the texture in Draw, instead of having to pass the renderer to the constructor / Reset method
+    //The font whose glyph atlas is used to draw the text. Kept so that the atlas can be obtained in Draw, instead of having to pass the renderer to the constructor / Reset method
     std::shared_ptr<TTF_Font> mpFont;
-    //The texture
-    std::unique_ptr<SDL_Texture, PointerDeleter> mpTextTexture;
-    //The actual width and height in pixels of the texture
+    //The actual width and height in pixels of the text
     SDL_Point mTextSize = {0, 0};
     //The coordinates and sizes used for displaying the text
     SDL_Rect mDimensions = {0, 0, 0, 0};
@@ -113,7 +110,7 @@ class TextField{
     //Returns a string view to the inputted text
     std::string_view GetText();
 
-    //Returns true if the function text texture is going to get updated the next time Draw is called
+    //Returns true if the text has changed since the last time Draw was called
     bool HasChanged();
 
     bool HandleEvent(SDL_Event *event);
@@ -144,7 +141,8 @@ class TextField{
             void DecreasePosition(int minPosition, int maxPosition, int amount = 1);
             void IncreasePosition(int minPosition, int maxPosition, int amount = 1);
 
-            void Draw(SDL_Renderer* pRenderer, SDL_Color cursorColor, int height, TTF_Font *pFont, const std::string& text);
+            //prefixWidth is the width of the text before the cursor, at the size of the atlas whose height is fontHeight
+            void Draw(SDL_Renderer* pRenderer, SDL_Color cursorColor, int height, int prefixWidth, int fontHeight);
 
         private:
         
@@ -161,18 +159,25 @@ class TextField{
     //Contains the text currently inputed into the TextField
     std::string mTextString;
 
-    //The font used to update the texture
+    //mTextPrefixWidths[i] holds the width, at the size of the atlas that draws the text, of the first i bytes of mTextString. Bytes in the middle of a UTF-8 character share the value of its first byte
+    //It only gets recalculated from the first byte that changes, so that the cursor and clicks don't need to measure the text
+    std::vector<int> mTextPrefixWidths = {0};
+    int mAtlasHeight = 0; //The height the atlas of the prefix widths was requested with, set by Draw
+
+    //Recalculates mTextPrefixWidths from the given byte until the end of mTextString
+    void UpdatePrefixWidths(size_t firstChanged);
+    //Returns the cursor position closest to x, which is relative to the left side of the TextField
+    int GetPositionAt(int x);
+
+    //The font whose glyph atlas is used to draw the text
     std::shared_ptr<TTF_Font> mpFont;
     
     //Used to handle text input
     bool mSelected = false;
 
-    //When true, Draw updates the  mpTextTexture
+    //Set to true when the text changes, and back to false in Draw
     bool mUpdateText = true;
 
-    //The texture of the text
-    std::unique_ptr<SDL_Texture, PointerDeleter> mpTextTexture;
-
     //The color used to draw the inputted text
     SDL_Color mTextColor = {0, 0, 0, SDL_ALPHA_OPAQUE};
 };
@@ -300,6 +305,13 @@ struct OptionInfo{
         SOFT_ALPHA_CALCULATION = 4,
         AREA_WRAP_AROUND = 5,
         AREA_DRAW_OUTLINE = 6,
+        FILL_TOLERANCE = 7,
+        FILL_SAMPLE_MERGED = 8,
+        AREA_RESTRICT = 9,
+        AREA_SMOOTH_EDGES = 10,
+        AREA_FILL = 11,
+        SMUDGE_STRENGTH = 12,
+        CLONE_SAMPLE_MERGED = 13,
         
         CHOOSE_TOOL = 20,
 
@@ -308,6 +320,12 @@ struct OptionInfo{
         SELECT_LAYER = 52,
         SHOW_LAYER = 53,
         LAYER_ALPHA = 54,
+        LAYER_BLEND_MODE = 55,
+
+        FILTER_TYPE = 60,
+        FILTER_RADIUS = 61,
+        FILTER_AMOUNT = 62,
+        FILTER_APPLY = 63,
         
         NEW_CANVAS_WIDTH = 100,
         NEW_CANVAS_HEIGHT = 101,
@@ -373,6 +391,8 @@ struct OptionInfo{
     }
 };
 
+struct OptionCommand;
+
 class Option{
     public:
     enum class InputMethod{
@@ -392,7 +412,10 @@ class Option{
         PENCIL_OPTION = 0x01,
         ERASER_OPTION = 0x02,
         COLOR_PICKER_OPTION = 0x04,
-        AREA_DELIMITER_OPTION = 0x08
+        AREA_DELIMITER_OPTION = 0x08,
+        BUCKET_FILL_OPTION = 0x10,
+        SMUDGE_OPTION = 0x20,
+        CLONE_STAMP_OPTION = 0x40
     };
 
     Option(int nTextWidth, SDL_Rect nDimensions, std::string_view nInfo = "");
@@ -413,6 +436,9 @@ class Option{
 
     void FetchInfo(std::string_view info);
 
+    //Typed counterpart of FetchInfo, used at runtime so that no text has to be built nor parsed
+    void ApplyCommand(const OptionCommand &command);
+
     //Returns a value of type Tag that holds all the tags passed as parametters
     //static Tag ComposeTag();
     //Returns true if the option has the given tag, even if combined with others. Returns false if the given tag, or part of it, can't be found on the option
@@ -441,6 +467,12 @@ class Option{
     //Gets set to true when any relevant data gets changed and therefore should be applied (example, activating a button to change from pencil to eraser)
     bool mModified = false;
 
+    //Set by the window holding the option. The option appends itself to it when it gets modified, so that only changed options need to be visited
+    std::vector<Option*> *mpChangedOptions = nullptr;
+
+    //Set to true whenever the look of the option may have changed, so that the window holding it knows it has to be drawn again
+    bool mNeedsRedraw = true;
+
     //If set to false, functions like Draw or HandleEvent will immediately return, in the latter the value returned is 'false'
     bool mActive = true;
 
@@ -464,7 +496,15 @@ class Option{
     //TODO probably change, I don't think we just want to use hard coded values
     static constexpr int MIN_SPACE = 3;
 
-    OptionInfo *GetData();
+    //Returns false if the option wasn't modified since the last call. Otherwise, data gets set to the current value and true is returned
+    bool GetData(OptionInfo &data);
+
+    //Sets mModified (and mNeedsRedraw) and, if it wasn't already set, appends the option to mpChangedOptions
+    void SetModified();
+    //Returns mNeedsRedraw, setting it back to false
+    bool TakeNeedsRedraw();
+    //The buffer must have room for each option of the window twice (an option may get modified again while the buffer is being processed). If the option was already modified, it gets appended
+    void SetChangedOptionsBuffer(std::vector<Option*> *npChangedOptions);
 
     void HandleInfo(std::string_view info);
     void SetInputMethod(InputMethod nInputMethod);
@@ -500,4 +540,52 @@ class Option{
 
     //TODO: only a friend because of the Load/Unload Commands, eventually will be changed
     friend class AppManager;
-};
\ No newline at end of file
+};
+
+//A single command for an option (or for every option with a given tag), equivalent to one of the text commands used by the InternalData files
+struct OptionCommand{
+    enum class Operation : Uint8{
+        SET_ACTIVE, //Same as 'Active', uses a bool value
+        SET_VALUE, //Same as 'InitialValue', the value type depends on the input method (see OptionInfo's typedefs)
+        SET_SLIDER_MIN, //Same as 'SliderMin', uses a float value
+        SET_SLIDER_MAX //Same as 'SliderMax', uses a float value
+    };
+
+    //Only types that don't allocate are allowed, so that the commands can be stored in a fixed ring. Plain text fields can't be set this way
+    using value_t = std::variant<std::monostate, SDL_Color, float, int, bool>;
+
+    Operation operation;
+
+    //If tag is not Tag::NONE the command applies to every option holding it and optionID is ignored
+    OptionInfo::OptionIDs optionID;
+    Option::Tag tag;
+
+    value_t value;
+
+    static OptionCommand SetActive(OptionInfo::OptionIDs nOptionID, bool nActive){return {Operation::SET_ACTIVE, nOptionID, Option::Tag::NONE, nActive};}
+    static OptionCommand SetActive(Option::Tag nTag, bool nActive){return {Operation::SET_ACTIVE, (OptionInfo::OptionIDs)(-1), nTag, nActive};}
+    static OptionCommand SetValue(OptionInfo::OptionIDs nOptionID, value_t nValue){return {Operation::SET_VALUE, nOptionID, Option::Tag::NONE, nValue};}
+    static OptionCommand SetSliderMin(OptionInfo::OptionIDs nOptionID, float nMin){return {Operation::SET_SLIDER_MIN, nOptionID, Option::Tag::NONE, nMin};}
+    static OptionCommand SetSliderMax(OptionInfo::OptionIDs nOptionID, float nMax){return {Operation::SET_SLIDER_MAX, nOptionID, Option::Tag::NONE, nMax};}
+};
+
+//A fixed capacity ring of commands. Neither pushing nor popping allocates memory
+class OptionCommandQueue{
+    public:
+
+    static constexpr size_t M_CAPACITY = 64;
+
+    //Returns false if the queue is full, in which case the command gets discarded
+    bool Push(const OptionCommand &command);
+
+    //Returns false if there are no commands left, otherwise command gets set to the oldest one, which is removed from the queue
+    bool Pop(OptionCommand &command);
+
+    bool IsEmpty();
+
+    private:
+
+    std::array<OptionCommand, M_CAPACITY> mCommands;
+    size_t mFirst = 0;
+    size_t mSize = 0;
+};
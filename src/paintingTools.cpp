@@ -1,11 +1,20 @@
 #include "paintingTools.hpp"
 #include "renderLib.hpp"
+#include "pngStream.hpp"
+#include "threadPool.hpp"
 #include "logger.hpp"
 #include <iomanip>
 #include <functional>
 #include <algorithm>
 #include <future>
 #include <sstream>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <filesystem>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 //Given a file path, returns its contents as a std::string
 std::string ReadFileToString(const std::string& filePath) {
@@ -22,6 +31,105 @@ std::string ReadFileToString(const std::string& filePath) {
     return buffer.str();
 }
 
+//Loads the image as a RGBA8888 surface, decoding pngs straight into it when possible instead of converting a copy made by SDL_image
+//Nothing gets logged, as the imports call it from other threads. If it fails, the reason is written into 'error'
+//'onRows' gets called as the rows of a png are decoded, the images loaded by SDL_image only get a single call once converted
+static std::unique_ptr<SDL_Surface, PointerDeleter> LoadLayerSurface(const char *pPath, std::string &error, const DecodedRowsCallback &onRows = nullptr){
+	std::string_view path(pPath);
+	if(IsPngStreamAvailable() && path.size() >= 4 && path.substr(path.size()-4) == ".png"){
+		if(SDL_Surface *pStreamed = LoadPNGStreamed(pPath, error, onRows)) return std::unique_ptr<SDL_Surface, PointerDeleter>(pStreamed);
+	}
+
+	std::unique_ptr<SDL_Surface, PointerDeleter> loaded(IMG_Load(pPath));
+	if(!loaded){
+		error = "Couldn't load image "+std::string(pPath)+": "+std::string(IMG_GetError());
+		return nullptr;
+	}
+
+	std::unique_ptr<SDL_Surface, PointerDeleter> converted(SDL_ConvertSurfaceFormat(loaded.get(), SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888, 0));
+	if(!converted) error = "Couldn't convert image "+std::string(pPath)+": "+std::string(SDL_GetError());
+	else if(onRows) onRows(converted.get(), 0, converted->h);
+	return converted;
+}
+
+//Blends 'color' over the pixels of the RGBA8888 surface covered by the mask, scaling its alpha by their coverage (and by the one of 'pClip', if any)
+//Returns the rect of the mask, as every changed pixel is inside it
+static SDL_Rect BlendCoverage(SDL_Surface *pSurface, CoverageMask &mask, SDL_Color color, const CoverageMask *pClip){
+	const SDL_Rect bounds = mask.GetBounds();
+	if(mask.IsEmpty() || color.a == SDL_ALPHA_TRANSPARENT) return {0, 0, 0, 0};
+
+	const Uint32 mappedColor = SDL_MapRGBA(pSurface->format, color.r, color.g, color.b, color.a);
+	//Every row has different pixels, so they can be blended in parallel
+	ThreadPool::GetShared().ParallelFor(bounds.h, [&](size_t begin, size_t end){
+		for(int y = bounds.y + (int)begin; y < bounds.y + (int)end; y++){
+			Uint32 *pRow = UnsafeGetPixelFromSurface<Uint32>({0, y}, pSurface);
+			const Uint8 *pCoverage = mask.GetRow(y);
+
+			for(int x = bounds.x; x < bounds.x + bounds.w; x++){
+				int coverage = pCoverage[x - bounds.x];
+				if(pClip != nullptr) coverage = coverage*pClip->GetCoverage(x, y)/SDL_ALPHA_OPAQUE;
+
+				SDL_Color appliedColor = color;
+				appliedColor.a = color.a*coverage/SDL_ALPHA_OPAQUE;
+				if(appliedColor.a == SDL_ALPHA_TRANSPARENT) continue;
+				if(appliedColor.a == SDL_ALPHA_OPAQUE){
+					pRow[x] = mappedColor;
+					continue;
+				}
+
+				SDL_Color pixelColor;
+				SDL_GetRGBA(pRow[x], pSurface->format, &pixelColor.r, &pixelColor.g, &pixelColor.b, &pixelColor.a);
+				MutableTexture::ApplyColorToColor(pixelColor, appliedColor);
+				pRow[x] = SDL_MapRGBA(pSurface->format, pixelColor.r, pixelColor.g, pixelColor.b, pixelColor.a);
+			}
+		}
+	});
+
+	return bounds;
+}
+
+//Moves every pixel of 'pBase' towards the one of 'pTarget' by its weight, from 0 (unchanged) to 255 (replaced). Every channel is interpolated on its own
+static void LerpRow(Uint32 *pBase, const Uint32 *pTarget, const Uint8 *pWeights, int count){
+	int x = 0;
+
+#ifdef __SSE2__
+	//4 pixels at a time, with a 16 bit lane per channel. base*(255-weight) + target*weight fits in 16 bits, and it's divided by 255 with shifts
+	const __m128i zero = _mm_setzero_si128(), maxWeight = _mm_set1_epi16(255), half = _mm_set1_epi16(128);
+	auto lerpLanes = [&](__m128i base, __m128i target, __m128i weights){
+		__m128i mixed = _mm_add_epi16(_mm_mullo_epi16(base, _mm_sub_epi16(maxWeight, weights)), _mm_mullo_epi16(target, weights));
+		mixed = _mm_add_epi16(mixed, half);
+		return _mm_srli_epi16(_mm_add_epi16(mixed, _mm_srli_epi16(mixed, 8)), 8);
+	};
+
+	for(; x+4 <= count; x += 4){
+		Uint32 packedWeights;
+		std::memcpy(&packedWeights, pWeights + x, 4);
+		if(packedWeights == 0) continue;
+
+		//Every weight repeated for the 4 channels of its pixel
+		__m128i weights = _mm_cvtsi32_si128((int)packedWeights);
+		weights = _mm_unpacklo_epi8(weights, weights);
+		weights = _mm_unpacklo_epi16(weights, weights);
+
+		__m128i base = _mm_loadu_si128((const __m128i*)(pBase + x)), target = _mm_loadu_si128((const __m128i*)(pTarget + x));
+		__m128i low = lerpLanes(_mm_unpacklo_epi8(base, zero), _mm_unpacklo_epi8(target, zero), _mm_unpacklo_epi8(weights, zero));
+		__m128i high = lerpLanes(_mm_unpackhi_epi8(base, zero), _mm_unpackhi_epi8(target, zero), _mm_unpackhi_epi8(weights, zero));
+		_mm_storeu_si128((__m128i*)(pBase + x), _mm_packus_epi16(low, high));
+	}
+#endif
+
+	for(; x < count; x++){
+		if(pWeights[x] == 0) continue;
+
+		Uint32 pixel = 0;
+		for(int shift = 0; shift < 32; shift += 8){
+			Uint32 mixed = ((pBase[x] >> shift) & 0xFF)*(255 - pWeights[x]) + ((pTarget[x] >> shift) & 0xFF)*pWeights[x] + 128;
+			pixel |= ((mixed + (mixed >> 8)) >> 8) << shift;
+		}
+		pBase[x] = pixel;
+	}
+}
+
 //TOOL CIRCLE DATA FUNCTIONS:
 
 namespace tool_circle_data{
@@ -269,7 +377,7 @@ void Pencil::SetPencilType(PencilType nPencilType){
 	tool_circle_data::needsUpdate = true;
 }
 
-void Pencil::ApplyOn(const std::span<SDL_Point> circleCenters, SDL_Color drawColor, SDL_Surface *pSurfaceToModify, SDL_Rect *pTotalUsedArea){
+void Pencil::ApplyOn(const std::span<SDL_Point> circleCenters, SDL_Color drawColor, SDL_Surface *pSurfaceToModify, SDL_Rect *pTotalUsedArea, const CoverageMask *pClip){
 	int smallestX = INT_MAX, biggestX = INT_MIN, smallestY = INT_MAX, biggestY = INT_MIN;
 	bool changeWasApplied = false;
 
@@ -279,7 +387,8 @@ void Pencil::ApplyOn(const std::span<SDL_Point> circleCenters, SDL_Color drawCol
 
 	for(const auto &center : circleCenters){
 		SDL_Rect drawArea = {center.x - tool_circle_data::radius, center.y - tool_circle_data::radius, 2*tool_circle_data::radius+1, 2*tool_circle_data::radius+1};
-		if(mPencilType == PencilType::HARD){
+		//The clipped stamps are applied a pixel at a time, as the coverage has to be looked up for each of them
+		if(mPencilType == PencilType::HARD && pClip == nullptr){
 			SDL_SetSurfaceColorMod(pCircleSurface, drawColor.r, drawColor.g, drawColor.b);
 			SDL_SetSurfaceAlphaMod(pCircleSurface, drawColor.a);
 			SDL_SetSurfaceBlendMode(pCircleSurface, SDL_BLENDMODE_BLEND);
@@ -298,6 +407,10 @@ void Pencil::ApplyOn(const std::span<SDL_Point> circleCenters, SDL_Color drawCol
 		} else {
 
 			SDL_Rect givenArea = {0, 0, pSurfaceToModify->w, pSurfaceToModify->h},  usedArea = {0,0,0,0};
+			if(pClip != nullptr){
+				SDL_Rect clipBounds = pClip->GetBounds();
+				if(SDL_IntersectRect(&clipBounds, &drawArea, &givenArea) == SDL_FALSE) continue;
+			}
 			if(SDL_IntersectRect(&givenArea, &drawArea, &usedArea) == SDL_FALSE) continue;
 			SDL_Point circleOffset = {usedArea.x-drawArea.x, usedArea.y-drawArea.y};
 			
@@ -306,6 +419,9 @@ void Pencil::ApplyOn(const std::span<SDL_Point> circleCenters, SDL_Color drawCol
 
 			for(int y = 0; y < usedArea.h; ++y){
 				for(int x = 0; x < usedArea.w; ++x){
+					Uint8 coverage = (pClip != nullptr ? pClip->GetCoverage(x+usedArea.x, y+usedArea.y) : SDL_ALPHA_OPAQUE);
+					if(coverage == 0) continue;
+
 					Uint32 *basePixel = UnsafeGetPixelFromSurface<Uint32>({x+usedArea.x, y+usedArea.y}, pSurfaceToModify);
 					SDL_Color actualColor = {0, 0, 0, 0};
 					SDL_GetRGBA(*basePixel, pSurfaceToModify->format, &actualColor.r, &actualColor.g, &actualColor.b, &actualColor.a);
@@ -313,7 +429,7 @@ void Pencil::ApplyOn(const std::span<SDL_Point> circleCenters, SDL_Color drawCol
 					SDL_Color circleColor; SDL_GetRGBA(*circlePixel, pCircleSurface->format, &circleColor.r, &circleColor.g, &circleColor.b, &circleColor.a); //We only care about the alpha
 					
 					FColor baseColor = {.r = actualColor.r/255.0f, .g = actualColor.g/255.0f, .b = actualColor.b/255.0f, .a = actualColor.a/255.0f};
-					appliedColor.a = (appliedAlpha*circleColor.a)/255.0f;
+					appliedColor.a = (appliedAlpha*circleColor.a)/255.0f * (coverage/255.0f);
 					MutableTexture::ApplyColorToColor(baseColor, appliedColor);
 					*basePixel = SDL_MapRGBA(pSurfaceToModify->format, round(SDL_ALPHA_OPAQUE*baseColor.r), round(SDL_ALPHA_OPAQUE*baseColor.g), round(SDL_ALPHA_OPAQUE*baseColor.b), round(SDL_ALPHA_OPAQUE*baseColor.a));
 				}
@@ -402,7 +518,7 @@ void Eraser::Activate(){
 	tool_circle_data::needsUpdate = true;
 }
 
-void Eraser::ApplyOn(const std::span<SDL_Point> circleCenters, SDL_Surface *pSurfaceToModify, SDL_Rect *pTotalUsedArea){
+void Eraser::ApplyOn(const std::span<SDL_Point> circleCenters, SDL_Surface *pSurfaceToModify, SDL_Rect *pTotalUsedArea, const CoverageMask *pClip){
 	int smallestX = INT_MAX, biggestX = INT_MIN, smallestY = INT_MAX, biggestY = INT_MIN;
 	bool changeWasApplied = false;
 
@@ -415,15 +531,28 @@ void Eraser::ApplyOn(const std::span<SDL_Point> circleCenters, SDL_Surface *pSur
 	for(const auto &center : circleCenters){
 		SDL_Rect drawArea = {center.x - tool_circle_data::radius, center.y - tool_circle_data::radius, 2*tool_circle_data::radius+1, 2*tool_circle_data::radius+1};
 		SDL_Rect givenArea = {0, 0, pSurfaceToModify->w, pSurfaceToModify->h},  usedArea = {0,0,0,0};
+		if(pClip != nullptr){
+			SDL_Rect clipBounds = pClip->GetBounds();
+			if(SDL_IntersectRect(&clipBounds, &drawArea, &givenArea) == SDL_FALSE) continue;
+		}
 		if(SDL_IntersectRect(&givenArea, &drawArea, &usedArea) == SDL_FALSE) continue;
 		SDL_Point circleOffset = {usedArea.x-drawArea.x, usedArea.y-drawArea.y};
 		
 		for(int y = 0; y < usedArea.h; ++y){
 			for(int x = 0; x < usedArea.w; ++x){
 				Uint32 *circlePixel = UnsafeGetPixelFromSurface<Uint32>({x+circleOffset.x, y+circleOffset.y}, pCircleSurface);
-
-				if(*circlePixel == 0){
-					*UnsafeGetPixelFromSurface<Uint32>({x+usedArea.x, y+usedArea.y}, pSurfaceToModify) = 0;
+				if(*circlePixel != 0) continue;
+
+				Uint32 *erasedPixel = UnsafeGetPixelFromSurface<Uint32>({x+usedArea.x, y+usedArea.y}, pSurfaceToModify);
+				Uint8 coverage = (pClip != nullptr ? pClip->GetCoverage(x+usedArea.x, y+usedArea.y) : SDL_ALPHA_OPAQUE);
+
+				if(coverage == SDL_ALPHA_OPAQUE){
+					*erasedPixel = 0;
+				} else if(coverage > 0){
+					SDL_Color color;
+					SDL_GetRGBA(*erasedPixel, pSurfaceToModify->format, &color.r, &color.g, &color.b, &color.a);
+					color.a = color.a*(SDL_ALPHA_OPAQUE-coverage)/SDL_ALPHA_OPAQUE;
+					*erasedPixel = (color.a == 0 ? 0 : SDL_MapRGBA(pSurfaceToModify->format, color.r, color.g, color.b, color.a));
 				}
 			}
 		}
@@ -469,14 +598,7 @@ void ColorPicker::GrabColor(Canvas *pCanvas, MutableTexture *pTexture, SDL_Point
 	bool isValid = false;
 	SDL_Color color = pTexture->GetPixelColor(pixel, &isValid);
 	if(isValid){
-		std::stringstream hexColor;
-		
-		//We transform the red, green and blue into hex, making sure each one takes 2 characters and, in case they weren't 2 characters wide, we fill the hex with leading '0'
-		hexColor << std::hex << std::setw(2) << std::setfill('0') << ((unsigned int)color.r)
-							 << std::setw(2) << std::setfill('0') << ((unsigned int)color.g)
-							 << std::setw(2) << std::setfill('0') << ((unsigned int)color.b);
-							 
-		pCanvas->AppendCommand("0_H_InitialValue/"+hexColor.str()+"_"); //Refers to the DRAWING_COLOR hex field
+		pCanvas->PushCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::DRAWING_COLOR, color));
 	}
 }
     
@@ -497,6 +619,277 @@ void ColorPicker::DrawPreview(SDL_Point center, SDL_Renderer *pRenderer, SDL_Col
 
 }
 
+//SMUDGE METHODS:
+
+void Smudge::Activate(){
+	//The circle is only used for the preview
+	tool_circle_data::backgroundColor = {255, 255, 255, SDL_ALPHA_OPAQUE};
+	tool_circle_data::circleColor = {0, 0, 0};
+	tool_circle_data::alphaCalculation = [](const SDL_Point& center, const SDL_Point& position) -> Uint8 {return SDL_ALPHA_TRANSPARENT;};
+	tool_circle_data::needsUpdate = true;
+}
+
+void Smudge::BeginStroke(){
+	mHasPickup = false;
+}
+
+void Smudge::ApplyOn(const std::span<SDL_Point> circleCenters, SDL_Surface *pSurfaceToModify, SDL_Rect *pTotalUsedArea, const CoverageMask *pClip){
+	const int radius = tool_circle_data::radius, side = 2*radius+1;
+	mFootprint.Update(radius, 0.0f);
+
+	const int spacing = std::max(1, radius/M_SPACING_DIVISOR);
+	mPickupWeights.assign(side, (Uint8)std::lround((1.0f - std::clamp(strength, 0.0f, 1.0f))*SDL_ALPHA_OPAQUE));
+	mClippedWeights.resize(side);
+
+	SDL_Rect surfaceArea = {0, 0, pSurfaceToModify->w, pSurfaceToModify->h}, totalArea = {0, 0, 0, 0};
+
+	//The pickup is only valid for the brush size it was taken with, so it starts again if the radius changed since
+	if(mPickup.size() != (size_t)side*side) mHasPickup = false;
+
+	for(const auto &center : circleCenters){
+		int xDistance = center.x - mLastDab.x, yDistance = center.y - mLastDab.y;
+		if(mHasPickup && xDistance*xDistance + yDistance*yDistance < spacing*spacing) continue;
+
+		SDL_Rect drawArea = {center.x - radius, center.y - radius, side, side}, usedArea;
+		if(SDL_IntersectRect(&surfaceArea, &drawArea, &usedArea) == SDL_FALSE) continue;
+
+		//Whatever is outside the surface is picked up as transparent
+		if(!mHasPickup) mPickup.assign((size_t)side*side, 0);
+
+		for(int y = usedArea.y; y < usedArea.y + usedArea.h; y++){
+			const int brushRow = y - drawArea.y, halfWidth = mFootprint.GetRowHalfWidth(brushRow);
+			const int left = std::max(usedArea.x, center.x - halfWidth), right = std::min(usedArea.x + usedArea.w, center.x + halfWidth + 1);
+			if(right <= left) continue;
+
+			const int count = right - left;
+			const size_t brushOffset = (size_t)brushRow*side + (left - drawArea.x);
+			Uint32 *pLayerRow = UnsafeGetPixelFromSurface<Uint32>({left, y}, pSurfaceToModify);
+			Uint32 *pPickupRow = mPickup.data() + brushOffset;
+
+			//The brush keeps part of what it carried and picks up the rest from under it, then leaves it on the layer
+			if(mHasPickup) LerpRow(pPickupRow, pLayerRow, mPickupWeights.data(), count);
+			else std::copy(pLayerRow, pLayerRow + count, pPickupRow);
+
+			const Uint8 *pWeights = mFootprint.GetRow(brushRow) + (left - drawArea.x);
+			if(pClip != nullptr){
+				for(int x = 0; x < count; x++) mClippedWeights[x] = pWeights[x]*pClip->GetCoverage(left + x, y)/SDL_ALPHA_OPAQUE;
+				pWeights = mClippedWeights.data();
+			}
+			LerpRow(pLayerRow, pPickupRow, pWeights, count);
+		}
+
+		mHasPickup = true;
+		mLastDab = center;
+
+		if(totalArea.w > 0 && totalArea.h > 0) SDL_UnionRect(&totalArea, &usedArea, &totalArea);
+		else totalArea = usedArea;
+	}
+
+	if(pTotalUsedArea != nullptr) *pTotalUsedArea = totalArea;
+}
+
+void Smudge::SetResolution(float nResolution){
+	tool_circle_data::rectsResolution = nResolution;
+	tool_circle_data::UpdatePreviewRects();
+}
+
+void Smudge::DrawPreview(SDL_Point center, SDL_Renderer *pRenderer, SDL_Color previewColor){
+	tool_circle_data::DrawPreview(center, pRenderer, previewColor);
+}
+
+//CLONE STAMP METHODS:
+
+void CloneStamp::Activate(){
+	//The circle is only used for the preview
+	tool_circle_data::backgroundColor = {255, 255, 255, SDL_ALPHA_OPAQUE};
+	tool_circle_data::circleColor = {0, 0, 0};
+	tool_circle_data::alphaCalculation = [](const SDL_Point& center, const SDL_Point& position) -> Uint8 {return SDL_ALPHA_TRANSPARENT;};
+	tool_circle_data::needsUpdate = true;
+}
+
+void CloneStamp::SetSource(SDL_Point nSource){
+	mSource = nSource;
+	mHasSource = true;
+	mHasOffset = false;
+}
+
+bool CloneStamp::HasSource(){
+	return mHasSource;
+}
+
+SDL_Point CloneStamp::GetOffset(SDL_Point firstCenter){
+	if(mHasOffset) return mOffset;
+	return {mSource.x - firstCenter.x, mSource.y - firstCenter.y};
+}
+
+void CloneStamp::ApplyOn(const std::span<SDL_Point> circleCenters, SDL_Surface *pSurfaceToModify, SDL_Surface *pSourceSurface, SDL_Rect *pTotalUsedArea, const CoverageMask *pClip){
+	if(pTotalUsedArea != nullptr) *pTotalUsedArea = {0, 0, 0, 0};
+	if(!mHasSource || circleCenters.empty()) return;
+
+	if(!mHasOffset){
+		mOffset = {mSource.x - circleCenters[0].x, mSource.y - circleCenters[0].y};
+		mHasOffset = true;
+	}
+
+	const int radius = tool_circle_data::radius, side = 2*radius+1;
+	mFootprint.Update(radius, M_HARDNESS);
+	mCopied.resize((size_t)side*side);
+	mClippedWeights.resize(side);
+
+	//Only the pixels whose source is inside the image get copied
+	SDL_Rect surfaceArea = {0, 0, pSurfaceToModify->w, pSurfaceToModify->h}, totalArea = {0, 0, 0, 0};
+	SDL_Rect sourceArea = {-mOffset.x, -mOffset.y, pSourceSurface->w, pSourceSurface->h}, copiableArea;
+	if(SDL_IntersectRect(&surfaceArea, &sourceArea, &copiableArea) == SDL_FALSE) return;
+
+	for(const auto &center : circleCenters){
+		SDL_Rect drawArea = {center.x - radius, center.y - radius, side, side}, usedArea;
+		if(SDL_IntersectRect(&copiableArea, &drawArea, &usedArea) == SDL_FALSE) continue;
+
+		//The whole source of the dab is read before writing anything, as consecutive dabs (or this one, on the same surface) may overlap with it
+		for(int y = usedArea.y; y < usedArea.y + usedArea.h; y++){
+			const Uint32 *pSourceRow = UnsafeGetPixelFromSurface<Uint32>({usedArea.x + mOffset.x, y + mOffset.y}, pSourceSurface);
+			std::copy(pSourceRow, pSourceRow + usedArea.w, mCopied.data() + (size_t)(y - usedArea.y)*side);
+		}
+
+		for(int y = usedArea.y; y < usedArea.y + usedArea.h; y++){
+			const int brushRow = y - drawArea.y, halfWidth = mFootprint.GetRowHalfWidth(brushRow);
+			const int left = std::max(usedArea.x, center.x - halfWidth), right = std::min(usedArea.x + usedArea.w, center.x + halfWidth + 1);
+			if(right <= left) continue;
+
+			const int count = right - left;
+			const Uint8 *pWeights = mFootprint.GetRow(brushRow) + (left - drawArea.x);
+			if(pClip != nullptr){
+				for(int x = 0; x < count; x++) mClippedWeights[x] = pWeights[x]*pClip->GetCoverage(left + x, y)/SDL_ALPHA_OPAQUE;
+				pWeights = mClippedWeights.data();
+			}
+
+			const Uint32 *pCopiedRow = mCopied.data() + (size_t)(y - usedArea.y)*side + (left - usedArea.x);
+			LerpRow(UnsafeGetPixelFromSurface<Uint32>({left, y}, pSurfaceToModify), pCopiedRow, pWeights, count);
+		}
+
+		if(totalArea.w > 0 && totalArea.h > 0) SDL_UnionRect(&totalArea, &usedArea, &totalArea);
+		else totalArea = usedArea;
+	}
+
+	if(pTotalUsedArea != nullptr) *pTotalUsedArea = totalArea;
+}
+
+void CloneStamp::SetResolution(float nResolution){
+	tool_circle_data::rectsResolution = nResolution;
+	tool_circle_data::UpdatePreviewRects();
+}
+
+void CloneStamp::DrawPreview(SDL_Point center, SDL_Renderer *pRenderer, SDL_Color previewColor){
+	tool_circle_data::DrawPreview(center, pRenderer, previewColor);
+}
+
+//BRUSH FOOTPRINT METHODS:
+
+void BrushFootprint::Update(int radius, float hardness){
+	if(radius == mRadius && hardness == mHardness) return;
+
+	const int side = 2*radius+1;
+	mWeights.assign((size_t)side*side, 0);
+	mRowHalfWidths.assign(side, -1);
+
+	//Past the hard core, (1-t²)² of how far the pixel is towards the edge, which is smooth both where the falloff starts and at the edge
+	const float edge = radius + 0.5f;
+	for(int y = 0; y < side; y++){
+		for(int x = 0; x < side; x++){
+			float distance = std::hypot((float)(x - radius), (float)(y - radius))/edge;
+			if(distance >= 1.0f) continue;
+
+			float falloff = (hardness >= 1.0f ? 0.0f : std::max(0.0f, (distance - hardness)/(1.0f - hardness)));
+			Uint8 weight = (Uint8)std::lround((1.0f - falloff*falloff)*(1.0f - falloff*falloff)*SDL_ALPHA_OPAQUE);
+			mWeights[(size_t)y*side + x] = weight;
+			if(weight > 0) mRowHalfWidths[y] = std::max(mRowHalfWidths[y], std::abs(x - radius));
+		}
+	}
+
+	mRadius = radius;
+	mHardness = hardness;
+}
+
+//BUCKET FILL METHODS:
+
+void BucketFill::Activate(){
+	tool_circle_data::backgroundColor = {0, 0, 0, SDL_ALPHA_TRANSPARENT};
+	tool_circle_data::circleColor = {0, 0, 0, SDL_ALPHA_TRANSPARENT};
+}
+
+SDL_Rect BucketFill::ApplyOn(MutableTexture *pTexture, SDL_Point pixel, SDL_Color fillColor, const CoverageMask *pClip){
+	TRACE_SCOPE("Fill");
+	//A transparent color wouldn't change anything
+	if(fillColor.a == SDL_ALPHA_TRANSPARENT) return {0, 0, 0, 0};
+
+	SDL_Surface *pLayer = pTexture->GetCurrentSurface();
+	std::unique_ptr<SDL_Surface, PointerDeleter> pMerged;
+	if(sampleMerged) pMerged = pTexture->Flatten();
+
+	ThreadPool &pool = ThreadPool::GetShared();
+	SDL_Rect filledRect = mFloodFill.Find(pMerged ? pMerged.get() : pLayer, pixel, tolerance, &pool);
+	const std::vector<FillSpan> &spans = mFloodFill.GetSpans();
+	if(spans.empty()) return {0, 0, 0, 0};
+
+	if(pClip != nullptr){
+		SDL_Rect clipBounds = pClip->GetBounds(), clippedRect;
+		if(SDL_IntersectRect(&filledRect, &clipBounds, &clippedRect) == SDL_FALSE) return {0, 0, 0, 0};
+		filledRect = clippedRect;
+	}
+
+	PaintSpans(pLayer, spans, fillColor, pClip, &pool);
+
+	return filledRect;
+}
+
+void BucketFill::PaintSpans(SDL_Surface *pSurface, const std::vector<FillSpan> &spans, SDL_Color fillColor, const CoverageMask *pClip, ThreadPool *pPool){
+	const Uint32 mappedColor = SDL_MapRGBA(pSurface->format, fillColor.r, fillColor.g, fillColor.b, fillColor.a);
+	auto paintSpans = [&](size_t begin, size_t end){
+		for(size_t i = begin; i < end; i++){
+			Uint32 *pRow = UnsafeGetPixelFromSurface<Uint32>({0, spans[i].y}, pSurface);
+
+			if(fillColor.a == SDL_ALPHA_OPAQUE && pClip == nullptr){
+				std::fill(pRow + spans[i].left, pRow + spans[i].right + 1, mappedColor);
+				continue;
+			}
+
+			for(int x = spans[i].left; x <= spans[i].right; x++){
+				SDL_Color appliedColor = fillColor;
+				if(pClip != nullptr) appliedColor.a = fillColor.a*pClip->GetCoverage(x, spans[i].y)/SDL_ALPHA_OPAQUE;
+
+				if(appliedColor.a == SDL_ALPHA_TRANSPARENT) continue;
+				if(appliedColor.a == SDL_ALPHA_OPAQUE){
+					pRow[x] = mappedColor;
+					continue;
+				}
+
+				SDL_Color color;
+				SDL_GetRGBA(pRow[x], pSurface->format, &color.r, &color.g, &color.b, &color.a);
+				MutableTexture::ApplyColorToColor(color, appliedColor);
+				pRow[x] = SDL_MapRGBA(pSurface->format, color.r, color.g, color.b, color.a);
+			}
+		}
+	};
+	//Every span has different pixels, so they can be painted in parallel
+	if(pPool) pPool->ParallelFor(spans.size(), paintSpans);
+	else paintSpans(0, spans.size());
+}
+
+void BucketFill::SetResolution(float nResolution){
+	tool_circle_data::rectsResolution = nResolution;
+}
+
+void BucketFill::DrawPreview(SDL_Point center, SDL_Renderer *pRenderer, SDL_Color previewColor){
+	SDL_SetRenderDrawColor(pRenderer, previewColor.r, previewColor.g, previewColor.b, previewColor.a);
+	SDL_SetRenderDrawBlendMode(pRenderer, SDL_BLENDMODE_BLEND);
+
+	SDL_Rect resultingRect ={center.x, center.y, (int)roundf(tool_circle_data::rectsResolution), (int)roundf(tool_circle_data::rectsResolution)};
+	resultingRect.x -= ((int)roundf(tool_circle_data::rectsResolution))/2;
+	resultingRect.y -= ((int)roundf(tool_circle_data::rectsResolution))/2;
+
+	SDL_RenderFillRect(pRenderer, &resultingRect);
+}
+
 //AREA DELIMITER METHODS:
     
 void AreaDelimiter::Activate(){
@@ -630,53 +1023,63 @@ SDL_FPoint *AreaDelimiter::GetPoint(SDL_FPoint &target){
 
 //MUTABLE TEXTURE METHODS:
 
-MutableTexture::MutableTexture(SDL_Renderer *pRenderer, int width, int height, SDL_Color fillColor){
+bool MutableTexture::useLayerTextures = false;
+
+MutableTexture::MutableTexture(SDL_Renderer *pRenderer, int width, int height, SDL_Color fillColor) : M_USE_LAYER_TEXTURES(useLayerTextures), mpRenderer(pRenderer){
 	mSelectedLayer = 0;
 	
 	mShowSurface.resize(1);
 	mShowSurface[mSelectedLayer] = true;
+	mBlendModes.assign(1, BlendMode::NORMAL);
 	mpSurfaces.resize(1);
 	mpSurfaces[mSelectedLayer].reset(SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888));
-    mpTexture.reset(SDL_CreateTexture(pRenderer, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888, SDL_TextureAccess::SDL_TEXTUREACCESS_STREAMING, width, height));
 	SDL_SetSurfaceBlendMode(mpSurfaces[mSelectedLayer].get(), SDL_BLENDMODE_BLEND);
-	SDL_SetTextureBlendMode(mpTexture.get(), SDL_BLENDMODE_BLEND);
+	CreateCompositeTexture({width, height});
 
 	Clear(fillColor);
 }
 
-MutableTexture::MutableTexture(SDL_Renderer *pRenderer, const char *pImage){
-	SDL_Surface *loaded = IMG_Load(pImage);
+MutableTexture::MutableTexture(SDL_Renderer *pRenderer, const char *pImage) : M_USE_LAYER_TEXTURES(useLayerTextures), mpRenderer(pRenderer){
 	mSelectedLayer = 0;
 	
 	mShowSurface.resize(1);
 	mShowSurface[mSelectedLayer] = true;
+	mBlendModes.assign(1, BlendMode::NORMAL);
 	mpSurfaces.resize(1);
-	mpSurfaces[mSelectedLayer].reset(SDL_ConvertSurfaceFormat(loaded, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888, 0));
-    mpTexture.reset(SDL_CreateTexture(pRenderer, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888, SDL_TextureAccess::SDL_TEXTUREACCESS_STREAMING, loaded->w, loaded->h));
+	std::string error;
+	mpSurfaces[mSelectedLayer] = LoadLayerSurface(pImage, error);
+	if(!mpSurfaces[mSelectedLayer]){
+		ErrorPrint(error);
+		//An empty image is used instead, as the layers are expected to exist
+		mpSurfaces[mSelectedLayer].reset(SDL_CreateRGBSurfaceWithFormat(0, 100, 100, 32, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888));
+		SDL_FillRect(mpSurfaces[mSelectedLayer].get(), nullptr, SDL_MapRGBA(mpSurfaces[mSelectedLayer]->format, 255, 255, 255, SDL_ALPHA_TRANSPARENT));
+	}
 	SDL_SetSurfaceBlendMode(mpSurfaces[mSelectedLayer].get(), SDL_BLENDMODE_BLEND);
-	SDL_SetTextureBlendMode(mpTexture.get(), SDL_BLENDMODE_BLEND);
-
-    SDL_FreeSurface(loaded);
+	CreateCompositeTexture({GetWidth(), GetHeight()});
 	
 	UpdateWholeTexture();
 }
 
-void MutableTexture::AddFileAsLayer(SDL_Renderer *pRenderer, const char *pImage, SDL_Point imageSize){
+void MutableTexture::AddSurfaceAsLayer(SDL_Renderer *pRenderer, std::unique_ptr<SDL_Surface, PointerDeleter> pSurface){
+	if(!pSurface){
+		ErrorPrint("tried to add a null surface as a layer");
+		return;
+	}
+
 	SDL_Point currentSize = {GetWidth(), GetHeight()};
+	SDL_Point imageSize = {pSurface->w, pSurface->h};
 	SDL_Point finalSize = {std::max(currentSize.x, imageSize.x), std::max(currentSize.y, imageSize.y)};
 
 	//If the final size differs from the previous size, we need to resize all existing layers
 	if(finalSize.x != currentSize.x || finalSize.y != currentSize.y) ResizeAllLayers(pRenderer, finalSize);
 	AddLayer();
 
-	SDL_Surface *loaded = IMG_Load(pImage);
-
 	//If the final size differs from the image's size, we just blit it onto the new layer. Otherwise we just set the layer directly
 	if(finalSize.x != imageSize.x || finalSize.y != imageSize.y){
-		SDL_SetSurfaceBlendMode(loaded, SDL_BLENDMODE_NONE);
-		SDL_BlitSurface(loaded, nullptr, mpSurfaces[mSelectedLayer].get(), nullptr);
+		SDL_SetSurfaceBlendMode(pSurface.get(), SDL_BLENDMODE_NONE);
+		SDL_BlitSurface(pSurface.get(), nullptr, mpSurfaces[mSelectedLayer].get(), nullptr);
 	} else {
-		mpSurfaces[mSelectedLayer].reset(loaded);
+		mpSurfaces[mSelectedLayer] = std::move(pSurface);
 	}
 	
 	mShowSurface[mSelectedLayer] = true;
@@ -731,9 +1134,9 @@ void MutableTexture::ResizeAllLayers(SDL_Renderer *pRenderer, SDL_Point nSize){
 		pSurface.reset(nSurface);
 	}
 
-	//Finally we also need to resize the texture
-    mpTexture.reset(SDL_CreateTexture(pRenderer, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888, SDL_TextureAccess::SDL_TEXTUREACCESS_STREAMING, nSize.x, nSize.y));
-	SDL_SetTextureBlendMode(mpTexture.get(), SDL_BLENDMODE_BLEND);
+	//Finally we also need to resize the texture (the layer textures are created again by UpdateTexture, as their size doesn't match anymore)
+	mpRenderer = pRenderer;
+	CreateCompositeTexture(nSize);
 	UpdateWholeTexture();
 }
 
@@ -814,25 +1217,59 @@ void MutableTexture::UpdateTexture(){
 }
 
 void MutableTexture::UpdateTexture(const SDL_Rect &rect){
+	UpdateTexture(rect, -1);
+}
+
+void MutableTexture::UpdateTexture(const SDL_Rect &rect, int layer){
 	if(rect.w <= 0 || rect.h <= 0){
 		ErrorPrint("limitating rect's width or height was less than or equal to 0 (must at least be 1)");
 		return;
 	}
 
-	SDL_Surface *texturesSurface;
+	SDL_Rect imageRect = {0, 0, GetWidth(), GetHeight()}, updatedRect;
+	if(!SDL_IntersectRect(&rect, &imageRect, &updatedRect)) return;
 
-	SDL_LockTextureToSurface(mpTexture.get(), &rect, &texturesSurface);
-	
-	SDL_FillRect(texturesSurface, nullptr, SDL_MapRGBA(texturesSurface->format, 255, 255, 255, SDL_ALPHA_TRANSPARENT));
-	for(size_t i = 0; i < mpSurfaces.size(); i++){
-		if(mShowSurface[i]) SDL_BlitSurface(mpSurfaces[i].get(), &rect, texturesSurface, nullptr);
+	if(M_USE_LAYER_TEXTURES && !NeedsComposite()){
+		//The layers are uploaded as they are, they get blended by the renderer
+		TRACE_SCOPE("Upload");
+		mpLayerTextures.resize(mpSurfaces.size());
+		if(mLayerTexturesStale){
+			//They weren't uploaded while the composite was drawn, so they are created again with the whole layers
+			for(auto &pLayerTexture : mpLayerTextures) pLayerTexture.reset();
+			mpTexture.reset();
+			mLayerTexturesStale = false;
+		}
+		//Only the changed layer needs its rect uploaded, the others just need their textures to exist
+		for(size_t i = 0; i < mpSurfaces.size(); i++){
+			if(layer < 0 || (int)i == layer || !mpLayerTextures[i]) UploadLayer(i, updatedRect);
+		}
+		return;
+	}
+
+	if(M_USE_LAYER_TEXTURES){
+		//The renderer only blends the normal mode, and would round a layer alpha a second time, so the layers are composited as when they don't have their own textures
+		int textureWidth = 0, textureHeight = 0;
+		if(mpTexture) SDL_QueryTexture(mpTexture.get(), nullptr, nullptr, &textureWidth, &textureHeight);
+		if(textureWidth != imageRect.w || textureHeight != imageRect.h){
+			mpTexture.reset(SDL_CreateTexture(mpRenderer, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888, SDL_TextureAccess::SDL_TEXTUREACCESS_STREAMING, imageRect.w, imageRect.h));
+			SDL_SetTextureBlendMode(mpTexture.get(), SDL_BLENDMODE_BLEND);
+			updatedRect = imageRect;
+		}
+		mLayerTexturesStale = true;
 	}
+
+	Composite(updatedRect);
 	
-	SDL_UnlockTexture(mpTexture.get());
+	//The texture is only written, sequentially and once per pixel
+	TRACE_SCOPE("Upload");
+	const Uint8 *pStagingPixels = (const Uint8*)mpStaging->pixels + updatedRect.y*mpStaging->pitch + updatedRect.x*mpStaging->format->BytesPerPixel;
+	SDL_UpdateTexture(mpTexture.get(), &updatedRect, pStagingPixels, mpStaging->pitch);
 }
 
 void MutableTexture::AddLayer(){
+	if(M_USE_LAYER_TEXTURES) mpLayerTextures.emplace(mpLayerTextures.begin()+std::min<size_t>(mSelectedLayer+1, mpLayerTextures.size()));
 	mShowSurface.emplace(mShowSurface.begin()+mSelectedLayer+1, true);
+	mBlendModes.emplace(mBlendModes.begin()+mSelectedLayer+1, BlendMode::NORMAL);
 	mpSurfaces.emplace(mpSurfaces.begin()+mSelectedLayer+1, SDL_CreateRGBSurfaceWithFormat(0, GetWidth(), GetHeight(), 32, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888));
     mSelectedLayer++;
 	
@@ -852,7 +1289,9 @@ bool MutableTexture::DeleteCurrentLayer(){
 	mSelectedLayer = std::clamp(mSelectedLayer, 0, (int)(mpSurfaces.size()-1));
 
 	mShowSurface.erase(mShowSurface.begin() + mSelectedLayer);
+	mBlendModes.erase(mBlendModes.begin() + mSelectedLayer);
 	mpSurfaces.erase(mpSurfaces.begin() + mSelectedLayer);
+	if(M_USE_LAYER_TEXTURES && mSelectedLayer < (int)mpLayerTextures.size()) mpLayerTextures.erase(mpLayerTextures.begin() + mSelectedLayer);
 	
 	UpdateWholeTexture();
 	if(mSelectedLayer != 0) mSelectedLayer--;
@@ -863,17 +1302,28 @@ bool MutableTexture::DeleteCurrentLayer(){
 void MutableTexture::SetLayerVisibility(bool visible){
 	mShowSurface[mSelectedLayer] = visible;
 
-	UpdateWholeTexture();
+	//The hidden layers are just skipped by DrawIntoRenderer, unless they are composited (which showing or hiding the layer may switch to or from)
+	if(!M_USE_LAYER_TEXTURES || mLayerTexturesStale || NeedsComposite()) UpdateWholeTexture();
 }
 
 bool MutableTexture::GetLayerVisibility(){
 	return mShowSurface[mSelectedLayer];
 }
 
+bool MutableTexture::GetLayerVisibility(int layer){
+	return mShowSurface[std::clamp(layer, 0, (int)mShowSurface.size()-1)];
+}
+
 void MutableTexture::SetLayerAlpha(Uint8 alpha){
+	//The surface keeps the alpha too, as it's used when saving
 	SDL_SetSurfaceAlphaMod(mpSurfaces[mSelectedLayer].get(), alpha);
 
-	UpdateWholeTexture();
+	if(M_USE_LAYER_TEXTURES && mSelectedLayer < (int)mpLayerTextures.size() && mpLayerTextures[mSelectedLayer]){
+		SDL_SetTextureAlphaMod(mpLayerTextures[mSelectedLayer].get(), alpha);
+	}
+
+	//An alpha below opaque makes the layers get composited, and going back to opaque returns to the layer textures
+	if(!M_USE_LAYER_TEXTURES || mLayerTexturesStale || NeedsComposite()) UpdateWholeTexture();
 }
 
 Uint8 MutableTexture::GetLayerAlpha(){
@@ -882,6 +1332,22 @@ Uint8 MutableTexture::GetLayerAlpha(){
 	return nAlpha;
 }
 
+void MutableTexture::SetLayerBlendMode(BlendMode mode){
+	if(mBlendModes[mSelectedLayer] == mode) return;
+	mBlendModes[mSelectedLayer] = mode;
+
+	//With layer textures, this may also switch between drawing them and drawing the composite
+	UpdateWholeTexture();
+}
+
+BlendMode MutableTexture::GetLayerBlendMode(){
+	return mBlendModes[mSelectedLayer];
+}
+
+BlendMode MutableTexture::GetLayerBlendMode(int layer){
+	return mBlendModes[std::clamp(layer, 0, (int)mBlendModes.size()-1)];
+}
+
 void MutableTexture::SetLayer(int nLayer){
 	nLayer = std::clamp(nLayer, 0, (int)mpSurfaces.size()-1);
 	mSelectedLayer = nLayer;
@@ -896,17 +1362,108 @@ int MutableTexture::GetTotalLayers(){
 }
 
 void MutableTexture::DrawIntoRenderer(SDL_Renderer *pRenderer, const SDL_Rect &dimensions){
-	SDL_RenderCopy(pRenderer, mpTexture.get(), nullptr, &dimensions);
+	if(!M_USE_LAYER_TEXTURES || mLayerTexturesStale){
+		SDL_RenderCopy(pRenderer, mpTexture.get(), nullptr, &dimensions);
+		return;
+	}
+
+	//BlendLayers uses the same source-over, so blending the layers one after the other gives the colors of the composite, but the renderer rounds the
+	//semitransparent pixels of each of them on its own and the result can be a few levels away from what gets saved (see 'useLayerTextures')
+	for(size_t i = 0; i < mpLayerTextures.size() && i < mpSurfaces.size(); i++){
+		if(mShowSurface[i] && mpLayerTextures[i]) SDL_RenderCopy(pRenderer, mpLayerTextures[i].get(), nullptr, &dimensions);
+	}
+}
+
+bool MutableTexture::Save(const char *pSavePath, const PngEncodeSettings &settings){
+	return Save(pSavePath, settings, &ThreadPool::GetShared());
+}
+
+bool MutableTexture::Save(const char *pSavePath, const PngEncodeSettings &settings, ThreadPool *pPool){
+	if(!IsPngStreamAvailable()) return SaveWithSDLImage(pSavePath);
+
+	PngWriter writer(pSavePath, GetWidth(), GetHeight(), settings, pPool);
+	if(!writer.IsOpen()){
+		ErrorPrint("Couldn't save image in file "+std::string(pSavePath));
+		return true;
+	}
+
+	//The layers get flattened and encoded a band of rows at a time, so that the whole flattened image never has to be held
+	constexpr int BAND_HEIGHT = 64;
+	std::unique_ptr<SDL_Surface, PointerDeleter> pBand(SDL_CreateRGBSurfaceWithFormat(0, GetWidth(), std::min(BAND_HEIGHT, GetHeight()), 32, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888));
+
+	for(int y = 0; y < GetHeight(); y += pBand->h){
+		SDL_Rect bandRect = {0, y, GetWidth(), std::min(pBand->h, GetHeight()-y)};
+		BlendLayers(bandRect, pBand.get(), {0, 0}, pPool);
+
+		if(!writer.WriteRows(pBand.get(), bandRect.h)){
+			ErrorPrint("Couldn't save image in file "+std::string(pSavePath));
+			return true;
+		}
+	}
+
+	if(!writer.Finish()){
+		ErrorPrint("Couldn't save image in file "+std::string(pSavePath));
+		return true;
+	}
+	return false;
+}
+
+std::unique_ptr<SDL_Surface, PointerDeleter> MutableTexture::Flatten(){
+	std::unique_ptr<SDL_Surface, PointerDeleter> pFlattened(SDL_CreateRGBSurfaceWithFormat(0, GetWidth(), GetHeight(), 32, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888));
+	BlendLayers({0, 0, GetWidth(), GetHeight()}, pFlattened.get(), {0, 0}, &ThreadPool::GetShared());
+
+	return pFlattened;
+}
+
+void MutableTexture::Flatten(const SDL_Rect &rect, SDL_Surface *pDestination){
+	SDL_Rect imageRect = {0, 0, GetWidth(), GetHeight()}, flattenedRect;
+	if(SDL_IntersectRect(&rect, &imageRect, &flattenedRect) == SDL_FALSE) return;
+	BlendLayers(flattenedRect, pDestination, {flattenedRect.x, flattenedRect.y}, nullptr);
+}
+
+void MutableTexture::Composite(const SDL_Rect &rect){
+	TRACE_SCOPE("Composite");
+	if(!mpStaging || mpStaging->w != GetWidth() || mpStaging->h != GetHeight()){
+		mpStaging.reset(SDL_CreateRGBSurfaceWithFormat(0, GetWidth(), GetHeight(), 32, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888));
+	}
+
+	BlendLayers(rect, mpStaging.get(), {rect.x, rect.y}, &ThreadPool::GetShared());
 }
 
-bool MutableTexture::Save(const char *pSavePath){
-	std::unique_ptr<SDL_Surface, PointerDeleter> pSaveSurface(SDL_CreateRGBSurfaceWithFormat(0, GetWidth(), GetHeight(), 32, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888));
-	SDL_FillRect(pSaveSurface.get(), nullptr, SDL_MapRGBA(pSaveSurface->format, 255, 255, 255, SDL_ALPHA_TRANSPARENT));
+void MutableTexture::BlendLayers(const SDL_Rect &rect, SDL_Surface *pDestination, SDL_Point destination, ThreadPool *pPool){
+	auto blendRows = [&](size_t begin, size_t end){
+		for(int y = (int)begin; y < (int)end; y++){
+			//Starting from transparent white, as SDL_BlitSurface did before the blend modes existed
+			Uint32 *pRow = UnsafeGetPixelFromSurface<Uint32>({destination.x, destination.y + y}, pDestination);
+			std::fill(pRow, pRow + rect.w, 0xFFFFFF00);
+
+			for(size_t i = 0; i < mpSurfaces.size(); i++){
+				if(!mShowSurface[i]) continue;
+
+				Uint8 alpha = SDL_ALPHA_OPAQUE;
+				SDL_GetSurfaceAlphaMod(mpSurfaces[i].get(), &alpha);
+				BlendRow(mBlendModes[i], pRow, UnsafeGetPixel({rect.x, rect.y + y}, i), rect.w, alpha);
+			}
+		}
+	};
+
+	if(pPool != nullptr) pPool->ParallelFor(rect.h, blendRows);
+	else blendRows(0, rect.h);
+}
 
+bool MutableTexture::NeedsComposite(){
 	for(size_t i = 0; i < mpSurfaces.size(); i++){
-		//Only the surfaces that are being shown get applied
-		if(mShowSurface[i]) SDL_BlitSurface(mpSurfaces[i].get(), nullptr, pSaveSurface.get(), nullptr);
+		if(!mShowSurface[i]) continue;
+
+		Uint8 alpha = SDL_ALPHA_OPAQUE;
+		SDL_GetSurfaceAlphaMod(mpSurfaces[i].get(), &alpha);
+		if(mBlendModes[i] != BlendMode::NORMAL || alpha != SDL_ALPHA_OPAQUE) return true;
 	}
+	return false;
+}
+
+bool MutableTexture::SaveWithSDLImage(const char *pSavePath){
+	std::unique_ptr<SDL_Surface, PointerDeleter> pSaveSurface = Flatten();
 
 	if(IMG_SavePNG(pSaveSurface.get(), pSavePath)){
 		ErrorPrint("Couldn't save image in file "+std::string(pSavePath));
@@ -923,6 +1480,43 @@ int MutableTexture::GetHeight(){
 	return mpSurfaces[0]->h;
 }
 
+void MutableTexture::CreateCompositeTexture(SDL_Point size){
+	if(M_USE_LAYER_TEXTURES){
+		mpTexture.reset();
+		return;
+	}
+
+	mpTexture.reset(SDL_CreateTexture(mpRenderer, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888, SDL_TextureAccess::SDL_TEXTUREACCESS_STREAMING, size.x, size.y));
+	SDL_SetTextureBlendMode(mpTexture.get(), SDL_BLENDMODE_BLEND);
+}
+
+void MutableTexture::UploadLayer(size_t layer, const SDL_Rect &rect){
+	SDL_Surface *pLayer = mpSurfaces[layer].get();
+	std::unique_ptr<SDL_Texture, PointerDeleter> &pTexture = mpLayerTextures[layer];
+
+	int textureWidth = 0, textureHeight = 0;
+	if(pTexture) SDL_QueryTexture(pTexture.get(), nullptr, nullptr, &textureWidth, &textureHeight);
+
+	//New layers and those whose size changed get a new texture, which needs the whole layer
+	if(!pTexture || textureWidth != pLayer->w || textureHeight != pLayer->h){
+		pTexture.reset(SDL_CreateTexture(mpRenderer, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888, SDL_TextureAccess::SDL_TEXTUREACCESS_STREAMING, pLayer->w, pLayer->h));
+		if(!pTexture){
+			ErrorPrint("Couldn't create the texture of a layer: "+std::string(SDL_GetError()));
+			return;
+		}
+
+		Uint8 alpha = SDL_ALPHA_OPAQUE;
+		SDL_GetSurfaceAlphaMod(pLayer, &alpha);
+		SDL_SetTextureBlendMode(pTexture.get(), SDL_BLENDMODE_BLEND);
+		SDL_SetTextureAlphaMod(pTexture.get(), alpha);
+		SDL_UpdateTexture(pTexture.get(), nullptr, pLayer->pixels, pLayer->pitch);
+		return;
+	}
+
+	const Uint8 *pPixels = (const Uint8*)pLayer->pixels + rect.y*pLayer->pitch + rect.x*pLayer->format->BytesPerPixel;
+	SDL_UpdateTexture(pTexture.get(), &rect, pPixels, pLayer->pitch);
+}
+
 void MutableTexture::UpdateWholeTexture(){
 	UpdateTexture({0, 0, GetWidth(), GetHeight()});
 	
@@ -941,20 +1535,146 @@ SDL_Rect MutableTexture::GetChangesRect(){
 	return changesRect;
 }
 
+void BenchmarkTextureUpload(SDL_Renderer *pRenderer){
+	constexpr int SIZE = 2048, LAYERS = 4, REPETITIONS = 10;
 
+	MutableTexture image(pRenderer, SIZE, SIZE);
+	for(int i = 1; i < LAYERS; i++){
+		image.AddLayer();
 
-int Canvas::maxAmountOfUndoActionsSaved = 0;
-//CANVAS METHODS:
+		//Half transparent stripes, so that every layer has to be blended
+		SDL_Surface *pLayer = image.GetCurrentSurface();
+		for(int y = 0; y < SIZE; y += 8){
+			SDL_Rect stripe = {0, y + 2*i, SIZE, 4};
+			SDL_FillRect(pLayer, &stripe, SDL_MapRGBA(pLayer->format, 60*i, 200, 255 - 60*i, 128));
+		}
+	}
 
-Canvas::Canvas(SDL_Renderer *pRenderer, int nWidth, int nHeight) : mpImage(new MutableTexture(pRenderer, nWidth, nHeight)), mDisplayingHolder(this){
-	mActionsManager.Initialize(Canvas::maxAmountOfUndoActionsSaved);
-	mDimensions = {0, 0, nWidth, nHeight};
-	mDisplayingHolder.Update();
-	UpdateRealPosition();
-}
+	std::unique_ptr<SDL_Texture, PointerDeleter> pLockedTexture(SDL_CreateTexture(pRenderer, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888, SDL_TextureAccess::SDL_TEXTUREACCESS_STREAMING, SIZE, SIZE));
+	double counterToMs = 1000.0/SDL_GetPerformanceFrequency();
 
-Canvas::Canvas(SDL_Renderer *pRenderer, const char *pLoadFile) : mpImage(new MutableTexture(pRenderer, pLoadFile)), mDisplayingHolder(this){
-	mActionsManager.Initialize(Canvas::maxAmountOfUndoActionsSaved);
+	//The whole image (e.g: when a layer is added) and a rect of the size of a few stamps (while drawing)
+	const SDL_Rect updatedRects[2] = {{0, 0, SIZE, SIZE}, {SIZE/2, SIZE/2, 128, 128}};
+	for(const SDL_Rect &rect : updatedRects){
+		//Blending straight into the locked texture, as it was done before the staging surface existed
+		Uint64 start = SDL_GetPerformanceCounter();
+		for(int repetition = 0; repetition < REPETITIONS; repetition++){
+			SDL_Surface *pLocked = nullptr;
+			if(SDL_LockTextureToSurface(pLockedTexture.get(), &rect, &pLocked) != 0) break;
+
+			SDL_FillRect(pLocked, nullptr, SDL_MapRGBA(pLocked->format, 255, 255, 255, SDL_ALPHA_TRANSPARENT));
+			for(int layer = 0; layer < LAYERS; layer++) SDL_BlitSurface(image.GetSurfaceAtLayer(layer), &rect, pLocked, nullptr);
+			SDL_UnlockTexture(pLockedTexture.get());
+		}
+		double lockedMs = (SDL_GetPerformanceCounter() - start)*counterToMs;
+
+		start = SDL_GetPerformanceCounter();
+		for(int repetition = 0; repetition < REPETITIONS; repetition++) image.UpdateTexture(rect);
+		double stagingMs = (SDL_GetPerformanceCounter() - start)*counterToMs;
+
+		double megapixels = (double)rect.w*rect.h*REPETITIONS/1000000.0;
+		std::cout << "Composite and upload of " << rect.w << "x" << rect.h << " with " << LAYERS << " layers: " << lockedMs/megapixels << "ms/MP blending into the locked texture, "
+			<< stagingMs/megapixels << "ms/MP through the staging surface\n";
+	}
+}
+
+void BenchmarkSave(SDL_Renderer *pRenderer){
+	constexpr int SIZE = 3000, LAYERS = 3, REPETITIONS = 3;
+
+	//A gradient with some noise, so the filters and the compression have some work to do, below half transparent stripes
+	MutableTexture image(pRenderer, SIZE, SIZE);
+	for(int y = 0; y < SIZE; y++){
+		Uint32 *pRow = UnsafeGetPixelFromSurface<Uint32>({0, y}, image.GetCurrentSurface());
+		for(int x = 0; x < SIZE; x++) pRow[x] = ((x*255/SIZE) & 0xFF) << 24 | ((y*255/SIZE) & 0xFF) << 16 | (((x*y) >> 5) & 0x3F) << 8 | SDL_ALPHA_OPAQUE;
+	}
+	for(int i = 1; i < LAYERS; i++){
+		image.AddLayer();
+		SDL_Surface *pLayer = image.GetCurrentSurface();
+		for(int y = 0; y < SIZE; y += 16){
+			SDL_Rect stripe = {0, y + 4*i, SIZE, 6};
+			SDL_FillRect(pLayer, &stripe, SDL_MapRGBA(pLayer->format, 90*i, 40, 255 - 90*i, 128));
+		}
+	}
+
+	//Saved into a temporary file, so that the image of the user is never overwritten
+	const std::string savePath = (std::filesystem::temp_directory_path() / "PaintAppBenchmarkSave.png").string();
+	double counterToMs = 1000.0/SDL_GetPerformanceFrequency(), singleThreadMs = 0.0;
+
+	for(ThreadPool *pPool : {(ThreadPool*)nullptr, &ThreadPool::GetShared()}){
+		Uint64 start = SDL_GetPerformanceCounter();
+		for(int repetition = 0; repetition < REPETITIONS; repetition++){
+			if(image.Save(savePath.c_str(), Canvas::pngSaveSettings, pPool)){
+				std::remove(savePath.c_str());
+				return;
+			}
+		}
+		double saveMs = (SDL_GetPerformanceCounter() - start)*counterToMs/REPETITIONS;
+
+		if(pPool == nullptr){
+			singleThreadMs = saveMs;
+			std::cout << "Saving " << SIZE << "x" << SIZE << " with " << LAYERS << " layers in a single thread: " << saveMs << "ms\n";
+		} else {
+			std::cout << "Saving " << SIZE << "x" << SIZE << " with " << LAYERS << " layers with the thread pool (" << pPool->GetThreadAmount() << " threads): " << saveMs
+				<< "ms (" << singleThreadMs/saveMs << " times faster)\n";
+		}
+	}
+	if(!IsPngStreamAvailable()) std::cout << "The app was built without zlib, so both were saved by SDL_image in a single thread\n";
+
+	std::remove(savePath.c_str());
+}
+
+void BenchmarkComposite(SDL_Renderer *pRenderer){
+	constexpr int SIZE = 2048, LAYERS = 20, REPETITIONS = 3;
+	const char *modeNames[BLEND_MODE_AMOUNT] = {"normal", "multiply", "screen", "overlay", "add", "darken", "lighten", "difference"};
+
+	//The layers are filled once all of them exist, as compositing empty layers is quick
+	MutableTexture image(pRenderer, SIZE, SIZE);
+	for(int i = 1; i < LAYERS; i++) image.AddLayer();
+
+	//Half transparent noise above the opaque background, so that no pixel can be skipped
+	Uint32 seed = 12345;
+	for(int i = 1; i < LAYERS; i++){
+		SDL_Surface *pLayer = image.GetSurfaceAtLayer(i);
+		for(int y = 0; y < SIZE; y++){
+			Uint32 *pRow = UnsafeGetPixelFromSurface<Uint32>({0, y}, pLayer);
+			for(int x = 0; x < SIZE; x++){
+				seed = seed*1664525 + 1013904223;
+				pRow[x] = (seed & 0xFFFFFF00) | (64 + (seed >> 8 & 0x7F));
+			}
+		}
+	}
+
+	const SDL_Rect imageRect = {0, 0, SIZE, SIZE};
+	double counterToMs = 1000.0/SDL_GetPerformanceFrequency(), normalMs = 0.0;
+
+	for(int mode = 0; mode < BLEND_MODE_AMOUNT; mode++){
+		for(int i = 1; i < LAYERS; i++) image.mBlendModes[i] = (BlendMode)mode;
+
+		Uint64 start = SDL_GetPerformanceCounter();
+		for(int repetition = 0; repetition < REPETITIONS; repetition++) image.Composite(imageRect);
+		double modeMs = (SDL_GetPerformanceCounter() - start)*counterToMs/REPETITIONS;
+		if(mode == 0) normalMs = modeMs;
+
+		std::cout << "Compositing a " << SIZE << "x" << SIZE << " image with " << LAYERS << " " << modeNames[mode] << " layers (" << ThreadPool::GetShared().GetThreadAmount()
+			<< " threads): " << modeMs << "ms (" << modeMs/normalMs << " times the normal one)\n";
+	}
+}
+
+
+
+int Canvas::maxAmountOfUndoActionsSaved = 0;
+PngEncodeSettings Canvas::pngSaveSettings{};
+//CANVAS METHODS:
+
+Canvas::Canvas(SDL_Renderer *pRenderer, int nWidth, int nHeight) : mpImage(new MutableTexture(pRenderer, nWidth, nHeight)), mDisplayingHolder(this), mStrokeWorker(this){
+	mActionsManager.Initialize(Canvas::maxAmountOfUndoActionsSaved);
+	mDimensions = {0, 0, nWidth, nHeight};
+	mDisplayingHolder.Update();
+	UpdateRealPosition();
+}
+
+Canvas::Canvas(SDL_Renderer *pRenderer, const char *pLoadFile) : mpImage(new MutableTexture(pRenderer, pLoadFile)), mDisplayingHolder(this), mStrokeWorker(this){
+	mActionsManager.Initialize(Canvas::maxAmountOfUndoActionsSaved);
 	mDimensions = {0, 0, mpImage->GetWidth(), mpImage->GetHeight()};
 	mDisplayingHolder.Update();
 	UpdateRealPosition();
@@ -962,25 +1682,162 @@ Canvas::Canvas(SDL_Renderer *pRenderer, const char *pLoadFile) : mpImage(new Mut
 
 Canvas::~Canvas(){
 	if(saveOnDestroy) Save();
+
+	//The app is closing cleanly, so there is nothing to recover the next time
+	FinishPendingStrokes();
+	mJournal.Discard();
 }
 
 void Canvas::Resize(SDL_Renderer *pRenderer, int nWidth, int nHeight){
-	mpImage.reset(new MutableTexture(pRenderer, nWidth, nHeight));
+	FinishPendingStrokes();
+	{
+		//The journal may still be copying the old image, it stops once the new snapshot is queued
+		std::unique_lock<std::mutex> surfacesLock = mStrokeWorker.LockSurfaces();
+		mpImage.reset(new MutableTexture(pRenderer, nWidth, nHeight));
+		mJournal.RecordSnapshot(*mpImage);
+	}
 	mActionsManager.ClearData();
 	mDimensions = {0, 0, nWidth, nHeight};
 	UpdateRealPosition();
 	mDisplayingHolder.Update();
 	mAreaDelimiter.Clear();
+	UpdateSelection();
+}
+
+bool Canvas::StartJournal(SDL_Renderer *pRenderer){
+	bool recovered = false;
+	if(mJournal.HasRecoveryData()){
+		std::unique_ptr<MutableTexture> pRecovered = mJournal.Recover(pRenderer);
+		if(pRecovered){
+			FinishPendingStrokes();
+			mpImage = std::move(pRecovered);
+			mActionsManager.ClearData();
+			mDimensions = {0, 0, mpImage->GetWidth(), mpImage->GetHeight()};
+			UpdateRealPosition();
+			mDisplayingHolder.Update();
+			mAreaDelimiter.Clear();
+
+			PushCommand(OptionCommand::SetSliderMax(OptionInfo::OptionIDs::SELECT_LAYER, mpImage->GetTotalLayers()-1));
+			PushCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::SELECT_LAYER, mpImage->GetLayer()));
+			UpdateLayerOptions();
+			recovered = true;
+		}
+	}
+
+	//The recovered image becomes the new snapshot, so that the old journal is never replayed twice
+	mJournal.Start(*mpImage, [this]{ return mStrokeWorker.LockSurfaces(); });
+	return recovered;
+}
+
+void Canvas::ImportFile(const char *pLoadFile, SDL_Point imageSize){
+	PendingImport &pending = mPendingImports.emplace_back();
+	pending.path = pLoadFile;
+	pending.size = imageSize;
+	pending.startTime = SDL_GetTicks();
+
+	pending.pPreviewData = std::make_shared<PendingImport::PreviewData>();
+
+	//Each band of decoded rows is downscaled into the preview (taking the nearest pixels), which the main thread uploads while the rest gets decoded
+	auto onRows = [pPreviewData = pending.pPreviewData](SDL_Surface *pLayer, int firstRow, int rowCount){
+		std::lock_guard<std::mutex> previewLock(pPreviewData->mutex);
+		if(!pPreviewData->pSurface){
+			float scale = std::min(1.0f, M_PREVIEW_SIZE/(float)std::max(pLayer->w, pLayer->h));
+			pPreviewData->pSurface.reset(SDL_CreateRGBSurfaceWithFormat(0, std::max(1, (int)(pLayer->w*scale)), std::max(1, (int)(pLayer->h*scale)), 32, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888));
+			if(!pPreviewData->pSurface) return;
+		}
+
+		SDL_Surface *pPreview = pPreviewData->pSurface.get();
+		for(int y = 0; y < pPreview->h; y++){
+			int layerY = y*pLayer->h/pPreview->h;
+			if(layerY < firstRow || layerY >= firstRow + rowCount) continue;
+
+			const Uint32 *pLayerRow = UnsafeGetPixelFromSurface<Uint32>({0, layerY}, pLayer);
+			Uint32 *pPreviewRow = UnsafeGetPixelFromSurface<Uint32>({0, y}, pPreview);
+			for(int x = 0; x < pPreview->w; x++) pPreviewRow[x] = pLayerRow[x*pLayer->w/pPreview->w];
+		}
+		pPreviewData->changed = true;
+	};
+
+	//Only the surfaces are touched by the thread, the textures are created by the main thread. The layer is only returned once it's fully decoded
+	pending.layerResult = std::async(std::launch::async, [path = pending.path, size = pending.size, onRows]() -> PendingImport::Result {
+		TRACE_SCOPE("Import");
+		PendingImport::Result result;
+		result.pLayer = LoadLayerSurface(path.c_str(), result.error, onRows);
+
+		//The size was only checked against the header, which isn't guaranteed to match the pixels (a tga is only recognized by its header being valid)
+		if(result.pLayer && (result.pLayer->w != size.x || result.pLayer->h != size.y)){
+			result.error = "the decoded image is "+std::to_string(result.pLayer->w)+"x"+std::to_string(result.pLayer->h)+" but its header says "+std::to_string(size.x)+"x"+std::to_string(size.y);
+			result.pLayer.reset();
+		}
+		return result;
+	});
+}
+
+int Canvas::FinishImports(SDL_Renderer *pRenderer, int exactAmount){
+	int finishedAmount = 0;
+
+	//The layers are added in the order the files were imported, even if a later one finishes first. A stroke being drawn isn't interrupted either
+	while(!mPendingImports.empty() && !mHolded && finishedAmount != exactAmount){
+		PendingImport &pending = mPendingImports.front();
+		if(exactAmount < 0 && pending.layerResult.wait_for(std::chrono::seconds(0)) != std::future_status::ready) break;
+
+		PendingImport::Result result = pending.layerResult.get();
+		if(result.pLayer){
+			DebugPrint("Imported "+pending.path+" in "+std::to_string(SDL_GetTicks()-pending.startTime)+"ms");
+			AddImportedLayer(pRenderer, std::move(result.pLayer));
+		} else {
+			ErrorPrint("Couldn't import image "+pending.path+": "+result.error);
+		}
+
+		mPendingImports.pop_front();
+		finishedAmount++;
+	}
+
+	return finishedAmount;
 }
 
-void Canvas::OpenFile(SDL_Renderer *pRenderer, const char *pLoadFile, SDL_Point imageSize){
-	mpImage->AddFileAsLayer(pRenderer, pLoadFile, imageSize);
-	AppendCommand("52_S_SliderMax/"+std::to_string(mpImage->GetTotalLayers()-1)+"_InitialValue/"+std::to_string(mpImage->GetLayer())+"_"); //Refers to the slider SELECT_LAYER
+void Canvas::DrawPendingImports(SDL_Renderer *pRenderer){
+	for(auto &pending : mPendingImports){
+		//The preview texture gets the rows decoded since the last frame
+		{
+			std::lock_guard<std::mutex> previewLock(pending.pPreviewData->mutex);
+			SDL_Surface *pPreviewSurface = pending.pPreviewData->pSurface.get();
+			if(pending.pPreviewData->changed && pPreviewSurface){
+				if(!pending.pPreview){
+					pending.pPreview.reset(SDL_CreateTexture(pRenderer, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888, SDL_TextureAccess::SDL_TEXTUREACCESS_STREAMING, pPreviewSurface->w, pPreviewSurface->h));
+					SDL_SetTextureBlendMode(pending.pPreview.get(), SDL_BLENDMODE_BLEND);
+				}
+				if(pending.pPreview) SDL_UpdateTexture(pending.pPreview.get(), nullptr, pPreviewSurface->pixels, pPreviewSurface->pitch);
+				pending.pPreviewData->changed = false;
+			}
+		}
+
+		//The imported layers are placed at the top left corner of the image
+		SDL_Rect previewRect = {mDimensions.x, mDimensions.y, (int)(pending.size.x*mResolution), (int)(pending.size.y*mResolution)};
+		if(pending.pPreview){
+			SDL_SetTextureAlphaMod(pending.pPreview.get(), 150);
+			SDL_RenderCopy(pRenderer, pending.pPreview.get(), nullptr, &previewRect);
+		}
+		SDL_SetRenderDrawColor(pRenderer, toolPreviewMainColor.r, toolPreviewMainColor.g, toolPreviewMainColor.b, 100);
+		SDL_RenderDrawRect(pRenderer, &previewRect);
+	}
+}
+
+void Canvas::AddImportedLayer(SDL_Renderer *pRenderer, std::unique_ptr<SDL_Surface, PointerDeleter> pSurface){
+	if(!pSurface) return;
+	SDL_Point imageSize = {pSurface->w, pSurface->h};
+
+	FinishPendingStrokes();
+	std::unique_lock<std::mutex> surfacesLock = mStrokeWorker.LockSurfaces();
+	mpImage->AddSurfaceAsLayer(pRenderer, std::move(pSurface));
+	PushCommand(OptionCommand::SetSliderMax(OptionInfo::OptionIDs::SELECT_LAYER, mpImage->GetTotalLayers()-1));
+	PushCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::SELECT_LAYER, mpImage->GetLayer()));
 	UpdateLayerOptions();
 
 	//We can use GetCurrentSurface and GetLayer, since AddLayer also changes the current layer to the one just created
 	mActionsManager.SetOriginalLayer(mpImage->GetCurrentSurface(), mpImage->GetLayer());
 	mActionsManager.SetLayerCreation();
+	mJournal.RecordSnapshot(*mpImage);
 	
 	mDimensions = {0, 0, imageSize.x, imageSize.y};
 	UpdateRealPosition();
@@ -996,6 +1853,9 @@ void Canvas::SetColor(SDL_Color nDrawColor){
 }
 
 void Canvas::SetRadius(int nRadius){
+	//The circle surface is used by the worker
+	FinishPendingStrokes();
+
 	if(nRadius < 1){
 		nRadius = 1;
 	}
@@ -1011,58 +1871,49 @@ int Canvas::GetRadius(){
 	return tool_circle_data::radius+1;
 }
 
-void Canvas::DrawPixel(SDL_Point localPixel){
-	SDL_Rect usedArea{0, 0, 0, 0};
+void Canvas::DrawPixel(SDL_Point localPixel, Uint32 timestamp){
+	DrawPixels({localPixel}, timestamp);
+}
 
-	std::vector<SDL_Point> pixels{localPixel};
-	switch(mUsedTool){
-		case Tool::DRAW_TOOL:
-			mPencil.ApplyOn(pixels, mDrawColor, mpImage->GetCurrentSurface(), &usedArea);
-			break;
-		case Tool::ERASE_TOOL:
-			mEraser.ApplyOn(pixels, mpImage->GetCurrentSurface(), &usedArea);
-			break;
-		default:
-			ErrorPrint("mUsedTool can't have the value "+std::to_string(static_cast<int>(mUsedTool)));
-			break;
-	}
+void Canvas::DrawPixels(const std::vector<SDL_Point> &localPixels, Uint32 timestamp){
+	if(localPixels.empty()) return;
 
-	if(usedArea.w != 0){ //Theoretically if width is 0, height should also be 0, so no need to check
-		mpImage->UpdateTexture(usedArea);
+	if(mUsedTool != Tool::DRAW_TOOL && mUsedTool != Tool::ERASE_TOOL && mUsedTool != Tool::SMUDGE && mUsedTool != Tool::CLONE_STAMP){
+		ErrorPrint("mUsedTool shouldn't have the value "+std::to_string(static_cast<int>(mUsedTool))+ " when calling this method");
+		return;
 	}
 
-	mLastMousePixel = localPixel;
-	mActionsManager.pointTracker.push_back(mLastMousePixel);
-}
+	//The circle is generated here so that the worker never has to modify 'tool_circle_data'
+	tool_circle_data::GetCircleSurface();
 
-void Canvas::DrawPixels(const std::vector<SDL_Point> &localPixels){
-	SDL_Rect usedArea{0, 0, 0, 0};
-	
-	std::vector<SDL_Point> pixels(localPixels);
-	switch(mUsedTool){
-		case Tool::DRAW_TOOL:
-			mPencil.ApplyOn(pixels, mDrawColor, mpImage->GetCurrentSurface(), &usedArea);
-			break;
-		case Tool::ERASE_TOOL:
-			mEraser.ApplyOn(pixels, mpImage->GetCurrentSurface(), &usedArea);
-			break;
-		case Tool::COLOR_PICKER:
-			ErrorPrint("mUsedTool shouldn't have the value "+std::to_string(static_cast<int>(mUsedTool))+ " when calling this method");
-			break;
-		default:
-			ErrorPrint("mUsedTool can't have the value "+std::to_string(static_cast<int>(mUsedTool)));
-			break;
-	}
-
-	if(usedArea.w != 0){ //Theoretically if width is 0, height should also be 0, so no need to check
-		mpImage->UpdateTexture(usedArea);
-	}
+	StrokeWorker::Job job;
+	job.type = StrokeWorker::Job::Type::STAMP;
+	job.timestamp = (timestamp == 0 ? SDL_GetTicks() : timestamp);
+	job.tool = mUsedTool;
+	job.color = mDrawColor;
+	job.layer = mpImage->GetLayer();
+	job.centers = localPixels;
+	mStrokeWorker.Push(std::move(job));
 
     mLastMousePixel = localPixels.back();
 	mActionsManager.pointTracker.insert(mActionsManager.pointTracker.end(), localPixels.begin(), localPixels.end());
 }
 
+void Canvas::DrawStrokeSamples(bool strokeEnded){
+	std::vector<SDL_Point> pixels;
+	mStrokeSampler.TakeReadyPixels(pixels, strokeEnded);
+
+	//The start of the new pixels is the end of the previously drawn ones, so we don't draw it twice
+	if(!pixels.empty() && ArePointsEqual(pixels.front(), mLastMousePixel)) pixels.erase(pixels.begin());
+	if(pixels.empty()) return;
+
+	DrawPixels(pixels, mStrokeSampler.GetLastTimestamp());
+}
+
 void Canvas::Clear(std::optional<SDL_Color> clearColor){
+	FinishPendingStrokes();
+	std::unique_lock<std::mutex> surfacesLock = mStrokeWorker.LockSurfaces();
+
 	mActionsManager.SetOriginalLayer(mpImage->GetCurrentSurface(), mpImage->GetLayer());
 	
 	if (clearColor.has_value()) {
@@ -1072,6 +1923,7 @@ void Canvas::Clear(std::optional<SDL_Color> clearColor){
 	}
 	
 	mActionsManager.SetChange({0, 0, mpImage->GetWidth(), mpImage->GetHeight()}, mpImage->GetCurrentSurface());
+	mJournal.RecordRegion(mpImage->GetLayer(), mpImage->GetCurrentSurface(), {0, 0, mpImage->GetWidth(), mpImage->GetHeight()});
 }
 
 void Canvas::SetSavePath(const char *nSavePath){
@@ -1102,6 +1954,15 @@ void Canvas::SetResolution(float nResolution){
 		case Tool::AREA_DELIMITER:
 			mAreaDelimiter.SetResolution(mResolution);
 			break;
+		case Tool::BUCKET_FILL:
+			mBucketFill.SetResolution(mResolution);
+			break;
+		case Tool::SMUDGE:
+			mSmudge.SetResolution(mResolution);
+			break;
+		case Tool::CLONE_STAMP:
+			mCloneStamp.SetResolution(mResolution);
+			break;
 		default:
 			ErrorPrint("mUsedTool can't have the value "+std::to_string(static_cast<int>(mUsedTool)));
 			break;
@@ -1119,36 +1980,34 @@ void Canvas::SetResolution(float nResolution){
 }
 
 void Canvas::SetTool(Tool nUsedTool){
+	//Activating a tool modifies 'tool_circle_data', which may be in use by the worker
+	FinishPendingStrokes();
+
 	mUsedTool = nUsedTool;
 
 	switch(mUsedTool){
 		case Tool::DRAW_TOOL:
 			mPencil.Activate(); 
-			AppendCommand("T_"+std::to_string(std::to_underlying(Tool::ERASE_TOOL))+"_Active/F_\n" +
-						  "T_"+std::to_string(std::to_underlying(Tool::COLOR_PICKER))+"_Active/F_\n" + 
-						  "T_"+std::to_string(std::to_underlying(Tool::AREA_DELIMITER))+"_Active/F_\n" + 
-						  "T_"+std::to_string(std::to_underlying(Tool::DRAW_TOOL))+"_Active/T_");
 			break;
 		case Tool::ERASE_TOOL:
 			mEraser.Activate();
-			AppendCommand("T_"+std::to_string(std::to_underlying(Tool::DRAW_TOOL))+"_Active/F_\n" +
-						  "T_"+std::to_string(std::to_underlying(Tool::COLOR_PICKER))+"_Active/F_\n" + 
-						  "T_"+std::to_string(std::to_underlying(Tool::AREA_DELIMITER))+"_Active/F_\n" + 
-						  "T_"+std::to_string(std::to_underlying(Tool::ERASE_TOOL))+"_Active/T_");
 			break;
 		case Tool::COLOR_PICKER:
 			mColorPicker.Activate();
-			AppendCommand("T_"+std::to_string(std::to_underlying(Tool::DRAW_TOOL))+"_Active/F_\n" +
-						  "T_"+std::to_string(std::to_underlying(Tool::ERASE_TOOL))+"_Active/F_\n" + 
-						  "T_"+std::to_string(std::to_underlying(Tool::AREA_DELIMITER))+"_Active/F_\n" + 
-						  "T_"+std::to_string(std::to_underlying(Tool::COLOR_PICKER))+"_Active/T_");
 			break;
 		case Tool::AREA_DELIMITER:
 			mAreaDelimiter.Activate();
-			AppendCommand("T_"+std::to_string(std::to_underlying(Tool::DRAW_TOOL))+"_Active/F_\n" +
-						  "T_"+std::to_string(std::to_underlying(Tool::ERASE_TOOL))+"_Active/F_\n" + 
-						  "T_"+std::to_string(std::to_underlying(Tool::COLOR_PICKER))+"_Active/F_\n" +
-						  "T_"+std::to_string(std::to_underlying(Tool::AREA_DELIMITER))+"_Active/T_");
+			break;
+		case Tool::BUCKET_FILL:
+			mBucketFill.Activate();
+			break;
+		case Tool::SMUDGE:
+			mSmudge.Activate();
+			//Switching in the middle of a stroke continues it without a BEGIN_STROKE job, which must not carry the colors of the last smudge stroke
+			mSmudge.BeginStroke();
+			break;
+		case Tool::CLONE_STAMP:
+			mCloneStamp.Activate();
 			break;
 		default:
 			ErrorPrint("mUsedTool can't have the value "+std::to_string(static_cast<int>(mUsedTool)));
@@ -1156,62 +2015,118 @@ void Canvas::SetTool(Tool nUsedTool){
 			mPencil.Activate(); 
 			break;
 	}
+
+	//The options of the other tools get hidden before showing the ones of the used tool, so that the options shared with it stay active
+	for(auto tool : {Tool::DRAW_TOOL, Tool::ERASE_TOOL, Tool::COLOR_PICKER, Tool::AREA_DELIMITER, Tool::BUCKET_FILL, Tool::SMUDGE, Tool::CLONE_STAMP}){
+		if(tool != mUsedTool) PushCommand(OptionCommand::SetActive(Option::PrimitiveToTag(std::to_underlying(tool)), false));
+	}
+	PushCommand(OptionCommand::SetActive(Option::PrimitiveToTag(std::to_underlying(mUsedTool)), true));
 }
 
 void Canvas::ApplyAreaOutline(){
-	std::vector<SDL_Point> pixels {};
 	std::vector<SDL_FPoint> corners = mAreaDelimiter.GetPointsCopy();
-
 	if(corners.empty()) return;
 
-	for(int i = 0; i+1 < corners.size(); ++i){
-		std::vector<SDL_Point> segmentPoints = GetPointsInFSegment(corners[i], corners[i+1]);
-		pixels.insert(pixels.end(), segmentPoints.begin(), segmentPoints.end());
-	}
+	FinishPendingStrokes();
 
-	if(mAreaDelimiter.loopBack){
-		std::vector<SDL_Point> segmentPoints = GetPointsInFSegment(corners.back(), corners.front());
-		pixels.insert(pixels.end(), segmentPoints.begin(), segmentPoints.end());
+	//The whole outline is rasterized as a single shape, so every pixel is blended once no matter how much the segments and joins overlap
+	CoverageMask outlineMask;
+	mRasterizer.Clear();
+	mStroker.Stroke(corners, std::max(GetRadius() - 0.5f, 0.5f), mAreaDelimiter.loopBack, mRasterizer);
+	mRasterizer.Rasterize({0, 0, mpImage->GetWidth(), mpImage->GetHeight()}, FillRule::NON_ZERO, true, outlineMask);
+
+	ApplyCoverage(outlineMask);
+}
+
+void Canvas::ApplyAreaFill(){
+	std::vector<SDL_FPoint> corners = mAreaDelimiter.GetPointsCopy();
+	if(corners.size() < 3) return;
+
+	FinishPendingStrokes();
+
+	//The area is always closed, and self intersecting parts are filled too (non-zero rule)
+	CoverageMask fillMask;
+	mRasterizer.Clear();
+	mRasterizer.AddContour(corners);
+	mRasterizer.RasterizeExact({0, 0, mpImage->GetWidth(), mpImage->GetHeight()}, fillMask);
+
+	ApplyCoverage(fillMask);
+}
+
+void Canvas::ApplyCoverage(CoverageMask &mask){
+	if(mask.IsEmpty()) return;
+
+	std::unique_lock<std::mutex> surfacesLock = mStrokeWorker.LockSurfaces();
+	mActionsManager.SetOriginalLayer(mpImage->GetCurrentSurface(), mpImage->GetLayer());
+	SDL_Rect affectedRect = BlendCoverage(mpImage->GetCurrentSurface(), mask, mDrawColor, GetSelection());
+
+	if(affectedRect.w > 0 && affectedRect.h > 0){
+		mActionsManager.SetChange(affectedRect, mpImage->GetCurrentSurface());
+		mJournal.RecordRegion(mpImage->GetLayer(), mpImage->GetCurrentSurface(), affectedRect);
+		mpImage->UpdateTexture(affectedRect, mpImage->GetLayer());
 	}
+}
+
+void Canvas::FillArea(SDL_Point pixel){
+	FinishPendingStrokes();
+	std::unique_lock<std::mutex> surfacesLock = mStrokeWorker.LockSurfaces();
 
-	Tool usedTool = mUsedTool;
-	SetTool(Tool::DRAW_TOOL);
-	
 	mActionsManager.SetOriginalLayer(mpImage->GetCurrentSurface(), mpImage->GetLayer());
+	SDL_Rect affectedRect = mBucketFill.ApplyOn(mpImage.get(), pixel, mDrawColor, GetSelection());
 
-	DrawPixels(pixels);
+	if(affectedRect.w > 0 && affectedRect.h > 0){
+		mActionsManager.SetChange(affectedRect, mpImage->GetCurrentSurface());
+		mJournal.RecordRegion(mpImage->GetLayer(), mpImage->GetCurrentSurface(), affectedRect);
+		mpImage->UpdateTexture(affectedRect, mpImage->GetLayer());
+	}
+}
 
-	SDL_FRect enclosingRect = {-1,-1,-1,-1};
-	SDL_Rect affectedRect;
-	SDL_EncloseFPoints(corners.data(), corners.size(), nullptr, &enclosingRect);
-	
-	int radius = GetRadius();
+void Canvas::UpdateSelection(){
+	//The worker may be clipping its stamps against the current selection
+	FinishPendingStrokes();
 
-	affectedRect.x = std::max((int)floorf(enclosingRect.x)+1-radius, 0);
-	affectedRect.y = std::max((int)floorf(enclosingRect.y)+1-radius, 0);
-	//To the width and heigth, we substract the offset of the x and y, so, for example, if 2 rows of pixels fell above the canvas, the height should be reduced by 2
-	affectedRect.w = std::min((int)ceilf(enclosingRect.w)+1+radius - (affectedRect.x - (int)floorf(enclosingRect.x)+1-radius), mpImage->GetWidth());
-	affectedRect.h = std::min((int)ceilf(enclosingRect.h)+1+radius - (affectedRect.y - (int)floorf(enclosingRect.y)+1-radius), mpImage->GetHeight());
+	std::vector<SDL_FPoint> corners = mAreaDelimiter.GetPointsCopy();
+	mUseSelection = mAreaDelimiter.restrictPainting && corners.size() >= 3;
+	if(!mUseSelection){
+		mSelection.Reset({0, 0, 0, 0});
+		return;
+	}
 
-	mActionsManager.SetChange(affectedRect, mpImage->GetCurrentSurface());
-	mActionsManager.pointTracker.clear();
+	//Same rule as 'ApplyAreaFill', so the selection covers exactly what filling the area paints (e.g: the center of a pentagram)
+	mRasterizer.Clear();
+	mRasterizer.AddContour(corners);
+	mRasterizer.Rasterize({0, 0, mpImage->GetWidth(), mpImage->GetHeight()}, FillRule::NON_ZERO, mAreaDelimiter.smoothEdges, mSelection);
+}
 
-	SetTool(usedTool);
+void Canvas::ApplyFilter(){
+	FinishPendingStrokes();
+	std::unique_lock<std::mutex> surfacesLock = mStrokeWorker.LockSurfaces();
+
+	mActionsManager.SetOriginalLayer(mpImage->GetCurrentSurface(), mpImage->GetLayer());
+	SDL_Rect affectedRect = mFilterEngine.Apply(mpImage->GetCurrentSurface(), {0, 0, mpImage->GetWidth(), mpImage->GetHeight()}, GetSelection(), ThreadPool::GetShared());
+
+	if(affectedRect.w > 0 && affectedRect.h > 0){
+		mActionsManager.SetChange(affectedRect, mpImage->GetCurrentSurface());
+		mJournal.RecordRegion(mpImage->GetLayer(), mpImage->GetCurrentSurface(), affectedRect);
+		mpImage->UpdateTexture(affectedRect, mpImage->GetLayer());
+	}
 }
 
-void Canvas::AppendCommand(const std::string &nCommand){
-	mCommands += nCommand + "\n";
+void Canvas::PushCommand(const OptionCommand &nCommand){
+	if(!mCommands.Push(nCommand)){
+		ErrorPrint("The commands queue is full, a command for the option "+std::to_string(std::to_underlying(nCommand.optionID))+" was discarded");
+	}
 }
 
-std::string Canvas::GiveCommands(){
-	std::string sCopy(mCommands);
-	mCommands.clear();
-	return sCopy;
+OptionCommandQueue &Canvas::GetCommands(){
+	return mCommands;
 }
 
 void Canvas::Undo(){
 	//We don't want to undo anything if the user is drawing
 	if(mHolded) return;
+	FinishPendingStrokes();
+	std::unique_lock<std::mutex> surfacesLock = mStrokeWorker.LockSurfaces();
 
 	int neededLayer = mActionsManager.GetUndoLayer();
 	SDL_Rect affectedRect = {-1,-1,-1,-1};
@@ -1223,11 +2138,12 @@ void Canvas::Undo(){
 				//If the layer changed is not from the current one, we set it
 				if(mpImage->GetLayer() != neededLayer){
 					mpImage->SetLayer(neededLayer);
-					AppendCommand("52_S_InitialValue/"+std::to_string(mpImage->GetLayer())+"_"); //Refers to the slider SELECT_LAYER
+					PushCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::SELECT_LAYER, mpImage->GetLayer()));
 				}
 				
 				//Finally we update the texture as needed
-				mpImage->UpdateTexture(affectedRect);
+				mpImage->UpdateTexture(affectedRect, neededLayer);
+				mJournal.RecordRegion(neededLayer, mpImage->GetSurfaceAtLayer(neededLayer), affectedRect);
 			}
 			break;
 		
@@ -1238,10 +2154,12 @@ void Canvas::Undo(){
 			}
 
 			mpImage->DeleteCurrentLayer();
-			AppendCommand("52_S_SliderMax/"+std::to_string(mpImage->GetTotalLayers()-1)+"_InitialValue/"+std::to_string(mpImage->GetLayer())+"_"); //Refers to the slider SELECT_LAYER
+			PushCommand(OptionCommand::SetSliderMax(OptionInfo::OptionIDs::SELECT_LAYER, mpImage->GetTotalLayers()-1));
+			PushCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::SELECT_LAYER, mpImage->GetLayer()));
 			
 			mActionsManager.UndoChange(nullptr, nullptr); //This does nothing apart from decrementing the undo index
 			//We don't need to update the texture, since DeleteCurrentLayer already does it
+			mJournal.RecordSnapshot(*mpImage);
 			break;
 
 		case ActionsManager::Action::LAYER_DESTRUCTION:
@@ -1251,12 +2169,14 @@ void Canvas::Undo(){
 			}
 
 			mpImage->AddLayer();
-			AppendCommand("52_S_SliderMax/"+std::to_string(mpImage->GetTotalLayers()-1)+"_InitialValue/"+std::to_string(mpImage->GetLayer())+"_"); //Refers to the slider SELECT_LAYER
+			PushCommand(OptionCommand::SetSliderMax(OptionInfo::OptionIDs::SELECT_LAYER, mpImage->GetTotalLayers()-1));
+			PushCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::SELECT_LAYER, mpImage->GetLayer()));
 
 			//Finally we set the surface to the deleted one
 			mActionsManager.UndoChange(mpImage->GetCurrentSurface(), &affectedRect);
 			//We need to update the texture since, even though AddLayer already does it, we then apply the changes of the destroyed layer
 			mpImage->UpdateTexture(affectedRect);
+			mJournal.RecordSnapshot(*mpImage);
 			break;
 			
 		default: break;
@@ -1267,6 +2187,8 @@ void Canvas::Undo(){
 void Canvas::Redo(){
 	//We don't want to redo anything if the user is drawing
 	if(mHolded) return;
+	FinishPendingStrokes();
+	std::unique_lock<std::mutex> surfacesLock = mStrokeWorker.LockSurfaces();
 
 	int neededLayer = mActionsManager.GetRedoLayer();
 	SDL_Rect affectedRect = {-1,-1,-1,-1};
@@ -1278,11 +2200,12 @@ void Canvas::Redo(){
 				//If the layer changed is not from the current one, we set it
 				if(mpImage->GetLayer() != neededLayer){
 					mpImage->SetLayer(neededLayer);
-					AppendCommand("52_S_InitialValue/"+std::to_string(mpImage->GetLayer())+"_"); //Refers to the slider SELECT_LAYER
+					PushCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::SELECT_LAYER, mpImage->GetLayer()));
 				}
 				
 				//Finally we update the texture as needed
-				mpImage->UpdateTexture(affectedRect);
+				mpImage->UpdateTexture(affectedRect, neededLayer);
+				mJournal.RecordRegion(neededLayer, mpImage->GetSurfaceAtLayer(neededLayer), affectedRect);
 			}
 			break;
 
@@ -1293,12 +2216,14 @@ void Canvas::Redo(){
 			}
 
 			mpImage->AddLayer();
-			AppendCommand("52_S_SliderMax/"+std::to_string(mpImage->GetTotalLayers()-1)+"_InitialValue/"+std::to_string(mpImage->GetLayer())+"_"); //Refers to the slider SELECT_LAYER
+			PushCommand(OptionCommand::SetSliderMax(OptionInfo::OptionIDs::SELECT_LAYER, mpImage->GetTotalLayers()-1));
+			PushCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::SELECT_LAYER, mpImage->GetLayer()));
 
 			//Finally we redo the surface
 			mActionsManager.RedoChange(mpImage->GetCurrentSurface(), &affectedRect);
 			//We need to update the texture since, even though AddLayer already does it, we then apply the changes of the layer
 			mpImage->UpdateTexture(affectedRect);
+			mJournal.RecordSnapshot(*mpImage);
 			break;
 		
 		case ActionsManager::Action::LAYER_DESTRUCTION:
@@ -1308,10 +2233,12 @@ void Canvas::Redo(){
 			}
 
 			mpImage->DeleteCurrentLayer();
-			AppendCommand("52_S_SliderMax/"+std::to_string(mpImage->GetTotalLayers()-1)+"_InitialValue/"+std::to_string(mpImage->GetLayer())+"_"); //Refers to the slider SELECT_LAYER
+			PushCommand(OptionCommand::SetSliderMax(OptionInfo::OptionIDs::SELECT_LAYER, mpImage->GetTotalLayers()-1));
+			PushCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::SELECT_LAYER, mpImage->GetLayer()));
 
 			mActionsManager.RedoChange(nullptr, nullptr); //This does nothing apart from decrementing the undo index
 			//We don't need to update the texture, since DeleteCurrentLayer already does it
+			mJournal.RecordSnapshot(*mpImage);
 			break;
 
 		default: break;
@@ -1326,20 +2253,47 @@ void Canvas::HandleEvent(SDL_Event *event){
 		if(!SDL_PointInRect(&mousePos, &viewport)) return;
 
 		switch(mUsedTool){
-			case Tool::DRAW_TOOL: case Tool::ERASE_TOOL:{
-				mActionsManager.SetOriginalLayer(mpImage->GetCurrentSurface(), mpImage->GetLayer());
-
+			case Tool::DRAW_TOOL: case Tool::ERASE_TOOL: case Tool::SMUDGE: case Tool::CLONE_STAMP:{
 				SDL_Point pixel = GetPointCell({mousePos.x-(mDimensions.x+viewport.x), mousePos.y-(mDimensions.y+viewport.y)}, mResolution);
-				DrawPixel(pixel);
+
+				//Alt clicking with the clone stamp chooses where it copies from instead of painting
+				if(mUsedTool == Tool::CLONE_STAMP && (SDL_GetModState() & KMOD_ALT)){
+					FinishPendingStrokes();
+					mCloneStamp.SetSource(pixel);
+					break;
+				}
+				if(mUsedTool == Tool::CLONE_STAMP && !mCloneStamp.HasSource()){
+					DebugPrint("The clone stamp needs a source, alt click the point to copy from");
+					break;
+				}
+
+				//The original layer is copied by the worker, so that the previous stroke has already been applied when it happens
+				StrokeWorker::Job beginJob;
+				beginJob.type = StrokeWorker::Job::Type::BEGIN_STROKE;
+				beginJob.timestamp = event->button.timestamp;
+				beginJob.tool = mUsedTool;
+				beginJob.layer = mpImage->GetLayer();
+				mStrokeWorker.Push(std::move(beginJob));
+
+				DrawPixel(pixel, event->button.timestamp);
+
+				mStrokeSampler.Clear();
+				mStrokeSampler.Push(GetRealPointCell({mousePos.x-(mDimensions.x+viewport.x), mousePos.y-(mDimensions.y+viewport.y)}, mResolution), event->button.timestamp);
 				
 				mHolded = true;
 				break;
 			}
 			case Tool::COLOR_PICKER:{
 				SDL_Point pixel = GetPointCell({mousePos.x-(mDimensions.x+viewport.x), mousePos.y-(mDimensions.y+viewport.y)}, mResolution);
+				FinishPendingStrokes();
 				mColorPicker.GrabColor(this, mpImage.get(), pixel);
 				break;
 			}	
+			case Tool::BUCKET_FILL:{
+				SDL_Point pixel = GetPointCell({mousePos.x-(mDimensions.x+viewport.x), mousePos.y-(mDimensions.y+viewport.y)}, mResolution);
+				FillArea(pixel);
+				break;
+			}
 			case Tool::AREA_DELIMITER:{
 				SDL_FPoint relativePosition = GetRealPointCell({mousePos.x-(mDimensions.x+viewport.x), mousePos.y-(mDimensions.y+viewport.y)}, mResolution);
 				mHolded = mAreaDelimiter.HandleEvent(event, relativePosition);
@@ -1351,52 +2305,36 @@ void Canvas::HandleEvent(SDL_Event *event){
 		}
 	}
 	else if (mHolded && event->type == SDL_MOUSEMOTION){
-        SDL_Point mousePos = {event->button.x, event->button.y};
+        SDL_Point mousePos = {event->motion.x, event->motion.y};
 		SDL_Point pixel = GetPointCell({mousePos.x-(mDimensions.x+viewport.x), mousePos.y-(mDimensions.y+viewport.y)}, mResolution);
 
-        //Check the mouse is in the viewport
-		if(!SDL_PointInRect(&mousePos, &viewport)){
-			//We still set mLastMousePixel
-			mLastMousePixel = pixel;
-			return;
-		}
-
-	
-		//Check the pixel wasn't the last one modified
-		if(ArePointsEqual(mLastMousePixel, pixel)) return;
-		
-		//If the last pixel where the mouse was registered and the current pixel are separated by more than 1 unit in any axis, we also set the pixels in between
-		if(std::abs(pixel.x-mLastMousePixel.x) > 1 || std::abs(pixel.y-mLastMousePixel.y) > 1){
-			
-			switch(mUsedTool){
-				case Tool::DRAW_TOOL: case Tool::ERASE_TOOL:
-					DrawPixels(GetPointsInSegment(mLastMousePixel, pixel));
-					break;
-
-				case Tool::AREA_DELIMITER:
-					SDL_FPoint relativePosition = GetRealPointCell({mousePos.x-(mDimensions.x+viewport.x), mousePos.y-(mDimensions.y+viewport.y)}, mResolution);
-					mAreaDelimiter.HandleEvent(event, relativePosition);
-					break;
+		switch(mUsedTool){
+			case Tool::DRAW_TOOL: case Tool::ERASE_TOOL: case Tool::SMUDGE: case Tool::CLONE_STAMP:{
+				//Every motion is sampled, even outside the viewport, so that the stroke keeps its shape when the mouse goes back in
+				mStrokeSampler.Push(GetRealPointCell({mousePos.x-(mDimensions.x+viewport.x), mousePos.y-(mDimensions.y+viewport.y)}, mResolution), event->motion.timestamp);
+				if(!SDL_PointInRect(&mousePos, &viewport)) return;
 
-				default:
-					ErrorPrint("mUsedTool can't have the value "+std::to_string(static_cast<int>(mUsedTool)));
-					break;
+				DrawStrokeSamples(false);
+				break;
 			}
-		} else {
-			switch(mUsedTool){
-				case Tool::DRAW_TOOL: case Tool::ERASE_TOOL:
-					DrawPixel(pixel);
-					break;
+			case Tool::AREA_DELIMITER:{
+				//Check the mouse is in the viewport
+				if(!SDL_PointInRect(&mousePos, &viewport)){
+					//We still set mLastMousePixel
+					mLastMousePixel = pixel;
+					return;
+				}
 
-				case Tool::AREA_DELIMITER:
-					SDL_FPoint relativePosition = GetRealPointCell({mousePos.x-(mDimensions.x+viewport.x), mousePos.y-(mDimensions.y+viewport.y)}, mResolution);
-					mAreaDelimiter.HandleEvent(event, relativePosition);
-					break;
+				//Check the pixel wasn't the last one modified
+				if(ArePointsEqual(mLastMousePixel, pixel)) return;
 
-				default:
-					ErrorPrint("mUsedTool can't have the value "+std::to_string(static_cast<int>(mUsedTool)));
-					break;
+				SDL_FPoint relativePosition = GetRealPointCell({mousePos.x-(mDimensions.x+viewport.x), mousePos.y-(mDimensions.y+viewport.y)}, mResolution);
+				mAreaDelimiter.HandleEvent(event, relativePosition);
+				break;
 			}
+			default:
+				ErrorPrint("mUsedTool can't have the value "+std::to_string(static_cast<int>(mUsedTool)));
+				break;
 		}
 	}
 	else if (event->type == SDL_MOUSEBUTTONUP){
@@ -1404,8 +2342,15 @@ void Canvas::HandleEvent(SDL_Event *event){
 
 		if(mUsedTool == Tool::AREA_DELIMITER){
 			mAreaDelimiter.HandleEvent(event, {-1, -1}); //This one doesn't really matter
+			if(mAreaDelimiter.restrictPainting) UpdateSelection();
+		}
+		else if(mUsedTool == Tool::DRAW_TOOL || mUsedTool == Tool::ERASE_TOOL || mUsedTool == Tool::SMUDGE || mUsedTool == Tool::CLONE_STAMP){
+			//The last segment of the stroke can only be drawn now that we know no more samples will follow
+			DrawStrokeSamples(true);
+			mStrokeSampler.Clear();
 		}
-		else if(mActionsManager.pointTracker.size() != 0){
+		
+		if(mUsedTool != Tool::AREA_DELIMITER && mActionsManager.pointTracker.size() != 0){
 			SDL_Rect enclosingRect = {-1,-1,-1,-1}, affectedRect;
 			SDL_EnclosePoints(mActionsManager.pointTracker.data(), mActionsManager.pointTracker.size(), nullptr, &enclosingRect);
 			
@@ -1419,8 +2364,15 @@ void Canvas::HandleEvent(SDL_Event *event){
 			
 			mActionsManager.pointTracker.clear();
 
-			//We make sure there is actually some change to apply
-			if(affectedRect.w > 0 && affectedRect.h > 0) mActionsManager.SetChange(affectedRect, mpImage->GetCurrentSurface());
+			//We make sure there is actually some change to apply. It's saved by the worker once the whole stroke has been applied
+			if(affectedRect.w > 0 && affectedRect.h > 0){
+				StrokeWorker::Job commitJob;
+				commitJob.type = StrokeWorker::Job::Type::COMMIT;
+				commitJob.timestamp = event->button.timestamp;
+				commitJob.layer = mpImage->GetLayer();
+				commitJob.affectedRect = affectedRect;
+				mStrokeWorker.Push(std::move(commitJob));
+			}
 		}
 	}
 	else if(event->type == SDL_KEYDOWN){
@@ -1437,9 +2389,9 @@ void Canvas::HandleEvent(SDL_Event *event){
 			case SDLK_q: SetResolution(mResolution-10.0f*M_MIN_RESOLUTION); break;
 			case SDLK_0: Undo(); break;
 			case SDLK_9: Redo(); break;
-			case SDLK_r: if(mUsedTool == Tool::AREA_DELIMITER && !mHolded) mAreaDelimiter.AddBeforeSelected(); break;
-			case SDLK_f: if(mUsedTool == Tool::AREA_DELIMITER && !mHolded) mAreaDelimiter.EraseSelected(); break;
-			case SDLK_c: if(mUsedTool == Tool::AREA_DELIMITER && !mHolded) mAreaDelimiter.Clear(); break;
+			case SDLK_r: if(mUsedTool == Tool::AREA_DELIMITER && !mHolded){ mAreaDelimiter.AddBeforeSelected(); UpdateSelection(); } break;
+			case SDLK_f: if(mUsedTool == Tool::AREA_DELIMITER && !mHolded){ mAreaDelimiter.EraseSelected(); UpdateSelection(); } break;
+			case SDLK_c: if(mUsedTool == Tool::AREA_DELIMITER && !mHolded){ mAreaDelimiter.Clear(); UpdateSelection(); } break;
 		}
 	}
 	else if (event->type == SDL_KEYUP){
@@ -1463,7 +2415,16 @@ void Canvas::HandleEvent(SDL_Event *event){
 }
 
 void Canvas::Update(float deltaTime){
-	mpImage->UpdateTexture();
+	//We upload whatever the worker has finished so far, without waiting for the rest of the stroke
+	//Every upload reads the layers, so it has to happen while the worker can't write them
+	{
+		std::unique_lock<std::mutex> surfacesLock = mStrokeWorker.LockSurfaces();
+		mpImage->UpdateTexture();
+
+		int dirtyLayer = -1;
+		SDL_Rect dirtyRect = mStrokeWorker.TakeDirtyRect(&dirtyLayer);
+		if(dirtyRect.w > 0 && dirtyRect.h > 0) mpImage->UpdateTexture(dirtyRect, dirtyLayer);
+	}
 
 	if(mCanvasMovement != Movement::NONE){
 		float speed = ((SDL_GetModState() & KMOD_SHIFT) ? fastMovementSpeed : defaultMovementSpeed);
@@ -1477,6 +2438,13 @@ void Canvas::Update(float deltaTime){
 		mDimensions.y = (int)mRealPosition.y;
 		mDisplayingHolder.Update();
 	}
+
+	//The journal gets folded into its snapshot, so that it doesn't grow forever nor take long to replay. Never in the middle of a stroke
+	mInternalTimer += deltaTime;
+	if(mInternalTimer >= M_MAX_TIMER && !mHolded){
+		mJournal.Compact(*mpImage);
+		mInternalTimer = 0.0f;
+	}
 }
 
 void Canvas::DrawIntoRenderer(SDL_Renderer *pRenderer){
@@ -1511,13 +2479,14 @@ void Canvas::DrawIntoRenderer(SDL_Renderer *pRenderer){
 	//SDL_RenderSetViewport(pRenderer, &intersectRect);
 	SDL_RenderSetViewport(pRenderer, &viewport);
 	mpImage->DrawIntoRenderer(pRenderer, mDimensions);
+	DrawPendingImports(pRenderer);
 
 	bool enoughRadius = false;
 	switch(mUsedTool){
-		case Tool::DRAW_TOOL: case Tool::ERASE_TOOL:
+		case Tool::DRAW_TOOL: case Tool::ERASE_TOOL: case Tool::SMUDGE: case Tool::CLONE_STAMP:
 			enoughRadius = GetRadius() > 4;
 			break;
-		case Tool::COLOR_PICKER: case Tool::AREA_DELIMITER:
+		case Tool::COLOR_PICKER: case Tool::AREA_DELIMITER: case Tool::BUCKET_FILL:
 			enoughRadius = true;
 			break;
 		default:
@@ -1542,12 +2511,15 @@ void Canvas::DrawIntoRenderer(SDL_Renderer *pRenderer){
 		//We find the middle pixel
 		SDL_Point pixel = GetPointCell({(int)mousePosition.x-viewport.x-mDimensions.x, (int)mousePosition.y-viewport.y-mDimensions.y}, mResolution);
 		
-		SDL_Color previewColor = toolPreviewMainColor;
-		bool validColor = true;
-		SDL_Color pixelColor = mpImage->GetPixelColor(pixel, &validColor);
-		if(validColor && ((int)pixelColor.r + (int)pixelColor.g + (int)pixelColor.b)*(pixelColor.a/255.0f) <= 127.0f*3){
-			previewColor = toolPreviewAlternateColor;
+		//If the worker is painting, we keep the last preview color instead of waiting for it
+		std::unique_lock<std::mutex> surfacesLock = mStrokeWorker.TryLockSurfaces();
+		if(surfacesLock.owns_lock()){
+			bool validColor = true;
+			SDL_Color pixelColor = mpImage->GetPixelColor(pixel, &validColor);
+			mUseAlternatePreviewColor = validColor && ((int)pixelColor.r + (int)pixelColor.g + (int)pixelColor.b)*(pixelColor.a/255.0f) <= 127.0f*3;
+			surfacesLock.unlock();
 		}
+		SDL_Color previewColor = (mUseAlternatePreviewColor ? toolPreviewAlternateColor : toolPreviewMainColor);
 
         /*
         We would perform these operations in order to then send pixel to Pencil::DrawPreview. This has been discarded as it wouldn't result in a pixel perfect preview 	
@@ -1568,6 +2540,15 @@ void Canvas::DrawIntoRenderer(SDL_Renderer *pRenderer){
 			case Tool::COLOR_PICKER:
 				mColorPicker.DrawPreview(mouseToCanvas, pRenderer, previewColor);
 				break;
+			case Tool::BUCKET_FILL:
+				mBucketFill.DrawPreview(mouseToCanvas, pRenderer, previewColor);
+				break;
+			case Tool::SMUDGE:
+				mSmudge.DrawPreview(mouseToCanvas, pRenderer, previewColor);
+				break;
+			case Tool::CLONE_STAMP:
+				mCloneStamp.DrawPreview(mouseToCanvas, pRenderer, previewColor);
+				break;
 			case Tool::AREA_DELIMITER:
 				SDL_RenderSetViewport(pRenderer, &viewport);
 				mAreaDelimiter.DrawPreview({mDimensions.x, mDimensions.y}, pRenderer, areaDelimiterColor);
@@ -1588,11 +2569,14 @@ void Canvas::Save(){
 	if(mSavePath.empty()){
 		return;
 	}
+	TRACE_SCOPE("Save");
 
 	DebugPrint("About to save "+mSavePath);
+	FinishPendingStrokes();
 	
-	if(!mpImage->Save(mSavePath.c_str())){
-		DebugPrint("Saved "+mSavePath);
+	Uint32 startTime = SDL_GetTicks();
+	if(!mpImage->Save(mSavePath.c_str(), pngSaveSettings)){
+		DebugPrint("Saved "+mSavePath+" in "+std::to_string(SDL_GetTicks()-startTime)+"ms");
 	}
 }
 
@@ -1617,24 +2601,30 @@ SDL_Point Canvas::GetGlobalPosition(){
 
 void Canvas::AddLayer(){
 	if(mHolded) return; //We don't want to change the current layer if its being used
+	FinishPendingStrokes();
+	std::unique_lock<std::mutex> surfacesLock = mStrokeWorker.LockSurfaces();
 
 	mpImage->AddLayer();
 
 	//We can use GetCurrentSurface and GetLayer, since AddLayer also changes the current layer to the one just created
 	mActionsManager.SetOriginalLayer(mpImage->GetCurrentSurface(), mpImage->GetLayer());
 	mActionsManager.SetLayerCreation();
+	mJournal.RecordSnapshot(*mpImage);
 	
 	UpdateLayerOptions();
 }
 
 void Canvas::DeleteCurrentLayer(){
 	if(mHolded) return; //We don't want the current layer to get deleted if its being used
+	FinishPendingStrokes();
+	std::unique_lock<std::mutex> surfacesLock = mStrokeWorker.LockSurfaces();
 
 	mActionsManager.SetOriginalLayer(mpImage->GetCurrentSurface(), mpImage->GetLayer());
 
 	//We need to make sure that the current layer can be deleted, otherwise we would be adding an event that really didn't ocurr
 	if(mpImage->DeleteCurrentLayer()){
 		mActionsManager.SetLayerDestruction();
+		mJournal.RecordSnapshot(*mpImage);
 	}
 
 	UpdateLayerOptions();
@@ -1650,14 +2640,26 @@ void Canvas::SetLayer(int nLayer){
 
 void Canvas::SetLayerVisibility(bool visible){
 	if(mHolded) return; //We don't want to make the current layer visible or hiden
+	FinishPendingStrokes();
 
 	mpImage->SetLayerVisibility(visible);
+	mJournal.RecordLayerState(mpImage->GetLayer(), visible, mpImage->GetLayerAlpha(), mpImage->GetLayerBlendMode());
 }
 
 void Canvas::SetLayerAlpha(Uint8 alpha){
 	if(mHolded) return; //We don't want to make the current layer visible or hiden
+	FinishPendingStrokes();
 
 	mpImage->SetLayerAlpha(alpha);
+	mJournal.RecordLayerState(mpImage->GetLayer(), mpImage->GetLayerVisibility(), alpha, mpImage->GetLayerBlendMode());
+}
+
+void Canvas::SetLayerBlendMode(BlendMode mode){
+	if(mHolded) return; //We don't want to change how the current layer looks while it's being drawn on
+	FinishPendingStrokes();
+
+	mpImage->SetLayerBlendMode(mode);
+	mJournal.RecordLayerState(mpImage->GetLayer(), mpImage->GetLayerVisibility(), mpImage->GetLayerAlpha(), mode);
 }
 
 MutableTexture *Canvas::GetImage(){
@@ -1936,7 +2938,252 @@ void Canvas::ActionsManager::RotateUndoHistoryIfFull(){
 	}
 }
 
+//STROKE SAMPLER METHODS:
+
+void Canvas::StrokeSampler::Clear(){
+	mFirst = 0;
+	mSize = 0;
+	mTotalPushed = 0;
+	mNextSegment = 0;
+}
+
+void Canvas::StrokeSampler::Push(SDL_FPoint position, Uint32 timestamp){
+	//Samples that fall in the same pixel as the previous one would only result in empty segments
+	if(mSize > 0){
+		Sample &last = GetSample(mTotalPushed-1);
+		if(floorf(last.position.x) == floorf(position.x) && floorf(last.position.y) == floorf(position.y)) return;
+	}
+
+	mSamples[(mFirst+mSize)%M_CAPACITY] = {position, timestamp};
+	
+	//If the buffer is full, the oldest sample gets overwritten
+	if(mSize == M_CAPACITY) mFirst = (mFirst+1)%M_CAPACITY;
+	else mSize++;
+
+	mTotalPushed++;
+}
+
+void Canvas::StrokeSampler::TakeReadyPixels(std::vector<SDL_Point> &pixels, bool strokeEnded){
+	//The segment that starts at the sample 'i' can be calculated once the sample 'i+2' exists, or once the stroke has ended
+	int lastReadySegment = mTotalPushed - (strokeEnded ? 2 : 3);
+
+	//If the samples of a segment were overwritten, we just skip it
+	mNextSegment = std::max(mNextSegment, mTotalPushed-mSize);
+
+	for(; mNextSegment <= lastReadySegment; ++mNextSegment){
+		//The neighbouring control points are repeated in the extremes of the stroke (or of the samples that are still stored)
+		SDL_FPoint point1 = GetSample(mNextSegment).position, point2 = GetSample(mNextSegment+1).position;
+		SDL_FPoint point0 = (mNextSegment-1 >= mTotalPushed-mSize) ? GetSample(mNextSegment-1).position : point1;
+		SDL_FPoint point3 = (mNextSegment+2 < mTotalPushed) ? GetSample(mNextSegment+2).position : point2;
+
+		std::vector<SDL_Point> curvePoints = GetPointsInCatmullRom(point0, point1, point2, point3);
+
+		//Consecutive segments share their extremes
+		if(!pixels.empty() && !curvePoints.empty() && ArePointsEqual(pixels.back(), curvePoints.front())) pixels.insert(pixels.end(), curvePoints.begin()+1, curvePoints.end());
+		else pixels.insert(pixels.end(), curvePoints.begin(), curvePoints.end());
+	}
+}
+
+Uint32 Canvas::StrokeSampler::GetLastTimestamp(){
+	if(mSize == 0) return 0;
+	return GetSample(mTotalPushed-1).timestamp;
+}
+
+Canvas::StrokeSampler::Sample &Canvas::StrokeSampler::GetSample(int index){
+	return mSamples[(mFirst + index - (mTotalPushed-mSize))%M_CAPACITY];
+}
+
+//STROKE WORKER METHODS:
+
+Canvas::StrokeWorker::StrokeWorker(Canvas *npOwner) : mpOwner(npOwner){
+	mThread = std::thread(&StrokeWorker::Run, this);
+}
+
+Canvas::StrokeWorker::~StrokeWorker(){
+	{
+		std::lock_guard<std::mutex> queueLock(mQueueMutex);
+		mStop = true;
+	}
+	mQueueCondition.notify_all();
+	
+	if(mThread.joinable()) mThread.join();
+}
+
+void Canvas::StrokeWorker::Push(Job &&job){
+	{
+		std::lock_guard<std::mutex> queueLock(mQueueMutex);
+		mJobs.push_back(std::move(job));
+	}
+	mQueueCondition.notify_one();
+}
+
+void Canvas::StrokeWorker::WaitUntilIdle(){
+	std::unique_lock<std::mutex> queueLock(mQueueMutex);
+	mIdleCondition.wait(queueLock, [this](){return mJobs.empty() && !mBusy;});
+}
+
+std::unique_lock<std::mutex> Canvas::StrokeWorker::LockSurfaces(){
+	return std::unique_lock<std::mutex>(mSurfacesMutex);
+}
+
+std::unique_lock<std::mutex> Canvas::StrokeWorker::TryLockSurfaces(){
+	return std::unique_lock<std::mutex>(mSurfacesMutex, std::try_to_lock);
+}
+
+SDL_Rect Canvas::StrokeWorker::TakeDirtyRect(int *pLayer){
+	SDL_Rect dirtyRect = mDirtyRect;
+	*pLayer = mDirtyLayer;
+	mDirtyRect = {0, 0, 0, 0};
+	mDirtyLayer = -1;
+	return dirtyRect;
+}
+
+Uint32 Canvas::StrokeWorker::GetLastAppliedTimestamp(){
+	std::lock_guard<std::mutex> queueLock(mQueueMutex);
+	return mLastAppliedTimestamp;
+}
+
+void Canvas::StrokeWorker::Run(){
+	tracing::SetThreadName("Stroke worker");
+
+	while(true){
+		Job job;
+		{
+			std::unique_lock<std::mutex> queueLock(mQueueMutex);
+			mQueueCondition.wait(queueLock, [this](){return mStop || !mJobs.empty();});
+			
+			//We finish the queued jobs before stopping
+			if(mJobs.empty()) return;
+
+			job = std::move(mJobs.front());
+			mJobs.pop_front();
+			mBusy = true;
+		}
+
+		Process(job);
+
+		{
+			std::lock_guard<std::mutex> queueLock(mQueueMutex);
+			mBusy = false;
+			mLastAppliedTimestamp = job.timestamp;
+		}
+		mIdleCondition.notify_all();
+	}
+}
+
+void Canvas::StrokeWorker::Process(Job &job){
+	switch(job.type){
+		case Job::Type::BEGIN_STROKE:{
+			std::lock_guard<std::mutex> surfacesLock(mSurfacesMutex);
+			mpOwner->mActionsManager.SetOriginalLayer(mpOwner->mpImage->GetSurfaceAtLayer(job.layer), job.layer);
+			if(job.tool == Tool::SMUDGE) mpOwner->mSmudge.BeginStroke();
+
+			//The whole stroke copies the layers as they are now, so what it copies doesn't depend on how far the worker is ahead of the uploads
+			//Nothing gets blended yet, the stamps blend the tiles they need (see FlattenMergedTiles)
+			mSampleMerged = (job.tool == Tool::CLONE_STAMP && mpOwner->mCloneStamp.sampleMerged);
+			if(mSampleMerged){
+				const int width = mpOwner->mpImage->GetWidth(), height = mpOwner->mpImage->GetHeight();
+				if(!mpMergedSource || mpMergedSource->w != width || mpMergedSource->h != height){
+					mpMergedSource.reset(SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888));
+				}
+				const int tilesX = (width + M_MERGED_TILE_SIZE - 1)/M_MERGED_TILE_SIZE, tilesY = (height + M_MERGED_TILE_SIZE - 1)/M_MERGED_TILE_SIZE;
+				mMergedTiles.assign((size_t)tilesX*tilesY, false);
+			} else {
+				mpMergedSource.reset();
+			}
+			break;
+		}
+		case Job::Type::STAMP:
+			//The stamps are applied in small groups, releasing the surfaces in between so they can be uploaded
+			for(size_t first = 0; first < job.centers.size(); first += M_STAMPS_PER_LOCK){
+				TRACE_SCOPE("Stamp");
+				std::span<SDL_Point> centers(job.centers.data()+first, std::min(M_STAMPS_PER_LOCK, job.centers.size()-first));
+				SDL_Rect usedArea = {0, 0, 0, 0};
+
+				std::lock_guard<std::mutex> surfacesLock(mSurfacesMutex);
+				SDL_Surface *pLayer = mpOwner->mpImage->GetSurfaceAtLayer(job.layer);
+
+				switch(job.tool){
+					case Tool::DRAW_TOOL:
+						mpOwner->mPencil.ApplyOn(centers, job.color, pLayer, &usedArea, mpOwner->GetSelection());
+						break;
+					case Tool::ERASE_TOOL:
+						mpOwner->mEraser.ApplyOn(centers, pLayer, &usedArea, mpOwner->GetSelection());
+						break;
+					case Tool::SMUDGE:
+						mpOwner->mSmudge.ApplyOn(centers, pLayer, &usedArea, mpOwner->GetSelection());
+						break;
+					case Tool::CLONE_STAMP:{
+						if(mSampleMerged){
+							//Both what the dabs read and what they write, as a later dab may read where this one writes
+							const int radius = tool_circle_data::radius;
+							const SDL_Point offset = mpOwner->mCloneStamp.GetOffset(centers[0]);
+							for(const SDL_Point &center : centers){
+								FlattenMergedTiles({center.x - radius, center.y - radius, 2*radius+1, 2*radius+1});
+								FlattenMergedTiles({center.x + offset.x - radius, center.y + offset.y - radius, 2*radius+1, 2*radius+1});
+							}
+						}
+						SDL_Surface *pSource = (mSampleMerged ? mpMergedSource.get() : pLayer);
+						mpOwner->mCloneStamp.ApplyOn(centers, pLayer, pSource, &usedArea, mpOwner->GetSelection());
+						break;
+					}
+					default:
+						ErrorPrint("job.tool can't have the value "+std::to_string(static_cast<int>(job.tool)));
+						break;
+				}
+
+				if(usedArea.w <= 0 || usedArea.h <= 0) continue;
+
+				if(mDirtyRect.w > 0 && mDirtyRect.h > 0){
+					SDL_UnionRect(&mDirtyRect, &usedArea, &mDirtyRect);
+					if(mDirtyLayer != job.layer) mDirtyLayer = -1;
+				} else {
+					mDirtyRect = usedArea;
+					mDirtyLayer = job.layer;
+				}
+			}
+			break;
+		case Job::Type::COMMIT:{
+			TRACE_SCOPE("Commit");
+			std::lock_guard<std::mutex> surfacesLock(mSurfacesMutex);
+			mpOwner->mActionsManager.SetChange(job.affectedRect, mpOwner->mpImage->GetSurfaceAtLayer(job.layer));
+			//Only the changed region is copied here, the journal writes it to disk on its own thread
+			mpOwner->mJournal.RecordRegion(job.layer, mpOwner->mpImage->GetSurfaceAtLayer(job.layer), job.affectedRect);
+			break;
+		}
+	}
+}
+
+void Canvas::StrokeWorker::FlattenMergedTiles(const SDL_Rect &rect){
+	SDL_Rect imageRect = {0, 0, mpMergedSource->w, mpMergedSource->h}, usedRect;
+	if(SDL_IntersectRect(&rect, &imageRect, &usedRect) == SDL_FALSE) return;
+
+	const int tilesX = (imageRect.w + M_MERGED_TILE_SIZE - 1)/M_MERGED_TILE_SIZE;
+	for(int tileY = usedRect.y/M_MERGED_TILE_SIZE; tileY <= (usedRect.y + usedRect.h - 1)/M_MERGED_TILE_SIZE; tileY++){
+		for(int tileX = usedRect.x/M_MERGED_TILE_SIZE; tileX <= (usedRect.x + usedRect.w - 1)/M_MERGED_TILE_SIZE; tileX++){
+			if(mMergedTiles[(size_t)tileY*tilesX + tileX]) continue;
+
+			mpOwner->mpImage->Flatten({tileX*M_MERGED_TILE_SIZE, tileY*M_MERGED_TILE_SIZE, M_MERGED_TILE_SIZE, M_MERGED_TILE_SIZE}, mpMergedSource.get());
+			mMergedTiles[(size_t)tileY*tilesX + tileX] = true;
+		}
+	}
+}
+
+bool Canvas::IsHolded(){
+	return mHolded;
+}
+
+void Canvas::FinishPendingStrokes(){
+	mStrokeWorker.WaitUntilIdle();
+
+	//There is no need to lock the surfaces, as the worker is idle
+	int dirtyLayer = -1;
+	SDL_Rect dirtyRect = mStrokeWorker.TakeDirtyRect(&dirtyLayer);
+	if(dirtyRect.w > 0 && dirtyRect.h > 0) mpImage->UpdateTexture(dirtyRect, dirtyLayer);
+}
+
 void Canvas::UpdateLayerOptions(){
-	AppendCommand("53_T_InitialValue/"+std::string(mpImage->GetLayerVisibility() ? "T" : "F")+"_"); //Refers to the tick button SHOW_LAYER
-	AppendCommand("54_S_InitialValue/"+std::to_string(mpImage->GetLayerAlpha())+"_"); //Refers to the slider LAYER_ALPHA
+	PushCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::SHOW_LAYER, mpImage->GetLayerVisibility()));
+	PushCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::LAYER_ALPHA, (int)mpImage->GetLayerAlpha()));
+	PushCommand(OptionCommand::SetValue(OptionInfo::OptionIDs::LAYER_BLEND_MODE, std::to_underlying(mpImage->GetLayerBlendMode())));
 }
\ No newline at end of file
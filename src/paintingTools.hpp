@@ -2,6 +2,13 @@
 #include "SDL.h"
 #include "SDL_ttf.h"
 #include "renderLib.hpp"
+#include "options.hpp"
+#include "pngStream.hpp"
+#include "journal.hpp"
+#include "floodFill.hpp"
+#include "rasterizer.hpp"
+#include "filterEngine.hpp"
+#include "blendModes.hpp"
 #include <string>
 #include <memory>
 #include <vector>
@@ -12,6 +19,11 @@
 #include <functional>
 #include <type_traits>
 #include <array>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <future>
 
 class MutableTexture;
 class Canvas;
@@ -84,8 +96,8 @@ struct Pencil{
     void SetAlphaCalculation(AlphaCalculation nAlphaCalculation);
     void SetPencilType(PencilType nPencilType);
 
-    //Applies the current pencil to the passed surface on the given centers
-    void ApplyOn(const std::span<SDL_Point> circleCenters, SDL_Color drawColor, SDL_Surface *pSurfaceToModify, SDL_Rect *pTotalUsedArea = nullptr);
+    //Applies the current pencil to the passed surface on the given centers. If 'pClip' is given, the alpha applied on each pixel is scaled by its coverage
+    void ApplyOn(const std::span<SDL_Point> circleCenters, SDL_Color drawColor, SDL_Surface *pSurfaceToModify, SDL_Rect *pTotalUsedArea = nullptr, const CoverageMask *pClip = nullptr);
 
     //Only affects the preview display, has no effect on the value of ApplyOn. Calls UpdatePreviewRects
     void SetResolution(float nResolution);
@@ -106,7 +118,8 @@ struct Pencil{
 struct Eraser{
     void Activate();
 
-    void ApplyOn(const std::span<SDL_Point> circleCenters, SDL_Surface *pSurfaceToModify, SDL_Rect *pTotalUsedArea = nullptr);
+    //If 'pClip' is given, only the covered pixels are erased (the partially covered ones only lose part of their alpha)
+    void ApplyOn(const std::span<SDL_Point> circleCenters, SDL_Surface *pSurfaceToModify, SDL_Rect *pTotalUsedArea = nullptr, const CoverageMask *pClip = nullptr);
 
     //Only affects the preview display, has no effect on the value of ApplyOn. Calls UpdatePreviewRects
     void SetResolution(float nResolution);
@@ -114,6 +127,97 @@ struct Eraser{
     void DrawPreview(SDL_Point center, SDL_Renderer *pRenderer, SDL_Color previewColor = {0, 0, 0, SDL_ALPHA_OPAQUE});
 };
 
+//Weight of every pixel of the square of a round brush, from 255 inside its hard core to 0 at its edge, falling off smoothly in between
+//Used by the brushes that blend whole dabs at once, which keep it until their radius changes
+class BrushFootprint{
+    public:
+
+    //Does nothing if neither the radius nor the hardness (the part of the radius fully covered, in the range [0, 1]) changed
+    void Update(int radius, float hardness);
+
+    //'y' goes from 0 to 2*radius. The first weight is the one of the left side of the square
+    inline const Uint8 *GetRow(int y) const{
+        return mWeights.data() + (size_t)y*(2*mRadius+1);
+    }
+    //Half width of the covered part of the row, so that the pixels further than it from the center can be skipped. It's -1 if none is covered
+    inline int GetRowHalfWidth(int y) const{
+        return mRowHalfWidths[y];
+    }
+
+    private:
+
+    std::vector<Uint8> mWeights;
+    std::vector<int> mRowHalfWidths;
+    int mRadius = -1;
+    float mHardness = -1.0f;
+};
+
+//Picks up the colors under the brush and drags them along the stroke
+struct Smudge{
+    float strength = 0.8f; //How much of the picked up colors is kept on every dab, in the range [0, 1]. The higher, the further the colors get dragged
+
+    void Activate();
+
+    //Must be called before the first dab of every stroke, so that it picks up the colors under it instead of carrying the ones of the previous stroke
+    void BeginStroke();
+
+    //Applies a dab on the centers far enough from the previous one (see M_SPACING_DIVISOR). If 'pClip' is given, the change on each pixel is scaled by its coverage
+    void ApplyOn(const std::span<SDL_Point> circleCenters, SDL_Surface *pSurfaceToModify, SDL_Rect *pTotalUsedArea = nullptr, const CoverageMask *pClip = nullptr);
+
+    //Only affects the preview display, has no effect on the value of ApplyOn. Calls UpdatePreviewRects
+    void SetResolution(float nResolution);
+
+    void DrawPreview(SDL_Point center, SDL_Renderer *pRenderer, SDL_Color previewColor = {0, 0, 0, SDL_ALPHA_OPAQUE});
+
+    private:
+    //Every dab blends the whole brush, so they are spaced by a fraction of the radius instead of being applied on every pixel of the stroke
+    static constexpr int M_SPACING_DIVISOR = 8;
+
+    //The colors carried by the brush, one per pixel of its square. They move with it, so every dab reads and writes the same ones
+    std::vector<Uint32> mPickup;
+    bool mHasPickup = false;
+    SDL_Point mLastDab = {0, 0};
+
+    BrushFootprint mFootprint; //With no hard core, so that the dragged colors blend with the ones they land on
+    std::vector<Uint8> mPickupWeights, mClippedWeights; //Scratch rows
+};
+
+//Paints with a copy of the image taken from an offset, which is set by alt clicking the point to copy from before the first stroke
+//The offset is kept for the next strokes (so they keep copying from the same place relative to them) until another source is chosen
+struct CloneStamp{
+    //If true, the copy is taken from the visible layers blended together as they were when the stroke began, so the stroke never copies itself
+    //Otherwise it's taken from the current layer, where every dab may copy the ones applied before it in the same stroke
+    bool sampleMerged = false;
+
+    void Activate();
+
+    //The source must be set while no stroke is being applied
+    void SetSource(SDL_Point nSource);
+    bool HasSource();
+    //Returns how far the source is from each dab, which is taken from the first dab of the stroke (given as 'firstCenter' if it hasn't been applied yet)
+    SDL_Point GetOffset(SDL_Point firstCenter);
+
+    //Copies into the surface the pixels of 'pSourceSurface' (which has the same size) at the offset from every center. The copied area is read before being
+    //written, so it can overlap with the one written when both are the same surface. If 'pClip' is given, the copy on each pixel is scaled by its coverage
+    void ApplyOn(const std::span<SDL_Point> circleCenters, SDL_Surface *pSurfaceToModify, SDL_Surface *pSourceSurface, SDL_Rect *pTotalUsedArea = nullptr, const CoverageMask *pClip = nullptr);
+
+    //Only affects the preview display, has no effect on the value of ApplyOn. Calls UpdatePreviewRects
+    void SetResolution(float nResolution);
+
+    void DrawPreview(SDL_Point center, SDL_Renderer *pRenderer, SDL_Color previewColor = {0, 0, 0, SDL_ALPHA_OPAQUE});
+
+    private:
+    //The part of the radius that gets copied fully, the rest fades into what was under it
+    static constexpr float M_HARDNESS = 0.6f;
+
+    SDL_Point mSource = {0, 0}, mOffset = {0, 0};
+    bool mHasSource = false, mHasOffset = false; //The offset is taken on the first dab after the source is set
+
+    BrushFootprint mFootprint;
+    std::vector<Uint32> mCopied; //The source pixels of the dab being applied
+    std::vector<Uint8> mClippedWeights;
+};
+
 //Sets the currently used color as the one on the canvas
 struct ColorPicker{
     void Activate();
@@ -128,9 +232,34 @@ struct ColorPicker{
     void DrawPreview(SDL_Point center, SDL_Renderer *pRenderer, SDL_Color previewColor = {0, 0, 0, SDL_ALPHA_OPAQUE});
 };
 
+//Fills the area around the clicked pixel that has a similar color (like a paint bucket)
+struct BucketFill{
+    Uint8 tolerance = 0; //The maximum difference allowed on each channel for a pixel to be filled
+    bool sampleMerged = false; //If true, the area is found on the visible layers blended together instead of on the current one
+
+    void Activate();
+
+    //Fills the current layer of the texture, only on the pixels covered by 'pClip' if given. Returns the rect of the modified area, which is empty if nothing changed
+    SDL_Rect ApplyOn(MutableTexture *pTexture, SDL_Point pixel, SDL_Color fillColor, const CoverageMask *pClip = nullptr);
+
+    //Only affects the preview display, has no effect on the value of ApplyOn.
+    void SetResolution(float nResolution);
+
+    void DrawPreview(SDL_Point center, SDL_Renderer *pRenderer, SDL_Color previewColor = {0, 0, 0, SDL_ALPHA_OPAQUE});
+
+    //Blends 'fillColor' over the spans of the RGBA8888 surface, scaled by the coverage of 'pClip' if given. The spans are split among the threads of 'pPool', if any
+    static void PaintSpans(SDL_Surface *pSurface, const std::vector<FillSpan> &spans, SDL_Color fillColor, const CoverageMask *pClip, ThreadPool *pPool);
+
+    private:
+
+    FloodFill mFloodFill;
+};
+
 //Delimiters the currentl area that can be modified
 struct AreaDelimiter{
     bool loopBack = true; //If true, the points wrap around
+    bool restrictPainting = false; //If true, the tools can only modify the inside of the area (see Canvas::UpdateSelection)
+    bool smoothEdges = true; //If true, the pixels on the edges of the restricted area can be partially modified
 
     void Activate();
 
@@ -166,10 +295,17 @@ struct AreaDelimiter{
 class MutableTexture{
     public:
 
+    //If true, the textures created from now on keep a texture per layer, which get blended by the renderer when drawn. Showing or hiding a layer then costs nothing,
+    //in exchange for the renderer blending every layer each frame. Works with any renderer, including the software one
+    //The renderer rounds the semitransparent pixels of each layer on its own, so this mode is exempt from the display matching the saved image exactly.
+    //To keep that difference small, the layers are composited as without this mode while one of them has another blend mode or a layer alpha below opaque
+    static bool useLayerTextures;
+
     MutableTexture(SDL_Renderer *pRenderer, int width, int height, SDL_Color fillColor = {255, 255, 255, SDL_ALPHA_OPAQUE});
     MutableTexture(SDL_Renderer *pRenderer, const char *pImage);
 
-    void AddFileAsLayer(SDL_Renderer *pRenderer, const char *pImage, SDL_Point imageSize);
+    //Adds the surface as a new layer above the current one, taking its ownership. It must be in the RGBA8888 format
+    void AddSurfaceAsLayer(SDL_Renderer *pRenderer, std::unique_ptr<SDL_Surface, PointerDeleter> pSurface);
 
     SDL_Color GetPixelColor(SDL_Point pixel, bool *validValue = nullptr);
 
@@ -196,14 +332,20 @@ class MutableTexture{
     //Updates the texture, applying all the changes made since the last call. Must be called outside the class
     void UpdateTexture();
     void UpdateTexture(const SDL_Rect &rect);
+    //Same, but only 'layer' changed inside the rect, so it's the only layer texture uploaded. With a negative layer, any of them may have changed
+    void UpdateTexture(const SDL_Rect &rect, int layer);
 
     void AddLayer();
     bool DeleteCurrentLayer(); //Returns false if unable
 
     void SetLayerVisibility(bool visible); //Shows or hides the current layer based on the value of 'visible'
     bool GetLayerVisibility(); //Returns wether the current layer is drawn or not
+    bool GetLayerVisibility(int layer); //Returns wether the chosen layer is drawn or not, the layer is clamped like in GetSurfaceAtLayer
     void SetLayerAlpha(Uint8 alpha); //Sets the alpha mod of the current layer
     Uint8 GetLayerAlpha(); //Returns the alpha mod of the current layer
+    void SetLayerBlendMode(BlendMode mode); //Sets how the current layer gets blended with the ones below it
+    BlendMode GetLayerBlendMode(); //Returns the blend mode of the current layer
+    BlendMode GetLayerBlendMode(int layer); //Returns the blend mode of the chosen layer, the layer is clamped like in GetSurfaceAtLayer
 
     //Sets the selected layer to the chosen one clamped between 0 and the amount of layers minus 1
     void SetLayer(int nLayer);
@@ -212,8 +354,16 @@ class MutableTexture{
 
     void DrawIntoRenderer(SDL_Renderer *pRenderer, const SDL_Rect &dimensions);
 
-    //Returns true if unable to save
-    bool Save(const char *pSavePath);
+    //Returns a new surface with the visible layers blended together
+    std::unique_ptr<SDL_Surface, PointerDeleter> Flatten();
+    //Only blends the visible layers inside 'rect', into the same rect of 'pDestination' (which must have the size of the image), in the calling thread
+    void Flatten(const SDL_Rect &rect, SDL_Surface *pDestination);
+
+    //Returns true if unable to save. The layers are flattened as the composite texture displays them and encoded a few rows at a time, unless the png streams aren't available
+    //What the layer textures of 'useLayerTextures' display can differ from it by a few levels, see the setting
+    bool Save(const char *pSavePath, const PngEncodeSettings &settings = {});
+    //Same, but flattening and compressing with the threads of 'pPool' instead of the shared one. Without a pool, everything is done by the calling thread
+    bool Save(const char *pSavePath, const PngEncodeSettings &settings, ThreadPool *pPool);
 
     int GetWidth();
     int GetHeight();
@@ -222,12 +372,26 @@ class MutableTexture{
 
     int mSelectedLayer = 0;
 
+    //Set to 'useLayerTextures' upon construction
+    const bool M_USE_LAYER_TEXTURES;
+    //Needed to create the textures of new layers. The renderer always outlives the image
+    SDL_Renderer *mpRenderer;
+
     //This is what stores the pixel data
     std::vector<std::unique_ptr<SDL_Surface, PointerDeleter>> mpSurfaces;
     std::vector<bool> mShowSurface;
+    std::vector<BlendMode> mBlendModes;
 
     //Formed by the compound of surfaces. It's what gets drawn into the screen
     std::unique_ptr<SDL_Texture, PointerDeleter> mpTexture;
+    //The visible layers are blended here before being uploaded into 'mpTexture', as blending reads the destination and reading locked texture memory can be very slow
+    //It has the size of the image, and is created again by 'UpdateTexture' when the size changes
+    std::unique_ptr<SDL_Surface, PointerDeleter> mpStaging;
+
+    //Only used with M_USE_LAYER_TEXTURES, instead of 'mpTexture' and 'mpStaging'. Kept in the same order as the layers, a null texture gets created when uploaded
+    //While a visible layer has a blend mode the renderer doesn't have, the layers are composited into 'mpTexture' instead, and these aren't uploaded
+    std::vector<std::unique_ptr<SDL_Texture, PointerDeleter>> mpLayerTextures;
+    bool mLayerTexturesStale = false; //Set when 'mpTexture' was drawn instead of the layer textures, which then have to be uploaded whole
 
     //Holds the position of all the pixels that have been modified since the last call to UpdateTexture
     std::vector<SDL_Point> mChangedPixels;
@@ -235,6 +399,22 @@ class MutableTexture{
     //Used only in the constructor
     void UpdateWholeTexture();
 
+    //Creates 'mpTexture' with the given size, unless the layers have their own textures
+    void CreateCompositeTexture(SDL_Point size);
+    //Uploads the rect of the layer into its texture, creating it first if needed
+    void UploadLayer(size_t layer, const SDL_Rect &rect);
+
+    //Blends the visible layers into the rect of 'mpStaging', creating it first if its size doesn't match the image
+    void Composite(const SDL_Rect &rect);
+    //Blends the visible layers inside 'rect' into 'pDestination', placing its top left pixel at 'destination'. The rows are split between the threads of the shared pool
+    //The composite texture and the saved images are blended here, so that both always match. Without a pool, the calling thread blends every row
+    void BlendLayers(const SDL_Rect &rect, SDL_Surface *pDestination, SDL_Point destination, ThreadPool *pPool);
+    //Returns true if a visible layer has a blend mode other than the normal one or a layer alpha below opaque, which the layer textures don't reproduce
+    bool NeedsComposite();
+
+    //Flattens the whole image into a surface and saves it with IMG_SavePNG, used when the png streams aren't available
+    bool SaveWithSDLImage(const char *pSavePath);
+
     //Calculates the smallest rect that contains all points in 'mChangedPixels'
     SDL_Rect GetChangesRect();
 
@@ -247,8 +427,23 @@ class MutableTexture{
     inline Uint32* UnsafeGetPixel(SDL_Point index, int layer){
         return UnsafeGetPixelFromSurface<Uint32>(index, mpSurfaces[layer].get());
     }
+
+    //Only a friend to set the blend modes of every layer without compositing after each one
+    friend void BenchmarkComposite(SDL_Renderer *pRenderer);
 };
 
+//Composites and uploads a big image with several layers, both by blending straight into the locked texture and through the staging surface of MutableTexture
+//Prints the milliseconds per megapixel of each way, used by the --benchmark-upload argument
+void BenchmarkTextureUpload(SDL_Renderer *pRenderer);
+
+//Saves a big image with several layers into a temporary file, in a single thread and with the shared thread pool, and prints how long each takes
+//Used by the --benchmark-save argument
+void BenchmarkSave(SDL_Renderer *pRenderer);
+
+//Composites a big image with many layers through MutableTexture, as the display and the export do, with every blend mode and prints how long each takes
+//Unlike BenchmarkBlendModes, every row has its own pixels, so it also measures the memory. Used by the --benchmark-blend argument
+void BenchmarkComposite(SDL_Renderer *pRenderer);
+
 //TODO: add an actual base class Tool, that has method to process a quantity of pixels. The Pencil class would inherit from it, as so would Eraser, ColorPicker, RangeSelection  
 class Canvas{
     public:
@@ -257,10 +452,14 @@ class Canvas{
         DRAW_TOOL = 0,
         ERASE_TOOL = 1,
         COLOR_PICKER = 2,
-        AREA_DELIMITER = 3
+        AREA_DELIMITER = 3,
+        BUCKET_FILL = 4,
+        SMUDGE = 5,
+        CLONE_STAMP = 6
     };
 
     static int maxAmountOfUndoActionsSaved; //This is only used in Canvas creation
+    static PngEncodeSettings pngSaveSettings; //Used every time the canvas is saved
 
     SDL_Color toolPreviewMainColor = {0, 0, 0, SDL_ALPHA_OPAQUE};
     SDL_Color toolPreviewAlternateColor = {255, 255, 255, SDL_ALPHA_OPAQUE};
@@ -279,7 +478,14 @@ class Canvas{
     ~Canvas();
 
     void Resize(SDL_Renderer *pRenderer, int nWidth, int nHeight);
-    void OpenFile(SDL_Renderer *pRenderer, const char *pLoadFile, SDL_Point imageSize);
+    //Starts decoding the file in another thread, a preview of it gets drawn until it's added as a layer by 'FinishImports'
+    void ImportFile(const char *pLoadFile, SDL_Point imageSize);
+    //Adds as layers the imports that have finished decoding, in the same order they were started. Returns the amount of imports finished (even if they failed)
+    //If 'exactAmount' isn't negative, that amount of imports gets finished, waiting for them if needed (used to replay recorded sessions)
+    int FinishImports(SDL_Renderer *pRenderer, int exactAmount = -1);
+
+    //Replaces the image with the one recovered from the journal of a previous run, if any, and starts journaling. Returns true if something was recovered
+    bool StartJournal(SDL_Renderer *pRenderer);
 
     SDL_Color GetColor();
     void SetColor(SDL_Color nDrawColor);
@@ -288,8 +494,9 @@ class Canvas{
     int GetRadius();
 
     //Like SetPixel and SetPixels but it uses the pencil/eraser and changes the value of mLastMousePixel
-    void DrawPixel(SDL_Point localPixel);
-    void DrawPixels(const std::vector<SDL_Point> &localPixels);
+    //The pixels aren't drawn instantly, they are queued to the stroke worker. 'timestamp' is the SDL timestamp of the input that caused them (0 means now)
+    void DrawPixel(SDL_Point localPixel, Uint32 timestamp = 0);
+    void DrawPixels(const std::vector<SDL_Point> &localPixels, Uint32 timestamp = 0);
     void Clear(std::optional<SDL_Color> clearColor = {});
 
     void SetSavePath(const char *nSavePath);
@@ -297,11 +504,21 @@ class Canvas{
     void SetResolution(float nResolution);
     void SetTool(Tool nUsedTool);
     
-    //Uses the data inside 'mAreaDelimiter' with the 'mPencil'
+    //Draws the lines of 'mAreaDelimiter' with the draw color, as thick as the pencil and with round ends, and saves the change to the undo chain
     void ApplyAreaOutline();
+    //Fills the area of 'mAreaDelimiter' with the draw color, with anti aliased edges, and saves the change to the undo chain
+    void ApplyAreaFill();
+    //Rasterizes the area of 'mAreaDelimiter' (always closed) into the selection that clips the tools, or removes the selection if the area doesn't restrict painting
+    //Must be called whenever the area changes
+    void UpdateSelection();
 
-    void AppendCommand(const std::string &nCommand);
-    std::string GiveCommands();
+    //Filters the current layer (or just the selection, if painting is restricted) with the settings of 'GetFilters' and saves the change to the undo chain
+    void ApplyFilter();
+    FilterEngine &GetFilters(){return mFilterEngine;}
+
+    //Queues a command for the AppManager, which will apply it to the options
+    void PushCommand(const OptionCommand &nCommand);
+    OptionCommandQueue &GetCommands();
 
     void Undo();
     void Redo();
@@ -312,6 +529,11 @@ class Canvas{
 
     void DrawIntoRenderer(SDL_Renderer *pRenderer);
 
+    //Waits for the stroke worker to finish and uploads its changes into the texture
+    void FinishPendingStrokes();
+    //Returns true while the mouse is held down on the canvas (e.g: a stroke is being drawn)
+    bool IsHolded();
+
     void Save();
 
     void CenterInViewport();
@@ -325,10 +547,13 @@ class Canvas{
     void SetLayer(int nLayer); //Makes sure the canvas isn't being drawn on and calls SetLayer method on the MutableTexture
     void SetLayerVisibility(bool visible); //Makes sure the canvas isn't being drawn on and makes the current layer visible if 'visible' is true, 
     void SetLayerAlpha(Uint8 alpha); //Makes sure the canvas isn't being drawn on and sets the alpha mod of the current layer
+    void SetLayerBlendMode(BlendMode mode); //Makes sure the canvas isn't being drawn on and sets the blend mode of the current layer
     MutableTexture *GetImage();
 
+    //Waits for the queued strokes to be applied, as the returned tool may be modified afterwards
     template <typename T>
-    constexpr T *GetTool(){
+    T *GetTool(){
+        FinishPendingStrokes();
         switch(mUsedTool){
             case Tool::DRAW_TOOL:
                 if constexpr (std::is_same<T, decltype(mPencil)>::value) return &mPencil;
@@ -342,6 +567,15 @@ class Canvas{
             case Tool::AREA_DELIMITER:
                 if constexpr (std::is_same<T, decltype(mAreaDelimiter)>::value) return &mAreaDelimiter;
                 else return nullptr;
+            case Tool::BUCKET_FILL:
+                if constexpr (std::is_same<T, decltype(mBucketFill)>::value) return &mBucketFill;
+                else return nullptr;
+            case Tool::SMUDGE:
+                if constexpr (std::is_same<T, decltype(mSmudge)>::value) return &mSmudge;
+                else return nullptr;
+            case Tool::CLONE_STAMP:
+                if constexpr (std::is_same<T, decltype(mCloneStamp)>::value) return &mCloneStamp;
+                else return nullptr;
             default:
                 return nullptr;
         }
@@ -353,18 +587,36 @@ class Canvas{
     Eraser mEraser;
     ColorPicker mColorPicker;
     AreaDelimiter mAreaDelimiter;
+    BucketFill mBucketFill;
+    Smudge mSmudge;
+    CloneStamp mCloneStamp;
+    FilterEngine mFilterEngine;
+
+    //Turn the area of 'mAreaDelimiter' into coverage, for the selection and for its fill and outline
+    Rasterizer mRasterizer;
+    Stroker mStroker;
+    //Only used while 'mUseSelection' is true. Read by the stroke worker, so it must not be modified while strokes are pending
+    CoverageMask mSelection;
+    bool mUseSelection = false;
+
+    //Returns the mask the tools have to be clipped against, or nullptr if they aren't restricted
+    const CoverageMask *GetSelection(){return mUseSelection ? &mSelection : nullptr;}
 
     SDL_Rect mDimensions;
     static constexpr float M_MIN_RESOLUTION = 0.01f, M_MAX_RESOLUTION = 100.0f;
     float mResolution = 1;
     std::unique_ptr<MutableTexture> mpImage;
 
-    //Every time 'mInternalTimer' surpasses 'M_MAX_TIMER', it saves the current image
+    //Every time 'mInternalTimer' surpasses 'M_MAX_TIMER', the journal gets compacted into a new snapshot of the image
     static constexpr float M_MAX_TIMER = 300.0f; 
     float mInternalTimer = 0.0f;
 
+    //Records every committed change, so that the image can be recovered if the app crashes. Declared before the stroke worker, which uses it
+    //Its thread copies the layers for the snapshots, so the main thread only modifies them while holding the surfaces lock of the worker
+    Journal mJournal{"Autosave"};
+
     //Commands that will be executed by the AppManager
-    std::string mCommands = "";
+    OptionCommandQueue mCommands;
 
     SDL_Color mDrawColor = {255, 0, 0, SDL_ALPHA_OPAQUE};
     bool mHolded = false;
@@ -461,6 +713,155 @@ class Canvas{
         void RotateUndoHistoryIfFull();
     } mActionsManager;
 
+    //Applies the tools on the layers in a separate thread, so that slow strokes don't delay the input handling nor the displaying
+    //Only the main thread may upload the changes into the texture, which it does with the rect given by 'TakeDirtyRect'
+    //Anything that reads or modifies the layers, the tools or 'mActionsManager' outside of the worker should call 'WaitUntilIdle' first
+    class StrokeWorker{
+        public:
+
+        struct Job{
+            enum class Type{
+                BEGIN_STROKE,   //Sets the original layer on the actions manager (and starts the pickup of the smudge or the merged source of the clone stamp)
+                STAMP,          //Applies the tool on 'centers'
+                COMMIT          //Saves the change of 'affectedRect' on the actions manager
+            };
+
+            Type type = Type::STAMP;
+            Uint32 timestamp = 0; //SDL timestamp of the input that generated the job
+            Tool tool = Tool::DRAW_TOOL;
+            SDL_Color color = {0, 0, 0, SDL_ALPHA_OPAQUE};
+            int layer = 0;
+            std::vector<SDL_Point> centers{};
+            SDL_Rect affectedRect = {0, 0, 0, 0};
+        };
+
+        StrokeWorker(Canvas *npOwner);
+        ~StrokeWorker();
+
+        void Push(Job &&job);
+        void WaitUntilIdle();
+
+        //Must be held while the layers are read outside of the worker
+        std::unique_lock<std::mutex> LockSurfaces();
+        std::unique_lock<std::mutex> TryLockSurfaces(); //Check 'owns_lock' on the returned value
+
+        //Returns the area modified since the last call, or an empty rect if none. The surfaces must be locked
+        //Its layer is written into 'pLayer', or -1 if the area was modified on more than one
+        SDL_Rect TakeDirtyRect(int *pLayer);
+
+        Uint32 GetLastAppliedTimestamp(); //Returns the timestamp of the last job applied, useful to measure how far behind the worker is
+
+        private:
+
+        //The maximum amount of stamps applied before releasing the surfaces, so that the main thread can upload them even during long strokes
+        static constexpr size_t M_STAMPS_PER_LOCK = 8;
+        //The side of the tiles in which 'mpMergedSource' gets blended
+        static constexpr int M_MERGED_TILE_SIZE = 64;
+
+        Canvas *mpOwner;
+
+        std::mutex mQueueMutex;
+        std::condition_variable mQueueCondition, mIdleCondition;
+        std::deque<Job> mJobs;
+        bool mBusy = false, mStop = false;
+        Uint32 mLastAppliedTimestamp = 0;
+
+        std::mutex mSurfacesMutex;
+        SDL_Rect mDirtyRect = {0, 0, 0, 0};
+        int mDirtyLayer = -1;
+
+        //The visible layers blended as they were when the current stroke began, which the clone stamp copies from if it samples them merged
+        //Only the tiles the stroke reads or writes get blended, and always before the stroke writes on them, so the start of a stroke doesn't blend the whole image
+        std::unique_ptr<SDL_Surface, PointerDeleter> mpMergedSource;
+        std::vector<bool> mMergedTiles; //If each tile of 'mpMergedSource' has been blended, by rows
+        bool mSampleMerged = false;
+
+        std::thread mThread;
+
+        void Run();
+        void Process(Job &job);
+        //Blends the tiles of 'mpMergedSource' that overlap the rect and weren't blended yet. The surfaces must be locked
+        void FlattenMergedTiles(const SDL_Rect &rect);
+    } mStrokeWorker;
+
+    //Holds the mouse positions (in image pixels) of the current stroke, together with the SDL timestamp of their events
+    //The stroke is rebuilt with a spline that passes through every sample, so its shape doesn't depend on how long each frame takes
+    class StrokeSampler{
+        public:
+
+        struct Sample{
+            SDL_FPoint position;
+            Uint32 timestamp;
+        };
+
+        void Clear();
+        void Push(SDL_FPoint position, Uint32 timestamp);
+
+        //Appends to 'pixels' the points of the segments between samples that haven't been taken yet. As a segment depends on the sample after it,
+        //the last one is only given if 'strokeEnded' is true
+        void TakeReadyPixels(std::vector<SDL_Point> &pixels, bool strokeEnded);
+
+        Uint32 GetLastTimestamp(); //Returns the timestamp of the last sample, or 0 if there is none
+
+        private:
+
+        static constexpr int M_CAPACITY = 64;
+
+        //Ring buffer, where 'mFirst' is the position of the oldest sample stored
+        std::array<Sample, M_CAPACITY> mSamples;
+        int mFirst = 0, mSize = 0;
+
+        //Both count every sample since the last call to 'Clear', including the ones that have been overwritten
+        int mTotalPushed = 0;
+        int mNextSegment = 0; //The sample where the next segment to be taken starts
+
+        //'index' counts from the start of the stroke and must refer to a sample that is still stored
+        Sample &GetSample(int index);
+    } mStrokeSampler;
+
+    //Draws the pixels of the stroke that 'mStrokeSampler' has ready
+    void DrawStrokeSamples(bool strokeEnded);
+
+    //Used by 'DrawIntoRenderer' when the layers are being painted on, so the preview color doesn't flicker
+    bool mUseAlternatePreviewColor = false;
+
+    //Files being decoded by 'ImportFile'. Each one is decoded by its own thread, so that several files can be decoded at the same time
+    struct PendingImport{
+        std::string path;
+        SDL_Point size = {0, 0};
+        Uint32 startTime = 0;
+
+        //The decoding thread doesn't log anything, so if the layer is null the main thread prints 'error'
+        struct Result{
+            std::unique_ptr<SDL_Surface, PointerDeleter> pLayer;
+            std::string error;
+        };
+
+        //A downscaled copy of the image, filled by the decoding thread from the top as the rows get decoded, so it shows up long before the layer is ready
+        struct PreviewData{
+            std::mutex mutex;
+            std::unique_ptr<SDL_Surface, PointerDeleter> pSurface; //Created with the first decoded rows
+            bool changed = false; //Set when rows were added since the main thread last uploaded it
+        };
+
+        std::shared_ptr<PreviewData> pPreviewData;
+        std::future<Result> layerResult;
+        std::unique_ptr<SDL_Texture, PointerDeleter> pPreview;
+    };
+    std::deque<PendingImport> mPendingImports;
+    //The biggest side of the previews, in pixels
+    static constexpr int M_PREVIEW_SIZE = 256;
+
+    //Draws the previews, or just their frames if they aren't decoded yet, where the imported layers will be
+    void DrawPendingImports(SDL_Renderer *pRenderer);
+    //Used by 'FinishImports' once the image has been loaded
+    void AddImportedLayer(SDL_Renderer *pRenderer, std::unique_ptr<SDL_Surface, PointerDeleter> pSurface);
+
+    //Fills the area around the pixel with 'mBucketFill' and saves the change to the undo chain
+    void FillArea(SDL_Point pixel);
+    //Blends the draw color with the coverage of the mask into the current layer (clipped by the selection) and saves the change to the undo chain
+    void ApplyCoverage(CoverageMask &mask);
+
     void UpdateRealPosition(){mRealPosition = {(float)mDimensions.x, (float)mDimensions.y};}
     void UpdateLayerOptions(); //Should be called when the current layer has been changed
 };
\ No newline at end of file
@@ -0,0 +1,778 @@
+#include "pngStream.hpp"
+#include "threadPool.hpp"
+#include "logger.hpp"
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#ifdef PAINTAPP_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+static constexpr Uint8 PNG_SIGNATURE[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+//Size of the IDAT chunks written, and of the reads done from the IDAT chunks
+static constexpr size_t PNG_BUFFER_SIZE = 1 << 16;
+
+//Png stores every number in big endian
+static void WriteBigEndian(Uint8 *pDestination, Uint32 value){
+	pDestination[0] = (Uint8)(value >> 24);
+	pDestination[1] = (Uint8)(value >> 16);
+	pDestination[2] = (Uint8)(value >> 8);
+	pDestination[3] = (Uint8)value;
+}
+
+static Uint32 ReadBigEndian(const Uint8 *pSource){
+	return ((Uint32)pSource[0] << 24) | ((Uint32)pSource[1] << 16) | ((Uint32)pSource[2] << 8) | (Uint32)pSource[3];
+}
+
+static Uint8 PaethPredictor(int a, int b, int c){
+	int p = a + b - c;
+	int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+	if(pa <= pb && pa <= pc) return (Uint8)a;
+	if(pb <= pc) return (Uint8)b;
+	return (Uint8)c;
+}
+
+//Writes the filter type followed by the 'size' filtered bytes of 'pRow' into 'pResult'. 'pAbove' is the unfiltered row above, all zeros for the first row
+static void FilterRow(PngEncodeSettings::Filter filter, const Uint8 *pRow, const Uint8 *pAbove, size_t size, Uint8 *pResult){
+	*(pResult++) = static_cast<Uint8>(filter);
+
+	//'a' is the byte of the previous pixel, 'b' the one above and 'c' the one above the previous pixel
+	switch(filter){
+		case PngEncodeSettings::Filter::NONE:
+			std::memcpy(pResult, pRow, size);
+			break;
+		case PngEncodeSettings::Filter::SUB:
+			for(size_t i = 0; i < size; i++) pResult[i] = pRow[i] - (i >= 4 ? pRow[i-4] : 0);
+			break;
+		case PngEncodeSettings::Filter::UP:
+			for(size_t i = 0; i < size; i++) pResult[i] = pRow[i] - pAbove[i];
+			break;
+		case PngEncodeSettings::Filter::AVERAGE:
+			for(size_t i = 0; i < size; i++) pResult[i] = pRow[i] - (Uint8)(((i >= 4 ? pRow[i-4] : 0) + pAbove[i]) / 2);
+			break;
+		case PngEncodeSettings::Filter::PAETH:
+			for(size_t i = 0; i < size; i++) pResult[i] = pRow[i] - PaethPredictor(i >= 4 ? pRow[i-4] : 0, pAbove[i], i >= 4 ? pAbove[i-4] : 0);
+			break;
+		default:
+			ErrorPrint("filter can't have the value "+std::to_string(static_cast<int>(filter)));
+			*(pResult-1) = 0;
+			std::memcpy(pResult, pRow, size);
+			break;
+	}
+}
+
+//Same as FilterRow, but with the ADAPTIVE filter. 'candidate' is used to try each filter, so it must have space for 'size'+1 bytes
+static void FilterRowAdaptive(const Uint8 *pRow, const Uint8 *pAbove, size_t size, Uint8 *pResult, std::vector<Uint8> &candidate){
+	size_t bestScore = SIZE_MAX;
+	for(int filter = 0; filter < static_cast<int>(PngEncodeSettings::Filter::ADAPTIVE); filter++){
+		FilterRow(static_cast<PngEncodeSettings::Filter>(filter), pRow, pAbove, size, candidate.data());
+
+		//The bytes are treated as signed, so that small negative differences also count as small
+		size_t score = 0;
+		for(size_t i = 1; i <= size; i++) score += std::abs((int)(Sint8)candidate[i]);
+		if(score < bestScore){
+			bestScore = score;
+			std::memcpy(pResult, candidate.data(), size+1);
+		}
+	}
+}
+
+PngEncodeSettings::Filter PngEncodeSettings::FilterFromString(std::string_view name, bool *valid){
+	if(valid) *valid = true;
+
+	if(name == "none") return Filter::NONE;
+	if(name == "sub") return Filter::SUB;
+	if(name == "up") return Filter::UP;
+	if(name == "average") return Filter::AVERAGE;
+	if(name == "paeth") return Filter::PAETH;
+	if(name == "adaptive") return Filter::ADAPTIVE;
+
+	if(valid) *valid = false;
+	return Filter::ADAPTIVE;
+}
+
+#ifdef PAINTAPP_HAS_ZLIB
+//Compresses a block of the parallel writer as raw deflate data. Every block but the last ends with a sync flush, so that they can just be concatenated
+//Returns an empty vector on failure, since even an empty block produces some bytes
+static std::vector<Uint8> CompressBlock(const std::vector<Uint8> &block, const std::vector<Uint8> *pDictionary, int level, bool last){
+	std::vector<Uint8> result;
+
+	//Negative window bits mean no zlib header nor checksum, as those are written once for the whole stream
+	z_stream stream{};
+	if(deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return result;
+
+	//The last 32KB of the previous block, as that's the most deflate can look back
+	if(pDictionary && !pDictionary->empty()){
+		size_t dictionarySize = std::min(pDictionary->size(), (size_t)32768);
+		deflateSetDictionary(&stream, pDictionary->data() + pDictionary->size() - dictionarySize, (uInt)dictionarySize);
+	}
+
+	result.resize(deflateBound(&stream, block.size()) + 16);
+	stream.next_in = const_cast<Bytef*>(block.data());
+	stream.avail_in = (uInt)block.size();
+	stream.next_out = result.data();
+	stream.avail_out = (uInt)result.size();
+
+	while(true){
+		int code = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+		if(code == Z_STREAM_ERROR){
+			deflateEnd(&stream);
+			return {};
+		}
+
+		if(last ? code == Z_STREAM_END : (stream.avail_in == 0 && stream.avail_out != 0)) break;
+
+		//Shouldn't happen thanks to deflateBound, but the flush markers aren't counted by it
+		size_t used = result.size() - stream.avail_out;
+		result.resize(result.size()*2);
+		stream.next_out = result.data() + used;
+		stream.avail_out = (uInt)(result.size() - used);
+	}
+
+	result.resize(result.size() - stream.avail_out);
+	deflateEnd(&stream);
+	return result;
+}
+#endif
+
+bool IsPngStreamAvailable(){
+#ifdef PAINTAPP_HAS_ZLIB
+	return true;
+#else
+	return false;
+#endif
+}
+
+//PNG WRITER METHODS:
+
+PngWriter::PngWriter(const char *pPath, int width, int height, const PngEncodeSettings &settings, ThreadPool *pPool) : mWidth(width), mHeight(height), mSettings(settings), mpPool(pPool){
+#ifdef PAINTAPP_HAS_ZLIB
+	if(width <= 0 || height <= 0){
+		ErrorPrint(std::to_string(width)+"x"+std::to_string(height)+" are not valid dimensions for a png");
+		return;
+	}
+	mSettings.compressionLevel = std::clamp(mSettings.compressionLevel, 0, 9);
+
+	//When compressing in parallel, each block uses its own stream
+	if(!mpPool){
+		z_stream *pStream = new z_stream{};
+		if(deflateInit(pStream, mSettings.compressionLevel) != Z_OK){
+			ErrorPrint("Couldn't initialize zlib's deflate");
+			delete pStream;
+			return;
+		}
+		mpStream = pStream;
+	}
+
+	mpFile = std::fopen(pPath, "wb");
+	if(!mpFile){
+		ErrorPrint("Couldn't open "+std::string(pPath)+" for writing");
+		return;
+	}
+
+	size_t rowBytes = (size_t)width*4;
+	mRow.resize(rowBytes);
+	mPreviousRow.assign(rowBytes, 0); //The row above the first one is treated as zeros by the filters
+	mFiltered.resize(rowBytes+1);
+	mCandidate.resize(rowBytes+1);
+	mOutput.resize(PNG_BUFFER_SIZE);
+
+	//8 bits per channel, RGBA, default compression and filtering methods, not interlaced
+	Uint8 header[13];
+	WriteBigEndian(header, width);
+	WriteBigEndian(header+4, height);
+	header[8] = 8;
+	header[9] = 6;
+	header[10] = header[11] = header[12] = 0;
+
+	if(std::fwrite(PNG_SIGNATURE, 1, sizeof(PNG_SIGNATURE), mpFile) != sizeof(PNG_SIGNATURE) || !WriteChunk("IHDR", header, sizeof(header))){
+		ErrorPrint("Couldn't write the png header of "+std::string(pPath));
+		std::fclose(mpFile);
+		mpFile = nullptr;
+		return;
+	}
+
+	if(mpPool){
+		mpBlock = std::make_shared<std::vector<Uint8>>();
+		mpBlock->reserve(M_BLOCK_SIZE + mRow.size());
+		mAdler = adler32(0L, Z_NULL, 0);
+
+		//The length of the IDAT chunk is written once all blocks are, so a placeholder is left
+		mIdatLengthPosition = std::ftell(mpFile);
+		Uint8 idatHeader[8] = {0, 0, 0, 0, 'I', 'D', 'A', 'T'};
+		mIdatCrc = crc32(0L, idatHeader+4, 4);
+		if(std::fwrite(idatHeader, 1, 8, mpFile) != 8){
+			ErrorPrint("Couldn't write the png header of "+std::string(pPath));
+			std::fclose(mpFile);
+			mpFile = nullptr;
+			return;
+		}
+
+		//zlib header: deflate with a 32KB window, and the level hint chosen so that both bytes are a multiple of 31
+		int levelHint = mSettings.compressionLevel < 2 ? 0 : (mSettings.compressionLevel < 6 ? 1 : (mSettings.compressionLevel == 6 ? 2 : 3));
+		Uint8 zlibHeader[2] = {0x78, (Uint8)(levelHint << 6)};
+		int remainder = ((zlibHeader[0] << 8) | zlibHeader[1]) % 31;
+		if(remainder != 0) zlibHeader[1] += 31 - remainder;
+		WriteIdatData(zlibHeader, 2);
+	}
+#endif
+}
+
+PngWriter::~PngWriter(){
+	//Only happens if 'Finish' wasn't called or failed
+	if(mpFile) std::fclose(mpFile);
+#ifdef PAINTAPP_HAS_ZLIB
+	if(mpStream){
+		deflateEnd(static_cast<z_stream*>(mpStream));
+		delete static_cast<z_stream*>(mpStream);
+	}
+#endif
+}
+
+bool PngWriter::IsOpen(){
+	return mpFile && (mpStream || mpPool);
+}
+
+bool PngWriter::WriteRows(SDL_Surface *pRows, int rowCount){
+	if(!IsOpen()) return false;
+	if(pRows->w != mWidth || pRows->format->format != SDL_PIXELFORMAT_RGBA8888 || rowCount > pRows->h || mWrittenRows+rowCount > mHeight){
+		ErrorPrint("the rows given don't match the png being written");
+		return false;
+	}
+
+	if(SDL_MUSTLOCK(pRows)) SDL_LockSurface(pRows);
+
+	bool success = true;
+	for(int y = 0; y < rowCount && success; y++){
+		const Uint32 *pPixels = reinterpret_cast<const Uint32*>(static_cast<const Uint8*>(pRows->pixels) + y*pRows->pitch);
+		for(int x = 0; x < mWidth; x++){
+			Uint32 pixel = pPixels[x];
+			mRow[x*4] = (Uint8)(pixel >> 24);
+			mRow[x*4+1] = (Uint8)(pixel >> 16);
+			mRow[x*4+2] = (Uint8)(pixel >> 8);
+			mRow[x*4+3] = (Uint8)pixel;
+		}
+
+		mWrittenRows++;
+
+		//The pool does the filtering too, so the rows are just gathered
+		if(mpPool){
+			mpBlock->insert(mpBlock->end(), mRow.begin(), mRow.end());
+			if(mpBlock->size() >= M_BLOCK_SIZE){
+				SubmitBlock(false);
+
+				//Only a few blocks are kept waiting per thread, so that memory doesn't grow with the size of the image
+				success = WriteFinishedBlocks(mpPool->GetThreadAmount()*2);
+			}
+			continue;
+		}
+
+		if(mSettings.filter == PngEncodeSettings::Filter::ADAPTIVE) FilterRowAdaptive(mRow.data(), mPreviousRow.data(), mRow.size(), mFiltered.data(), mCandidate);
+		else FilterRow(mSettings.filter, mRow.data(), mPreviousRow.data(), mRow.size(), mFiltered.data());
+
+		success = Deflate(mFiltered.data(), mFiltered.size(), false);
+		std::swap(mRow, mPreviousRow);
+	}
+
+	if(SDL_MUSTLOCK(pRows)) SDL_UnlockSurface(pRows);
+
+	return success;
+}
+
+bool PngWriter::Finish(){
+	if(!IsOpen()) return false;
+	if(mWrittenRows != mHeight){
+		ErrorPrint("Only "+std::to_string(mWrittenRows)+" rows out of "+std::to_string(mHeight)+" were written into the png");
+		return false;
+	}
+
+	bool success = true;
+	if(mpPool){
+		SubmitBlock(true);
+		success = WriteFinishedBlocks(0);
+
+		//The zlib stream ends with the checksum of the uncompressed data, then the IDAT chunk gets its length and crc
+		if(success){
+			Uint8 adler[4];
+			WriteBigEndian(adler, (Uint32)mAdler);
+			success = WriteIdatData(adler, 4);
+		}
+		if(success){
+			long endPosition = std::ftell(mpFile);
+			Uint8 length[4], crc[4];
+			WriteBigEndian(length, (Uint32)mIdatSize);
+			WriteBigEndian(crc, (Uint32)mIdatCrc);
+
+			success = std::fseek(mpFile, mIdatLengthPosition, SEEK_SET) == 0 && std::fwrite(length, 1, 4, mpFile) == 4 &&
+					  std::fseek(mpFile, endPosition, SEEK_SET) == 0 && std::fwrite(crc, 1, 4, mpFile) == 4;
+		}
+	} else {
+		success = Deflate(nullptr, 0, true);
+		if(success && mOutputSize > 0) success = WriteChunk("IDAT", mOutput.data(), mOutputSize);
+	}
+	if(success) success = WriteChunk("IEND", nullptr, 0);
+
+	if(std::fclose(mpFile) != 0) success = false;
+	mpFile = nullptr;
+
+	return success;
+}
+
+void PngWriter::SubmitBlock(bool last){
+#ifdef PAINTAPP_HAS_ZLIB
+	std::shared_ptr<const std::vector<Uint8>> pBlock = std::move(mpBlock);
+	std::shared_ptr<const std::vector<Uint8>> pPreviousBlock = std::move(mpPreviousBlock);
+
+	std::promise<std::shared_ptr<const std::vector<Uint8>>> filteredPromise;
+	std::shared_future<std::shared_ptr<const std::vector<Uint8>>> filteredResult = filteredPromise.get_future().share();
+
+	//The jobs are started in the order they are submitted, so the job of the previous block is always running or done by the time this one waits for it
+	mPendingBlocks.push_back(mpPool->Submit([pBlock, pPreviousBlock, previousFiltered = mPreviousFiltered, filteredPromise = std::move(filteredPromise), settings = mSettings, rowBytes = mRow.size(), last]() mutable {
+		TRACE_SCOPE("Png block");
+		auto pFiltered = std::make_shared<std::vector<Uint8>>(pBlock->size()/rowBytes*(rowBytes+1));
+		std::vector<Uint8> candidate(rowBytes+1);
+		std::vector<Uint8> zeros;
+
+		//The row above the first one is the last of the previous block
+		const Uint8 *pAbove = nullptr;
+		if(pPreviousBlock){
+			pAbove = pPreviousBlock->data() + pPreviousBlock->size() - rowBytes;
+		} else {
+			zeros.assign(rowBytes, 0);
+			pAbove = zeros.data();
+		}
+
+		for(size_t row = 0; row*rowBytes < pBlock->size(); row++){
+			const Uint8 *pRow = pBlock->data() + row*rowBytes;
+			Uint8 *pResult = pFiltered->data() + row*(rowBytes+1);
+			if(settings.filter == PngEncodeSettings::Filter::ADAPTIVE) FilterRowAdaptive(pRow, pAbove, rowBytes, pResult, candidate);
+			else FilterRow(settings.filter, pRow, pAbove, rowBytes, pResult);
+			pAbove = pRow;
+		}
+		filteredPromise.set_value(pFiltered);
+
+		std::shared_ptr<const std::vector<Uint8>> pDictionary = previousFiltered.valid() ? previousFiltered.get() : nullptr;
+
+		CompressedBlock result;
+		result.data = CompressBlock(*pFiltered, pDictionary.get(), settings.compressionLevel, last);
+		result.adler = adler32(adler32(0L, Z_NULL, 0), pFiltered->data(), (uInt)pFiltered->size());
+		result.filteredSize = pFiltered->size();
+		return result;
+	}));
+
+	mPreviousFiltered = std::move(filteredResult);
+	mpPreviousBlock = std::move(pBlock);
+	mpBlock = std::make_shared<std::vector<Uint8>>();
+	mpBlock->reserve(M_BLOCK_SIZE + mRow.size());
+#endif
+}
+
+bool PngWriter::WriteFinishedBlocks(size_t maxPending){
+#ifdef PAINTAPP_HAS_ZLIB
+	while(!mPendingBlocks.empty()){
+		bool ready = mPendingBlocks.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+		if(!ready && mPendingBlocks.size() <= maxPending) break;
+
+		CompressedBlock compressed = mPendingBlocks.front().get();
+		mPendingBlocks.pop_front();
+
+		if(compressed.data.empty()){
+			ErrorPrint("Couldn't compress a block of the png");
+			return false;
+		}
+		mAdler = adler32_combine(mAdler, compressed.adler, (z_off_t)compressed.filteredSize);
+		if(!WriteIdatData(compressed.data.data(), compressed.data.size())) return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool PngWriter::WriteIdatData(const Uint8 *pData, size_t size){
+#ifdef PAINTAPP_HAS_ZLIB
+	mIdatCrc = crc32(mIdatCrc, pData, (uInt)size);
+	mIdatSize += size;
+	return std::fwrite(pData, 1, size, mpFile) == size;
+#else
+	return false;
+#endif
+}
+
+bool PngWriter::Deflate(const Uint8 *pData, size_t size, bool finish){
+#ifdef PAINTAPP_HAS_ZLIB
+	z_stream *pStream = static_cast<z_stream*>(mpStream);
+	pStream->next_in = const_cast<Bytef*>(pData);
+	pStream->avail_in = (uInt)size;
+
+	while(true){
+		//The buffer is full, so it becomes a chunk
+		if(mOutputSize == mOutput.size()){
+			if(!WriteChunk("IDAT", mOutput.data(), mOutputSize)) return false;
+			mOutputSize = 0;
+		}
+
+		pStream->next_out = mOutput.data() + mOutputSize;
+		pStream->avail_out = (uInt)(mOutput.size() - mOutputSize);
+
+		int result = deflate(pStream, finish ? Z_FINISH : Z_NO_FLUSH);
+		mOutputSize = mOutput.size() - pStream->avail_out;
+
+		if(result == Z_STREAM_ERROR){
+			ErrorPrint("zlib's deflate failed");
+			return false;
+		}
+
+		if(finish){
+			if(result == Z_STREAM_END) break;
+		} else if(pStream->avail_in == 0 && pStream->avail_out != 0){
+			break;
+		}
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool PngWriter::WriteChunk(const char *pType, const Uint8 *pData, size_t size){
+#ifdef PAINTAPP_HAS_ZLIB
+	Uint8 header[8];
+	WriteBigEndian(header, (Uint32)size);
+	std::memcpy(header+4, pType, 4);
+
+	//The crc covers the type and the data, but not the length
+	uLong crc = crc32(0L, header+4, 4);
+	if(size > 0) crc = crc32(crc, pData, (uInt)size);
+	Uint8 footer[4];
+	WriteBigEndian(footer, (Uint32)crc);
+
+	return std::fwrite(header, 1, 8, mpFile) == 8 && (size == 0 || std::fwrite(pData, 1, size, mpFile) == size) && std::fwrite(footer, 1, 4, mpFile) == 4;
+#else
+	return false;
+#endif
+}
+
+//PNG READER METHODS:
+
+PngReader::PngReader(const char *pPath){
+#ifdef PAINTAPP_HAS_ZLIB
+	mpFile = std::fopen(pPath, "rb");
+	if(!mpFile){
+		mError = "Couldn't open "+std::string(pPath);
+		return;
+	}
+
+	if(!ReadHeader()){
+		std::fclose(mpFile);
+		mpFile = nullptr;
+		return;
+	}
+
+	z_stream *pStream = new z_stream{};
+	if(inflateInit(pStream) != Z_OK){
+		mError = "Couldn't initialize zlib's inflate";
+		delete pStream;
+		return;
+	}
+	mpStream = pStream;
+
+	mRow.resize(mRowBytes+1);
+	mPreviousRow.assign(mRowBytes+1, 0);
+	mInput.resize(PNG_BUFFER_SIZE);
+#endif
+}
+
+PngReader::~PngReader(){
+	if(mpFile) std::fclose(mpFile);
+#ifdef PAINTAPP_HAS_ZLIB
+	if(mpStream){
+		inflateEnd(static_cast<z_stream*>(mpStream));
+		delete static_cast<z_stream*>(mpStream);
+	}
+#endif
+}
+
+bool PngReader::IsOpen(){
+	return mpFile && mpStream;
+}
+
+SDL_Point PngReader::GetSize(){
+	return {mWidth, mHeight};
+}
+
+const std::string &PngReader::GetError(){
+	return mError;
+}
+
+bool PngReader::ReadRows(SDL_Surface *pDestination, int firstRow, int rowCount){
+	if(!IsOpen()) return false;
+	if(pDestination->w != mWidth || pDestination->format->format != SDL_PIXELFORMAT_RGBA8888 || firstRow < 0 || firstRow+rowCount > pDestination->h || mReadRows+rowCount > mHeight){
+		mError = "the destination doesn't match the png being read";
+		return false;
+	}
+
+	if(SDL_MUSTLOCK(pDestination)) SDL_LockSurface(pDestination);
+
+	bool success = true;
+	for(int y = 0; y < rowCount && success; y++){
+		success = ReadRawRow();
+		if(!success) break;
+
+		Uint32 *pPixels = reinterpret_cast<Uint32*>(static_cast<Uint8*>(pDestination->pixels) + (firstRow+y)*pDestination->pitch);
+		for(int x = 0; x < mWidth; x++) pPixels[x] = ConvertPixel(x);
+
+		std::swap(mRow, mPreviousRow);
+		mReadRows++;
+	}
+
+	if(SDL_MUSTLOCK(pDestination)) SDL_UnlockSurface(pDestination);
+
+	return success;
+}
+
+bool PngReader::ReadHeader(){
+	Uint8 signature[8];
+	if(std::fread(signature, 1, 8, mpFile) != 8 || std::memcmp(signature, PNG_SIGNATURE, 8) != 0){
+		mError = "The file isn't a png";
+		return false;
+	}
+
+	//The chunks before the first IDAT are read, leaving the file at the start of its data
+	bool headerRead = false;
+	Uint8 chunkHeader[8];
+	while(std::fread(chunkHeader, 1, 8, mpFile) == 8){
+		Uint32 length = ReadBigEndian(chunkHeader);
+		const char *pType = reinterpret_cast<const char*>(chunkHeader+4);
+
+		if(std::memcmp(pType, "IHDR", 4) == 0){
+			Uint8 data[13];
+			if(length != 13 || std::fread(data, 1, 13, mpFile) != 13) break;
+			mWidth = (int)ReadBigEndian(data);
+			mHeight = (int)ReadBigEndian(data+4);
+			mBitDepth = data[8];
+			mColorType = data[9];
+
+			if(data[12] != 0){
+				mError = "Interlaced pngs can't be streamed";
+				return false;
+			}
+
+			bool validDepth = false;
+			switch(mColorType){
+				case 0: mChannels = 1; validDepth = mBitDepth == 1 || mBitDepth == 2 || mBitDepth == 4 || mBitDepth == 8 || mBitDepth == 16; break;
+				case 2: mChannels = 3; validDepth = mBitDepth == 8 || mBitDepth == 16; break;
+				case 3: mChannels = 1; validDepth = mBitDepth == 1 || mBitDepth == 2 || mBitDepth == 4 || mBitDepth == 8; break;
+				case 4: mChannels = 2; validDepth = mBitDepth == 8 || mBitDepth == 16; break;
+				case 6: mChannels = 4; validDepth = mBitDepth == 8 || mBitDepth == 16; break;
+				default: break;
+			}
+			if(!validDepth || mWidth <= 0 || mHeight <= 0 || data[10] != 0 || data[11] != 0){
+				mError = "The png header is corrupted";
+				return false;
+			}
+
+			mRowBytes = ((size_t)mWidth*mChannels*mBitDepth + 7)/8;
+			mFilterStep = std::max(1, mChannels*mBitDepth/8);
+			headerRead = true;
+			std::fseek(mpFile, 4, SEEK_CUR); //CRC
+		} else if(std::memcmp(pType, "PLTE", 4) == 0){
+			Uint8 data[256*3];
+			if(length > sizeof(data) || length%3 != 0 || std::fread(data, 1, length, mpFile) != length) break;
+			for(Uint32 i = 0; i < length/3; i++){
+				mPalette[i] = ((Uint32)data[i*3] << 24) | ((Uint32)data[i*3+1] << 16) | ((Uint32)data[i*3+2] << 8) | SDL_ALPHA_OPAQUE;
+			}
+			std::fseek(mpFile, 4, SEEK_CUR);
+		} else if(std::memcmp(pType, "tRNS", 4) == 0){
+			Uint8 data[256];
+			if(length > sizeof(data) || std::fread(data, 1, length, mpFile) != length) break;
+
+			//It must come after the palette, so the alpha of each entry can be set directly
+			if(mColorType == 3){
+				for(Uint32 i = 0; i < length; i++) mPalette[i] = (mPalette[i] & 0xFFFFFF00) | data[i];
+			} else if(mColorType == 0 && length >= 2){
+				mTransparentGray = (data[0] << 8) | data[1];
+			} else if(mColorType == 2 && length >= 6){
+				for(int i = 0; i < 3; i++) mTransparentRGB[i] = (data[i*2] << 8) | data[i*2+1];
+			}
+			std::fseek(mpFile, 4, SEEK_CUR);
+		} else if(std::memcmp(pType, "IDAT", 4) == 0){
+			if(!headerRead) break;
+			mChunkLeft = length;
+			return true;
+		} else if(std::memcmp(pType, "IEND", 4) == 0){
+			break;
+		} else {
+			//Ancillary chunks (text, gamma, etc.) are ignored
+			std::fseek(mpFile, (long)length+4, SEEK_CUR);
+		}
+	}
+
+	mError = "The png is corrupted or has no image data";
+	return false;
+}
+
+bool PngReader::FillInput(){
+#ifdef PAINTAPP_HAS_ZLIB
+	//The data of an image may be split in several consecutive IDAT chunks
+	while(mChunkLeft == 0){
+		if(mNoMoreData) return false;
+
+		//CRC of the previous chunk, then the length and type of the next one
+		Uint8 chunkHeader[12];
+		if(std::fread(chunkHeader, 1, 12, mpFile) != 12 || std::memcmp(chunkHeader+8, "IDAT", 4) != 0){
+			mNoMoreData = true;
+			return false;
+		}
+		mChunkLeft = ReadBigEndian(chunkHeader+4);
+	}
+
+	size_t read = std::fread(mInput.data(), 1, std::min((size_t)mChunkLeft, mInput.size()), mpFile);
+	if(read == 0){
+		mNoMoreData = true;
+		return false;
+	}
+	mChunkLeft -= read;
+
+	z_stream *pStream = static_cast<z_stream*>(mpStream);
+	pStream->next_in = mInput.data();
+	pStream->avail_in = (uInt)read;
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool PngReader::ReadRawRow(){
+#ifdef PAINTAPP_HAS_ZLIB
+	z_stream *pStream = static_cast<z_stream*>(mpStream);
+	pStream->next_out = mRow.data();
+	pStream->avail_out = (uInt)mRow.size();
+
+	while(pStream->avail_out > 0){
+		if(pStream->avail_in == 0 && !FillInput()){
+			mError = "The png data ended before all of its rows were read";
+			return false;
+		}
+
+		int result = inflate(pStream, Z_NO_FLUSH);
+		if(result == Z_STREAM_END){
+			if(pStream->avail_out > 0){
+				mError = "The png data ended before all of its rows were read";
+				return false;
+			}
+			break;
+		}
+		if(result != Z_OK && result != Z_BUF_ERROR){
+			mError = "The png data is corrupted";
+			return false;
+		}
+	}
+
+	if(mRow[0] > 4){
+		mError = "The png has a row with the invalid filter "+std::to_string(mRow[0]);
+		return false;
+	}
+	UnfilterRow(mRow[0]);
+	return true;
+#else
+	return false;
+#endif
+}
+
+void PngReader::UnfilterRow(Uint8 filter){
+	Uint8 *pRow = mRow.data()+1;
+	const Uint8 *pAbove = mPreviousRow.data()+1;
+	const size_t step = mFilterStep;
+
+	switch(filter){
+		case 1:
+			for(size_t i = step; i < mRowBytes; i++) pRow[i] += pRow[i-step];
+			break;
+		case 2:
+			for(size_t i = 0; i < mRowBytes; i++) pRow[i] += pAbove[i];
+			break;
+		case 3:
+			for(size_t i = 0; i < mRowBytes; i++) pRow[i] += (Uint8)(((i >= step ? pRow[i-step] : 0) + pAbove[i]) / 2);
+			break;
+		case 4:
+			for(size_t i = 0; i < mRowBytes; i++) pRow[i] += PaethPredictor(i >= step ? pRow[i-step] : 0, pAbove[i], i >= step ? pAbove[i-step] : 0);
+			break;
+		default:
+			break;
+	}
+}
+
+Uint32 PngReader::ConvertPixel(int x){
+	const Uint8 *pRow = mRow.data()+1;
+
+	//Returns the sample with its original depth
+	auto getSample = [&](int channel) -> int {
+		size_t index = (size_t)x*mChannels + channel;
+		switch(mBitDepth){
+			case 8: return pRow[index];
+			case 16: return (pRow[index*2] << 8) | pRow[index*2+1];
+			default:{
+				size_t bit = index*mBitDepth;
+				int shift = 8 - mBitDepth - (int)(bit%8);
+				return (pRow[bit/8] >> shift) & ((1 << mBitDepth) - 1);
+			}
+		}
+	};
+	auto toByte = [&](int sample) -> Uint32 {
+		if(mBitDepth == 16) return (Uint32)(sample >> 8);
+		if(mBitDepth < 8) return (Uint32)(sample*255/((1 << mBitDepth) - 1));
+		return (Uint32)sample;
+	};
+
+	switch(mColorType){
+		case 0:{
+			int gray = getSample(0);
+			Uint32 value = toByte(gray);
+			return (value << 24) | (value << 16) | (value << 8) | (gray == mTransparentGray ? SDL_ALPHA_TRANSPARENT : SDL_ALPHA_OPAQUE);
+		}
+		case 2:{
+			int r = getSample(0), g = getSample(1), b = getSample(2);
+			bool transparent = r == mTransparentRGB[0] && g == mTransparentRGB[1] && b == mTransparentRGB[2];
+			return (toByte(r) << 24) | (toByte(g) << 16) | (toByte(b) << 8) | (transparent ? SDL_ALPHA_TRANSPARENT : SDL_ALPHA_OPAQUE);
+		}
+		case 3:
+			return mPalette[getSample(0)];
+		case 4:{
+			Uint32 value = toByte(getSample(0));
+			return (value << 24) | (value << 16) | (value << 8) | toByte(getSample(1));
+		}
+		case 6:
+			return (toByte(getSample(0)) << 24) | (toByte(getSample(1)) << 16) | (toByte(getSample(2)) << 8) | toByte(getSample(3));
+		default:
+			return 0;
+	}
+}
+
+SDL_Surface *LoadPNGStreamed(const char *pPath, std::string &error, const DecodedRowsCallback &onRows){
+	PngReader reader(pPath);
+	if(!reader.IsOpen()){
+		error = reader.GetError();
+		return nullptr;
+	}
+
+	SDL_Point size = reader.GetSize();
+	SDL_Surface *pSurface = SDL_CreateRGBSurfaceWithFormat(0, size.x, size.y, 32, SDL_PixelFormatEnum::SDL_PIXELFORMAT_RGBA8888);
+	if(!pSurface){
+		error = SDL_GetError();
+		return nullptr;
+	}
+
+	constexpr int BAND_ROWS = 64;
+	for(int firstRow = 0; firstRow < size.y; firstRow += BAND_ROWS){
+		int rowCount = std::min(BAND_ROWS, size.y - firstRow);
+		if(!reader.ReadRows(pSurface, firstRow, rowCount)){
+			error = reader.GetError();
+			SDL_FreeSurface(pSurface);
+			return nullptr;
+		}
+		if(onRows) onRows(pSurface, firstRow, rowCount);
+	}
+	return pSurface;
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include "SDL.h"
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <deque>
+#include <future>
+#include <memory>
+#include <functional>
+
+class ThreadPool;
+
+//Png reading and writing that works a few rows at a time, so that saving and loading big images doesn't need extra full size buffers
+//It needs zlib (PAINTAPP_HAS_ZLIB is defined by CMake when it's found). Without it nothing can be opened, and SDL_image has to be used instead
+
+struct PngEncodeSettings{
+    enum class Filter : int{
+        NONE = 0,
+        SUB = 1,
+        UP = 2,
+        AVERAGE = 3,
+        PAETH = 4,
+        ADAPTIVE = 5 //Picks for each row the filter with the smallest sum of absolute values, which usually compresses the best
+    };
+
+    //From 0 (no compression, fastest) to 9 (smallest file, slowest)
+    int compressionLevel = 6;
+    Filter filter = Filter::ADAPTIVE;
+
+    //Accepts the names in lowercase ("none", "sub", "up", "average", "paeth", "adaptive"). Returns ADAPTIVE and sets valid to false if it's unknown
+    static Filter FilterFromString(std::string_view name, bool *valid = nullptr);
+};
+
+//Returns false if the png streams can't be used, because the app was built without zlib
+bool IsPngStreamAvailable();
+
+//Writes a non interlaced, 8 bits RGBA png. The rows have to be written from top to bottom
+//If a thread pool is given, the filtered rows are split into blocks that get compressed in parallel (like pigz does), which still form a single IDAT chunk
+class PngWriter{
+    public:
+
+    PngWriter(const char *pPath, int width, int height, const PngEncodeSettings &settings, ThreadPool *pPool = nullptr);
+    ~PngWriter();
+
+    PngWriter(const PngWriter&) = delete;
+    PngWriter &operator=(const PngWriter&) = delete;
+
+    bool IsOpen();
+
+    //Writes the first 'rowCount' rows of the surface, which must be in the RGBA8888 format and have the width of the png. Returns false on failure
+    bool WriteRows(SDL_Surface *pRows, int rowCount);
+    //Writes what is left of the compressed data and closes the file. Returns false on failure or if not all rows were written
+    bool Finish();
+
+    private:
+
+    FILE *mpFile = nullptr;
+    int mWidth = 0, mHeight = 0, mWrittenRows = 0;
+    PngEncodeSettings mSettings;
+
+    //Raw bytes (R, G, B, A) of the current and the previous rows
+    std::vector<Uint8> mRow, mPreviousRow;
+    //Filter type byte followed by the filtered row, and the space used by the adaptive filter to try each filter
+    std::vector<Uint8> mFiltered, mCandidate;
+    //Compressed data waiting to be written as an IDAT chunk, of which only the first 'mOutputSize' bytes are used
+    std::vector<Uint8> mOutput;
+    size_t mOutputSize = 0;
+
+    //z_stream, kept opaque so that zlib.h isn't needed by the rest of the app
+    void *mpStream = nullptr;
+
+    //Used only when compressing in parallel:
+    ThreadPool *mpPool = nullptr;
+    //Unfiltered rows waiting to be submitted. Each block gets filtered and compressed by a job of the pool, which uses the end of the previous block as dictionary
+    static constexpr size_t M_BLOCK_SIZE = 1 << 18;
+    std::shared_ptr<std::vector<Uint8>> mpBlock;
+    std::shared_ptr<const std::vector<Uint8>> mpPreviousBlock;
+    //Set by the job of the previous block as soon as its rows are filtered
+    std::shared_future<std::shared_ptr<const std::vector<Uint8>>> mPreviousFiltered;
+
+    struct CompressedBlock{
+        std::vector<Uint8> data; //Empty if the compression failed
+        unsigned long adler = 1; //Checksum of the filtered block
+        size_t filteredSize = 0;
+    };
+    //In the order they have to be written
+    std::deque<std::future<CompressedBlock>> mPendingBlocks;
+
+    //Checksum of all the uncompressed data, written at the end of the zlib stream
+    unsigned long mAdler = 1;
+    //Where the length of the IDAT chunk has to be written once it's known, and the data needed to finish the chunk
+    long mIdatLengthPosition = 0;
+    size_t mIdatSize = 0;
+    unsigned long mIdatCrc = 0;
+
+    void SubmitBlock(bool last);
+    //Writes the compressed blocks that have finished into the IDAT chunk, waiting for the oldest ones while more than 'maxPending' are left
+    bool WriteFinishedBlocks(size_t maxPending);
+    bool WriteIdatData(const Uint8 *pData, size_t size);
+
+    bool Deflate(const Uint8 *pData, size_t size, bool finish);
+    bool WriteChunk(const char *pType, const Uint8 *pData, size_t size);
+};
+
+//Reads non interlaced pngs of any color type and bit depth, converting them into RGBA8888 rows from top to bottom
+//Nothing gets logged, the failures are kept in 'GetError' instead, so the files can be read from any thread
+class PngReader{
+    public:
+
+    PngReader(const char *pPath);
+    ~PngReader();
+
+    PngReader(const PngReader&) = delete;
+    PngReader &operator=(const PngReader&) = delete;
+
+    //False if the file couldn't be opened, isn't a valid png or uses a feature that isn't supported (e.g: interlacing)
+    bool IsOpen();
+    SDL_Point GetSize();
+
+    //Decodes the next 'rowCount' rows into the surface, starting at 'firstRow'. The surface must be in the RGBA8888 format and have the width of the png
+    bool ReadRows(SDL_Surface *pDestination, int firstRow, int rowCount);
+    //Why the reader couldn't be opened or the last rows couldn't be read
+    const std::string &GetError();
+
+    private:
+
+    FILE *mpFile = nullptr;
+    std::string mError;
+    int mWidth = 0, mHeight = 0, mReadRows = 0;
+    Uint8 mBitDepth = 0, mColorType = 0;
+    int mChannels = 0;
+    size_t mRowBytes = 0; //Bytes of a row without its filter byte
+    int mFilterStep = 0; //Bytes per complete pixel (at least 1), used by the filters
+
+    std::array<Uint32, 256> mPalette{};
+    //Color of the single transparent value of gray and RGB images, or -1 if none
+    int mTransparentGray = -1;
+    int mTransparentRGB[3] = {-1, -1, -1};
+
+    std::vector<Uint8> mRow, mPreviousRow;
+    std::vector<Uint8> mInput; //Compressed data read from the IDAT chunks
+    Uint32 mChunkLeft = 0; //Bytes left to read of the current IDAT chunk
+    bool mNoMoreData = false;
+
+    void *mpStream = nullptr;
+
+    bool ReadHeader();
+    //Reads more of the IDAT chunks into 'mInput'. Returns false if there's nothing left
+    bool FillInput();
+    bool ReadRawRow();
+    void UnfilterRow(Uint8 filter);
+    Uint32 ConvertPixel(int x);
+};
+
+//Called with the surface being decoded and the rows that have just been decoded into it
+using DecodedRowsCallback = std::function<void(SDL_Surface *pSurface, int firstRow, int rowCount)>;
+
+//Decodes the png straight into a new RGBA8888 surface. Returns nullptr if it couldn't (writing why into 'error'), in which case IMG_Load may still be able to
+//It's decoded in bands of rows, and 'onRows' (if any) gets called after each of them, so the image can be shown while it loads
+SDL_Surface *LoadPNGStreamed(const char *pPath, std::string &error, const DecodedRowsCallback &onRows = nullptr);
@@ -0,0 +1,246 @@
+#include "rasterizer.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+//COVERAGE MASK METHODS:
+
+void CoverageMask::Reset(SDL_Rect nBounds){
+	mBounds = nBounds;
+	if(mBounds.w <= 0 || mBounds.h <= 0) mBounds = {0, 0, 0, 0};
+
+	mCoverage.assign((size_t)mBounds.w*mBounds.h, 0);
+}
+
+SDL_Rect CoverageMask::GetBounds() const{
+	return mBounds;
+}
+
+bool CoverageMask::IsEmpty() const{
+	return mBounds.w <= 0 || mBounds.h <= 0;
+}
+
+Uint8 *CoverageMask::GetRow(int y){
+	return mCoverage.data() + (size_t)(y - mBounds.y)*mBounds.w;
+}
+
+//RASTERIZER METHODS:
+
+void Rasterizer::Clear(){
+	mEdges.clear();
+}
+
+void Rasterizer::AddContour(std::span<const SDL_FPoint> points){
+	if(points.empty()) return;
+
+	if(mEdges.empty()){
+		mMinX = mMaxX = points[0].x;
+		mMinY = mMaxY = points[0].y;
+	}
+
+	for(size_t i = 0; i < points.size(); i++){
+		const SDL_FPoint &start = points[i], &end = points[(i+1) % points.size()];
+		mMinX = std::min(mMinX, start.x);
+		mMaxX = std::max(mMaxX, start.x);
+		mMinY = std::min(mMinY, start.y);
+		mMaxY = std::max(mMaxY, start.y);
+
+		if(start.y == end.y) continue;
+
+		const SDL_FPoint &upper = (start.y < end.y ? start : end), &lower = (start.y < end.y ? end : start);
+		mEdges.push_back({upper.y, lower.y, upper.x, (lower.x - upper.x)/(lower.y - upper.y), (start.y < end.y ? 1 : -1)});
+	}
+}
+
+void Rasterizer::Rasterize(SDL_Rect clip, FillRule rule, bool antiAliasing, CoverageMask &mask){
+	TRACE_SCOPE("Rasterize");
+
+	SDL_Rect bounds = GetClippedBounds(clip);
+	mask.Reset(bounds);
+	if(mask.IsEmpty()) return;
+
+	const int left = bounds.x, top = bounds.y, bottom = bounds.y + bounds.h;
+	const int width = bounds.w;
+	const int samples = (antiAliasing ? M_SUBSAMPLES : 1);
+	const float weight = 255.0f/samples;
+
+	mPartial.assign(width+1, 0.0f);
+	mFull.assign(width+1, 0.0f);
+
+	//Adds the span between both x (in image coordinates) to the coverage of the row
+	auto addSpan = [&](float startX, float endX){
+		startX = std::clamp(startX - left, 0.0f, (float)width);
+		endX = std::clamp(endX - left, 0.0f, (float)width);
+		if(endX <= startX) return;
+
+		if(!antiAliasing){
+			//The pixels whose center is inside
+			int first = (int)std::ceil(startX - 0.5f), last = (int)std::ceil(endX - 0.5f);
+			mFull[first] += weight;
+			mFull[last] -= weight;
+			return;
+		}
+
+		int first = (int)startX, last = (int)endX;
+		if(first == last){
+			mPartial[first] += (endX - startX)*weight;
+			return;
+		}
+
+		mPartial[first] += (first + 1 - startX)*weight;
+		mFull[first+1] += weight;
+		mFull[last] -= weight;
+		mPartial[last] += (endX - last)*weight;
+	};
+
+	//The edges get activated in order as the scanlines go down, so every scanline only looks at the edges that cross it
+	std::sort(mEdges.begin(), mEdges.end(), [](const Edge &a, const Edge &b){ return a.top < b.top; });
+	size_t nextEdge = 0;
+	mActiveEdges.clear();
+
+	for(int y = top; y < bottom; y++){
+		for(int sample = 0; sample < samples; sample++){
+			const float scanlineY = y + (sample + 0.5f)/samples;
+
+			while(nextEdge < mEdges.size() && mEdges[nextEdge].top <= scanlineY) mActiveEdges.push_back(&mEdges[nextEdge++]);
+			std::erase_if(mActiveEdges, [scanlineY](const Edge *pEdge){ return pEdge->bottom <= scanlineY; });
+
+			mCrossings.clear();
+			for(const Edge *pEdge : mActiveEdges) mCrossings.push_back({pEdge->x + (scanlineY - pEdge->top)*pEdge->slope, pEdge->direction});
+			std::sort(mCrossings.begin(), mCrossings.end(), [](const Crossing &a, const Crossing &b){ return a.x < b.x; });
+
+			int winding = 0;
+			for(size_t i = 0; i+1 < mCrossings.size(); i++){
+				winding += (rule == FillRule::EVEN_ODD ? 1 : mCrossings[i].direction);
+				bool inside = (rule == FillRule::EVEN_ODD ? (winding & 1) != 0 : winding != 0);
+				if(inside) addSpan(mCrossings[i].x, mCrossings[i+1].x);
+			}
+		}
+
+		Uint8 *pRow = mask.GetRow(y);
+		float fullCoverage = 0.0f;
+		for(int x = 0; x < width; x++){
+			fullCoverage += mFull[x];
+			pRow[x] = (Uint8)std::clamp((int)std::lround(fullCoverage + mPartial[x]), 0, 255);
+		}
+
+		std::fill(mPartial.begin(), mPartial.end(), 0.0f);
+		std::fill(mFull.begin(), mFull.end(), 0.0f);
+	}
+}
+
+void Rasterizer::RasterizeExact(SDL_Rect clip, CoverageMask &mask){
+	TRACE_SCOPE("Rasterize exact");
+
+	SDL_Rect bounds = GetClippedBounds(clip);
+	mask.Reset(bounds);
+	if(mask.IsEmpty()) return;
+
+	//Every row has 2 extra cells, as the area of an edge can reach the cell after the one it ends in. The one at the end holds what falls right of the mask
+	const size_t stride = bounds.w + 2;
+	mAccumulation.assign(stride*bounds.h, 0.0f);
+
+	for(const Edge &edge : mEdges){
+		const int firstRow = std::max(bounds.y, (int)std::floor(edge.top)), lastRow = std::min(bounds.y + bounds.h, (int)std::ceil(edge.bottom));
+		const float direction = (float)edge.direction;
+
+		for(int y = firstRow; y < lastRow; y++){
+			//The part of the edge inside the row, in mask coordinates
+			float startY = std::max((float)y, edge.top), endY = std::min((float)(y+1), edge.bottom);
+			if(endY <= startY) continue;
+
+			float startX = edge.x + (startY - edge.top)*edge.slope - bounds.x, endX = edge.x + (endY - edge.top)*edge.slope - bounds.x;
+			float height = (endY - startY)*direction;
+			float *pRow = mAccumulation.data() + (size_t)(y - bounds.y)*stride;
+
+			//The cells left of the mask add up into its first one, as only their sum matters. The ones right of it are never read
+			auto addArea = [pRow, stride](int cell, float area){
+				pRow[std::clamp(cell, 0, (int)stride-1)] += area;
+			};
+
+			float minX = std::min(startX, endX), maxX = std::max(startX, endX);
+			int firstCell = (int)std::floor(minX), lastCell = (int)std::ceil(maxX);
+
+			if(lastCell <= firstCell + 1){
+				//Within a single cell: the part of the cell right of the edge is covered
+				float middle = 0.5f*(startX + endX) - firstCell;
+				addArea(firstCell, height*(1.0f - middle));
+				addArea(firstCell+1, height*middle);
+				continue;
+			}
+
+			//Across several cells: the area right of the edge grows linearly from the cell where it starts to the one where it ends
+			float inverseWidth = 1.0f/(maxX - minX);
+			float startFraction = minX - firstCell;
+			float firstArea = 0.5f*inverseWidth*(1.0f - startFraction)*(1.0f - startFraction);
+			float endFraction = maxX - lastCell + 1.0f;
+			float lastArea = 0.5f*inverseWidth*endFraction*endFraction;
+
+			addArea(firstCell, height*firstArea);
+			if(lastCell == firstCell + 2){
+				addArea(firstCell+1, height*(1.0f - firstArea - lastArea));
+			} else {
+				float secondArea = inverseWidth*(1.5f - startFraction);
+				addArea(firstCell+1, height*(secondArea - firstArea));
+				for(int cell = firstCell+2; cell < lastCell-1; cell++) addArea(cell, height*inverseWidth);
+
+				float beforeLastArea = secondArea + (lastCell - firstCell - 3)*inverseWidth;
+				addArea(lastCell-1, height*(1.0f - beforeLastArea - lastArea));
+			}
+			addArea(lastCell, height*lastArea);
+		}
+	}
+
+	for(int y = 0; y < bounds.h; y++){
+		const float *pCells = mAccumulation.data() + (size_t)y*stride;
+		Uint8 *pRow = mask.GetRow(bounds.y + y);
+
+		float coverage = 0.0f;
+		for(int x = 0; x < bounds.w; x++){
+			coverage += pCells[x];
+			pRow[x] = (Uint8)std::lround(std::min(std::abs(coverage), 1.0f)*255.0f);
+		}
+	}
+}
+
+SDL_Rect Rasterizer::GetClippedBounds(SDL_Rect clip){
+	int left = std::max(clip.x, (int)std::floor(mMinX)), right = std::min(clip.x + clip.w, (int)std::ceil(mMaxX));
+	int top = std::max(clip.y, (int)std::floor(mMinY)), bottom = std::min(clip.y + clip.h, (int)std::ceil(mMaxY));
+	if(mEdges.empty() || right <= left || bottom <= top) return {0, 0, 0, 0};
+
+	return {left, top, right - left, bottom - top};
+}
+
+//STROKER METHODS:
+
+void Stroker::Stroke(std::span<const SDL_FPoint> points, float halfWidth, bool closed, Rasterizer &rasterizer){
+	if(points.empty() || halfWidth <= 0.0f) return;
+
+	//About a side every 2 pixels of perimeter, which keeps the sides within a small fraction of a pixel from the circle
+	const int sides = std::clamp((int)std::ceil(std::numbers::pi_v<float>*halfWidth), M_MIN_ROUND_SIDES, M_MAX_ROUND_SIDES);
+	mRound.resize(sides);
+
+	//Both the circles and the rectangles go counter-clockwise on screen (y grows downwards), so the winding of every overlap adds up instead of cancelling
+	for(const SDL_FPoint &point : points){
+		for(int i = 0; i < sides; i++){
+			float angle = -2.0f*std::numbers::pi_v<float>*i/sides;
+			mRound[i] = {point.x + halfWidth*std::cos(angle), point.y + halfWidth*std::sin(angle)};
+		}
+		rasterizer.AddContour(mRound);
+	}
+
+	const size_t segments = (closed && points.size() > 2 ? points.size() : points.size()-1);
+	for(size_t i = 0; i < segments; i++){
+		const SDL_FPoint &start = points[i], &end = points[(i+1) % points.size()];
+		float length = std::hypot(end.x - start.x, end.y - start.y);
+		if(length == 0.0f) continue;
+
+		SDL_FPoint normal = {(start.y - end.y)/length*halfWidth, (end.x - start.x)/length*halfWidth};
+		const SDL_FPoint rectangle[4] = {
+			{start.x + normal.x, start.y + normal.y}, {end.x + normal.x, end.y + normal.y},
+			{end.x - normal.x, end.y - normal.y}, {start.x - normal.x, start.y - normal.y}
+		};
+		rasterizer.AddContour(rectangle);
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "SDL.h"
+#include <span>
+#include <vector>
+
+//Determines which parts of overlapping or self intersecting contours are inside
+enum class FillRule{
+    EVEN_ODD, //Inside if a ray from the point crosses the contours an odd amount of times
+    NON_ZERO  //Inside if the contours wind around the point, no matter how many times (overlapping contours get merged)
+};
+
+//Coverage of every pixel of a rect, from 0 (outside) to 255 (inside). The pixels outside the rect aren't covered
+class CoverageMask{
+    public:
+
+    //Sets the rect held by the mask, with every pixel uncovered
+    void Reset(SDL_Rect nBounds);
+
+    SDL_Rect GetBounds() const;
+    bool IsEmpty() const;
+
+    //Constant time, so that looking up a pixel doesn't depend on what was rasterized
+    inline Uint8 GetCoverage(int x, int y) const{
+        x -= mBounds.x;
+        y -= mBounds.y;
+        if((unsigned)x >= (unsigned)mBounds.w || (unsigned)y >= (unsigned)mBounds.h) return 0;
+        return mCoverage[(size_t)y*mBounds.w + x];
+    }
+
+    //'y' is in image coordinates and must be inside the bounds. The first value is the one of the pixel at 'GetBounds().x'
+    Uint8 *GetRow(int y);
+
+    private:
+
+    SDL_Rect mBounds = {0, 0, 0, 0};
+    std::vector<Uint8> mCoverage;
+};
+
+//Scanline polygon rasterizer. The contours are gathered with 'AddContour' and then turned into a CoverageMask
+//Pixels are squares of side 1 whose top left corner is at their coordinates, so the pixel (x, y) has its center at (x+0.5, y+0.5)
+class Rasterizer{
+    public:
+
+    void Clear();
+
+    //The contour is closed automatically, joining its last point with the first one
+    void AddContour(std::span<const SDL_FPoint> points);
+
+    //Rasterizes the contours added since the last 'Clear' into 'mask', which only spans the part of their bounding rect inside 'clip'
+    //Without anti aliasing a pixel is covered if its center is inside. With it, every row is sampled M_SUBSAMPLES times and the coverage of
+    //the pixels at the ends of each sample is their exact fraction inside
+    void Rasterize(SDL_Rect clip, FillRule rule, bool antiAliasing, CoverageMask &mask);
+
+    //Like 'Rasterize' with the non-zero rule, but with the exact area of every pixel inside the contours. Every edge adds its signed area to the cells
+    //it crosses (as font rasterizers do), and a single running sum per row turns them into coverage, so it takes a single pass over the edges
+    //Overlapping contours are merged, clamping the coverage to 255
+    void RasterizeExact(SDL_Rect clip, CoverageMask &mask);
+
+    private:
+
+    static constexpr int M_SUBSAMPLES = 5; //255 is divisible by it, so full pixels are covered exactly
+
+    struct Edge{
+        float top, bottom; //top < bottom, horizontal edges are discarded as no scanline crosses them
+        float x, slope;    //'x' at 'top', and its change per unit of y
+        int direction;     //+1 if the contour goes down along the edge, -1 if it goes up
+    };
+    std::vector<Edge> mEdges;
+    float mMinX = 0.0f, mMinY = 0.0f, mMaxX = 0.0f, mMaxY = 0.0f;
+
+    //Reused by every call to 'Rasterize'
+    struct Crossing{
+        float x;
+        int direction;
+    };
+    std::vector<const Edge*> mActiveEdges;
+    std::vector<Crossing> mCrossings;
+    std::vector<float> mPartial, mFull; //Coverage of the row being rasterized: exact one at the ends of the spans, and differences for the full pixels
+    std::vector<float> mAccumulation; //Signed area of every cell of the mask, used by 'RasterizeExact'
+
+    //Returns the part of the bounding rect of the contours inside 'clip', which is empty if there are no edges
+    SDL_Rect GetClippedBounds(SDL_Rect clip);
+};
+
+//Turns polylines into the contours of a thick line with round caps and joins, to be filled by a Rasterizer with the non-zero rule
+//Every segment becomes a rectangle and every point a circle, all with the same orientation, so their overlaps merge into a single shape
+class Stroker{
+    public:
+
+    //Adds the contours of the line through 'points' (a dot if there's a single one) to 'rasterizer'. If 'closed', the last point is joined with the first one
+    void Stroke(std::span<const SDL_FPoint> points, float halfWidth, bool closed, Rasterizer &rasterizer);
+
+    private:
+
+    static constexpr int M_MIN_ROUND_SIDES = 8, M_MAX_ROUND_SIDES = 256;
+    std::vector<SDL_FPoint> mRound; //Reused for the circle of every point
+};
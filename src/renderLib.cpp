@@ -3,98 +3,272 @@
 #include <ctime>
 #include <cstdlib>
 #include <cmath>
+#include <cstring>
+#include <climits>
 #include <iostream>
 #include <algorithm>
-
-SDL_Point GetSizeOfPNG(const char *path){
-	SDL_Point result = {0, 0};
-	std::ifstream png(path, std::ios::binary);
-
-	if(!png.is_open()){
-		std::cout << "\nCannot open png " << path << '\n';
-		return result;
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//Read only view of a whole file, unmapped on destruction
+class MappedFile{
+	public:
+
+	MappedFile(const char *path){
+#ifdef _WIN32
+		mFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if(mFile == INVALID_HANDLE_VALUE) return;
+
+		LARGE_INTEGER fileSize;
+		if(!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart == 0) return;
+
+		mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if(!mMapping) return;
+
+		mpData = static_cast<const Uint8*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+		if(mpData) mSize = (size_t)fileSize.QuadPart;
+#else
+		mFile = open(path, O_RDONLY);
+		if(mFile < 0) return;
+
+		struct stat fileStats;
+		if(fstat(mFile, &fileStats) != 0 || fileStats.st_size == 0) return;
+
+		void *pMapped = mmap(nullptr, fileStats.st_size, PROT_READ, MAP_PRIVATE, mFile, 0);
+		if(pMapped == MAP_FAILED) return;
+
+		mpData = static_cast<const Uint8*>(pMapped);
+		mSize = (size_t)fileStats.st_size;
+#endif
 	}
 
-	//We check the first 8 bytes to make sure it is a png
-	{
-		unsigned char magicNumber[8] = {0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A};
-		unsigned char pngHeader[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	~MappedFile(){
+#ifdef _WIN32
+		if(mpData) UnmapViewOfFile(mpData);
+		if(mMapping) CloseHandle(mMapping);
+		if(mFile != INVALID_HANDLE_VALUE) CloseHandle(mFile);
+#else
+		if(mpData) munmap(const_cast<Uint8*>(mpData), mSize);
+		if(mFile >= 0) close(mFile);
+#endif
+	}
 
-		png.read((char*)pngHeader, 8);
-	
-		for(int i = 0; i < 8; ++i){
-			if(pngHeader[i] != magicNumber[i]){
-				std::cout << '\n' << path << " is not a png\n";
-				return result;
-			}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile &operator=(const MappedFile&) = delete;
+
+	//nullptr if the file couldn't be mapped
+	const Uint8 *GetData(){ return mpData; }
+	size_t GetSize(){ return mSize; }
+
+	private:
+
+#ifdef _WIN32
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = nullptr;
+#else
+	int mFile = -1;
+#endif
+	const Uint8 *mpData = nullptr;
+	size_t mSize = 0;
+};
+
+static Uint32 ReadBigEndian32(const Uint8 *pData){ return ((Uint32)pData[0] << 24) | ((Uint32)pData[1] << 16) | ((Uint32)pData[2] << 8) | pData[3]; }
+static Uint16 ReadBigEndian16(const Uint8 *pData){ return (Uint16)((pData[0] << 8) | pData[1]); }
+static Uint32 ReadLittleEndian32(const Uint8 *pData){ return ((Uint32)pData[3] << 24) | ((Uint32)pData[2] << 16) | ((Uint32)pData[1] << 8) | pData[0]; }
+static Uint32 ReadLittleEndian24(const Uint8 *pData){ return ((Uint32)pData[2] << 16) | ((Uint32)pData[1] << 8) | pData[0]; }
+static Uint16 ReadLittleEndian16(const Uint8 *pData){ return (Uint16)((pData[1] << 8) | pData[0]); }
+
+//Each of these returns {0, 0} if the header is invalid. They are only called once the magic bytes have been checked
+static SDL_Point ProbePNG(const Uint8 *pData, size_t size){
+	//Signature, then the IHDR chunk, which must be the first one and have a length of 13
+	if(size < 33 || ReadBigEndian32(pData+8) != 13 || std::memcmp(pData+12, "IHDR", 4) != 0) return {0, 0};
+
+	Uint32 width = ReadBigEndian32(pData+16), height = ReadBigEndian32(pData+20);
+	if(width > INT32_MAX || height > INT32_MAX) return {0, 0};
+	return {(int)width, (int)height};
+}
+
+static SDL_Point ProbeBMP(const Uint8 *pData, size_t size){
+	if(size < 18) return {0, 0};
+
+	Uint32 fileSize = ReadLittleEndian32(pData+2);
+	Uint32 pixelsOffset = ReadLittleEndian32(pData+10);
+	Uint32 headerSize = ReadLittleEndian32(pData+14);
+	if(size < 14+(size_t)headerSize || pixelsOffset >= size || (fileSize != 0 && fileSize > size)) return {0, 0};
+
+	//The header size identifies the variant. Only the OS/2 1.x one stores the size in 16 bits
+	switch(headerSize){
+		case 12:
+			return {ReadLittleEndian16(pData+18), ReadLittleEndian16(pData+20)};
+		case 16: case 40: case 52: case 56: case 64: case 108: case 124:{
+			Sint32 width = (Sint32)ReadLittleEndian32(pData+18);
+			Sint32 height = (Sint32)ReadLittleEndian32(pData+22);
+
+			//A negative height means the rows are stored from top to bottom
+			if(width <= 0 || height == 0 || height == INT32_MIN) return {0, 0};
+			return {width, std::abs(height)};
 		}
+		default:
+			return {0, 0};
 	}
+}
 
-	//We check that the first chunk is the IHDR chunk and then read the width and height
-	{
-		unsigned char chunkLength[4] = {0, 0, 0, 0};
-		unsigned char chunkType[4] = {0, 0, 0, 0};
+static SDL_Point ProbeJPEG(const Uint8 *pData, size_t size){
+	//The size is in the first start of frame segment, so the segments before it are skipped
+	size_t position = 2;
+	while(position+1 < size){
+		if(pData[position] != 0xFF) return {0, 0};
 
-		unsigned char IHDRLength[4] = {0x00, 0x00, 0x00, 0x0D};
-		unsigned char IHDRType[4] = {0x49, 0x48, 0x44, 0x52};
+		Uint8 marker = pData[position+1];
+		position += 2;
 
-		unsigned char readWidth[4] = {0, 0, 0, 0};
-		unsigned char readHeight[4] = {0, 0, 0, 0};
+		//Fill bytes, and markers that have no segment
+		if(marker == 0xFF){ position--; continue; }
+		if(marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) continue;
+		//Start of scan or end of image before any frame
+		if(marker == 0xDA || marker == 0xD9) return {0, 0};
 
-		png.read((char*)chunkLength, 4);
-		png.read((char*)chunkType, 4);
-		png.read((char*)readWidth, 4);
-		png.read((char*)readHeight, 4);
+		if(position+2 > size) return {0, 0};
+		Uint16 length = ReadBigEndian16(pData+position);
+		if(length < 2 || position+length > size) return {0, 0};
 
-		//Check that the first chunk is the IHDR
-		for(int i = 0; i < 4; ++i){
-			if(chunkLength[i] != IHDRLength[i]){
-				std::cout << '\n' << path << " chunk length does not match\n";
-				return result;
-			}
-		}
-		for(int i = 0; i < 4; ++i){
-			if(chunkType[i] != IHDRType[i]){
-				std::cout << '\n' << path << " chunk type does not match\n";
-				return result;
-			}
+		//Every start of frame (0xC0 to 0xCF) except the ones that are actually DHT, JPG and DAC
+		if(marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC){
+			if(length < 7) return {0, 0};
+			//Precision, then height and width
+			return {ReadBigEndian16(pData+position+5), ReadBigEndian16(pData+position+3)};
 		}
 
-		//We set the result based on the read values, we have to do it this way as it's in big endian
-		for(int i = 0; i < 4; ++i){
-			result.x |= (int)readWidth[i] << (8*(3-i));
-			result.y |= (int)readHeight[i] << (8*(3-i));
-		}
+		position += length;
 	}
+	return {0, 0};
+}
+
+static SDL_Point ProbeQOI(const Uint8 *pData, size_t size){
+	if(size < 14) return {0, 0};
+
+	Uint32 width = ReadBigEndian32(pData+4), height = ReadBigEndian32(pData+8);
+	Uint8 channels = pData[12], colorSpace = pData[13];
+	if((channels != 3 && channels != 4) || colorSpace > 1 || width > INT32_MAX || height > INT32_MAX) return {0, 0};
+	return {(int)width, (int)height};
+}
+
+static SDL_Point ProbeWEBP(const Uint8 *pData, size_t size){
+	//RIFF header, then the first chunk, which tells which kind of webp it is
+	if(size < 30) return {0, 0};
+	const Uint8 *pChunk = pData+12;
+	const Uint8 *pChunkData = pData+20;
+
+	if(std::memcmp(pChunk, "VP8 ", 4) == 0){
+		//Lossy: a frame tag of 3 bytes, the start code and the 14 bit dimensions
+		if(pChunkData[3] != 0x9D || pChunkData[4] != 0x01 || pChunkData[5] != 0x2A) return {0, 0};
+		return {ReadLittleEndian16(pChunkData+6) & 0x3FFF, ReadLittleEndian16(pChunkData+8) & 0x3FFF};
+	} else if(std::memcmp(pChunk, "VP8L", 4) == 0){
+		//Lossless: a signature byte, then the dimensions minus one in 14 bits each
+		if(pChunkData[0] != 0x2F) return {0, 0};
+		Uint32 bits = ReadLittleEndian32(pChunkData+1);
+		return {(int)(bits & 0x3FFF) + 1, (int)((bits >> 14) & 0x3FFF) + 1};
+	} else if(std::memcmp(pChunk, "VP8X", 4) == 0){
+		//Extended: flags and reserved bytes, then the canvas dimensions minus one in 24 bits each
+		return {(int)ReadLittleEndian24(pChunkData+4) + 1, (int)ReadLittleEndian24(pChunkData+7) + 1};
+	}
+	return {0, 0};
+}
+
+static SDL_Point ProbeGIF(const Uint8 *pData, size_t size){
+	//The logical screen size follows the signature
+	if(size < 13) return {0, 0};
+	return {ReadLittleEndian16(pData+6), ReadLittleEndian16(pData+8)};
+}
+
+static SDL_Point ProbeTIFF(const Uint8 *pData, size_t size){
+	//The byte order comes from the header, then the size is in the tags of the first directory
+	if(size < 8) return {0, 0};
+	bool bigEndian = pData[0] == 'M';
+	auto read16 = [&](size_t offset){ return bigEndian ? ReadBigEndian16(pData+offset) : ReadLittleEndian16(pData+offset); };
+	auto read32 = [&](size_t offset){ return bigEndian ? ReadBigEndian32(pData+offset) : ReadLittleEndian32(pData+offset); };
+
+	size_t directory = read32(4);
+	if(directory+2 > size) return {0, 0};
+	Uint16 entries = read16(directory);
+	if(directory+2+entries*(size_t)12 > size) return {0, 0};
+
+	Uint32 width = 0, height = 0;
+	for(Uint16 i = 0; i < entries; i++){
+		size_t entry = directory+2+i*(size_t)12;
+		Uint16 tag = read16(entry), type = read16(entry+2);
+		//The value is either a short or a long, stored at the start of the value field
+		Uint32 value = type == 3 ? read16(entry+8) : type == 4 ? read32(entry+8) : 0;
+		if(tag == 256) width = value;
+		else if(tag == 257) height = value;
+	}
+	if(width > INT32_MAX || height > INT32_MAX) return {0, 0};
+	return {(int)width, (int)height};
+}
 
-	png.close();
-
-	return result;
+static SDL_Point ProbeTGA(const Uint8 *pData, size_t size){
+	//Targa has no magic bytes, so every field of the header has to hold a valid value for the file to be taken as one
+	if(size < 18) return {0, 0};
+	Uint8 colorMapType = pData[1], imageType = pData[2], depth = pData[16];
+	bool validType = imageType == 1 || imageType == 2 || imageType == 3 || imageType == 9 || imageType == 10 || imageType == 11;
+	bool validDepth = depth == 8 || depth == 15 || depth == 16 || depth == 24 || depth == 32;
+	bool colorMapped = imageType == 1 || imageType == 9;
+	if(colorMapType > 1 || !validType || !validDepth || colorMapped != (colorMapType == 1) || (pData[17] & 0xC0) != 0) return {0, 0};
+	return {ReadLittleEndian16(pData+12), ReadLittleEndian16(pData+14)};
 }
-SDL_Point GetSizeOfBMP(const char *path){
-	SDL_Point result = {0, 0};
-	std::ifstream bmp(path, std::ios::binary);
 
-	if(!bmp.is_open()){
-		std::cout << "\nCannot open bmp" << path << '\n';
+ImageProbe ProbeImage(const char *path){
+	ImageProbe result;
+
+	MappedFile file(path);
+	const Uint8 *pData = file.GetData();
+	size_t size = file.GetSize();
+	if(!pData){
+		ErrorPrint("Cannot open the image "+std::string(path));
 		return result;
 	}
 
-	//TODO: check that it is indeed a bmp, we currently don't as I find there to be a lot of bmp formats. Currently using "Windows BITMAPINFOHEADER" and jumping straight into the size data
-	bmp.ignore(0x12);
-
-	{
-		char readWidth[4] = {0, 0, 0, 0};
-		char readHeight[4] = {0, 0, 0, 0};
-
-		bmp.read(readWidth, 4);
-		bmp.read(readHeight, 4);
-		
-		result.x = *(int*)readWidth;
-		result.y = *(int*)readHeight;
+	constexpr Uint8 PNG_MAGIC[8] = {0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A};
+	if(size >= 8 && std::memcmp(pData, PNG_MAGIC, 8) == 0){
+		result.type = ImageProbe::Type::PNG;
+		result.size = ProbePNG(pData, size);
+	} else if(size >= 2 && pData[0] == 'B' && pData[1] == 'M'){
+		result.type = ImageProbe::Type::BMP;
+		result.size = ProbeBMP(pData, size);
+	} else if(size >= 3 && pData[0] == 0xFF && pData[1] == 0xD8 && pData[2] == 0xFF){
+		result.type = ImageProbe::Type::JPEG;
+		result.size = ProbeJPEG(pData, size);
+	} else if(size >= 4 && std::memcmp(pData, "qoif", 4) == 0){
+		result.type = ImageProbe::Type::QOI;
+		result.size = ProbeQOI(pData, size);
+	} else if(size >= 12 && std::memcmp(pData, "RIFF", 4) == 0 && std::memcmp(pData+8, "WEBP", 4) == 0){
+		result.type = ImageProbe::Type::WEBP;
+		result.size = ProbeWEBP(pData, size);
+	} else if(size >= 6 && (std::memcmp(pData, "GIF87a", 6) == 0 || std::memcmp(pData, "GIF89a", 6) == 0)){
+		result.type = ImageProbe::Type::GIF;
+		result.size = ProbeGIF(pData, size);
+	} else if(size >= 4 && (std::memcmp(pData, "II*\0", 4) == 0 || std::memcmp(pData, "MM\0*", 4) == 0)){
+		result.type = ImageProbe::Type::TIFF;
+		result.size = ProbeTIFF(pData, size);
+	} else {
+		//Last, since it is only recognized by its header being valid
+		result.type = ImageProbe::Type::TGA;
+		result.size = ProbeTGA(pData, size);
 	}
 
-	bmp.close();
+	if(result.size.x <= 0 || result.size.y <= 0){
+		ErrorPrint("The image "+std::string(path)+" isn't in a supported format or its header is corrupted");
+		result.type = ImageProbe::Type::UNKNOWN;
+		result.size = {0, 0};
+	}
 
 	return result;
 }
@@ -151,14 +325,14 @@ SDL_Texture* LoadTexture(const char *path, SDL_Renderer *renderer, Format format
 	
     if( image == nullptr )
     {
-        std::cout<<"Failed to load image at "<<path<<": "<<SDL_GetError()<<'\n';
+        ErrorPrint("Failed to load image at "+std::string(path)+": "+SDL_GetError());
     }
 	else
 	{
         texture = SDL_CreateTextureFromSurface( renderer, image );
         if( texture == NULL )
         {
-            std::cout<<"Unable to create texture from "<<path<<"! SDL Error: "<<SDL_GetError()<<'\n';
+            ErrorPrint("Unable to create texture from "+std::string(path)+"! SDL Error: "+SDL_GetError());
         }
 		
 		SDL_FreeSurface( image );
@@ -178,7 +352,7 @@ SDL_Texture* LoadTexture(const char *path, SDL_Renderer *renderer, SDL_Color col
 	
     if( image == nullptr )
     {
-        std::cout<<"Failed to load image at "<<path<<": "<<SDL_GetError()<<'\n';
+        ErrorPrint("Failed to load image at "+std::string(path)+": "+SDL_GetError());
     }
 	else
 	{
@@ -187,7 +361,7 @@ SDL_Texture* LoadTexture(const char *path, SDL_Renderer *renderer, SDL_Color col
         texture = SDL_CreateTextureFromSurface( renderer, image );
         if( texture == NULL )
         {
-            std::cout<<"Unable to create texture from "<<path<<"! SDL Error: "<<SDL_GetError()<<'\n';
+            ErrorPrint("Unable to create texture from "+std::string(path)+"! SDL Error: "+SDL_GetError());
         }
 
 		SDL_FreeSurface( image );
@@ -232,6 +406,204 @@ SDL_Texture* LoadTextureFromText(const char *text, SDL_Renderer *renderer, TTF_F
 	return resultingTexture;
 }
 
+//Sets the size of a font until destroyed, when it goes back to the one the fonts are loaded with
+class FontSizeScope{
+	public:
+
+	FontSizeScope(TTF_Font *pFont, int pointSize) : mpFont(pFont){
+		TTF_SetFontSize(mpFont, pointSize);
+	}
+	~FontSizeScope(){
+		TTF_SetFontSize(mpFont, FONT_POINT_SIZE);
+	}
+
+	private:
+
+	TTF_Font *mpFont;
+};
+
+std::unordered_map<TTF_Font*, std::unordered_map<int, std::unique_ptr<GlyphAtlas>>> GlyphAtlas::mAtlases;
+
+GlyphAtlas *GlyphAtlas::Get(SDL_Renderer *pRenderer, TTF_Font *pFont, int height){
+	if(pFont == nullptr || height <= 0) return nullptr;
+
+	if(GlyphAtlas *pAtlas = Find(pFont, height)) return pAtlas;
+
+	std::unique_ptr<GlyphAtlas> pAtlas(new GlyphAtlas(pRenderer, pFont, height));
+	if(pAtlas->mpTexture == nullptr) return nullptr;
+
+	return mAtlases[pFont].emplace(height, std::move(pAtlas)).first->second.get();
+}
+
+GlyphAtlas *GlyphAtlas::Find(TTF_Font *pFont, int height){
+	auto fontAtlases = mAtlases.find(pFont);
+	if(fontAtlases == mAtlases.end()) return nullptr;
+
+	auto it = fontAtlases->second.find(height);
+	return (it != fontAtlases->second.end()) ? it->second.get() : nullptr;
+}
+
+void GlyphAtlas::ReleaseAll(){
+	mAtlases.clear();
+}
+
+GlyphAtlas::GlyphAtlas(SDL_Renderer *pRenderer, TTF_Font *pFont, int height) : mpFont(pFont){
+	//The height of a font is proportional to its point size, so the one it's loaded with tells which point size gets closest to 'height'
+	mPointSize = std::max(1, (int)std::lround(FONT_POINT_SIZE*height/(double)TTF_FontHeight(pFont)));
+	FontSizeScope fontSize(mpFont, mPointSize);
+	mHeight = TTF_FontHeight(mpFont);
+
+	mpTexture.reset(SDL_CreateTexture(pRenderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, M_ATLAS_SIZE, M_ATLAS_SIZE));
+	if(mpTexture == nullptr){
+		printf( "Unable to create the glyph atlas! SDL Error: %s\n", SDL_GetError() );
+		return;
+	}
+	SDL_SetTextureBlendMode(mpTexture.get(), SDL_BLENDMODE_BLEND);
+
+	for(Uint32 character = M_FIRST_ASCII; character <= M_LAST_ASCII; character++){
+		mAsciiGlyphs[character-M_FIRST_ASCII] = AddGlyph(character);
+	}
+
+	if(TTF_GetFontKerning(mpFont) == 0) return;
+
+	constexpr Uint32 ASCII_AMOUNT = M_LAST_ASCII-M_FIRST_ASCII+1;
+	mAsciiKerning.resize(ASCII_AMOUNT*ASCII_AMOUNT);
+	for(Uint32 previous = 0; previous < ASCII_AMOUNT; previous++){
+		for(Uint32 character = 0; character < ASCII_AMOUNT; character++){
+			mAsciiKerning[previous*ASCII_AMOUNT + character] = TTF_GetFontKerningSizeGlyphs(mpFont, M_FIRST_ASCII+previous, M_FIRST_ASCII+character);
+		}
+	}
+}
+
+int GlyphAtlas::GetAdvance(Uint32 character){
+	return FindGlyph(character).advance;
+}
+
+int GlyphAtlas::GetKerning(Uint32 previous, Uint32 character){
+	if(mAsciiKerning.empty() || previous == 0) return 0;
+
+	if(previous >= M_FIRST_ASCII && previous <= M_LAST_ASCII && character >= M_FIRST_ASCII && character <= M_LAST_ASCII){
+		return mAsciiKerning[(previous-M_FIRST_ASCII)*(M_LAST_ASCII-M_FIRST_ASCII+1) + (character-M_FIRST_ASCII)];
+	}
+
+	//The kerning functions of SDL_ttf that are used only take characters from the basic multilingual plane
+	if(previous > 0xFFFF || character > 0xFFFF) return 0;
+
+	Uint64 pair = (Uint64)previous << 32 | character;
+	if(auto it = mOtherKerning.find(pair); it != mOtherKerning.end()) return it->second;
+
+	FontSizeScope fontSize(mpFont, mPointSize);
+	return mOtherKerning.emplace(pair, TTF_GetFontKerningSizeGlyphs(mpFont, (Uint16)previous, (Uint16)character)).first->second;
+}
+
+int GlyphAtlas::GetTextWidth(std::string_view text){
+	int width = 0;
+	Uint32 previous = 0;
+	for(size_t i = 0; i < text.size();){
+		Uint32 character = DecodeUTF8(text, i);
+		width += GetKerning(previous, character) + FindGlyph(character).advance;
+		previous = character;
+	}
+	return width;
+}
+
+int GlyphAtlas::GetHeight(){
+	return mHeight;
+}
+
+void GlyphAtlas::DrawText(SDL_Renderer *pRenderer, std::string_view text, int x, int y, int height, SDL_Color color){
+	if(text.empty() || height <= 0) return;
+
+	mVertices.clear();
+	mIndices.clear();
+
+	const float scale = height/(float)mHeight;
+	float penX = x;
+	Uint32 previous = 0;
+
+	for(size_t i = 0; i < text.size();){
+		Uint32 character = DecodeUTF8(text, i);
+		const Glyph &glyph = FindGlyph(character);
+		penX += GetKerning(previous, character)*scale;
+		previous = character;
+
+		if(glyph.source.w > 0 && glyph.source.h > 0){
+			const float left = penX, top = y, right = penX+glyph.source.w*scale, bottom = y+glyph.source.h*scale;
+			const float uLeft = glyph.source.x/(float)M_ATLAS_SIZE, vTop = glyph.source.y/(float)M_ATLAS_SIZE;
+			const float uRight = (glyph.source.x+glyph.source.w)/(float)M_ATLAS_SIZE, vBottom = (glyph.source.y+glyph.source.h)/(float)M_ATLAS_SIZE;
+
+			int firstVertex = mVertices.size();
+			mVertices.push_back({{left, top}, color, {uLeft, vTop}});
+			mVertices.push_back({{right, top}, color, {uRight, vTop}});
+			mVertices.push_back({{right, bottom}, color, {uRight, vBottom}});
+			mVertices.push_back({{left, bottom}, color, {uLeft, vBottom}});
+
+			for(int index : {0, 1, 2, 0, 2, 3}) mIndices.push_back(firstVertex+index);
+		}
+
+		penX += glyph.advance*scale;
+	}
+
+	if(!mVertices.empty()) SDL_RenderGeometry(pRenderer, mpTexture.get(), mVertices.data(), mVertices.size(), mIndices.data(), mIndices.size());
+}
+
+Uint32 GlyphAtlas::DecodeUTF8(std::string_view text, size_t &index){
+	Uint8 first = text[index++];
+	
+	int extraBytes = 0;
+	Uint32 character = first;
+	if((first & 0xE0) == 0xC0)		{extraBytes = 1; character = first & 0x1F;}
+	else if((first & 0xF0) == 0xE0) {extraBytes = 2; character = first & 0x0F;}
+	else if((first & 0xF8) == 0xF0) {extraBytes = 3; character = first & 0x07;}
+
+	for(; extraBytes > 0 && index < text.size() && (text[index] & 0xC0) == 0x80; extraBytes--){
+		character = (character << 6) | (text[index++] & 0x3F);
+	}
+
+	return character;
+}
+
+GlyphAtlas::Glyph &GlyphAtlas::FindGlyph(Uint32 character){
+	if(character >= M_FIRST_ASCII && character <= M_LAST_ASCII) return mAsciiGlyphs[character-M_FIRST_ASCII];
+
+	if(auto it = mOtherGlyphs.find(character); it != mOtherGlyphs.end()) return it->second;
+	
+	//Characters that couldn't be added are also stored (without a source), so that they aren't attempted again
+	FontSizeScope fontSize(mpFont, mPointSize);
+	return mOtherGlyphs.emplace(character, AddGlyph(character)).first->second;
+}
+
+GlyphAtlas::Glyph GlyphAtlas::AddGlyph(Uint32 character){
+	Glyph glyph;
+
+	//The glyph functions of SDL_ttf that are used only take characters from the basic multilingual plane
+	int minX, maxX, minY, maxY;
+	if(character > 0xFFFF || TTF_GlyphMetrics(mpFont, (Uint16)character, &minX, &maxX, &minY, &maxY, &glyph.advance) != 0) return glyph;
+
+	std::unique_ptr<SDL_Surface, PointerDeleter> pRendered(TTF_RenderGlyph_Blended(mpFont, (Uint16)character, SDL_Color{255, 255, 255, SDL_ALPHA_OPAQUE}));
+	if(pRendered == nullptr) return glyph; //Happens with characters that have nothing to draw, like spaces
+
+	std::unique_ptr<SDL_Surface, PointerDeleter> pGlyphSurface(SDL_ConvertSurfaceFormat(pRendered.get(), SDL_PIXELFORMAT_ARGB8888, 0));
+	if(pGlyphSurface == nullptr) return glyph;
+
+	//We move to the next row when the current one is full
+	if(mNextPosition.x + pGlyphSurface->w > M_ATLAS_SIZE){
+		mNextPosition.x = 0;
+		mNextPosition.y += mHeight;
+	}
+	if(mNextPosition.y + pGlyphSurface->h > M_ATLAS_SIZE || pGlyphSurface->w > M_ATLAS_SIZE){
+		ErrorPrint("The glyph atlas is full, the character "+std::to_string(character)+" will not be displayed");
+		return glyph;
+	}
+
+	SDL_Rect source = {mNextPosition.x, mNextPosition.y, pGlyphSurface->w, pGlyphSurface->h};
+	if(SDL_UpdateTexture(mpTexture.get(), &source, pGlyphSurface->pixels, pGlyphSurface->pitch) != 0) return glyph;
+
+	glyph.source = source;
+	mNextPosition.x += source.w;
+	return glyph;
+}
+
 TTF_Font* LoadFont(std::string path, int size){
 	TTF_Font *createdFont = TTF_OpenFont( path.c_str(), size );
 	if( createdFont == nullptr )
@@ -474,6 +846,52 @@ std::vector<SDL_Point> GetPointsInFSegment(SDL_FPoint initialPoint, SDL_FPoint f
 	return result;
 }
 
+std::vector<SDL_Point> GetPointsInCatmullRom(SDL_FPoint point0, SDL_FPoint point1, SDL_FPoint point2, SDL_FPoint point3){
+	//The knots are separated by the square root of the distance (centripetal parametrization), which avoids the loops and cusps that the uniform one produces in sharp turns
+	//A minimum separation is kept so that repeated control points don't result in a division by 0
+	auto knotInterval = [](SDL_FPoint &from, SDL_FPoint &to){return std::max(sqrtf(Distance(from, to)), 0.001f);};
+	const float t0 = 0.0f;
+	const float t1 = t0 + knotInterval(point0, point1);
+	const float t2 = t1 + knotInterval(point1, point2);
+	const float t3 = t2 + knotInterval(point2, point3);
+
+	auto interpolate = [](const SDL_FPoint &from, const SDL_FPoint &to, float tFrom, float tTo, float t) -> SDL_FPoint{
+		float weight = (t-tFrom)/(tTo-tFrom);
+		return {from.x + (to.x-from.x)*weight, from.y + (to.y-from.y)*weight};
+	};
+
+	//Twice the chord length is enough samples for most curves, any gap left between two samples is filled with a segment
+	const int steps = std::max((int)ceilf(2.0f*Distance(point1, point2)), 1);
+
+	std::vector<SDL_Point> result;
+	result.reserve(steps+1);
+
+	for(int i = 0; i <= steps; ++i){
+		//Barry and Goldman's pyramidal formulation
+		float t = t1 + (t2-t1)*i/steps;
+		SDL_FPoint a1 = interpolate(point0, point1, t0, t1, t), a2 = interpolate(point1, point2, t1, t2, t), a3 = interpolate(point2, point3, t2, t3, t);
+		SDL_FPoint b1 = interpolate(a1, a2, t0, t2, t), b2 = interpolate(a2, a3, t1, t3, t);
+		SDL_FPoint curvePoint = interpolate(b1, b2, t1, t2, t);
+
+		SDL_Point pixel = {(int)floorf(curvePoint.x), (int)floorf(curvePoint.y)};
+
+		if(result.empty()){
+			result.push_back(pixel);
+		} else if(!ArePointsEqual(result.back(), pixel)){
+			if(std::abs(pixel.x-result.back().x) > 1 || std::abs(pixel.y-result.back().y) > 1){
+				std::vector<SDL_Point> gap = GetPointsInSegment(result.back(), pixel);
+				//The first point of the gap is already in the result
+				result.insert(result.end(), gap.begin()+1, gap.end());
+				if(!ArePointsEqual(result.back(), pixel)) result.push_back(pixel);
+			} else {
+				result.push_back(pixel);
+			}
+		}
+	}
+
+	return result;
+}
+
 bool ArePointsEqual(const SDL_Point &point1, const SDL_Point &point2){
 	return point1.x == point2.x && point1.y == point2.y;
 }
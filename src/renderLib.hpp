@@ -4,7 +4,11 @@
 #include "SDL_image.h"
 #include "SDL_ttf.h"
 #include <string>
+#include <string_view>
 #include <vector>
+#include <array>
+#include <memory>
+#include <unordered_map>
 
 struct FColor{
     float r, g, b, a;
@@ -26,11 +30,27 @@ enum class Format
     TOTAL_FORMATS
 };
 
-//Retrieves the size of a png formated image
-SDL_Point GetSizeOfPNG(const char *path);
+//Format and size of an image, as read from its header
+struct ImageProbe{
+    enum class Type{
+        UNKNOWN, //Either not an image, corrupted or a format that isn't supported
+        PNG,
+        BMP,
+        JPEG,
+        QOI,
+        WEBP,
+        GIF,
+        TIFF,
+        TGA
+    };
+
+    Type type = Type::UNKNOWN;
+    SDL_Point size = {0, 0};
+};
 
-//Retrieves the size of a bmp formated image
-SDL_Point GetSizeOfBMP(const char *path);
+//Retrieves the format and size of an image without decoding it, mapping the file into memory instead of reading it. The format comes from the magic bytes, not the extension
+//Supports png, every bmp header (from OS/2 to V5), jpeg, qoi, webp (lossy, lossless and extended), gif, tiff and tga. The size is only set if the header is valid
+ImageProbe ProbeImage(const char *path);
 
 //Frees the window and the renderer and stops dependenies, used by default in main.cpp 
 void Release(SDL_Window *&window, SDL_Renderer *&renderer);
@@ -52,6 +72,9 @@ SDL_Texture* NFLoadTexture(std::string path, SDL_Renderer *renderer, SDL_Color k
 //Returns a pointer to a texture of the given text
 SDL_Texture* LoadTextureFromText(const char *text, SDL_Renderer *renderer, TTF_Font *font, SDL_Color colorText = {0, 0, 0, SDL_ALPHA_OPAQUE});
 
+//The point size of the fonts loaded for the UI. The glyph atlases change it to rasterize at other sizes, setting it back afterwards
+constexpr int FONT_POINT_SIZE = 72;
+
 //Returns a pointer to a font on the given path 
 TTF_Font* LoadFont(std::string path, int size);
 
@@ -148,6 +171,10 @@ std::vector<SDL_Point> GetPointsInSegment(SDL_Point initialPoint, SDL_Point fina
 //The points returned have a unique x or y coordinate each (depending on the segment's slope)
 std::vector<SDL_Point> GetPointsInFSegment(SDL_FPoint initialPoint, SDL_FPoint finalPoint); 
 
+//Returns a series of points, that belong in the centripetal Catmull-Rom curve that goes from 'point1' to 'point2', using 'point0' and 'point3' as its neighbouring control points
+//Consecutive points returned are always adjacent, so chaining the curves of a series of samples results in a continuous line through all of them
+std::vector<SDL_Point> GetPointsInCatmullRom(SDL_FPoint point0, SDL_FPoint point1, SDL_FPoint point2, SDL_FPoint point3);
+
 //Returns true only if both x values and y values are equal (e.g. (10,12) == (10,12) => true)
 bool ArePointsEqual(const SDL_Point &point1, const SDL_Point &point2);
 
@@ -172,4 +199,69 @@ inline bool IsRectCompletelyInsideRect(const SDL_Rect &contained, const SDL_Rect
 template <typename PixelType>
 inline PixelType *UnsafeGetPixelFromSurface(SDL_Point pixelPosition, SDL_Surface *pSurface){
     return (PixelType*)((Uint8*)pSurface->pixels + pixelPosition.y * pSurface->pitch + pixelPosition.x * pSurface->format->BytesPerPixel);
-}
\ No newline at end of file
+}
+
+//Holds the glyphs of a font rasterized for a single height in a texture, so that text gets drawn as a batch of quads through SDL_RenderGeometry instead of creating a texture per text
+//Printable ASCII characters are rasterized when the atlas is created, any other character the first time it's used (as long as there's space left)
+class GlyphAtlas{
+    public:
+
+    //Returns the atlas of the font for text 'height' pixels tall, creating it the first time. Returns nullptr if it couldn't be created
+    static GlyphAtlas *Get(SDL_Renderer *pRenderer, TTF_Font *pFont, int height);
+    //Same, but returns nullptr instead of creating it, so it doesn't need the renderer
+    static GlyphAtlas *Find(TTF_Font *pFont, int height);
+
+    //Destroys every atlas, must be called before the renderer gets destroyed
+    static void ReleaseAll();
+
+    //Returns the advance of the character in pixels, at the size of the atlas
+    int GetAdvance(Uint32 character);
+    //Returns the kerning between both consecutive characters in pixels, at the size of the atlas. The first character of a text has 0 as 'previous'
+    int GetKerning(Uint32 previous, Uint32 character);
+    //Returns the width of the UTF-8 text (the advances of every character and the kerning between them), in pixels at the size of the atlas
+    int GetTextWidth(std::string_view text);
+    //Returns the height of every line of the atlas, as close to the one requested as the point sizes of the font allow
+    int GetHeight();
+
+    //Draws the UTF-8 text with its top left corner at (x, y), scaled so that its height matches 'height'
+    void DrawText(SDL_Renderer *pRenderer, std::string_view text, int x, int y, int height, SDL_Color color);
+
+    //Returns the next character of the UTF-8 text starting at 'index', which is advanced to the start of the following one
+    static Uint32 DecodeUTF8(std::string_view text, size_t &index);
+
+    private:
+
+    GlyphAtlas(SDL_Renderer *pRenderer, TTF_Font *pFont, int height);
+
+    struct Glyph{
+        SDL_Rect source = {0, 0, 0, 0}; //Where the glyph is inside the atlas, empty for characters without a visible glyph
+        int advance = 0;
+    };
+
+    Glyph &FindGlyph(Uint32 character);
+    //Rasterizes the character and copies it into the next free space of the atlas. The font must be at 'mPointSize'
+    Glyph AddGlyph(Uint32 character);
+
+    static constexpr int M_ATLAS_SIZE = 1024;
+    static constexpr Uint32 M_FIRST_ASCII = 32, M_LAST_ASCII = 126;
+
+    //The font is shared by every atlas made from it, so it's only set to 'mPointSize' while the atlas rasterizes or measures with it
+    TTF_Font *mpFont;
+    int mPointSize, mHeight;
+    std::unique_ptr<SDL_Texture, PointerDeleter> mpTexture;
+    SDL_Point mNextPosition = {0, 0}; //The glyphs are placed in rows of mHeight pixels
+
+    std::array<Glyph, M_LAST_ASCII-M_FIRST_ASCII+1> mAsciiGlyphs;
+    std::unordered_map<Uint32, Glyph> mOtherGlyphs;
+
+    //Empty if the font has no kerning. The ASCII pairs are measured when the atlas is created, the rest the first time they are drawn
+    std::vector<Sint16> mAsciiKerning;
+    std::unordered_map<Uint64, int> mOtherKerning;
+
+    //Reused between draws, so that they stop allocating once they are big enough
+    std::vector<SDL_Vertex> mVertices;
+    std::vector<int> mIndices;
+
+    //By font and then by the requested height
+    static std::unordered_map<TTF_Font*, std::unordered_map<int, std::unique_ptr<GlyphAtlas>>> mAtlases;
+};
@@ -0,0 +1,213 @@
+#include "sessionRecorder.hpp"
+#include "paintingTools.hpp"
+#include "logger.hpp"
+#include <cstring>
+
+static constexpr char SESSION_MAGIC[4] = {'P', 'A', 'S', '2'};
+//Longer texts are considered corrupted data
+static constexpr Uint32 MAX_SESSION_TEXT = 1 << 20;
+
+//Returns how many bytes of the event are worth recording, or 0 if it shouldn't be recorded. Only the member of the union used by the event is kept
+static size_t GetRecordedEventSize(Uint32 type){
+	switch(type){
+		case SDL_MOUSEMOTION:
+			return sizeof(SDL_MouseMotionEvent);
+		case SDL_MOUSEBUTTONDOWN: case SDL_MOUSEBUTTONUP:
+			return sizeof(SDL_MouseButtonEvent);
+		case SDL_MOUSEWHEEL:
+			return sizeof(SDL_MouseWheelEvent);
+		case SDL_KEYDOWN: case SDL_KEYUP:
+			return sizeof(SDL_KeyboardEvent);
+		case SDL_TEXTINPUT:
+			return sizeof(SDL_TextInputEvent);
+		case SDL_WINDOWEVENT:
+			return sizeof(SDL_WindowEvent);
+		default:
+			return 0;
+	}
+}
+
+//SESSION RECORDER METHODS:
+
+SessionRecorder::SessionRecorder(const char *pPath, SDL_Point windowSize){
+	mpFile = std::fopen(pPath, "wb");
+	if(!mpFile){
+		ErrorPrint("Couldn't open "+std::string(pPath)+" to record the session");
+		return;
+	}
+
+	mBuffer.reserve(M_BUFFER_SIZE);
+	Append(SESSION_MAGIC, sizeof(SESSION_MAGIC));
+
+	Sint32 size[2] = {windowSize.x, windowSize.y};
+	Append(size, sizeof(size));
+}
+
+SessionRecorder::~SessionRecorder(){
+	if(!mpFile) return;
+
+	WriteBuffer();
+	std::fclose(mpFile);
+}
+
+bool SessionRecorder::IsOpen(){
+	return mpFile != nullptr;
+}
+
+void SessionRecorder::RecordEvent(const SDL_Event &event){
+	size_t size = GetRecordedEventSize(event.type);
+	if(!mpFile || size == 0) return;
+
+	Uint8 header[4] = {(Uint8)SessionEntry::Type::EVENT, 0, 0, (Uint8)size};
+	Uint16 modState = SDL_GetModState();
+	std::memcpy(header+1, &modState, sizeof(modState));
+	Append(header, sizeof(header));
+	Append(&event, size);
+}
+
+void SessionRecorder::RecordFrame(float deltaTime, int finishedImports){
+	if(!mpFile) return;
+
+	Uint8 type = (Uint8)SessionEntry::Type::FRAME;
+	Uint16 modState = SDL_GetModState();
+	Uint16 imports = (Uint16)finishedImports;
+	Append(&type, sizeof(type));
+	Append(&modState, sizeof(modState));
+	Append(&deltaTime, sizeof(deltaTime));
+	Append(&imports, sizeof(imports));
+}
+
+void SessionRecorder::RecordImage(const std::string &path){
+	if(!mpFile) return;
+
+	Uint8 type = (Uint8)SessionEntry::Type::IMAGE;
+	Append(&type, sizeof(type));
+	AppendText(path);
+}
+
+void SessionRecorder::Append(const void *pData, size_t size){
+	if(mBuffer.size() + size > M_BUFFER_SIZE) WriteBuffer();
+
+	const Uint8 *pBytes = (const Uint8*)pData;
+	mBuffer.insert(mBuffer.end(), pBytes, pBytes + size);
+}
+
+void SessionRecorder::AppendText(const std::string &text){
+	Uint32 length = text.size();
+	Append(&length, sizeof(length));
+	Append(text.data(), text.size());
+}
+
+void SessionRecorder::WriteBuffer(){
+	if(mBuffer.empty()) return;
+
+	if(std::fwrite(mBuffer.data(), 1, mBuffer.size(), mpFile) != mBuffer.size()){
+		ErrorPrint("Couldn't write the recorded session, the recording is stopped");
+		std::fclose(mpFile);
+		mpFile = nullptr;
+	}
+	mBuffer.clear();
+}
+
+//SESSION READER METHODS:
+
+SessionReader::SessionReader(const char *pPath){
+	mpFile = std::fopen(pPath, "rb");
+	if(!mpFile){
+		ErrorPrint("Couldn't open the session "+std::string(pPath));
+		return;
+	}
+
+	char magic[4];
+	Sint32 size[2] = {0, 0};
+	if(std::fread(magic, 1, sizeof(magic), mpFile) != sizeof(magic) || std::memcmp(magic, SESSION_MAGIC, sizeof(magic)) != 0 ||
+		std::fread(size, sizeof(size), 1, mpFile) != 1 || size[0] <= 0 || size[1] <= 0){
+		ErrorPrint(std::string(pPath)+" isn't a recorded session");
+		std::fclose(mpFile);
+		mpFile = nullptr;
+		return;
+	}
+	mWindowSize = {size[0], size[1]};
+}
+
+SessionReader::~SessionReader(){
+	if(mpFile) std::fclose(mpFile);
+}
+
+bool SessionReader::IsOpen(){
+	return mpFile != nullptr;
+}
+
+SDL_Point SessionReader::GetWindowSize(){
+	return mWindowSize;
+}
+
+bool SessionReader::Next(SessionEntry &entry){
+	if(!mpFile) return false;
+
+	Uint8 type;
+	if(std::fread(&type, 1, 1, mpFile) != 1) return false;
+	entry.type = (SessionEntry::Type)type;
+
+	switch(entry.type){
+		case SessionEntry::Type::EVENT:{
+			Uint8 size = 0;
+			if(std::fread(&entry.modState, sizeof(entry.modState), 1, mpFile) != 1 || std::fread(&size, 1, 1, mpFile) != 1) return false;
+			if(size > sizeof(SDL_Event)) return false;
+
+			entry.event = SDL_Event{};
+			if(std::fread(&entry.event, 1, size, mpFile) != size) return false;
+			return GetRecordedEventSize(entry.event.type) == size;
+		}
+		case SessionEntry::Type::FRAME:{
+			Uint16 imports = 0;
+			if(std::fread(&entry.modState, sizeof(entry.modState), 1, mpFile) != 1 || std::fread(&entry.deltaTime, sizeof(entry.deltaTime), 1, mpFile) != 1) return false;
+			if(std::fread(&imports, sizeof(imports), 1, mpFile) != 1) return false;
+			entry.finishedImports = imports;
+			return true;
+		}
+		case SessionEntry::Type::IMAGE:
+			return ReadText(entry.text);
+		default:
+			ErrorPrint("Unknown entry of type "+std::to_string(type)+" in the session, the rest of it is ignored");
+			return false;
+	}
+}
+
+bool SessionReader::ReadText(std::string &text){
+	Uint32 length = 0;
+	if(std::fread(&length, sizeof(length), 1, mpFile) != 1 || length > MAX_SESSION_TEXT) return false;
+
+	text.resize(length);
+	return std::fread(text.data(), 1, length, mpFile) == length;
+}
+
+Uint64 HashImage(MutableTexture &image){
+	Uint64 hash = 14695981039346656037ull;
+	auto hashBytes = [&hash](const void *pData, size_t size){
+		const Uint8 *pBytes = (const Uint8*)pData;
+		for(size_t i = 0; i < size; i++){
+			hash ^= pBytes[i];
+			hash *= 1099511628211ull;
+		}
+	};
+
+	int size[3] = {image.GetWidth(), image.GetHeight(), image.GetTotalLayers()};
+	hashBytes(size, sizeof(size));
+
+	for(int layer = 0; layer < image.GetTotalLayers(); layer++){
+		SDL_Surface *pLayer = image.GetSurfaceAtLayer(layer);
+		Uint8 state[2] = {(Uint8)image.GetLayerVisibility(layer), 0};
+		SDL_GetSurfaceAlphaMod(pLayer, &state[1]);
+		hashBytes(state, sizeof(state));
+
+		//Only hashed when used, so the sessions recorded before the blend modes existed keep their hash
+		BlendMode blendMode = image.GetLayerBlendMode(layer);
+		if(blendMode != BlendMode::NORMAL) hashBytes(&blendMode, sizeof(blendMode));
+
+		//Row by row, as the padding at the end of the rows isn't part of the image
+		for(int y = 0; y < pLayer->h; y++) hashBytes((const Uint8*)pLayer->pixels + y*pLayer->pitch, pLayer->w*4);
+	}
+
+	return hash;
+}
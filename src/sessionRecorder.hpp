@@ -0,0 +1,86 @@
+#pragma once
+#include "SDL.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class MutableTexture;
+
+//Sessions are stored as a binary log with everything that reaches the app from the outside: the SDL events (with the keyboard modifiers held when
+//they were handled), the imported images and the length of every frame. Replaying them in order reproduces the session
+//The log starts with "PAS2" and the size of the app window (as the layout decides where the mouse events land), followed by the entries, each one
+//made of its type (a byte) and its data
+
+struct SessionEntry{
+    enum class Type : Uint8{
+        EVENT = 1,
+        FRAME = 2,
+        IMAGE = 3 //An image imported through AppManager::AddImage, the path is kept in 'text'
+    };
+
+    Type type = Type::FRAME;
+    SDL_Event event{};
+    Uint16 modState = KMOD_NONE;
+
+    float deltaTime = 0.0f;
+    int finishedImports = 0; //Imports that were added as layers during the frame, so that they are added at the same point when replaying
+
+    std::string text;
+};
+
+class SessionRecorder{
+    public:
+
+    //'windowSize' is the size the app was laid out with (see AppManager::GetWindowSize)
+    SessionRecorder(const char *pPath, SDL_Point windowSize);
+    ~SessionRecorder();
+
+    SessionRecorder(const SessionRecorder&) = delete;
+    SessionRecorder &operator=(const SessionRecorder&) = delete;
+
+    bool IsOpen();
+
+    //Only the input and window events are recorded, the rest depend on the machine or hold pointers (dropped files get recorded by RecordImage instead)
+    void RecordEvent(const SDL_Event &event);
+    void RecordFrame(float deltaTime, int finishedImports);
+    void RecordImage(const std::string &path);
+
+    private:
+
+    FILE *mpFile = nullptr;
+    //Entries are gathered here and written once it fills up, so that recording doesn't write to the file on every event
+    std::vector<Uint8> mBuffer;
+    static constexpr size_t M_BUFFER_SIZE = 1 << 16;
+
+    void Append(const void *pData, size_t size);
+    void AppendText(const std::string &text);
+    void WriteBuffer();
+};
+
+class SessionReader{
+    public:
+
+    SessionReader(const char *pPath);
+    ~SessionReader();
+
+    SessionReader(const SessionReader&) = delete;
+    SessionReader &operator=(const SessionReader&) = delete;
+
+    //False if the file couldn't be opened or isn't a session log
+    bool IsOpen();
+    //The size of the app window when the session was recorded, which the replay must use too
+    SDL_Point GetWindowSize();
+
+    //Reads the next entry. Returns false at the end of the log, or if the rest of it is corrupted
+    bool Next(SessionEntry &entry);
+
+    private:
+
+    FILE *mpFile = nullptr;
+    SDL_Point mWindowSize = {0, 0};
+
+    bool ReadText(std::string &text);
+};
+
+//64 bits FNV-1a of the size, layers and pixels of the image, used to check that a replayed session ends with the same image
+Uint64 HashImage(MutableTexture &image);
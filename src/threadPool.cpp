@@ -0,0 +1,47 @@
+#include "threadPool.hpp"
+#include "logger.hpp"
+
+ThreadPool::ThreadPool(size_t threadAmount){
+	mThreads.reserve(threadAmount);
+	for(size_t i = 0; i < threadAmount; i++) mThreads.emplace_back(&ThreadPool::Run, this);
+}
+
+ThreadPool::~ThreadPool(){
+	{
+		std::lock_guard<std::mutex> jobsLock(mJobsMutex);
+		mStop = true;
+	}
+	mJobsCondition.notify_all();
+
+	for(auto &thread : mThreads){
+		if(thread.joinable()) thread.join();
+	}
+}
+
+size_t ThreadPool::GetThreadAmount(){
+	return mThreads.size();
+}
+
+ThreadPool &ThreadPool::GetShared(){
+	static ThreadPool sharedPool;
+	return sharedPool;
+}
+
+void ThreadPool::Run(){
+	tracing::SetThreadName("Thread pool");
+
+	while(true){
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> jobsLock(mJobsMutex);
+			mJobsCondition.wait(jobsLock, [this](){ return mStop || !mJobs.empty(); });
+
+			//The remaining jobs are still run when stopping, so that no future is left without a value
+			if(mJobs.empty()) return;
+
+			job = std::move(mJobs.front());
+			mJobs.pop_front();
+		}
+		job();
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <algorithm>
+
+//Runs the submitted jobs on a fixed amount of threads, in the order they were submitted (although they may finish in any order)
+class ThreadPool{
+    public:
+
+    //By default, one thread per core
+    explicit ThreadPool(size_t threadAmount = std::max(1u, std::thread::hardware_concurrency()));
+    //Waits for the jobs already submitted to finish
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool &operator=(const ThreadPool&) = delete;
+
+    //Returns a future that holds the value returned by 'function' once it has been run
+    template <typename F>
+    std::future<std::invoke_result_t<std::decay_t<F>>> Submit(F &&function){
+        using Result = std::invoke_result_t<std::decay_t<F>>;
+
+        //std::function needs to be copyable, so the task is shared
+        auto pTask = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(function));
+        std::future<Result> result = pTask->get_future();
+        {
+            std::lock_guard<std::mutex> jobsLock(mJobsMutex);
+            mJobs.emplace_back([pTask](){ (*pTask)(); });
+        }
+        mJobsCondition.notify_one();
+
+        return result;
+    }
+
+    //Splits [0, count) into a range per thread and calls 'function(begin, end)' on each of them, returning once all have been run
+    //The calling thread runs one of the ranges itself, so it must not be called from a job of the same pool
+    template <typename F>
+    void ParallelFor(size_t count, F &&function){
+        size_t chunks = std::min(count, mThreads.size()+1);
+        if(chunks <= 1){
+            if(count > 0) function((size_t)0, count);
+            return;
+        }
+
+        std::vector<std::future<void>> results;
+        results.reserve(chunks-1);
+        for(size_t i = 1; i < chunks; i++){
+            size_t begin = count*i/chunks, end = count*(i+1)/chunks;
+            results.push_back(Submit([&function, begin, end](){ function(begin, end); }));
+        }
+
+        function((size_t)0, count/chunks);
+        for(auto &result : results) result.get();
+    }
+
+    size_t GetThreadAmount();
+
+    //Pool shared by the whole app, created the first time it's needed
+    static ThreadPool &GetShared();
+
+    private:
+
+    std::vector<std::thread> mThreads;
+
+    std::mutex mJobsMutex;
+    std::condition_variable mJobsCondition;
+    std::deque<std::function<void()>> mJobs;
+    bool mStop = false;
+
+    void Run();
+};